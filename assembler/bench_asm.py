@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Assembler throughput: lines/s of zx16asm.assemble() in two-pass and single-pass
+mode over the compiler's output for every compiler/examples program and dhrystone
+(each with the libc it links), plus any .s files named on the command line.
+
+  python3 assembler/bench_asm.py [-n REPEAT] [extra.s ...]
+
+Each mode's time is the best of REPEAT runs over the whole corpus, tokenizing
+included. The two modes must produce the same image for every source; the script
+exits 1 if they do not.
+"""
+import argparse, glob, os, sys, time
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+sys.path.insert(0, HERE)
+sys.path.insert(0, os.path.join(ROOT, "compiler"))
+import zx16asm                                  # noqa: E402
+import buildcache                               # noqa: E402
+
+def corpus(extra):
+    lib = os.path.join(ROOT, "compiler", "lib")
+    progs = sorted(glob.glob(os.path.join(ROOT, "compiler", "examples", "*.c")))
+    progs.append(os.path.join(ROOT, "compiler", "bench", "dhrystone.c"))
+    srcs = [(os.path.basename(p), buildcache.compile_src(open(p).read(), lib)) for p in progs]
+    return srcs + [(os.path.basename(p), open(p).read()) for p in extra]
+
+def best(fn, repeat):
+    times = []
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        fn()
+        times.append(time.perf_counter() - t0)
+    return min(times)
+
+def main():
+    ap = argparse.ArgumentParser(description="zx16asm throughput benchmark")
+    ap.add_argument("-n", "--repeat", type=int, default=5)
+    ap.add_argument("extra", nargs="*", help="more .s files to include")
+    args = ap.parse_args()
+    srcs = corpus(args.extra)
+    lines = sum(len(text.splitlines()) for _, text in srcs)
+
+    mismatched = []
+    for name, text in srcs:
+        one, two = zx16asm.assemble(text, name, True), zx16asm.assemble(text, name)
+        if (one.ok, one.sections, one.section_addresses, one.symbols) != \
+           (two.ok, two.sections, two.section_addresses, two.symbols):
+            mismatched.append(name)
+
+    lex = lambda: [zx16asm.ZX16Lexer(t).tokenize() for _, t in srcs]
+    lex1 = lambda: [zx16asm.ZX16Lexer(t).tokenize_array() for _, t in srcs]
+    two = lambda: [zx16asm.assemble(t, n) for n, t in srcs]
+    one = lambda: [zx16asm.assemble(t, n, True) for n, t in srcs]
+    t_lex, t_lex1 = best(lex, args.repeat), best(lex1, args.repeat)
+    t_two, t_one = best(two, args.repeat), best(one, args.repeat)
+
+    print(f"{len(srcs)} sources, {lines} lines, best of {args.repeat}")
+    print(f"  {'':<22} {'seconds':>8} {'lines/s':>10}")
+    for label, t in (("tokenize()", t_lex), ("tokenize_array()", t_lex1),
+                     ("two-pass assemble", t_two), ("single-pass assemble", t_one)):
+        print(f"  {label:<22} {t:8.3f} {lines / t:10.0f}")
+    print(f"  single-pass speedup {t_two / t_one:.2f}x")
+    if mismatched:
+        print("images differ between the modes: " + ", ".join(mismatched))
+        return 1
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -10,9 +10,12 @@ License: MIT
 """
 
 import argparse
+import json
 import re
+import struct
 import sys
 import os
+from array import array
 from dataclasses import dataclass, field
 from enum import Enum, auto
 from typing import Dict, List, Optional, Tuple, Union, Any
@@ -71,6 +74,7 @@ class Symbol:
     defined: bool = False
     global_symbol: bool = False
     line: int = 0
+    section: Optional[str] = None  # relocatable objects: the section a label is in
 
 
 @dataclass
@@ -84,6 +88,20 @@ class Instruction:
     line: int = 0
 
 
+@dataclass
+class Relocation:
+    """A statement of a relocatable object that names an address only the linker
+    knows: `size` bytes at `offset` in `section`, re-encoded as mnemonic/operands
+    with the operand equal to `symbol` replaced by its final value."""
+    section: str
+    offset: int
+    size: int
+    mnemonic: str
+    operands: List[Union[int, str]]
+    symbol: str
+    line: int = 0
+
+
 class InstructionFormat(Enum):
     """ZX16 instruction formats."""
     R_TYPE = 0b000
@@ -96,6 +114,76 @@ class InstructionFormat(Enum):
     SYS_TYPE = 0b111
 
 
+# Token kinds as stored in TokenArray.kinds
+_K_INSTRUCTION = TokenType.INSTRUCTION.value
+_K_REGISTER = TokenType.REGISTER.value
+_K_IMMEDIATE = TokenType.IMMEDIATE.value
+_K_LABEL = TokenType.LABEL.value
+_K_DIRECTIVE = TokenType.DIRECTIVE.value
+_K_STRING = TokenType.STRING.value
+_K_CHARACTER = TokenType.CHARACTER.value
+_K_COMMENT = TokenType.COMMENT.value
+_K_NEWLINE = TokenType.NEWLINE.value
+_K_COMMA = TokenType.COMMA.value
+_K_COLON = TokenType.COLON.value
+_K_LPAREN = TokenType.LPAREN.value
+_K_RPAREN = TokenType.RPAREN.value
+_K_EOF = TokenType.EOF.value
+
+
+class TokenArray:
+    """A token stream as parallel arrays instead of one Token object per token:
+    kinds holds TokenType.value bytes, values the token text (as Token.value), and
+    lines/columns the positions. Produced by ZX16Lexer.tokenize_array()."""
+    __slots__ = ('kinds', 'values', 'lines', 'columns')
+    
+    def __init__(self):
+        self.kinds = bytearray()
+        self.values: List[str] = []
+        self.lines = array('I')
+        self.columns = array('I')
+    
+    def __len__(self) -> int:
+        return len(self.kinds)
+    
+    def token(self, i: int) -> Token:
+        """Token i as a Token object."""
+        return Token(TokenType(self.kinds[i]), self.values[i], self.lines[i], self.columns[i])
+    
+    def to_tokens(self) -> List[Token]:
+        """The whole stream as ZX16Lexer.tokenize() returns it."""
+        return [self.token(i) for i in range(len(self.kinds))]
+
+
+# One alternative per token class, in the order ZX16Lexer.tokenize() tries them.
+_SCAN = re.compile(r"""
+    (?P<ws>[ \t\r]+)
+  | (?P<nl>\n)
+  | (?P<comment>\#[^\n]*)
+  | (?P<block>/\*)
+  | (?P<punct>[,:()])
+  | "(?P<string>(?:\\[\s\S]|[^"\\])*\\?)"?
+  | '(?P<char>\\[\s\S]?|[\s\S])?'?
+  | (?P<number>-?(?:0[xX][0-9a-fA-F]*|0[bB][01]*|0[oO][0-7]*|[0-9]+))
+  | (?P<directive>\.\w*)
+  | (?P<ident>[^\W\d]\w*)(?P<colon>[ \t\r]*:)?
+""", re.VERBOSE)
+_STRING_ESCAPE = re.compile(r'\\([\s\S]?)')
+_STRING_ESCAPES = {'n': '\n', 't': '\t', 'r': '\r', '\\': '\\', '"': '"'}
+_CHAR_ESCAPES = {'n': 10, 't': 9, 'r': 13, '\\': 92, "'": 39}
+_PUNCT = {',': _K_COMMA, ':': _K_COLON, '(': _K_LPAREN, ')': _K_RPAREN}
+_REGISTERS = frozenset(('x0', 'x1', 'x2', 'x3', 'x4', 'x5', 'x6', 'x7',
+                        't0', 'ra', 'sp', 's0', 's1', 't1', 'a0', 'a1'))
+
+
+def _lex_number(text: str) -> int:
+    """Value of a number token as ZX16Lexer.read_number() reads it."""
+    digits = text.lstrip('-')
+    base = {'x': 16, 'b': 2, 'o': 8}.get(digits[1:2].lower(), 10) if digits[:1] == '0' else 10
+    value = int(digits, base)
+    return -value if text[0] == '-' else value
+
+
 class ZX16Lexer:
     """Lexical analyzer for ZX16 assembly language."""
     
@@ -131,7 +219,7 @@ class ZX16Lexer:
     
     def skip_whitespace(self) -> None:
         """Skip whitespace except newlines."""
-        while self.current_char() in ' \t\r':
+        while self.current_char() and self.current_char() in ' \t\r':
             self.advance()
     
     def read_string(self) -> str:
@@ -167,24 +255,25 @@ class ZX16Lexer:
             if self.current_char().lower() == 'x':
                 # Hexadecimal
                 self.advance()
-                while self.current_char().lower() in '0123456789abcdef':
+                while self.current_char() and self.current_char().lower() in '0123456789abcdef':
                     self.advance()
                 return int(self.text[start_pos:self.pos], 16)
             elif self.current_char().lower() == 'b':
                 # Binary
                 self.advance()
-                while self.current_char() in '01':
+                while self.current_char() and self.current_char() in '01':
                     self.advance()
                 return int(self.text[start_pos:self.pos], 2)
             elif self.current_char().lower() == 'o':
                 # Octal
                 self.advance()
-                while self.current_char() in '01234567':
+                while self.current_char() and self.current_char() in '01234567':
                     self.advance()
                 return int(self.text[start_pos:self.pos], 8)
             else:
                 # Decimal starting with 0
                 self.pos = start_pos
+                self.column -= 1
         
         # Decimal number
         while self.current_char().isdigit():
@@ -197,7 +286,7 @@ class ZX16Lexer:
         start_pos = self.pos
         
         while (self.current_char().isalnum() or 
-               self.current_char() in '_'):
+               self.current_char() == '_'):
             self.advance()
         
         return self.text[start_pos:self.pos]
@@ -320,14 +409,14 @@ class ZX16Lexer:
                 identifier = self.read_identifier()
                 
                 # Check if it's followed by a colon (label)
-                old_pos = self.pos
+                old_pos, old_column = self.pos, self.column
                 self.skip_whitespace()
                 if self.current_char() == ':':
                     self.advance()  # Consume the colon
                     self.tokens.append(Token(TokenType.LABEL, identifier, line, column))
                     continue
                 else:
-                    self.pos = old_pos  # Restore position
+                    self.pos, self.column = old_pos, old_column  # Restore position
                 
                 # Check if it's a register
                 if self.is_register(identifier):
@@ -342,6 +431,78 @@ class ZX16Lexer:
         
         self.tokens.append(Token(TokenType.EOF, '', self.line, self.column))
         return self.tokens
+    
+    def tokenize_array(self) -> TokenArray:
+        """Tokenize the input into a TokenArray: the same tokens, values and positions
+        as tokenize(), from one regex scan instead of a call per character."""
+        text = self.text
+        out = TokenArray()
+        kinds, values, lines, columns = out.kinds, out.values, out.lines, out.columns
+        match = _SCAN.match
+        pos, end = 0, len(text)
+        line, line_start = 1, 0                 # line_start: index after the last '\n'
+        while pos < end:
+            m = match(text, pos)
+            if m is None:                       # unknown character - skip it
+                pos += 1
+                continue
+            group = m.lastgroup
+            start, pos = pos, m.end()
+            if group == 'ws':
+                continue
+            column = start - line_start + 1
+            if group == 'ident' or group == 'colon':
+                name = m.group('ident')
+                if m.group('colon') is not None:
+                    kind = _K_LABEL
+                else:
+                    kind = _K_REGISTER if name.lower() in _REGISTERS else _K_INSTRUCTION
+                    pos = m.end('ident')
+                value = name
+            elif group == 'nl':
+                kind, value = _K_NEWLINE, '\n'
+            elif group == 'number':
+                kind, value = _K_IMMEDIATE, str(_lex_number(m.group()))
+            elif group == 'punct':
+                value = m.group()
+                kind = _PUNCT[value]
+            elif group == 'comment':
+                kind, value = _K_COMMENT, m.group()
+            elif group == 'directive':
+                kind, value = _K_DIRECTIVE, m.group()
+            elif group == 'block':
+                close = text.find('*/', pos)
+                pos = close + 2 if close >= 0 else max(pos, end - 1)
+                kind, value = _K_COMMENT, text[start:pos]
+            elif group == 'string':
+                kind = _K_STRING
+                value = _STRING_ESCAPE.sub(lambda e: _STRING_ESCAPES.get(e.group(1), e.group(1)),
+                                           m.group('string'))
+            else:                               # character literal
+                body = m.group('char')
+                if not body or body == '\\':
+                    raise SyntaxError(f"Unterminated character literal at line {line}")
+                if body[0] == '\\':
+                    kind, value = _K_CHARACTER, str(_CHAR_ESCAPES.get(body[1], ord(body[1])))
+                else:
+                    kind, value = _K_CHARACTER, str(ord(body))
+            kinds.append(kind)
+            values.append(value)
+            lines.append(line)
+            columns.append(column)
+            if kind == _K_NEWLINE:
+                line += 1
+                line_start = pos
+            elif kind == _K_STRING or kind == _K_CHARACTER or group == 'block':
+                newlines = text.count('\n', start, pos)
+                if newlines:
+                    line += newlines
+                    line_start = text.rindex('\n', start, pos) + 1
+        kinds.append(_K_EOF)
+        values.append('')
+        lines.append(line)
+        columns.append(end - line_start + 1)
+        return out
 
 
 class ZX16Parser:
@@ -358,7 +519,10 @@ class ZX16Parser:
             'add': (0x0, 0x0), 'sub': (0x1, 0x0), 'slt': (0x2, 0x1), 'sltu': (0x3, 0x2),
             'sll': (0x4, 0x3), 'srl': (0x5, 0x3), 'sra': (0x6, 0x3), 'or': (0x7, 0x4),
             'and': (0x8, 0x5), 'xor': (0x9, 0x6), 'mv': (0xa, 0x7), 'jr': (0xb, 0x0),
-            'jalr': (0xc, 0x0)
+            'jalr': (0xc, 0x0),
+            # optional multiply/divide unit (funct4 0xD, the operation in func3)
+            'mul': (0xd, 0x0), 'mulh': (0xd, 0x1), 'mulhu': (0xd, 0x2), 'div': (0xd, 0x4),
+            'divu': (0xd, 0x5), 'rem': (0xd, 0x6), 'remu': (0xd, 0x7)
         }
         
         self.i_type_instructions = {
@@ -394,6 +558,22 @@ class ZX16Parser:
             'li16', 'la', 'push', 'pop', 'call', 'ret',
             'inc', 'dec', 'neg', 'not', 'clr', 'nop'
         }
+        
+        # Bytes each pseudo-instruction expands to. Must match
+        # expand_pseudo_instruction(), or labels after a pseudo will be misplaced.
+        self.pseudo_sizes = {
+            'li16': 4, 'la': 4, 'push': 4, 'pop': 4, 'neg': 4,
+            'call': 2, 'ret': 2, 'inc': 2, 'dec': 2, 'not': 2, 'clr': 2, 'nop': 2
+        }
+    
+    def statement_size(self, mnemonic: str, operands: List[Union[int, str]]) -> int:
+        """Bytes one source instruction assembles to. An LI immediate that does not
+        fit 7 bits becomes LI16; one still unresolved (a str) is assumed to fit."""
+        if mnemonic == 'li':
+            if len(operands) >= 2 and isinstance(operands[1], int) and not -64 <= operands[1] <= 63:
+                return 4
+            return 2
+        return self.pseudo_sizes.get(mnemonic, 2)
     
     def advance(self) -> None:
         """Move to the next token."""
@@ -567,6 +747,123 @@ class ZX16Parser:
         return expansions
 
 
+# Relocatable objects: statements whose label operand is PC-relative, and so resolve
+# in the object when the label is in the same section; and the statements that can
+# carry a relocation at all (an LI or a load offset has no room for an address)
+_PC_RELATIVE = {'la', 'j', 'jal', 'call', 'beq', 'bne', 'bz', 'bnz', 'blt', 'bge',
+                'bltu', 'bgeu'}
+_RELOCATABLE = _PC_RELATIVE | {'li16', '.word'}
+
+
+# Segment-list images (.zxi, `-f zxi`): the 8-byte magic and a u16 record count, then
+# per record <kind u8, address u16, length u32> followed, for a data record, by its
+# `length` bytes. A zero-fill record carries no bytes. Everything outside the records
+# is zero, so a loader need only touch the populated words.
+IMAGE_MAGIC = b"ZX16IMG1"
+SEG_DATA, SEG_ZERO = 0, 1
+ZERO_RUN = 32          # zero runs at least this long split a data segment
+_IMAGE_HDR = struct.Struct("<8sH")
+_IMAGE_SEG = struct.Struct("<BHI")
+
+
+def image_segments(flat: bytes, ranges: Optional[List[Tuple[int, int]]] = None,
+                   min_zero_run: int = ZERO_RUN) -> List[Tuple[int, int, Optional[bytes]]]:
+    """Split a flat image into (address, length, bytes) segments, bytes None for a
+    zero fill. `ranges` are the (start, length) extents of the sections: zero runs
+    inside them (.bss, gaps left by .org) become zero-fill records and nothing
+    outside them is kept. Without ranges the whole image is scanned and its zero runs
+    are dropped. Segment edges inside a range fall on 4-byte boundaries, so a 16- or
+    32-bit memh writer never sees two segments share a word."""
+    keep_zero = ranges is not None
+    spans = []
+    for lo, n in sorted(ranges if keep_zero else [(0, len(flat))]):
+        if spans and lo < spans[-1][1] + min_zero_run:          # overlapping or close
+            spans[-1][1] = max(spans[-1][1], lo + n)
+        else:
+            spans.append([lo, lo + n])
+    zeros = re.compile(b"\0{%d,}" % min_zero_run)
+    segs = []
+    for lo, hi in spans:
+        at = lo
+        for m in zeros.finditer(flat, lo, hi):
+            zs = lo if m.start() == lo else (m.start() + 3) & ~3
+            ze = hi if m.end() == hi else m.end() & ~3
+            if ze <= zs:
+                continue
+            if zs > at:
+                segs.append((at, zs - at, bytes(flat[at:zs])))
+            if keep_zero:
+                segs.append((zs, ze - zs, None))
+            at = ze
+        if hi > at:
+            segs.append((at, hi - at, bytes(flat[at:hi])))
+    return segs
+
+
+def pack_image(segments: List[Tuple[int, int, Optional[bytes]]]) -> bytes:
+    """Serialize image_segments() output as a .zxi file."""
+    out = bytearray(_IMAGE_HDR.pack(IMAGE_MAGIC, len(segments)))
+    for addr, n, data in segments:
+        out += _IMAGE_SEG.pack(SEG_ZERO if data is None else SEG_DATA, addr, n)
+        if data is not None:
+            out += data
+    return bytes(out)
+
+
+def unpack_image(buf) -> List[Tuple[int, int, Optional[memoryview]]]:
+    """Parse a .zxi file (bytes, or an mmap) back into segments. Data segments are
+    memoryview slices of `buf`, not copies; ValueError on a malformed file."""
+    view = memoryview(buf)
+    if len(view) < _IMAGE_HDR.size:
+        raise ValueError("not a ZX16 image (too short)")
+    magic, count = _IMAGE_HDR.unpack_from(view)
+    if magic != IMAGE_MAGIC:
+        raise ValueError(f"not a ZX16 image (magic {bytes(magic)!r})")
+    segs, at = [], _IMAGE_HDR.size
+    for _ in range(count):
+        if at + _IMAGE_SEG.size > len(view):
+            raise ValueError("truncated ZX16 image")
+        kind, addr, n = _IMAGE_SEG.unpack_from(view, at)
+        at += _IMAGE_SEG.size
+        if addr + n > 0x10000 or kind not in (SEG_DATA, SEG_ZERO):
+            raise ValueError(f"bad ZX16 image segment at 0x{addr:04X} (+{n}, kind {kind})")
+        if kind == SEG_ZERO:
+            segs.append((addr, n, None))
+            continue
+        if at + n > len(view):
+            raise ValueError("truncated ZX16 image")
+        segs.append((addr, n, view[at:at + n]))
+        at += n
+    return segs
+
+
+def segments_to_flat(segments, size: int = 0x10000) -> bytes:
+    """The flat image the segments describe."""
+    out = bytearray(size)
+    for addr, n, data in segments:
+        if data is not None:
+            out[addr:addr + n] = data
+    return bytes(out)
+
+
+def memh_from_segments(segments, width: int = 16) -> List[str]:
+    """$readmemh lines for the populated words only: an `@<word index>` line starting
+    each data segment, then one little-endian `width`-bit word per line. Zero fill is
+    left out, so the memory must be cleared before loading (every testbench does)."""
+    wb = width // 8
+    fmt = f"0{width // 4}X"
+    lines = []
+    for addr, n, data in segments:
+        if data is None:
+            continue
+        lo, hi = addr - addr % wb, -(-(addr + n) // wb) * wb
+        chunk = bytes(addr - lo) + bytes(data) + bytes(hi - addr - n)
+        lines.append(f"@{lo // wb:X}")
+        lines += [format(int.from_bytes(chunk[i:i + wb], "little"), fmt)
+                  for i in range(0, len(chunk), wb)]
+    return lines
+
+
 class ZX16Assembler:
     """Main assembler class for ZX16."""
     
@@ -579,7 +876,13 @@ class ZX16Assembler:
         self.current_section = '.text'
         self.output_format = OutputFormat.BINARY
         self.verbose = False
-        
+        self.single_pass_mode = False      # assemble() via single_pass() instead of pass1 + pass2
+        self.fixups: Dict[str, List[list]] = {}   # undefined symbol -> fixups waiting on it
+        self.patched = 0                   # fixups re-encoded by define_and_patch()
+        self.relocatable = False           # single_pass() builds an object (see assemble_object)
+        self.relocations: List[Relocation] = []
+        self.exports: set = set()          # .global names of a relocatable object
+
         # Built-in symbols
         self.init_builtin_symbols()
         
@@ -632,20 +935,33 @@ class ZX16Assembler:
             self.add_error(f"Unknown symbol '{name}'", line)
             return 0
     
-    def define_symbol(self, name: str, value: int, line: int = 0, global_sym: bool = False) -> None:
+    def define_symbol(self, name: str, value: int, line: int = 0, global_sym: bool = False,
+                      section: Optional[str] = None) -> None:
         """Define a symbol."""
         if name in self.symbols:
             if self.symbols[name].defined:
                 self.add_error(f"Symbol '{name}' already defined", line)
                 return
         
-        self.symbols[name] = Symbol(name, value, defined=True, global_symbol=global_sym, line=line)
+        self.symbols[name] = Symbol(name, value, defined=True, global_symbol=global_sym, line=line,
+                                    section=section)
     
     def assemble(self, source_code: str, filename: str = "<input>") -> bool:
         """Assemble source code."""
         try:
-            # Tokenize
             lexer = ZX16Lexer(source_code, filename)
+            if self.single_pass_mode:
+                tokens = lexer.tokenize_array()
+                if self.verbose:
+                    print(f"Tokenized {len(tokens)} tokens")
+                self.single_pass(tokens, filename)
+                if self.verbose:
+                    print(f"Single pass complete. Found {len(self.symbols)} symbols, "
+                          f"backpatched {self.patched} forward references, generated "
+                          f"{len(self.sections['.text'])} bytes of code")
+                return len(self.errors) == 0
+            
+            # Tokenize
             tokens = lexer.tokenize()
             
             if self.verbose:
@@ -766,7 +1082,7 @@ class ZX16Assembler:
                                 break
                     
                     elif directive == '.word':
-                        while parser.current_token.type == TokenType.IMMEDIATE:
+                        while parser.current_token.type in [TokenType.IMMEDIATE, TokenType.INSTRUCTION]:
                             self.current_address += 2
                             parser.advance()
                             if parser.current_token.type == TokenType.COMMA:
@@ -818,9 +1134,16 @@ class ZX16Assembler:
                             immediate_value = int(parser.current_token.value)
                             has_immediate = True
                             parser.advance()
+                        elif (parser.current_token.type == TokenType.INSTRUCTION
+                              and parser.current_token.value in self.symbols):
+                            # A symbol defined above: sized by its value, as pass 2 emits it
+                            immediate_value = self.symbols[parser.current_token.value].value
+                            has_immediate = True
+                            parser.advance()
                         else:
                             parser.advance()
                     parser.pos = temp_pos  # Restore position
+                    parser.current_token = parser.tokens[temp_pos]
                 
                 # Skip all operands
                 while (parser.current_token.type not in [TokenType.NEWLINE, TokenType.EOF, TokenType.COMMENT]):
@@ -835,15 +1158,7 @@ class ZX16Assembler:
                     else:
                         self.current_address += 4  # Expands to LI16 (LUI + ORI)
                 elif mnemonic in parser.pseudo_instructions:
-                    # Size must match the actual expansion in
-                    # expand_pseudo_instruction(), or labels after a pseudo
-                    # will be misplaced.
-                    #   li16, la, push, pop, neg  -> 2 instructions (4 bytes)
-                    #   call, ret, inc, dec, not, clr, nop -> 1 instruction (2 bytes)
-                    if mnemonic in ['li16', 'la', 'push', 'pop', 'neg']:
-                        self.current_address += 4  # Expands to 2 instructions
-                    else:
-                        self.current_address += 2  # Expands to 1 instruction
+                    self.current_address += parser.pseudo_sizes[mnemonic]
                 else:
                     self.current_address += 2  # Regular instruction
                 
@@ -917,8 +1232,11 @@ class ZX16Assembler:
                             break
                 
                 elif directive == '.word':
-                    while parser.current_token.type == TokenType.IMMEDIATE:
-                        value = int(parser.current_token.value) & 0xFFFF
+                    while parser.current_token.type in [TokenType.IMMEDIATE, TokenType.INSTRUCTION]:
+                        if parser.current_token.type == TokenType.INSTRUCTION:
+                            value = self.resolve_symbol(parser.current_token.value, line) & 0xFFFF
+                        else:
+                            value = int(parser.current_token.value) & 0xFFFF
                         # Little-endian encoding
                         current_section_data.append(value & 0xFF)
                         current_section_data.append((value >> 8) & 0xFF)
@@ -1001,56 +1319,224 @@ class ZX16Assembler:
                 
                 # Generate machine code
                 try:
-                    # Special handling for LI instruction
-                    if mnemonic == 'li':
-                        if len(operands) >= 2:
-                            rd, imm = operands[0], operands[1]
-                            
-                            # Check if immediate fits in 7-bit signed range
-                            if -64 <= imm <= 63:
-                                # Use real LI instruction (I-Type)
-                                encoding = self.encode_instruction(mnemonic, operands, parser)
-                                if isinstance(encoding, int):
-                                    current_section_data.append(encoding & 0xFF)
-                                    current_section_data.append((encoding >> 8) & 0xFF)
-                                    self.current_address += 2
+                    self.emit_statement(current_section_data, mnemonic, operands, parser, line)
+                except Exception as e:
+                    self.add_error(f"Error encoding instruction '{mnemonic}': {str(e)}", line)
+                    self.current_address += 2
+                
+                continue
+            
+            # Skip unknown tokens
+            parser.advance()
+    
+    def single_pass(self, tokens: TokenArray, filename: str = "<input>") -> None:
+        """pass1 + pass2 in one walk over a TokenArray. Labels and .equ values are
+        defined where they appear; an instruction naming a symbol not yet defined
+        is emitted as zeros of its final size (statement_size()) and queued on
+        self.fixups under each missing name, then re-encoded in place when the last
+        one is defined. Anything still queued at the end is an unknown symbol.
+        Sections, symbols and bytes come out as from pass1 + pass2.
+        
+        With self.relocatable every section starts at 0, `.section NAME` opens more
+        of them, `.org` is refused, and each statement naming a label is queued to
+        the end of the walk: resolve_object() then fills in what the object knows
+        and leaves the rest to the linker as self.relocations."""
+        parser = ZX16Parser([], filename)
+        registers = parser.register_map
+        kinds, values, lines = tokens.kinds, tokens.values, tokens.lines
+        symbols = self.symbols
+        relocatable = self.relocatable
+        if relocatable:
+            self.section_addresses = {name: 0 for name in self.sections}
+        self.current_address = self.section_addresses[self.current_section]
+        current_section_data = self.sections[self.current_section]
+        end_of_statement = (_K_NEWLINE, _K_EOF, _K_COMMENT)
+        i = 0
+        
+        while kinds[i] != _K_EOF:
+            kind = kinds[i]
+            if kind == _K_NEWLINE or kind == _K_COMMENT:
+                i += 1
+                continue
+            
+            line = lines[i]
+            
+            if kind == _K_LABEL:
+                self.define_and_patch(values[i], self.current_address, line, parser,
+                                      self.current_section if relocatable else None)
+                i += 1
+                continue
+            
+            if kind == _K_DIRECTIVE:
+                directive = values[i].lower()
+                i += 1
+                kind = kinds[i]
+                
+                if directive == '.org':
+                    if relocatable:
+                        self.add_error(".org is not allowed in a relocatable object "
+                                       "(the linker places sections)", line)
+                    elif kind == _K_IMMEDIATE:
+                        org = int(values[i])
+                        base = self.section_addresses[self.current_section]
+                        if len(current_section_data) == 0:
+                            self.section_addresses[self.current_section] = org
+                        elif org >= base + len(current_section_data):
+                            current_section_data.extend(
+                                b'\x00' * (org - base - len(current_section_data)))
+                        else:
+                            self.add_error(".org cannot move backward within a section", line)
+                        self.current_address = org
+                    else:
+                        self.add_error("Expected address after .org", line)
+                
+                elif directive in ('.text', '.data', '.bss') or directive == '.section':
+                    if directive == '.section':
+                        # `.text.main` lexes as the directives .text and .main
+                        name = ''
+                        while kinds[i] == _K_DIRECTIVE or kinds[i] == _K_INSTRUCTION:
+                            name += values[i]
+                            i += 1
+                        if not relocatable:
+                            self.add_error(".section is only allowed in a relocatable object", line)
+                            name = ''
+                        elif not name:
+                            self.add_error("Expected section name after .section", line)
+                        directive = name
+                    if directive:
+                        if directive not in self.sections:
+                            self.sections[directive] = bytearray()
+                            self.section_addresses[directive] = 0
+                        self.current_section = directive
+                        current_section_data = self.sections[directive]
+                        self.current_address = (len(current_section_data) if relocatable
+                                                else self.section_addresses[directive])
+                
+                elif directive in ('.equ', '.set'):
+                    if kind == _K_INSTRUCTION:
+                        symbol_name = values[i]
+                        i += 1
+                        if kinds[i] == _K_COMMA:
+                            i += 1
+                        if kinds[i] == _K_IMMEDIATE:
+                            self.define_and_patch(symbol_name, int(values[i]), line, parser)
+                        elif kinds[i] == _K_INSTRUCTION:
+                            ref_symbol = values[i]
+                            if ref_symbol in symbols:
+                                self.define_and_patch(symbol_name, symbols[ref_symbol].value,
+                                                      line, parser, symbols[ref_symbol].section)
                             else:
-                                # Expand to LI16 (LUI + ORI)
-                                def symbol_resolver(name):
-                                    return self.resolve_symbol(name, line)
-                                
-                                expanded = parser.expand_pseudo_instruction('li16', [rd, imm], self.current_address, symbol_resolver)
-                                for exp_mnemonic, exp_operands in expanded:
-                                    encoding = self.encode_instruction(exp_mnemonic, exp_operands, parser)
-                                    if isinstance(encoding, int):
-                                        current_section_data.append(encoding & 0xFF)
-                                        current_section_data.append((encoding >> 8) & 0xFF)
-                                        self.current_address += 2
+                                self.add_error(f"Undefined symbol '{ref_symbol}' in .equ", line)
                         else:
-                            raise SyntaxError("LI instruction requires 2 operands")
-                    
-                    elif mnemonic in parser.pseudo_instructions:
-                        # Handle other pseudo-instruction expansion with symbol resolution
-                        def symbol_resolver(name):
-                            return self.resolve_symbol(name, line)
-                        
-                        expanded = parser.expand_pseudo_instruction(mnemonic, operands, self.current_address, symbol_resolver)
-                        for exp_mnemonic, exp_operands in expanded:
-                            encoding = self.encode_instruction(exp_mnemonic, exp_operands, parser)
-                            if isinstance(encoding, int):
-                                # Little-endian encoding
-                                current_section_data.append(encoding & 0xFF)
-                                current_section_data.append((encoding >> 8) & 0xFF)
-                                self.current_address += 2
+                            self.add_error("Expected value after symbol name", line)
                     else:
-                        # Regular instruction
-                        encoding = self.encode_instruction(mnemonic, operands, parser)
-                        if isinstance(encoding, int):
-                            # Little-endian encoding
-                            current_section_data.append(encoding & 0xFF)
-                            current_section_data.append((encoding >> 8) & 0xFF)
-                            self.current_address += 2
+                        self.add_error(f"Expected symbol name after {directive}", line)
+                
+                elif directive == '.global':
+                    if kind == _K_INSTRUCTION:
+                        if relocatable:
+                            self.exports.add(values[i])    # may come before the label
+                        elif values[i] in symbols:
+                            symbols[values[i]].global_symbol = True
+                    else:
+                        self.add_error("Expected symbol name after .global", line)
+                
+                elif directive == '.byte':
+                    while kinds[i] == _K_IMMEDIATE or kinds[i] == _K_CHARACTER:
+                        current_section_data.append(int(values[i]) & 0xFF)
+                        self.current_address += 1
+                        i += 1
+                        if kinds[i] != _K_COMMA:
+                            break
+                        i += 1
+                
+                elif directive == '.word':
+                    while kinds[i] == _K_IMMEDIATE or kinds[i] == _K_INSTRUCTION:
+                        if kinds[i] == _K_INSTRUCTION:
+                            symbol = symbols.get(values[i])
+                            if (symbol is None or not symbol.defined
+                                    or symbol.section is not None):
+                                self.queue_fixup(current_section_data, '.word', [values[i]],
+                                                 line, {values[i]}, parser)
+                                i += 1
+                                if kinds[i] != _K_COMMA:
+                                    break
+                                i += 1
+                                continue
+                            value = symbol.value & 0xFFFF
+                        else:
+                            value = int(values[i]) & 0xFFFF
+                        current_section_data.append(value & 0xFF)
+                        current_section_data.append(value >> 8)
+                        self.current_address += 2
+                        i += 1
+                        if kinds[i] != _K_COMMA:
+                            break
+                        i += 1
+                
+                elif directive in ('.string', '.ascii'):
+                    if kind == _K_STRING:
+                        string_data = values[i].encode('utf-8')
+                        current_section_data.extend(string_data)
+                        self.current_address += len(string_data)
+                        if directive == '.string':
+                            current_section_data.append(0)
+                            self.current_address += 1
+                    else:
+                        self.add_error(f"Expected string after {directive}", line)
+                
+                elif directive == '.space':
+                    if kind == _K_IMMEDIATE:
+                        space_size = int(values[i])
+                        current_section_data.extend(bytes(space_size))
+                        self.current_address += space_size
+                    else:
+                        self.add_error("Expected size after .space", line)
+                
+                # Skip remaining tokens on this line
+                while kinds[i] != _K_NEWLINE and kinds[i] != _K_EOF:
+                    i += 1
+                continue
+            
+            if kind == _K_INSTRUCTION:
+                mnemonic = values[i].lower()
+                i += 1
+                
+                # Parse operands; a symbol not yet defined (or, in an object, any
+                # label) stays a str
+                operands = []
+                missing = None
+                while kinds[i] not in end_of_statement:
+                    kind = kinds[i]
+                    if kind == _K_REGISTER:
+                        operands.append(registers.get(values[i].lower(), 0))
+                    elif kind == _K_IMMEDIATE or kind == _K_CHARACTER:
+                        operands.append(int(values[i]))
+                    elif kind == _K_INSTRUCTION:
+                        symbol = symbols.get(values[i])
+                        if symbol is not None and symbol.defined and symbol.section is None:
+                            operands.append(symbol.value)
+                        else:
+                            operands.append(values[i])
+                            if missing is None:
+                                missing = set()
+                            missing.add(values[i])
+                    elif kind == _K_LPAREN:
+                        # Memory operand: offset(register)
+                        if kinds[i + 1] == _K_REGISTER:
+                            i += 1
+                            operands.append(registers.get(values[i].lower(), 0))
+                        if kinds[i + 1] == _K_RPAREN:
+                            i += 1
+                    i += 1
                 
+                if missing:
+                    self.queue_fixup(current_section_data, mnemonic, operands, line, missing,
+                                     parser)
+                    continue
+                
+                try:
+                    self.emit_statement(current_section_data, mnemonic, operands, parser, line)
                 except Exception as e:
                     self.add_error(f"Error encoding instruction '{mnemonic}': {str(e)}", line)
                     self.current_address += 2
@@ -1058,8 +1544,165 @@ class ZX16Assembler:
                 continue
             
             # Skip unknown tokens
-            parser.advance()
+            i += 1
+        
+        if relocatable:
+            self.resolve_object(parser)
+            return
+        
+        # Whatever is still queued names a symbol that never got defined
+        for fix_line, name in sorted((fixup[6], name) for name, queue in self.fixups.items()
+                                     for fixup in queue):
+            self.add_error(f"Unknown symbol '{name}'", fix_line)
+    
+    def queue_fixup(self, data: bytearray, mnemonic: str, operands: List[Union[int, str]],
+                    line: int, missing: set, parser: ZX16Parser) -> None:
+        """Reserve the statement's final size at the current address and queue it on
+        self.fixups under each name in `missing`; define_and_patch() fills it in."""
+        size = parser.statement_size(mnemonic, operands)
+        fixup = [data, len(data), self.current_address, size, mnemonic, operands, line,
+                 missing, self.current_section]
+        for name in missing:
+            self.fixups.setdefault(name, []).append(fixup)
+        data.extend(bytes(size))
+        self.current_address += size
     
+    def define_and_patch(self, name: str, value: int, line: int, parser: ZX16Parser,
+                         section: Optional[str] = None) -> None:
+        """define_symbol(), then re-encode the fixups waiting on `name` whose other
+        symbols are already defined, over the zeros single_pass() reserved. An
+        object's fixups wait for resolve_object() instead."""
+        self.define_symbol(name, value, line, section=section)
+        if self.relocatable:
+            return
+        queue = self.fixups.pop(name, None)
+        if not queue:
+            return
+        value = self.symbols[name].value
+        for fixup in queue:
+            operands, missing = fixup[5], fixup[7]
+            operands[:] = [value if op == name else op for op in operands]
+            missing.discard(name)
+            if not missing:
+                self.patch_fixup(fixup, parser, name)
+    
+    def patch_fixup(self, fixup: list, parser: ZX16Parser, name: str) -> None:
+        """Encode a fixup whose operands are all values over its reserved bytes."""
+        data, offset, address, size, mnemonic, operands, fix_line = fixup[:7]
+        here = self.current_address
+        words = bytearray()
+        self.current_address = address
+        try:
+            self.emit_statement(words, mnemonic, operands, parser, fix_line)
+            if len(words) != size:
+                raise SyntaxError(f"'{name}' is defined after its use and needs "
+                                  f"{len(words)} bytes, not {size}")
+            data[offset:offset + size] = words
+        except Exception as e:
+            self.add_error(f"Error encoding instruction '{mnemonic}': {str(e)}", fix_line)
+        self.patched += 1
+        self.current_address = here
+    
+    def resolve_object(self, parser: ZX16Parser) -> None:
+        """End of a relocatable single_pass(): substitute every queued operand the
+        object can resolve (an absolute symbol, or a label in the statement's own
+        section used PC-relative) and encode the statement; keep one that names any
+        other label, or a symbol defined nowhere here, as a Relocation."""
+        symbols = self.symbols
+        for name in self.exports:
+            if name in symbols and symbols[name].defined:
+                symbols[name].global_symbol = True
+        queued = {id(fixup): fixup for queue in self.fixups.values() for fixup in queue}
+        self.fixups = {}
+        for fixup in sorted(queued.values(), key=lambda f: f[6]):
+            offset, size, mnemonic, operands, line, section = (fixup[1], fixup[3], fixup[4],
+                                                               fixup[5], fixup[6], fixup[8])
+            target = name = None
+            for k, op in enumerate(operands):
+                if not isinstance(op, str):
+                    continue
+                symbol = symbols.get(op)
+                if symbol is not None and symbol.defined and (
+                        symbol.section is None
+                        or (symbol.section == section and mnemonic in _PC_RELATIVE)):
+                    operands[k], name = symbol.value, op
+                elif target is None or target == op:
+                    target = op
+                else:
+                    self.add_error(f"'{mnemonic}' names two relocatable symbols, "
+                                   f"'{target}' and '{op}'", line)
+            if target is None:
+                self.patch_fixup(fixup, parser, name)
+            elif mnemonic not in _RELOCATABLE:
+                self.add_error(f"'{target}' is an address only the linker knows; "
+                               f"'{mnemonic}' cannot take one (use la or li16)", line)
+            else:
+                self.relocations.append(Relocation(section, offset, size, mnemonic,
+                                                   list(operands), target, line))
+    
+    
+    def emit_statement(self, out: bytearray, mnemonic: str, operands: List[Union[int, str]],
+                       parser: ZX16Parser, line: int) -> None:
+        """Encode one source instruction at self.current_address: append its
+        little-endian words to `out` and advance the address. LI and the
+        pseudo-instructions expand here; '.word' is a `.word symbol` fixup."""
+        if mnemonic == '.word':
+            value = operands[0] & 0xFFFF
+            out.append(value & 0xFF)
+            out.append(value >> 8)
+            self.current_address += 2
+            return
+        
+        # Special handling for LI instruction
+        if mnemonic == 'li':
+            if len(operands) >= 2:
+                rd, imm = operands[0], operands[1]
+                
+                # Check if immediate fits in 7-bit signed range
+                if -64 <= imm <= 63:
+                    # Use real LI instruction (I-Type)
+                    encoding = self.encode_instruction(mnemonic, operands, parser)
+                    if isinstance(encoding, int):
+                        out.append(encoding & 0xFF)
+                        out.append((encoding >> 8) & 0xFF)
+                        self.current_address += 2
+                else:
+                    # Expand to LI16 (LUI + ORI)
+                    def symbol_resolver(name):
+                        return self.resolve_symbol(name, line)
+                    
+                    expanded = parser.expand_pseudo_instruction('li16', [rd, imm], self.current_address, symbol_resolver)
+                    for exp_mnemonic, exp_operands in expanded:
+                        encoding = self.encode_instruction(exp_mnemonic, exp_operands, parser)
+                        if isinstance(encoding, int):
+                            out.append(encoding & 0xFF)
+                            out.append((encoding >> 8) & 0xFF)
+                            self.current_address += 2
+            else:
+                raise SyntaxError("LI instruction requires 2 operands")
+        
+        elif mnemonic in parser.pseudo_instructions:
+            # Handle other pseudo-instruction expansion with symbol resolution
+            def symbol_resolver(name):
+                return self.resolve_symbol(name, line)
+            
+            expanded = parser.expand_pseudo_instruction(mnemonic, operands, self.current_address, symbol_resolver)
+            for exp_mnemonic, exp_operands in expanded:
+                encoding = self.encode_instruction(exp_mnemonic, exp_operands, parser)
+                if isinstance(encoding, int):
+                    # Little-endian encoding
+                    out.append(encoding & 0xFF)
+                    out.append((encoding >> 8) & 0xFF)
+                    self.current_address += 2
+        else:
+            # Regular instruction
+            encoding = self.encode_instruction(mnemonic, operands, parser)
+            if isinstance(encoding, int):
+                # Little-endian encoding
+                out.append(encoding & 0xFF)
+                out.append((encoding >> 8) & 0xFF)
+                self.current_address += 2
+
     def encode_instruction(self, mnemonic: str, operands: List[Union[int, str]], parser: ZX16Parser) -> int:
         """Encode an instruction to machine code."""
         mnemonic = mnemonic.lower()
@@ -1154,7 +1797,10 @@ class ZX16Assembler:
             
             # Calculate relative offset
             offset = target - (self.current_address + 2)
-            if offset < -32 or offset > 28 or offset % 2 != 0:
+            # imm[4:1] is 4 bits with imm[0]=0 and bit 4 as the sign, so the branch
+            # reaches -16..+14. The old -32..28 check let offsets through that
+            # wrapped on encoding (+20 decoded as -12).
+            if offset < -16 or offset > 14 or offset % 2 != 0:
                 raise SyntaxError(f"Branch offset out of range or not word-aligned: {offset}")
             
             imm_high = (offset >> 1) & 0xF
@@ -1287,23 +1933,12 @@ class ZX16Assembler:
     
     def get_binary_output(self) -> bytes:
         """Get binary output."""
-        # Combine all sections
+        # Combine all sections (.text, .data, .bss zero-filled; a linked image's
+        # .vectors too)
         output = bytearray(65536)  # 64KB memory space
-        
-        # Write text section
-        text_start = self.section_addresses['.text']
-        text_data = self.sections['.text']
-        output[text_start:text_start + len(text_data)] = text_data
-        
-        # Write data section
-        data_start = self.section_addresses['.data']
-        data_data = self.sections['.data']
-        output[data_start:data_start + len(data_data)] = data_data
-        
-        # Write BSS section (zero-filled)
-        bss_start = self.section_addresses['.bss']
-        bss_data = self.sections['.bss']
-        output[bss_start:bss_start + len(bss_data)] = bss_data
+        for name, data in self.sections.items():
+            start = self.section_addresses[name]
+            output[start:start + len(data)] = data
         
         return bytes(output)
     
@@ -1406,36 +2041,11 @@ class ZX16Assembler:
         return '\n'.join(lines)
     
     def get_memory_file_output(self, sparse: bool = False) -> str:
-        """Get memory file output for $readmemh."""
+        """Get memory file output for $readmemh. sparse=True writes only the populated
+        words (see memh_from_segments()); the testbenches clear memory before loading."""
         if sparse:
             lines = ["# ZX16 Sparse Memory File"]
-            
-            # Text section
-            text_data = self.sections['.text']
-            text_start = self.section_addresses['.text']
-            for i in range(0, len(text_data), 2):
-                if i + 1 < len(text_data):
-                    word = text_data[i] | (text_data[i + 1] << 8)
-                    addr = text_start + i
-                    lines.append(f"@{addr:04X} {word:04X}")
-            
-            # Data section
-            data_data = self.sections['.data']
-            data_start = self.section_addresses['.data']
-            for i in range(0, len(data_data), 2):
-                if i + 1 < len(data_data):
-                    word = data_data[i] | (data_data[i + 1] << 8)
-                    addr = data_start + i
-                    lines.append(f"@{addr:04X} {word:04X}")
-            
-            # BSS section (zero-filled)
-            bss_data = self.sections['.bss']
-            bss_start = self.section_addresses['.bss']
-            for i in range(0, len(bss_data), 2):
-                if i + 1 < len(bss_data):
-                    word = bss_data[i] | (bss_data[i + 1] << 8)
-                    addr = bss_start + i
-                    lines.append(f"@{addr:04X} {word:04X}")
+            lines += memh_from_segments(self.get_segments())
         
         else:
             lines = ["# ZX16 Memory File"]
@@ -1471,6 +2081,17 @@ class ZX16Assembler:
         
         return '\n'.join(lines)
     
+    def get_segments(self, min_zero_run: int = ZERO_RUN) -> List[Tuple[int, int, Optional[bytes]]]:
+        """The image as a segment list (see image_segments()): the populated runs of
+        each section, with .bss and long zero runs as zero-fill records."""
+        ranges = [(self.section_addresses[name], len(data))
+                  for name, data in self.sections.items() if data]
+        return image_segments(self.get_binary_output(), ranges, min_zero_run)
+    
+    def get_image_file_output(self) -> bytes:
+        """Get segment-list image output (.zxi, see pack_image())."""
+        return pack_image(self.get_segments())
+    
     def get_listing_output(self, source_lines: List[str]) -> str:
         """Generate assembly listing."""
         lines = [
@@ -1526,19 +2147,152 @@ class ZX16Assembler:
             print("Assembly completed successfully.")
 
 
+class AssemblyFailed(Exception):
+    """Raised by AssemblyImage.check() when the source did not assemble."""
+
+
+@dataclass
+class AssemblyImage:
+    """In-memory result of assemble(): section contents at their load addresses, the
+    user symbol table, and the diagnostics. `ok` is False when errors is non-empty."""
+    ok: bool
+    sections: Dict[str, bytes]
+    section_addresses: Dict[str, int]
+    symbols: Dict[str, int]
+    errors: List[AssemblyError]
+    warnings: List[AssemblyError]
+    assembler: "ZX16Assembler" = field(repr=False, default=None)
+
+    def check(self) -> "AssemblyImage":
+        """Return self, or raise AssemblyFailed carrying the error report."""
+        if not self.ok:
+            raise AssemblyFailed("assembly failed:\n" + self.report())
+        return self
+
+    def report(self) -> str:
+        """Diagnostics in the same form the command-line assembler prints."""
+        lines = [f"Error at line {e.line}: {e.message}" for e in self.errors]
+        lines += [f"Warning at line {w.line}: {w.message}" for w in self.warnings]
+        return "\n".join(lines)
+
+    def binary(self) -> bytes:
+        """The full 64 KB memory image (what `zx16asm.py -f bin` writes)."""
+        return self.assembler.get_binary_output()
+
+    def memory_file(self, sparse: bool = False) -> str:
+        """$readmemh text (what `zx16asm.py -f mem [--mem-sparse]` writes)."""
+        return self.assembler.get_memory_file_output(sparse)
+
+    def segments(self) -> List[Tuple[int, int, Optional[bytes]]]:
+        """(address, length, bytes or None for a zero fill) for each populated run."""
+        return self.assembler.get_segments()
+
+    def image_file(self) -> bytes:
+        """The segment-list image (what `zx16asm.py -f zxi` writes)."""
+        return self.assembler.get_image_file_output()
+
+
+def assemble(source_code: str, filename: str = "<input>",
+             single_pass: bool = False) -> AssemblyImage:
+    """Library entry point: assemble `source_code` in this process and return an
+    AssemblyImage. Never raises for bad input; call .check() to turn errors into an
+    exception. single_pass=True takes ZX16Assembler.single_pass() (same image)."""
+    a = ZX16Assembler()
+    a.single_pass_mode = single_pass
+    builtins = set(a.symbols)
+    ok = a.assemble(source_code, filename)
+    return AssemblyImage(
+        ok=ok,
+        sections={name: bytes(data) for name, data in a.sections.items()},
+        section_addresses=dict(a.section_addresses),
+        symbols={n: sym.value for n, sym in a.symbols.items()
+                 if sym.defined and n not in builtins},
+        errors=list(a.errors), warnings=list(a.warnings), assembler=a)
+
+
+OBJECT_FORMAT = "zx16-object-1"
+
+
+@dataclass
+class ObjectFile:
+    """A relocatable object (assemble_object(), `zx16asm.py -c`): sections that each
+    start at 0, the symbols defined in them (plus .equ values, section None), and
+    the relocations the linker (zx16ld.py) resolves. Saved as JSON (.zo)."""
+    name: str
+    sections: Dict[str, bytes]
+    symbols: Dict[str, Symbol]
+    relocations: List[Relocation]
+    errors: List[AssemblyError] = field(default_factory=list)
+    warnings: List[AssemblyError] = field(default_factory=list)
+
+    @property
+    def ok(self) -> bool:
+        return not self.errors
+
+    def check(self) -> "ObjectFile":
+        """Return self, or raise AssemblyFailed carrying the error report."""
+        if not self.ok:
+            raise AssemblyFailed("assembly failed:\n" + self.report())
+        return self
+
+    def report(self) -> str:
+        """Diagnostics in the same form the command-line assembler prints."""
+        return AssemblyImage.report(self)
+
+    def to_json(self) -> str:
+        return json.dumps({
+            "format": OBJECT_FORMAT, "name": self.name,
+            "sections": {n: d.hex() for n, d in self.sections.items()},
+            "symbols": {n: [s.section, s.value, s.global_symbol, s.line]
+                        for n, s in self.symbols.items()},
+            "relocations": [[r.section, r.offset, r.size, r.mnemonic, r.operands, r.symbol,
+                             r.line] for r in self.relocations]})
+
+    @classmethod
+    def from_json(cls, text: str) -> "ObjectFile":
+        d = json.loads(text)
+        if d.get("format") != OBJECT_FORMAT:
+            raise ValueError(f"not a ZX16 object (format {d.get('format')!r})")
+        return cls(d["name"], {n: bytes.fromhex(h) for n, h in d["sections"].items()},
+                   {n: Symbol(n, value, True, glob, line, section)
+                    for n, (section, value, glob, line) in d["symbols"].items()},
+                   [Relocation(*r) for r in d["relocations"]])
+
+
+def assemble_object(source_code: str, filename: str = "<input>") -> ObjectFile:
+    """Assemble `source_code` as a relocatable object: a single pass with
+    ZX16Assembler.relocatable set. Like assemble(), never raises for bad input."""
+    a = ZX16Assembler()
+    a.single_pass_mode = a.relocatable = True
+    builtins = set(a.symbols)
+    a.assemble(source_code, filename)
+    return ObjectFile(
+        name=filename,
+        sections={name: bytes(data) for name, data in a.sections.items()
+                  if data or any(sym.section == name for sym in a.symbols.values())},
+        symbols={n: sym for n, sym in a.symbols.items()
+                 if sym.defined and n not in builtins},
+        relocations=a.relocations,
+        errors=list(a.errors), warnings=list(a.warnings))
+
+
 def main():
     """Main entry point for the assembler."""
     parser = argparse.ArgumentParser(description="ZX16 Assembler")
     parser.add_argument("input", help="Input assembly file")
     parser.add_argument("-o", "--output", help="Output file")
-    parser.add_argument("-f", "--format", choices=["bin", "hex", "verilog", "mem"],
+    parser.add_argument("-f", "--format", choices=["bin", "hex", "verilog", "mem", "zxi"],
                        default="bin", help="Output format")
     parser.add_argument("-l", "--listing", help="Generate listing file")
     parser.add_argument("-v", "--verbose", action="store_true", help="Verbose output")
     parser.add_argument("--verilog-module", default="program_memory",
                        help="Verilog module name")
     parser.add_argument("--mem-sparse", action="store_true",
-                       help="Generate sparse memory file")
+                       help="Generate a sparse memory file (only the populated words)")
+    parser.add_argument("-1", "--single-pass", action="store_true",
+                       help="Assemble in one pass, backpatching forward references")
+    parser.add_argument("-c", "--object", action="store_true",
+                       help="Write a relocatable object (.zo) for zx16ld.py instead of an image")
     
     args = parser.parse_args()
     
@@ -1554,9 +2308,29 @@ def main():
         print(f"Error reading input file: {e}", file=sys.stderr)
         return 1
     
+    if args.object:
+        obj = assemble_object(source_code, args.input)
+        for error in obj.errors:
+            print(f"Error at line {error.line}: {error.message}", file=sys.stderr)
+        if not obj.ok:
+            print(f"\nAssembly failed with {len(obj.errors)} errors.", file=sys.stderr)
+            return 1
+        output_file = args.output or Path(args.input).with_suffix('.zo')
+        try:
+            with open(output_file, 'w', encoding='utf-8') as f:
+                f.write(obj.to_json())
+        except IOError as e:
+            print(f"Error writing output file: {e}", file=sys.stderr)
+            return 1
+        if args.verbose:
+            print(f"{len(obj.sections)} sections, {len(obj.symbols)} symbols, "
+                  f"{len(obj.relocations)} relocations written to {output_file}")
+        return 0
+    
     # Create assembler
     assembler = ZX16Assembler()
     assembler.verbose = args.verbose
+    assembler.single_pass_mode = args.single_pass
     
     # Assemble
     success = assembler.assemble(source_code, args.input)
@@ -1581,6 +2355,8 @@ def main():
             output_file = input_path.with_suffix('.v')
         elif args.format == "mem":
             output_file = input_path.with_suffix('.mem')
+        elif args.format == "zxi":
+            output_file = input_path.with_suffix('.zxi')
     
     try:
         if args.format == "bin":
@@ -1603,6 +2379,11 @@ def main():
             with open(output_file, 'w', encoding='utf-8') as f:
                 f.write(output_data)
         
+        elif args.format == "zxi":
+            output_data = assembler.get_image_file_output()
+            with open(output_file, 'wb') as f:
+                f.write(output_data)
+        
         if args.verbose:
             print(f"Output written to {output_file}")
         
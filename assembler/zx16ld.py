@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+"""
+ZX16 linker: relocatable objects (zx16asm.py -c / assemble_object()) -> one image.
+
+  python3 assembler/zx16ld.py crt0.zo prog.zo libc.zo -o prog.bin [-f mem] [-M]
+
+Sections are placed in command-line (object) order, each at a 2-byte boundary:
+every .text* section from 0x0020, .data* from 0x8000 and .bss* from 0x9000, so the
+image lays out like one assembled file. A .vectors.irqN section (one interrupt
+vector's j, from zcc's #pragma interrupt) goes at N * 2 instead, and is always kept. A symbol a relocation names is looked up in
+its own object first, then among every object's .global symbols (defined twice is
+an error). With section stripping on (the default) only the sections reachable
+from the entry symbol's section through relocations are kept: a library object
+costs only the functions a program calls, and an undefined symbol is an error only
+where a kept section needs it. Each relocation is re-encoded at its final address
+by the assembler's own emit_statement(), so branch and jump ranges are checked the
+same way; a statement that comes out a different size is an error.
+"""
+import argparse, sys
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Dict, List, Optional, Tuple
+import zx16asm
+from zx16asm import AssemblyError, AssemblyImage, ObjectFile
+
+TEXT_BASE, DATA_BASE, BSS_BASE = 0x0020, 0x8000, 0x9000
+VECTOR_BASE = 0x0000
+_CLASSES = ('.vectors', '.text', '.data', '.bss')
+
+
+@dataclass
+class LinkedImage(AssemblyImage):
+    """An AssemblyImage from link(); `placed` lists the kept sections as (object,
+    section, address, size) in address order, `stripped` the (object, section)
+    pairs left out."""
+    placed: List[Tuple[str, str, int, int]] = field(default_factory=list)
+    stripped: List[Tuple[str, str]] = field(default_factory=list)
+
+    def map(self) -> str:
+        """A link map: every kept section and the global symbols in it."""
+        names: Dict[int, List[str]] = {}
+        for n, v in sorted(self.symbols.items(), key=lambda s: s[1]):
+            names.setdefault(v, []).append(n)
+        lines = [f"{'address':<8} {'size':>6}  section (object)"]
+        for obj, sec, addr, size in self.placed:
+            lines.append(f"0x{addr:04X}   {size:6d}  {sec} ({obj})")
+            for a in sorted(v for v in names if addr <= v < addr + size):
+                lines.append(f"  0x{a:04X}          {', '.join(names[a])}")
+        lines.append(f"{len(self.placed)} sections kept, {len(self.stripped)} stripped")
+        return "\n".join(lines)
+
+
+def section_class(name: str) -> Optional[str]:
+    """'.vectors', '.text', '.data' or '.bss' for .text / .text.NAME etc., else None."""
+    for c in _CLASSES:
+        if name == c or name.startswith(c + '.'):
+            return c
+    return None
+
+
+def vector_number(name: str) -> Optional[int]:
+    """N of a .vectors.irqN section (0..15), else None."""
+    n = name[len('.vectors.irq'):]
+    return int(n) if name.startswith('.vectors.irq') and n.isdigit() and int(n) < 16 else None
+
+
+def link(objects: List[ObjectFile], entry: str = '__start', strip: bool = True,
+         keep: Tuple[str, ...] = ()) -> LinkedImage:
+    """Link `objects` into an image. `keep` names more global symbols whose sections
+    survive stripping (e.g. code reached only from an interrupt vector). Never
+    raises for bad input: errors come back in the image, as from assemble()."""
+    errors: List[AssemblyError] = []
+    def error(obj, message, line=0):
+        errors.append(AssemblyError(f"{obj.name}: {message}" if obj else message, line, 0))
+
+    exports: Dict[str, int] = {}                    # global name -> object index
+    for i, obj in enumerate(objects):
+        for name, sym in obj.symbols.items():
+            if not sym.global_symbol:
+                continue
+            if name in exports:
+                error(obj, f"Symbol '{name}' already defined in {objects[exports[name]].name}",
+                      sym.line)
+            else:
+                exports[name] = i
+
+    def resolve(i, name):
+        """(object index, Symbol) that `name` means in object i, or None."""
+        sym = objects[i].symbols.get(name)
+        if sym is not None:
+            return i, sym
+        j = exports.get(name)
+        return (j, objects[j].symbols[name]) if j is not None else None
+
+    # Reachability from the entry (and `keep`) sections
+    relocs: Dict[Tuple[int, str], list] = {}
+    for i, obj in enumerate(objects):
+        for sec in obj.sections:
+            relocs[(i, sec)] = []
+        for r in obj.relocations:
+            relocs.setdefault((i, r.section), []).append(r)
+    roots = []
+    for name in (entry,) + tuple(keep):
+        j = exports.get(name)
+        if j is None or objects[j].symbols[name].section is None:
+            error(None, f"Entry symbol '{name}' is not a global label in any object")
+        else:
+            roots.append((j, objects[j].symbols[name].section))
+    roots += [(i, sec) for i, obj in enumerate(objects) for sec in obj.sections
+              if section_class(sec) == '.vectors']       # reached by the hardware
+    if strip:
+        kept, work = set(), roots
+        while work:
+            key = work.pop()
+            if key in kept:
+                continue
+            kept.add(key)
+            for r in relocs[key]:
+                target = resolve(key[0], r.symbol)
+                if target is not None and target[1].section is not None:
+                    work.append((target[0], target[1].section))
+    else:
+        kept = set(relocs)
+
+    # Layout: object order, 2-byte aligned, one run per section class
+    bases = {'.vectors': VECTOR_BASE, '.text': TEXT_BASE, '.data': DATA_BASE,
+             '.bss': BSS_BASE}
+    vectors: Dict[int, str] = {}                    # vector -> object that fills it
+    out = {c: bytearray() for c in _CLASSES}
+    where: Dict[Tuple[int, str], int] = {}
+    placed, stripped = [], []
+    for i, obj in enumerate(objects):
+        for sec, data in obj.sections.items():
+            if (i, sec) not in kept:
+                stripped.append((obj.name, sec))
+                continue
+            c = section_class(sec)
+            if c is None:
+                error(obj, f"Section '{sec}' is not .vectors*, .text*, .data* or .bss*")
+                continue
+            buf = out[c]
+            if c == '.vectors':
+                vec = vector_number(sec)
+                if vec is None or len(data) != 2:
+                    error(obj, f"Section '{sec}' is not .vectors.irq<0..15> holding one j")
+                elif vec in vectors:
+                    error(obj, f"Interrupt vector {vec} is already filled by {vectors[vec]}")
+                else:
+                    vectors[vec] = obj.name
+                    buf.extend(bytes(max(0, 2 * vec + 2 - len(buf))))
+                    buf[2 * vec:2 * vec + 2] = data
+                    where[(i, sec)] = VECTOR_BASE + 2 * vec
+                    placed.append((obj.name, sec, VECTOR_BASE + 2 * vec, 2))
+                continue
+            if len(buf) & 1:
+                buf.append(0)
+            where[(i, sec)] = bases[c] + len(buf)
+            placed.append((obj.name, sec, bases[c] + len(buf), len(data)))
+            buf.extend(data)
+    ends = [(c, bases[c], bases[c] + len(out[c])) for c in _CLASSES]
+    for (c, lo, hi), (c2, lo2, _) in zip(ends, ends[1:] + [('the end of memory', 0x10000, 0)]):
+        if hi > lo2:
+            error(None, f"{c} (0x{lo:04X}-0x{hi - 1:04X}) runs into {c2} at 0x{lo2:04X}")
+
+    # Patch every relocation of a kept section
+    asm = zx16asm.ZX16Assembler()
+    parser = zx16asm.ZX16Parser([])
+    for (i, sec), rs in relocs.items():
+        if (i, sec) not in where:
+            continue
+        obj, base = objects[i], where[(i, sec)]
+        buf = out[section_class(sec)]
+        for r in rs:
+            target = resolve(i, r.symbol)
+            if target is None:
+                error(obj, f"Undefined symbol '{r.symbol}'", r.line)
+                continue
+            j, sym = target
+            value = sym.value + (where.get((j, sym.section), 0) if sym.section else 0)
+            operands = [value if op == r.symbol else op for op in r.operands]
+            words = bytearray()
+            asm.current_address = base + r.offset
+            try:
+                asm.emit_statement(words, r.mnemonic, operands, parser, r.line)
+                if len(words) != r.size:
+                    raise SyntaxError(f"needs {len(words)} bytes, not {r.size}")
+            except Exception as e:
+                error(obj, f"Error encoding instruction '{r.mnemonic}' for '{r.symbol}': {e}",
+                      r.line)
+                continue
+            at = base - bases[section_class(sec)] + r.offset
+            buf[at:at + r.size] = words
+
+    asm.sections = out
+    asm.section_addresses = dict(bases)
+    symbols = {}
+    for name, i in exports.items():
+        sym = objects[i].symbols[name]
+        if sym.section is None:
+            symbols[name] = sym.value
+        elif (i, sym.section) in where:
+            symbols[name] = where[(i, sym.section)] + sym.value
+    return LinkedImage(ok=not errors, sections={c: bytes(d) for c, d in out.items()},
+                       section_addresses=dict(bases), symbols=symbols, errors=errors,
+                       warnings=[], assembler=asm, placed=sorted(placed, key=lambda p: p[2]),
+                       stripped=stripped)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ZX16 linker")
+    parser.add_argument("objects", nargs="+", help="Relocatable objects (.zo), in link order")
+    parser.add_argument("-o", "--output", help="Output file (default: the first object's name)")
+    parser.add_argument("-f", "--format", choices=["bin", "mem", "zxi"], default="bin",
+                        help="Output format")
+    parser.add_argument("-e", "--entry", default="__start", help="Entry symbol (default __start)")
+    parser.add_argument("--no-strip", action="store_true",
+                        help="Keep every section, reachable or not")
+    parser.add_argument("-M", "--map", action="store_true", help="Print a link map")
+    args = parser.parse_args()
+
+    objects = []
+    for path in args.objects:
+        try:
+            with open(path, encoding='utf-8') as f:
+                objects.append(ObjectFile.from_json(f.read()))
+        except (OSError, ValueError) as e:
+            print(f"Error reading {path}: {e}", file=sys.stderr)
+            return 1
+    image = link(objects, args.entry, strip=not args.no_strip)
+    if not image.ok:
+        print(image.report(), file=sys.stderr)
+        print(f"\nLink failed with {len(image.errors)} errors.", file=sys.stderr)
+        return 1
+    if args.map:
+        print(image.map())
+    output = args.output or Path(args.objects[0]).with_suffix('.' + args.format)
+    try:
+        if args.format in ("bin", "zxi"):
+            with open(output, 'wb') as f:
+                f.write(image.binary() if args.format == "bin" else image.image_file())
+        else:
+            with open(output, 'w', encoding='utf-8') as f:
+                f.write(image.memory_file())
+    except IOError as e:
+        print(f"Error writing output file: {e}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
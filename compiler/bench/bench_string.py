@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Cycles per byte of compiler/lib/string.c's memcpy / memset / memcmp / strlen
+against the byte-at-a-time loops they replaced, on the golden simulator.
+
+  python3 compiler/bench/bench_string.py [-n BYTES]
+
+Each figure is (cycles with n bytes - cycles with 0 bytes) / n for one call, so the
+call itself is not counted; "even" has both pointers even, "odd" both odd (one
+byte head) and "mixed" one of each, where memcpy and memcmp stay bytewise.
+"""
+import argparse, os, sys
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+sys.path.insert(0, os.path.join(ROOT, "compiler"))
+sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import buildcache                               # noqa: E402
+import zx16sim as Z                             # noqa: E402
+LIB = os.path.join(ROOT, "compiler", "lib")
+
+# the string.c loops before the word versions, renamed
+BYTEWISE = """
+int b_strlen(char *s){
+    int i; i = 0;
+    while (s[i] != 0) i = i + 1;
+    return i;
+}
+char *b_memcpy(char *d, char *s, int n){
+    int i; i = 0;
+    while (i < n){ d[i] = s[i]; i = i + 1; }
+    return d;
+}
+char *b_memset(char *d, int c, int n){
+    int i; i = 0;
+    while (i < n){ d[i] = c; i = i + 1; }
+    return d;
+}
+int b_memcmp(char *a, char *b, int n){
+    int i; i = 0;
+    while (i < n){
+        if (a[i] != b[i]) return (a[i] & 255) - (b[i] & 255);
+        i = i + 1;
+    }
+    return 0;
+}
+"""
+
+CALLS = {
+    "memcpy": "{f}(a + {da}, b + {db}, {n});",
+    "memset": "{f}(a + {da}, 90, {n});",
+    "memcmp": "putint({f}(a + {da}, b + {db}, {n}));",
+    "strlen": "a[{da} + {n}] = 0; putint({f}(a + {da}));",
+}
+ALIGN = {"even": (0, 0), "odd": (1, 1), "mixed": (0, 1)}
+
+def cycles(fn, prefix, da, db, n, size):
+    call = CALLS[fn].format(f=prefix + fn, da=da, db=db, n=n)
+    src = f"""#include "string.c"
+{BYTEWISE}
+#pragma noinline {prefix}{fn}
+char a[{size}]; char b[{size}];
+int main(void){{
+    memset(a, 65, {size}); memset(b, 65, {size});
+    {call}
+    return 0;
+}}"""
+    _, sim = Z.run_image(buildcache.build(src, LIB).binary)
+    return sim.cycles
+
+def per_byte(fn, prefix, align, n):
+    da, db = ALIGN[align]
+    size = n + 4
+    return (cycles(fn, prefix, da, db, n, size) - cycles(fn, prefix, da, db, 0, size)) / n
+
+def main():
+    ap = argparse.ArgumentParser(description="string.c cycles per byte")
+    ap.add_argument("-n", "--bytes", type=int, default=256)
+    n = ap.parse_args().bytes
+    print(f"cycles per byte over {n} bytes (bytewise -> string.c)")
+    for fn in CALLS:
+        cols = []
+        for align in ALIGN:
+            if fn in ("memset", "strlen") and align == "mixed":
+                continue
+            old, new = per_byte(fn, "b_", align, n), per_byte(fn, "", align, n)
+            cols.append(f"{align} {old:5.2f} -> {new:5.2f} ({old / new:.1f}x)")
+        print(f"  {fn:<7} " + "   ".join(cols))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,327 @@
+#!/usr/bin/env python3
+"""The benchmark suite: dhrystone and the compiler/examples kernels (checksum, matmul,
+TEA, MD5, FFT) on every execution target, as one machine-readable table, compared
+against a stored baseline with per-metric regression thresholds.
+
+  python3 compiler/bench/bench_suite.py [--targets sim,ahb-model,...] [--ws 0 2]
+          [--muldiv] [--json FILE|-] [--baseline FILE] [--update] [--no-compare]
+          [--threshold METRIC=FRACTION ...] [--repeat N]
+
+Targets (a row per program and configuration):
+
+  sim        golden simulator: retired instructions, .text / .data bytes and the
+             compile time (zcc + codegen + peephole + assembler, uncached, the best
+             of --repeat runs)
+  ahb-model  zx16prof.py's cycle model of rtl/ahb/zx16_core_ahb.v, FWD=0 and FWD=1
+             at each --ws (iws = dws): modeled cycles and CPI
+  core       rtl/zx16_core.v (tb_zx16.v): clocks from reset to the halt
+  ahb        rtl/ahb/zx16_core_ahb.v (tb_zx16_ahb.v), FWD=0 and FWD=1 at each +ws
+  soc-model  zx16sim + zx16soc.py: the program built as SoC firmware (stdio_si.c,
+             each putint() followed by a newline): instructions, .text bytes
+  soc        rtl/soc (tb_zx16_soc.v): clocks from power-on to the halt
+
+The RTL targets need an HDL simulator (../../rtl/hdlsim.py, ZX16_SIM=verilator
+selects Verilator) and are skipped without one. Every row checks the program's
+output against the golden simulator's; a mismatch fails the run like a regression.
+
+--json writes {"rows": [...]}, a row being an object of the table's columns (null
+where a target has no such figure); baseline.json next to this file is the
+same format. A metric regresses when it grows by more than its threshold over the
+baseline row with the same (program, target, config); THRESHOLDS are the defaults.
+cpi (a ratio, which a win that drops cheap instructions raises) and compile_ms
+(which depends on the host) are reported but not gated unless a --threshold names
+them. A row with no baseline row (an RTL target's first run on a host with an HDL
+simulator, a new --ws) cannot be gated, so it fails the run until --update records
+it. --update merges this run's rows into the baseline (rows of
+targets not run, e.g. RTL rows recorded on another host, are kept). --muldiv builds
+everything with codegen.HW_MULDIV and the RTL with MULDIV=1; its rows carry
+"muldiv" in their config.
+"""
+import argparse, json, os, re, sys, time
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+for d in ("compiler", "simulator", "assembler", "rtl", os.path.join("rtl", "ahb"),
+          os.path.join("rtl", "soc")):
+    sys.path.insert(0, os.path.join(ROOT, d))
+import buildcache, codegen                      # noqa: E402
+import hdlsim                                   # noqa: E402
+import zx16asm                                  # noqa: E402
+import zx16sim as Z, zx16prof as P              # noqa: E402
+LIB = os.path.join(ROOT, "compiler", "lib")
+EXAMPLES = os.path.join(ROOT, "compiler", "examples")
+BASELINE = os.path.join(HERE, "baseline.json")
+
+PROGRAMS = (("dhrystone", os.path.join(HERE, "dhrystone.c")),
+            ("checksum", os.path.join(EXAMPLES, "04_checksum.c")),
+            ("matmul", os.path.join(EXAMPLES, "06_matmul.c")),
+            ("tea", os.path.join(EXAMPLES, "07_tea.c")),
+            ("md5", os.path.join(EXAMPLES, "08_md5.c")),
+            ("fft", os.path.join(EXAMPLES, "09_fft.c")))
+TARGETS = ("sim", "ahb-model", "core", "ahb", "soc-model", "soc")
+RTL_TARGETS = ("core", "ahb", "soc")
+METRICS = ("instructions", "cycles", "cpi", "text_bytes", "data_bytes", "compile_ms")
+# the largest growth over the baseline that is not a regression (None: reported, not
+# gated). CPI is a ratio: dropping cheap instructions raises it on a real win.
+THRESHOLDS = {"instructions": 0.01, "cycles": 0.01, "cpi": None, "text_bytes": 0.01,
+              "data_bytes": 0.01, "compile_ms": None}
+
+# the examples print with the simulator's ECALLs; as SoC firmware the same calls go
+# through stdio_si.c's UART, one value a line
+SOC_PRELUDE = """#include "stdio_si.c"
+void bench_putint(int v){ putint(v); putchar(10); }
+"""
+SOC_MAIN = "\nint main(void){ uart_init(); bench_main(); return 0; }\n"
+
+def soc_source(src):
+    src = re.sub(r"\bputint\s*\(", "bench_putint(", src)
+    src = re.sub(r"\bint\s+main\s*\(\s*void\s*\)", "int bench_main(void)", src)
+    return SOC_PRELUDE + src + SOC_MAIN
+
+def soc_text(out):
+    """The UART text soc_source()'s build prints for the golden output `out`."""
+    return "".join(f"{v}\n" if k == "int" else chr(v) for k, v in out)
+
+def console(out):
+    """Golden output in vvp_batch.parse_output()'s form."""
+    return [("INT" if k == "int" else "CHR", v) for k, v in out]
+
+def row(program, target, config="-", ok=True, **metrics):
+    r = {"program": program, "target": target, "config": config, "ok": ok}
+    r.update(metrics)
+    if metrics.get("cycles") is not None and metrics.get("instructions"):
+        r["cpi"] = round(metrics["cycles"] / metrics["instructions"], 4)
+    return r
+
+def key(r):
+    return r["program"], r["target"], r["config"]
+
+def compile_timed(src, repeat):
+    """(AssemblyImage, best wall ms) of an uncached compile + assemble."""
+    best = None
+    for _ in range(max(1, repeat)):
+        t = time.perf_counter()
+        image = zx16asm.assemble(codegen.compile_src(src, LIB), "<asm>", single_pass=True)
+        ms = (time.perf_counter() - t) * 1000
+        best = ms if best is None else min(best, ms)
+    if not image.ok:
+        raise RuntimeError("assembly failed:\n" + image.report())
+    return image, round(best, 1)
+
+def section_bytes(image, *names):
+    return sum(len(image.sections.get(n, b"")) for n in names)
+
+def collect(targets=TARGETS, ws_list=(0, 2), muldiv=False, repeat=3, log=print):
+    """Run the suite; returns the rows (and prints a SKIP line per RTL target that
+    cannot run here)."""
+    def cfg(c):
+        parts = ([] if c == "-" else [c]) + (["muldiv"] if muldiv else [])
+        return " ".join(parts) or "-"
+    rtl = [t for t in targets if t in RTL_TARGETS]
+    if rtl and not hdlsim.available():
+        log(f"SKIP {', '.join(rtl)} ({hdlsim.backend()} not on the PATH)")
+        targets = [t for t in targets if t not in RTL_TARGETS]
+    save = codegen.HW_MULDIV
+    codegen.HW_MULDIV = bool(muldiv)
+    try:
+        return _collect(targets, ws_list, int(bool(muldiv)), repeat, cfg)
+    finally:
+        codegen.HW_MULDIV = save
+
+def _collect(targets, ws_list, md, repeat, cfg):
+    rows, golden, builds = [], {}, {}
+    for name, path in PROGRAMS:
+        src = open(path).read()
+        image, ms = compile_timed(src, repeat)
+        out, sim = Z.run_image(image.binary())
+        golden[name] = (out, sim.cycles)
+        builds[name] = buildcache.build(src, LIB)
+        if "sim" in targets:
+            rows.append(row(name, "sim", cfg("-"), sim.halted, instructions=sim.cycles,
+                            text_bytes=section_bytes(image, ".text"),
+                            data_bytes=section_bytes(image, ".data", ".bss"),
+                            compile_ms=ms))
+        if "ahb-model" in targets:
+            for fwd in (0, 1):
+                for ws in ws_list:
+                    o, s, prof = P.profile_image(image, None, ws, ws, fwd=bool(fwd))
+                    rows.append(row(name, "ahb-model", cfg(f"fwd={fwd} ws={ws}"), o == out,
+                                    instructions=prof.instructions, cycles=prof.cycles))
+    if "core" in targets or "ahb" in targets:
+        rows += _rtl_rows(targets, ws_list, md, cfg, golden, builds)
+    if "soc-model" in targets or "soc" in targets:
+        rows += _soc_rows(targets, md, cfg, golden)
+    order = [name for name, _ in PROGRAMS]
+    return sorted(rows, key=lambda r: (order.index(r["program"]), TARGETS.index(r["target"])))
+
+def _rtl_rows(targets, ws_list, md, cfg, golden, builds):
+    import verify, verify_ahb, vvp_batch
+    rows, vvps = [], []
+    if "core" in targets:
+        vvps.append(("core", "-", verify.build_rtl(muldiv=md), [0]))
+    if "ahb" in targets:
+        vvps += [("ahb", f"fwd={fwd}", verify_ahb.build(fwd=fwd, muldiv=md), ws_list)
+                 for fwd in (0, 1)]
+    mems = {name: vvp_batch.mem_image(b) for name, b in builds.items()}
+    try:
+        for target, base, vvp, wss in vvps:
+            jobs = [(mems[name], ws, golden[name][1] * (2 + ws))
+                    for name, _ in PROGRAMS for ws in wss]
+            texts = iter(vvp_batch.run_batch(vvp, jobs, timeout=900, raw=True))
+            for name, _ in PROGRAMS:
+                out, n = golden[name]
+                for ws in wss:
+                    t = next(texts)
+                    got = [o for o in vvp_batch.parse_output(t) if o[0] in ("INT", "CHR")]
+                    m = re.search(r"CYCLES (\d+)", t)
+                    config = base if target == "core" else f"{base} ws={ws}"
+                    rows.append(row(name, target, cfg(config),
+                                    got == console(out) and m is not None,
+                                    instructions=n, cycles=int(m.group(1)) if m else None))
+    finally:
+        for mem in mems.values(): os.unlink(mem)
+    return rows
+
+def _soc_rows(targets, md, cfg, golden):
+    import soc_run
+    rows = []
+    if "soc" in targets:
+        soc_run.build_sim(muldiv=md)
+    for name, path in PROGRAMS:
+        out = golden[name][0]
+        asm = soc_run.firmware_asm(soc_source(open(path).read()))
+        b = soc_run.assemble_image(asm, path)
+        text = soc_text(out)
+        res = soc_run.run_model(path, max_cycles=10**7, image=b)
+        if "soc-model" in targets:
+            image = zx16asm.assemble(asm, path, single_pass=True)
+            rows.append(row(name, "soc-model", cfg("-"), res["halted"] and res["text"] == text,
+                            instructions=res["cycles"],
+                            text_bytes=section_bytes(image, ".text")))
+        if "soc" in targets:
+            r = soc_run.run(path, timeout=3600, max_cycles=50 * res["cycles"] + 20000,
+                            image=b)
+            rows.append(row(name, "soc", cfg("-"), r["halted"] and r["text"] == text
+                            and r["cycles"] is not None,
+                            instructions=res["cycles"], cycles=r["cycles"]))
+    return rows
+
+# ---- the baseline ----------------------------------------------------------------
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)["rows"]
+
+def dump(rows):
+    """The JSON text of `rows`, one row a line (so a baseline update diffs by row)."""
+    return '{"rows": [\n' + ",\n".join(json.dumps(r) for r in rows) + "\n]}\n"
+
+def merge(base, rows):
+    """The baseline rows with this run's rows in place of (or added to) theirs."""
+    new = {key(r): r for r in rows}
+    merged = [new.pop(key(r), r) for r in base]
+    return merged + [r for r in rows if key(r) in new]
+
+def compare(rows, base, thresholds=THRESHOLDS):
+    """([(row key, metric, old, new, fraction)] regressions, report lines)."""
+    old = {key(r): r for r in base}
+    regressions, lines = [], []
+    for r in rows:
+        b = old.get(key(r))
+        if b is None:
+            lines.append(f"  new    {' '.join(key(r))}: no baseline row"); continue
+        for m in METRICS:
+            if r.get(m) is None or not b.get(m):
+                continue
+            frac = (r[m] - b[m]) / b[m]
+            tol = thresholds.get(m)
+            if frac == 0 or (m == "compile_ms" and tol is None):   # host noise
+                continue
+            bad = tol is not None and frac > tol
+            if bad:
+                regressions.append((key(r), m, b[m], r[m], frac))
+            mark = ("WORSE " if bad else "report" if tol is None else
+                    "better" if frac < 0 else "within")
+            lines.append(f"  {mark} {' '.join(key(r)):<34} {m:<12} {b[m]:>10} -> "
+                         f"{r[m]:>10} ({frac:+.2%})")
+    return regressions, lines
+
+def unbaselined(rows, base):
+    """The keys of `rows` that have no baseline row to be gated against."""
+    old = {key(r) for r in base}
+    return [key(r) for r in rows if key(r) not in old]
+
+# ---- the table -----------------------------------------------------------------
+
+def table(rows):
+    cols = ("program", "target", "config") + METRICS + ("ok",)
+    cell = lambda v: "-" if v is None else ("yes" if v is True else "NO" if v is False
+                                            else str(v))
+    body = [[cell(r.get(c)) for c in cols] for r in rows]
+    width = [max(len(c), *(len(b[i]) for b in body)) for i, c in enumerate(cols)]
+    fmt = lambda cells: "  ".join(c.ljust(w) if i < 3 else c.rjust(w)
+                                  for i, (c, w) in enumerate(zip(cells, width)))
+    return "\n".join([fmt(cols)] + [fmt(b) for b in body])
+
+def parse_thresholds(items):
+    th = dict(THRESHOLDS)
+    for it in items or ():
+        m, _, v = it.partition("=")
+        if m not in METRICS:
+            raise SystemExit(f"--threshold {it}: metric must be one of {', '.join(METRICS)}")
+        th[m] = None if v.lower() in ("", "none", "off") else float(v)
+    return th
+
+def main():
+    ap = argparse.ArgumentParser(description="ZX16 benchmark suite")
+    ap.add_argument("--targets", default=",".join(TARGETS),
+                    help="comma-separated subset of " + ",".join(TARGETS))
+    ap.add_argument("--ws", type=int, nargs="+", default=[0, 2],
+                    help="AHB wait states for ahb-model / ahb (default 0 2)")
+    ap.add_argument("--muldiv", action="store_true",
+                    help="codegen.HW_MULDIV builds on the MULDIV=1 RTL")
+    ap.add_argument("--json", metavar="FILE", help="write the rows ('-': stdout)")
+    ap.add_argument("--baseline", default=BASELINE)
+    ap.add_argument("--update", action="store_true", help="merge the rows into the baseline")
+    ap.add_argument("--no-compare", action="store_true")
+    ap.add_argument("--threshold", action="append", metavar="METRIC=FRACTION",
+                    help="override a regression threshold (e.g. cycles=0.02, compile_ms=0.5)")
+    ap.add_argument("--repeat", type=int, default=3, help="compile-time samples (best of)")
+    args = ap.parse_args()
+    targets = [t.strip() for t in args.targets.split(",") if t.strip()]
+    for t in targets:
+        if t not in TARGETS:
+            ap.error(f"unknown target {t!r}")
+    thresholds = parse_thresholds(args.threshold)
+    rows = collect(targets, args.ws, args.muldiv, args.repeat,
+                   log=lambda s: print(s, file=sys.stderr))
+    if args.json == "-":
+        sys.stdout.write(dump(rows))
+    else:
+        print(table(rows))
+        if args.json:
+            with open(args.json, "w") as f:
+                f.write(dump(rows))
+    failed = [key(r) for r in rows if not r["ok"]]
+    for k in failed:
+        print(f"FAIL {' '.join(k)}: output differs from the golden simulator", file=sys.stderr)
+    regressions, unrecorded = [], []
+    if not args.no_compare and os.path.exists(args.baseline):
+        base = load(args.baseline)
+        regressions, lines = compare(rows, base, thresholds)
+        unrecorded = unbaselined(rows, base)
+        print(f"\nagainst {os.path.relpath(args.baseline)}:", file=sys.stderr)
+        for line in lines or ["  no change"]:
+            print(line, file=sys.stderr)
+        print(f"{len(regressions)} regression(s) over the thresholds", file=sys.stderr)
+        if unrecorded and not args.update:
+            print(f"{len(unrecorded)} row(s) with no baseline row, so not gated: "
+                  "record them with --update", file=sys.stderr)
+    if args.update and not failed:
+        base = load(args.baseline) if os.path.exists(args.baseline) else []
+        with open(args.baseline, "w") as f:
+            f.write(dump(merge(base, rows)))
+        print(f"updated {os.path.relpath(args.baseline)}", file=sys.stderr)
+    sys.exit(1 if failed or ((regressions or unrecorded) and not args.update) else 0)
+
+if __name__ == "__main__":
+    main()
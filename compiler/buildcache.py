@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""
+Content-addressed on-disk cache for the compile -> assemble -> image pipeline.
+
+The test suites and the RTL verifiers rebuild the same examples and the same
+compiler/lib runtime on every run. build(src) returns a Build(asm, binary, mem) and
+only does front-end work when the inputs changed:
+
+  compile key  = sha256(preprocessed source + #defines, codegen flags, enabled
+                 peephole rules, compiler source text)                 -> <key>.s
+  image key    = sha256(assembly text, assembler source text)          -> <key>.zxi
+                                                                          <key>.mem
+
+Images come from the assembler's single-pass mode (the same bytes as two passes).
+They are stored as segment lists (zx16asm -f zxi) and sparse $readmemh text, a few KB
+each instead of 64 KB + 160 KB; Build.binary is still the flat 64 KB image and
+Build.mem holds only the populated words (the testbenches clear memory first).
+
+"Codegen flags" are every ALL_CAPS bool/int/str global of zcc, codegen,
+codegen_patterns and peephole (ELIMINATE_DEAD_FUNCS, INTRINSIC_IO, STACK_TOP,
+PUSH_POP, ...; ZX16_PEEPHOLE_OFF enters through peephole.enabled()), read at call
+time, so toggling a flag around a build can never hit a stale entry. Entries are
+written to a temp file and renamed into place, so parallel workers may share a cache.
+
+build_linked(src) is the separate-compilation pipeline. The program, each compiler/lib
+unit it includes (seen through its interface) and crt0 + runtime become their own
+cached .o.s / .zo objects: a library is compiled once, not per program. zx16ld links
+them and drops the functions nothing reaches.
+
+ZX16_CACHE=<dir> moves the cache (default $XDG_CACHE_HOME/zx16 or ~/.cache/zx16);
+ZX16_CACHE=off disables it (every call compiles and assembles). Nothing is ever
+evicted: delete the directory to reclaim space.
+"""
+import os, sys, hashlib, tempfile
+from collections import namedtuple
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(os.path.dirname(HERE), "assembler"))
+import zcc, codegen, codegen_patterns, peephole   # noqa: E402
+import zx16asm, zx16ld                     # noqa: E402
+
+Build = namedtuple("Build", "asm binary mem")
+
+STATS = {"hit": 0, "miss": 0}           # compile-stage + object lookups, for tests/benchmarks
+
+def cache_dir():
+    d = os.environ.get("ZX16_CACHE")
+    if d and d.lower() in ("0", "off", "none"):
+        return None
+    return d or os.path.join(os.environ.get("XDG_CACHE_HOME") or
+                             os.path.join(os.path.expanduser("~"), ".cache"), "zx16")
+
+_SRC_HASH = {}
+def _source_hash(*mods):
+    """Hash of the modules' .py text (memoised per path + mtime)."""
+    h = hashlib.sha256()
+    for m in mods:
+        path = m.__file__
+        stamp = (path, os.path.getmtime(path))
+        if stamp not in _SRC_HASH:
+            with open(path, "rb") as f:
+                _SRC_HASH[stamp] = hashlib.sha256(f.read()).hexdigest()
+        h.update(_SRC_HASH[stamp].encode())
+    return h.hexdigest()
+
+def _flags():
+    return sorted((m.__name__ + "." + k, repr(v))
+                  for m in (zcc, codegen, codegen_patterns, peephole)
+                  for k, v in vars(m).items()
+                  if k.isupper() and type(v) in (bool, int, str))
+
+def _key(*parts):
+    h = hashlib.sha256()
+    for p in parts:
+        h.update(repr(p).encode()); h.update(b"\0")
+    return h.hexdigest()
+
+def _path(d, key, ext):
+    return os.path.join(d, key[:2], key + ext)
+
+def _get(d, key, ext, mode="r"):
+    try:
+        with open(_path(d, key, ext), mode) as f:
+            return f.read()
+    except OSError:
+        return None
+
+def _put(d, key, ext, data):
+    p = _path(d, key, ext)
+    try:                                  # best effort: a read-only cache just misses
+        os.makedirs(os.path.dirname(p), exist_ok=True)
+        fd, tmp = tempfile.mkstemp(dir=os.path.dirname(p), suffix=".tmp")
+        with os.fdopen(fd, "wb" if isinstance(data, bytes) else "w") as f:
+            f.write(data)
+        os.replace(tmp, p)
+    except OSError:
+        pass
+
+def compile_src(src, base_dir="."):
+    """codegen.compile_src(), served from the cache when nothing relevant changed."""
+    d = cache_dir()
+    if d is None:
+        return codegen.compile_src(src, base_dir)
+    text, defines = zcc.preprocess(src, base_dir)
+    key = _key(text, sorted(defines.items()), _flags(), peephole.enabled(),
+               _source_hash(zcc, codegen, codegen_patterns, peephole))
+    asm = _get(d, key, ".s")
+    if asm is not None:
+        STATS["hit"] += 1
+        return asm
+    STATS["miss"] += 1
+    asm = codegen.compile_src(src, base_dir)
+    _put(d, key, ".s", asm)
+    return asm
+
+def assemble(asm, name="<asm>"):
+    """Assemble to a Build (64 KB flat binary + sparse $readmemh text); RuntimeError on
+    assembly errors (which are never cached)."""
+    d = cache_dir()
+    key = _key(asm, _source_hash(zx16asm)) if d else None
+    if d:
+        zxi, mem = _get(d, key, ".zxi", "rb"), _get(d, key, ".mem")
+        if zxi is not None and mem is not None:
+            return Build(asm, zx16asm.segments_to_flat(zx16asm.unpack_image(zxi)), mem)
+    image = zx16asm.assemble(asm, name, single_pass=True)
+    if not image.ok:
+        raise RuntimeError("assembly failed:\n" + image.report())
+    b = Build(asm, image.binary(), image.memory_file(sparse=True))
+    if d:
+        _put(d, key, ".zxi", image.image_file()); _put(d, key, ".mem", b.mem)
+    return b
+
+def build(src, base_dir=".", name="<asm>"):
+    """Compile + assemble ZC source; a warm call reads three files and hashes."""
+    return assemble(compile_src(src, base_dir), name)
+
+# ---------------------------------------------------------------------------
+# Separate compilation: relocatable objects + zx16ld
+# ---------------------------------------------------------------------------
+
+LIB = os.path.join(HERE, "lib")
+
+def _cached(ext, key, make):
+    """make(), or the text cached under key+ext (ZX16_CACHE=off: always make())."""
+    d = cache_dir()
+    if d is not None:
+        text = _get(d, key, ext)
+        if text is not None:
+            STATS["hit"] += 1
+            return text
+    STATS["miss"] += 1
+    text = make()
+    if d is not None:
+        _put(d, key, ext, text)
+    return text
+
+def compile_object(src, base_dir=".", lib=LIB):
+    """(asm, units): codegen.compile_object() of one unit, with the files it
+    includes from `lib` as interfaces only, and their paths. The key holds those
+    interfaces, not the libraries' code: editing a library function's body never
+    recompiles the programs that call it."""
+    units = []
+    text, defines = zcc.preprocess(src, base_dir, lib, units)
+    key = _key("object", text, sorted(defines.items()), _flags(), peephole.enabled(),
+               _source_hash(zcc, codegen, codegen_patterns, peephole))
+    return _cached(".o.s", key, lambda: codegen.compile_object(src, base_dir, lib)), units
+
+def assemble_object(asm, name="<asm>"):
+    """zx16asm.assemble_object(), cached as .zo JSON; RuntimeError on errors."""
+    def make():
+        obj = zx16asm.assemble_object(asm, name)
+        if not obj.ok:
+            raise RuntimeError("assembly failed:\n" + obj.report())
+        return obj.to_json()
+    return zx16asm.ObjectFile.from_json(
+        _cached(".zo", _key(asm, name, _source_hash(zx16asm)), make))
+
+def runtime_object():
+    """crt0 + the runtime routines (codegen.compile_runtime) as an object."""
+    key = _key("runtime", _flags(), peephole.enabled(),
+               _source_hash(codegen, codegen_patterns, peephole))
+    return assemble_object(_cached(".o.s", key, codegen.compile_runtime), "<runtime>")
+
+def link_objects(src, base_dir=".", lib=LIB):
+    """The objects build_linked() links, in link order: runtime, program, then each
+    library unit it includes (transitively), each compiled from its own file."""
+    asm, units = compile_object(src, base_dir, lib)
+    objects = [runtime_object(), assemble_object(asm, "<program>")]
+    for path in units:
+        with open(path) as f:
+            unit_asm, _ = compile_object(f.read(), os.path.dirname(path), lib)
+        objects.append(assemble_object(unit_asm, os.path.basename(path)))
+    return asm, objects
+
+def build_linked(src, base_dir=".", lib=LIB):
+    """build() by separate compilation: the program and every compiler/lib unit it
+    includes are compiled and assembled to objects on their own (each cached by its
+    own text, so a library is compiled once per set of codegen flags and shared by
+    every program), then linked with zx16ld, which drops the functions nothing
+    calls. Build.asm is the program unit's assembly; RuntimeError on link errors."""
+    asm, objects = link_objects(src, base_dir, lib)
+    image = zx16ld.link(objects)
+    if not image.ok:
+        raise RuntimeError("link failed:\n" + image.report())
+    return Build(asm, image.binary(), image.memory_file(sparse=True))
+
+
+if __name__ == "__main__":
+    for path in sys.argv[1:]:
+        b = build(open(path).read(), os.path.dirname(os.path.abspath(path)), path)
+        print(f"{path}: {len(b.asm.splitlines())} asm lines")
+    print(f"cache {cache_dir()}: {STATS['hit']} hit, {STATS['miss']} miss")
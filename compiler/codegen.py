@@ -11,6 +11,7 @@ Conventions:
 """
 import re
 import codegen_patterns as C
+import peephole
 import zcc
 
 WORD = 2
@@ -27,6 +28,67 @@ ELIMINATE_DEAD_FUNCS = True
 # functions (e.g. the MMIO UART driver in compiler/lib/stdio_si.c) instead.
 INTRINSIC_IO = True
 
+# Expression temporaries in registers. When True, side-effect-free expression
+# subtrees (no calls, assignments, or * / % other than by a constant that expands
+# to shifts and adds, or with HW_MULDIV) are evaluated Sethi-Ullman style into x6 plus the
+# temporaries x5/x4/x7 instead of the push/pop stack machine; only a tree
+# that needs more than those four registers pushes, at the nodes that overflow.
+# Variables, members and constant indices use reg+offset addressing directly, and
+# constants fold into I-type immediates. x4/x7 are free inside such a subtree: the
+# only users (far_jump, calls, the div/mod ABI) never occur in one. Set False for
+# the original uniform stack-machine codegen (e.g. to bisect a codegen bug).
+REG_TEMPS = True
+_TEMPS = ('x5', 'x4', 'x7')
+_INT = {'base':'int','ptr':0}
+
+# Leaf frames: a function whose call graph entry has no calls (intrinsic putint /
+# putchar aside) and no asm() skips the ra save ('leaf' frame); one whose body also
+# never moves sp drops the frame pointer and addresses its slots from sp ('none').
+# The shape is tried, the body checked (the runtime's __mul etc. are calls too) and
+# regenerated with the next shape if it broke one (codegen_patterns.frame_allows).
+# Set False for the uniform push x1 / push x3 frame everywhere.
+LEAF_FRAMES = True
+
+# Inlining: a call to a function of at most INLINE_NODES AST nodes (body), with no
+# asm() and not on a call-graph cycle, is expanded in place -- `return` a jump to the
+# end of the expansion -- instead of pushing arguments for la/jalr and a
+# prologue/epilogue. A constant, `&v` or array argument is substituted into the body
+# and a variable's slot shared (subst_arg / alias_arg); anything else is stored into
+# a fresh slot past the caller's locals, usually out of lw/sw reach, so only forced
+# expansions take such arguments (pure_arg). A function whose every call is expanded
+# is not emitted (see reachable_funcs). `#pragma inline f` forces it whatever the
+# size and arguments (an error if f cannot be inlined), `#pragma noinline f` forbids
+# it. Set INLINE False to expand nothing, pragmas included.
+INLINE = True
+INLINE_NODES = 24
+
+# Register locals: a scalar word local or parameter referenced inside a loop whose
+# address is never taken lives in a register instead of its frame slot. Live ranges
+# come from the AST (first to last reference, stretched over every loop that
+# references the variable) and the hottest variables (references weighted by loop
+# depth) get a register none of whose other variables is live at the same time:
+# x7 / x4 in a body with no call at all (it keeps the temporaries that are left;
+# far jumps take x5 for x4), else x0, which every function that uses it saves and
+# restores (see codegen_patterns.regs_allow). Each function with candidates gets a
+# `# regs:` comment giving the assignment and the pressure. Set False to keep every
+# variable in the frame.
+REG_LOCALS = True
+
+# Multiply/divide unit: when True, * / % and __mulhu compile to the optional
+# hardware instructions (MUL DIV DIVU REM REMU MULHU, R-type funct4 0xD; the RTL
+# cores' MULDIV=1 and rtl/zx16_muldiv.v) instead of calls to __mul / __udivmod /
+# __div / __mod / __umul32, and join REG_TEMPS trees as two-register operations.
+# Multiplies by a constant with a short shift-and-add expansion, and / % by powers
+# of two, keep their expansions; other constant divisors use DIVU / DIV rather
+# than a reciprocal. x / 0 gives what the runtime gives. The image then runs only on a
+# core built with the unit (and on the simulator, which always has it).
+HW_MULDIV = False
+
+# Run the peephole pass (peephole.py: rule table, per-rule switches) over the
+# emitted text. Set False to see gen_program()'s output unchanged.
+PEEPHOLE = True
+_REG_BINOPS = {'+','-','&','|','^','<<','>>','<','>','<=','>=','==','!='}
+
 # Per-op AST child fields holding node indices, so the call graph can be walked
 # without re-implementing codegen. single = one index (may be None); list = list.
 _CHILD_SINGLE = {
@@ -40,12 +102,32 @@ _IDENT_RE = re.compile(r'[A-Za-z_][A-Za-z0-9_]*')
 
 class CodegenError(Exception): pass
 
+def _fold(bop, a, b):
+    """a bop b for signed 16-bit ints, as the generated code computes it; None for
+    what stays a runtime operation (x / 0, shift counts outside 0..15)."""
+    if bop in ('/','%'):
+        if b==0: return None
+        q=abs(a)//abs(b)
+        if (a<0)!=(b<0): q=-q
+        return q if bop=='/' else a-q*b
+    if bop in ('<<','>>'):
+        if not 0<=b<=15: return None
+        return a<<b if bop=='<<' else a>>b
+    return {'+':a+b, '-':a-b, '*':a*b, '&':a&b, '|':a|b, '^':a^b, '<':a<b, '<=':a<=b,
+            '>':a>b, '>=':a>=b, '==':a==b, '!=':a!=b}[bop]
+
 class Func:
     def __init__(self, name):
         self.name=name
         self.slots={}      # varname -> (frame_index, type)  (locals + params unified)
         self.n_locals=0
         self.param_order=[] # names in order
+        self.frame='full'   # codegen_patterns frame shape: 'full' / 'leaf' / 'none'
+        self.base="x3"      # register slots are addressed from ...
+        self.bias=0         # ... and what to add to their s0-relative offsets
+        self.temps=_TEMPS   # expression temporaries no variable lives in
+        self.saves=[]       # (register, frame index) of callee-saved registers used
+        self.reg_stores={}  # register -> `mv reg, x6` stores of its variables emitted
 
 class Codegen:
     def __init__(self, parser):
@@ -55,6 +137,12 @@ class Codegen:
         self.global_syms={}  # name -> (label, type, arrlen)
         self.cur=None        # current Func
         self.func_types={}   # fname -> return type
+        self._reg_ok={}; self._need={}; self._reads_mem={}   # per-node REG_TEMPS memos
+        self._const={}       # node -> folded constant value (or None)
+        self.inlines=None    # fname -> func node index expanded in place (plan_inlines)
+        self.inline_base=0   # first frame slot free for the next inline expansion
+        self.scope_body=None # body of the function whose names are in scope
+        self._inline_need={}; self._real_calls={}            # per-function memos
 
     # ---------- type helpers ----------
     def is_unsigned(self, t):
@@ -79,91 +167,336 @@ class Codegen:
         return self.type_size(t)
 
     # ---------- dead-function elimination ----------
-    def _scan_body(self, idx, calls, asms):
-        """Collect direct-call callee names and asm() texts under node `idx`."""
+    def _scan_body(self, idx, calls, asms, sites=None):
+        """Collect direct-call callee names and asm() texts under node `idx` (and,
+        given `sites`, the call nodes' indices)."""
         if idx is None: return
         n=self.P.nodes[idx]; op=n['op']
         if op=='call':
             f=self.P.nodes[n['fn']]
             if f['op']=='ident': calls.add(f['name'])
+            if sites is not None: sites.append(idx)
         elif op=='asm':
             asms.append(n['text'])
         for fld in _CHILD_SINGLE.get(op,()):
             c=n.get(fld)
-            if c is not None: self._scan_body(c, calls, asms)
+            if c is not None: self._scan_body(c, calls, asms, sites)
         for fld in _CHILD_LIST.get(op,()):
             for c in n.get(fld,()):
-                if c is not None: self._scan_body(c, calls, asms)
+                if c is not None: self._scan_body(c, calls, asms, sites)
 
     def reachable_funcs(self):
-        """Function node-indices reachable from main (+ any named in reachable asm).
-        Falls back to all functions when there is no main (e.g. a library unit)."""
+        """Function node-indices reachable from main and the #pragma interrupt
+        handlers (+ any named in reachable asm),
+        less those whose every call is expanded inline (their own callees are still
+        reached through the expansions). Falls back to all functions when there is
+        no main (e.g. a library unit)."""
         by_name={self.P.nodes[i]['name']: i for i in self.P.funcs}
         if 'main' not in by_name:
             return set(self.P.funcs)
-        keep=set(); work=['main']
+        keep=set(); seen=set(); work=[('main', True)]
+        work+=[(name, True) for name in self.P.interrupts.values()]   # vectored
         while work:
-            fidx=by_name.get(work.pop())
-            if fidx is None or fidx in keep: continue
-            keep.add(fidx)
-            calls=set(); asms=[]
-            self._scan_body(self.P.nodes[fidx]['body'], calls, asms)
-            work.extend(calls)
+            name,emit=work.pop()
+            fidx=by_name.get(name)
+            if fidx is None: continue
+            if emit: keep.add(fidx)
+            if fidx in seen: continue
+            seen.add(fidx)
+            calls=set(); asms=[]; sites=[]
+            self._scan_body(self.P.nodes[fidx]['body'], calls, asms, sites)
+            for c in sites:
+                f=self.P.nodes[self.P.nodes[c]['fn']]
+                if f['op']=='ident':
+                    work.append((f['name'], self.inline_target(self.P.nodes[c]) is None))
             for blob in asms:                       # keep fns named inside this asm
-                work.extend(t for t in _IDENT_RE.findall(blob) if t in by_name)
+                work.extend((t, True) for t in _IDENT_RE.findall(blob) if t in by_name)
         return keep
 
+    # ---------- inlining ----------
+    def _size(self, idx):
+        """AST nodes under idx (the INLINE_NODES measure)."""
+        if idx is None: return 0
+        n=self.P.nodes[idx]; op=n['op']
+        return 1+sum(self._size(n.get(f)) for f in _CHILD_SINGLE.get(op,())) + \
+            sum(self._size(c) for f in _CHILD_LIST.get(op,()) for c in n.get(f,()))
+
+    def plan_inlines(self):
+        """fname -> node index of every function whose calls gen_inline expands."""
+        if self.inlines is not None: return self.inlines
+        by_name={self.P.nodes[i]['name']: i for i in self.P.funcs}
+        graph={}
+        for name,fidx in by_name.items():
+            calls=set(); asms=[]
+            self._scan_body(self.P.nodes[fidx]['body'], calls, asms)
+            graph[name]=(calls, asms)
+        def on_cycle(name):
+            seen=set(); work=list(graph[name][0])
+            while work:
+                c=work.pop()
+                if c==name: return True
+                if c in seen or c not in graph: continue
+                seen.add(c); work.extend(graph[c][0])
+            return False
+        self.inlines={}
+        for name,fidx in by_name.items():
+            fn=self.P.nodes[fidx]; force=self.P.inline.get(name)
+            if not INLINE or force is False or name=='main': continue
+            why=('it contains asm()' if graph[name][1] else
+                 'it is recursive' if on_cycle(name) else
+                 'a parameter is unnamed or wider than a word'
+                 if any(p is None or self.type_size(t)>WORD for p,t in fn['params']) else None)
+            if why:
+                if force: raise CodegenError(f"#pragma inline {name}: {why}")
+            elif force or self._size(fn['body'])<=INLINE_NODES:
+                self.inlines[name]=fidx
+        return self.inlines
+
+    def inline_target(self, n):
+        """Node index of the function call node n expands to, or None for a real
+        call (intrinsics, a wrong argument count, anything plan_inlines left)."""
+        f=self.P.nodes[n['fn']]
+        if f['op']!='ident': return None
+        name=f['name']; nargs=len(n['args'])
+        if (INTRINSIC_IO and name in ('putint','putchar') and nargs==1) or \
+                (name=='__mulhu' and nargs==2):
+            return None
+        fidx=self.plan_inlines().get(name)
+        if fidx is None or nargs!=len(self.P.nodes[fidx]['params']): return None
+        if not self.P.inline.get(name) and not all(map(self.pure_arg, n['args'])):
+            return None
+        return fidx
+
+    def pure_arg(self, idx):
+        """True for an argument an expansion can usually use without a copy (a
+        constant, a variable or its address: see subst_arg / alias_arg). A copy
+        lands past the caller's locals, where lw/sw rarely reach: only forced
+        expansions take other arguments."""
+        a=self.P.nodes[idx]
+        if a['op']=='unop' and a['uop']=='&': a=self.P.nodes[a['operand']]
+        return a['op']=='ident' or self.const_val(idx) is not None
+
+    def _inline_sites(self, idx):
+        """(call node, callee node index) of every expanded call under idx."""
+        calls=set(); asms=[]; sites=[]
+        self._scan_body(idx, calls, asms, sites)
+        return [(c, self.inline_target(self.P.nodes[c])) for c in sites]
+
+    def real_calls(self, fidx):
+        """Names fidx calls through la/jalr, looking through inline expansions."""
+        if fidx not in self._real_calls:
+            out=set()
+            for c,t in self._inline_sites(self.P.nodes[fidx]['body']):
+                if t is not None: out|=self.real_calls(t)
+                else: out.add(self.P.nodes[self.P.nodes[c]['fn']].get('name'))
+            self._real_calls[fidx]=out
+        return self._real_calls[fidx]
+
+    def inline_frame(self, fidx, base):
+        """(slot records, slot count) of fidx's params and locals, expanded with
+        its first slot at caller frame index `base`."""
+        fn=self.P.nodes[fidx]
+        f=Func(fn['name'])
+        self.collect_locals(fn['body'], f)
+        slots={k: (v[0]+base,)+v[1:] for k,v in f.slots.items()}
+        for i,(pname,pty) in enumerate(fn['params']):
+            slots[pname]=(base+f.n_locals+i, pty, None)
+        return slots, f.n_locals+len(fn['params'])
+
+    def inline_need(self, idx):
+        """Frame slots the expansions under node idx need: each expansion's own
+        slots, then those nested in its body above them."""
+        if idx not in self._inline_need:
+            need=0
+            for _,t in self._inline_sites(idx):
+                if t is not None:
+                    own=self.inline_frame(t, 0)[1]
+                    need=max(need, own+self.inline_need(self.P.nodes[t]['body']))
+            self._inline_need[idx]=need
+        return self._inline_need[idx]
+
+    def _names_var(self, idx, name, lhs=True):
+        """True if `&name` appears under node idx (or, with lhs, `name = ...`)."""
+        if idx is None: return False
+        n=self.P.nodes[idx]; op=n['op']
+        if op=='unop' and n['uop']=='&' or (lhs and op=='assign'):
+            t=self.P.nodes[n['operand' if op=='unop' else 'lhs']]
+            if t['op']=='ident' and t['name']==name: return True
+        return any(self._names_var(n.get(f), name, lhs) for f in _CHILD_SINGLE.get(op,())) or \
+            any(self._names_var(c, name, lhs) for f in _CHILD_LIST.get(op,()) for c in n.get(f,()))
+
+    def alias_arg(self, fn, i, args):
+        """The caller's slot record parameter i of fn can use in place of a copy: the
+        argument is a plain scalar frame variable of the parameter's type whose
+        address the scope never takes, fn never assigns the parameter, and no other
+        argument has a side effect that could change the variable first."""
+        a=self.P.nodes[args[i]]; pname,pty=fn['params'][i]
+        if a['op']!='ident' or a['name'] not in self.cur.slots: return None
+        kind,info=self.var_info(a['name'])
+        ty=self.var_type(a['name'])
+        if self.is_array_var(a['name']) or self.type_size(ty)>WORD or \
+                (ty['base'],ty['ptr'])!=(pty['base'],pty.get('ptr',0)):
+            return None
+        if self._names_var(fn['body'], pname) or \
+                self._names_var(self.scope_body, a['name'], lhs=False):
+            return None
+        if any(not self.reg_ok(b) for j,b in enumerate(args) if j!=i): return None
+        return info
+
+    def subst_arg(self, fn, i, args):
+        """An ('expr', ...) record standing for parameter i of fn when its argument
+        has the same value wherever the body reads it -- a constant for a word
+        parameter, `&v` or an array v -- and fn never assigns the parameter or
+        takes its address: the body then evaluates the argument in place (and
+        `*p`, `p->f` and `p[k]` address v's slot directly)."""
+        a=self.P.nodes[args[i]]; pname,pty=fn['params'][i]
+        if self._names_var(fn['body'], pname): return None
+        if self.const_val(args[i]) is not None:
+            ok=self.type_size(pty)==WORD
+        elif a['op']=='unop' and a['uop']=='&':
+            o=self.P.nodes[a['operand']]
+            ok=o['op']=='ident' and not self.subst(o['name'])
+        else:
+            ok=a['op']=='ident' and not self.subst(a['name']) and self.is_array_var(a['name'])
+        return ('expr', args[i], pty, self.cur.slots) if ok else None
+
+    def gen_inline(self, n, fidx):
+        """Expand call node n to function fidx in place; result in x6. Arguments are
+        evaluated right to left as for a call; with a call among them (whose own
+        expansion may use the same slots) they are pushed first, else each goes
+        straight into its parameter slot -- or the parameter just stands for the
+        argument subst_arg / alias_arg allow."""
+        e=self.e; f=self.cur; fn=self.P.nodes[fidx]
+        caller=f.slots
+        scope,own=self.inline_frame(fidx, self.inline_base)
+        params=[p for p,_ in fn['params']]
+        args=n['args']
+        if any(self._inline_sites(a) for a in args):
+            for a in reversed(args):
+                self.gen_expr(a); C.push_x6(e)
+            f.slots=scope
+            for p in params:
+                C.pop_to(e, "x6"); self.store_to_var(p)
+        else:
+            for i in reversed(range(len(args))):
+                f.slots=caller
+                alias=self.subst_arg(fn, i, args) or self.alias_arg(fn, i, args)
+                if alias is not None:
+                    scope[params[i]]=alias; continue
+                self.gen_expr(args[i])
+                f.slots=scope; self.store_to_var(params[i])
+        f.slots=scope
+        saved=self.epilogue_label, self.inline_base, self.scope_body
+        self.epilogue_label=e.label("inl"); self.inline_base+=own
+        self.scope_body=fn['body']
+        start=len(e.lines)
+        self.gen_stmt(fn['body'])
+        C.near_jumps(e, start, self.epilogue_label)
+        e.emit(f"{self.epilogue_label}:")
+        self.epilogue_label, self.inline_base, self.scope_body=saved
+        f.slots=caller
+        return self.func_types.get(fn['name'], {'base':'int','ptr':0})
+
     # ---------- program ----------
     def gen_program(self):
         e=self.e
-        C.crt0(e)
+        C.crt0(e, handlers=self.interrupt_handlers())
         C.runtime(e)
-        # globals storage
-        for (name,ty,arrlen,init) in self.P.globals:
-            label=f"g_{name}"
-            self.global_syms[name]=(label,ty,arrlen)
-        # functions: register all return types, but emit only those reachable
-        # from main (dead-function elimination -- see reachable_funcs).
-        for fidx in self.P.funcs:
-            fn=self.P.nodes[fidx]
-            self.func_types[fn['name']]=fn['ret']
+        self.declare()
+        # functions: emit only those reachable from main (dead-function elimination
+        # -- see reachable_funcs).
         keep = self.reachable_funcs() if ELIMINATE_DEAD_FUNCS else set(self.P.funcs)
         for fidx in self.P.funcs:
             if fidx in keep:
                 self.gen_func(fidx)
         # data section
         e.emit(".data")
-        for (name,ty,arrlen,init) in self.P.globals:
-            label=f"g_{name}"
-            if arrlen:
-                e.emit(f"{label}: .space {self.type_size(ty)*arrlen}")
-            else:
-                sz=self.type_size(ty)
-                if sz<=WORD:
-                    # scalar (int/unsigned/char/pointer): one word, constant init
-                    e.emit(f"{label}: .word {init if init is not None else 0}")
-                else:
-                    # struct (or any multi-word) global: reserve its FULL size,
-                    # word-rounded. This branch previously also emitted a single
-                    # .word, so struct globals were under-allocated to 2 bytes and
-                    # overlapped the next global (A.hi aliased B.lo) -- the actual
-                    # cause of the TEA failure (misattributed to evaluation order).
-                    e.emit(f"{label}: .space {(sz+WORD-1)//WORD*WORD}")
+        for g in self.P.globals:
+            e.emit(self.global_data(*g))
         for (label,text) in self.strings:
-            data=','.join(str(ord(c)) for c in text)+',0'
-            e.emit(f"{label}: .byte {data}")
+            e.emit(self.string_data(label, text))
         return e.text()
 
+    def gen_object(self):
+        """One relocatable unit (zx16asm.assemble_object) instead of a program:
+        every function and global in a .section of its own, exported with .global,
+        each string in a local one, and no crt0/runtime (compile_runtime()). Nothing
+        is pruned here: the linker (zx16ld) keeps only the sections reached from
+        __start."""
+        e=self.e
+        self.declare()
+        for vec, name in sorted(self.interrupt_handlers().items()):
+            C.isr_trampoline(e, vec, name, sections=True)
+        for fidx in self.P.funcs:
+            name=self.P.nodes[fidx]['name']
+            e.emit(f".section .text.{name}")
+            e.emit(f".global {name}")
+            self.gen_func(fidx)
+        for g in self.P.globals:
+            e.emit(f".section .data.g_{g[0]}")
+            e.emit(f".global g_{g[0]}")
+            e.emit(self.global_data(*g))
+        for (label,text) in self.strings:
+            e.emit(f".section .data.{label}")
+            e.emit(self.string_data(label, text))
+        return e.text()
+
+    def interrupt_handlers(self):
+        """#pragma interrupt's {vector: handler}, each a function of this unit that
+        takes no parameters (the trampoline passes none)."""
+        for vec, name in self.P.interrupts.items():
+            fn=next((self.P.nodes[i] for i in self.P.funcs
+                     if self.P.nodes[i]['name']==name), None)
+            if fn is None:
+                raise CodegenError(f"#pragma interrupt {vec} {name}: no such function")
+            if fn['params']:
+                raise CodegenError(f"#pragma interrupt {vec} {name}: a handler takes "
+                                   f"no parameters")
+        return dict(self.P.interrupts)
+
+    def declare(self):
+        """Global labels, and the return type of every function defined or
+        prototyped (a call to any other function is assumed to return int)."""
+        for (name,ty,arrlen,init) in self.P.globals:
+            self.global_syms[name]=(f"g_{name}",ty,arrlen)
+        self.func_types.update(self.P.protos)
+        for fidx in self.P.funcs:
+            fn=self.P.nodes[fidx]
+            self.func_types[fn['name']]=fn['ret']
+
+    def global_data(self, name, ty, arrlen, init):
+        label=f"g_{name}"
+        if arrlen:
+            return f"{label}: .space {self.type_size(ty)*arrlen}"
+        sz=self.type_size(ty)
+        if sz<=WORD:
+            # scalar (int/unsigned/char/pointer): one word, constant init
+            return f"{label}: .word {init if init is not None else 0}"
+        # struct (or any multi-word) global: reserve its FULL size,
+        # word-rounded. This branch previously also emitted a single
+        # .word, so struct globals were under-allocated to 2 bytes and
+        # overlapped the next global (A.hi aliased B.lo) -- the actual
+        # cause of the TEA failure (misattributed to evaluation order).
+        return f"{label}: .space {(sz+WORD-1)//WORD*WORD}"
+
+    def string_data(self, label, text):
+        data=','.join(str(ord(c)) for c in text)+',0'
+        return f"{label}: .byte {data}"
+
     # ---------- functions ----------
-    def collect_locals(self, idx, fn):
+    def collect_locals(self, idx, fn, regs={}):
+        """Give every local under idx a slot record in fn (a ('reg', r, type) record
+        and no slot for those regs names)."""
         n=self.P.nodes[idx]; op=n['op']
         if op=='block':
-            for s in n['stmts']: self.collect_locals(s,fn)
+            for s in n['stmts']: self.collect_locals(s,fn,regs)
         elif op=='if':
-            self.collect_locals(n['then'],fn)
-            if n['els'] is not None: self.collect_locals(n['els'],fn)
+            self.collect_locals(n['then'],fn,regs)
+            if n['els'] is not None: self.collect_locals(n['els'],fn,regs)
         elif op=='while':
-            self.collect_locals(n['body'],fn)
+            self.collect_locals(n['body'],fn,regs)
+        elif op=='vardecl' and n['name'] in regs:
+            fn.slots[n['name']]=('reg', regs[n['name']], n['vtype'])
         elif op=='vardecl':
             if n['arrlen']:
                 nslots=(self.type_size(n['vtype'])*n['arrlen']+WORD-1)//WORD
@@ -174,21 +507,148 @@ class Codegen:
             fn.slots[n['name']]=(base_index, n['vtype'], n['arrlen'])
             fn.n_locals+=nslots
 
-    def gen_func(self, fidx):
-        fn=self.P.nodes[fidx]
+    def is_leaf(self, fidx):
+        """No call in function fidx but intrinsic I/O (inline expansions included),
+        and no asm() that might hold one."""
+        calls=set(); asms=[]
+        self._scan_body(self.P.nodes[fidx]['body'], calls, asms)
+        intrinsic={'putint','putchar'} if INTRINSIC_IO else set()
+        return not asms and self.real_calls(fidx)<=intrinsic
+
+    def new_func(self, fn, regs):
+        """A Func for fn with the variables in regs (name -> register) in registers,
+        its frame sized: locals, a save slot for x0, then room for inline expansions."""
         f=Func(fn['name']); self.cur=f
         # params occupy positive offsets; record them
         for i,(pname,pty) in enumerate(fn['params']):
-            f.slots[pname]=('param',i,pty)
+            f.slots[pname]=('reg',regs[pname],pty) if pname in regs else ('param',i,pty)
             f.param_order.append(pname)
-        # collect locals to size the frame
-        self.collect_locals(fn['body'], f)
-        C.func_prologue(self.e, fn['name'], f.n_locals)
-        self.epilogue_label=self.e.label("epi")
-        self.gen_stmt(fn['body'])
-        self.e.emit(f"{self.epilogue_label}:")
-        C.func_epilogue(self.e)
-        self.cur=None
+        self.collect_locals(fn['body'], f, regs)
+        used=set(regs.values())
+        if 'x0' in used and fn['name']!='main':         # crt0 keeps nothing in x0
+            f.saves.append(('x0', f.n_locals)); f.n_locals+=1
+        f.temps=tuple(t for t in _TEMPS if t not in used)
+        f.reg_stores=dict.fromkeys(used, 0)
+        self.inline_base=f.n_locals; self.scope_body=fn['body']
+        f.n_locals+=self.inline_need(fn['body'])
+        return f
+
+    def gen_func(self, fidx):
+        fn=self.P.nodes[fidx]
+        leaf=self.is_leaf(fidx)
+        shapes=('none','leaf','full') if LEAF_FRAMES and leaf else ('full',)
+        plans=self.plan_regs(fidx, leaf)
+        e=self.e
+        for frame in shapes:
+            for regs,note in plans:
+                f=self.new_func(fn, regs)
+                if frame=='none' and C.frame_reach(frame, f.n_locals, len(fn['params']))>7:
+                    continue
+                f.frame, f.base, f.bias=frame, C.frame_base(frame), C.frame_bias(frame, f.n_locals)
+                e.jump_reg="x5" if 'x4' in regs.values() else "x4"
+                mark=(len(e.lines), e._label_n, len(self.strings))
+                C.func_prologue(e, fn['name'], f.n_locals, frame)
+                if note: e.emit(f"    # {note}")
+                self.reg_prologue(fn)
+                self.epilogue_label=e.label("epi")
+                body=len(e.lines)
+                self.gen_stmt(fn['body'])
+                end=len(e.lines)
+                e.emit(f"{self.epilogue_label}:")
+                for r,i in f.saves:
+                    self.load_at(_INT, r, f.base, self.frame_offset((i, _INT, None)))
+                C.func_epilogue(e, f.n_locals, frame)
+                e.jump_reg="x4"
+                framed=frame=='full' or C.frame_allows(frame, e.lines[mark[0]:])
+                if framed and C.regs_allow(e.lines[body:end], f.reg_stores):
+                    self.cur=None; return
+                del e.lines[mark[0]:]; del self.strings[mark[2]:]
+                e._label_n=mark[1]
+                if not framed: break
+        raise CodegenError(f"{fn['name']}: no frame fits")
+
+    def reg_prologue(self, fn):
+        """Save the callee-saved registers the function uses and load its register
+        parameters."""
+        f=self.cur
+        for r,i in f.saves:
+            self.store_at(_INT, r, f.base, self.frame_offset((i, _INT, None)), "x5")
+        for i,(pname,pty) in enumerate(fn['params']):
+            info=f.slots[pname]
+            if info[0]=='reg':
+                self.load_at(pty, info[1], f.base, C.param_addr_offset(i, f.frame)+f.bias)
+
+    # ---------- register locals ----------
+    def live_ranges(self, fn):
+        """name -> (first, last, weight) of each variable fn's body references: AST
+        positions (preorder) of its first and last reference, stretched over every
+        while loop that references it and, for a parameter, back to the entry (-1);
+        weight sums 8**loop depth over the references. Names referenced only
+        outside loops are left out."""
+        refs={}; loops=[]; pos=[0]
+        def walk(idx, depth):
+            n=self.P.nodes[idx]; op=n['op']; p=pos[0]; pos[0]+=1
+            if op=='ident': refs.setdefault(n['name'], []).append((p, depth))
+            d=depth+1 if op=='while' else depth
+            for fld in _CHILD_SINGLE.get(op,()):
+                c=n.get(fld)
+                if c is not None and not (op=='call' and fld=='fn'): walk(c, d)
+            for fld in _CHILD_LIST.get(op,()):
+                for c in n.get(fld,()):
+                    if c is not None: walk(c, d)
+            if op=='vardecl' and n['init'] is not None:
+                refs.setdefault(n['name'], []).append((pos[0], depth)); pos[0]+=1
+            if op=='while': loops.append((p, pos[0]-1))
+        walk(fn['body'], 0)
+        params={p for p,_ in fn['params']}
+        out={}
+        for name,rs in refs.items():
+            if all(d==0 for _,d in rs): continue
+            first=-1 if name in params else min(p for p,_ in rs)
+            last=max(p for p,_ in rs)
+            for s,t in loops:
+                if any(s<=p<=t for p,_ in rs): first,last=min(first,s),max(last,t)
+            out[name]=(first, last, sum(8**min(d,4) for _,d in rs))
+        return out
+
+    def plan_regs(self, fidx, leaf):
+        """[(name -> register, `-S` comment)] to try in order, ending with {} (every
+        variable in the frame). Candidates are word scalars (int / unsigned /
+        pointers) live in a loop whose address the body never takes."""
+        fn=self.P.nodes[fidx]; body=fn['body']
+        calls=set(); asms=[]
+        self._scan_body(body, calls, asms)
+        if not REG_LOCALS or asms: return [({}, None)]
+        f=Func(fn['name'])
+        for i,(pname,pty) in enumerate(fn['params']): f.slots[pname]=('param',i,pty)
+        self.collect_locals(body, f)
+        def scalar(info):
+            t=info[2] if info[0]=='param' else info[1]
+            return not (info[0]!='param' and info[2]) and \
+                (t['ptr']>0 or t['base'] in ('int','unsigned'))
+        ranges=self.live_ranges(fn)
+        cands=sorted((n for n in ranges if n in f.slots and scalar(f.slots[n])
+                      and not self._names_var(body, n, lhs=False)),
+                     key=lambda n: (-ranges[n][2], ranges[n][0]))
+        if not cands: return [({}, None)]
+        ends=sorted([(ranges[n][0], 1) for n in cands]+[(ranges[n][1]+0.5, -1) for n in cands])
+        live=peak=0
+        for _,d in ends: live+=d; peak=max(peak, live)
+        plans=[]
+        for pool in ((('x7','x4','x0'),) if leaf else ())+(('x0',),):
+            regs={}; held={r: [] for r in pool}
+            for n in cands:
+                a,b,_=ranges[n]
+                for r in pool:
+                    if all(b<c or d<a for c,d in held[r]):
+                        regs[n]=r; held[r].append((a, b)); break
+            mem=[n for n in cands if n not in regs]
+            note=(f"regs: {' '.join(f'{n}={r}' for n,r in regs.items())}"
+                  f"{'; in the frame: '+' '.join(mem) if mem else ''}"
+                  f" ({len(cands)} hot scalars, at most {peak} live at once, "
+                  f"{len(pool)} register{'s' if len(pool)>1 else ''})")
+            plans.append((regs, note))
+        return plans+[({}, f"regs: none; in the frame: {' '.join(cands)}")]
 
     # ---------- statements ----------
     def gen_stmt(self, idx):
@@ -234,39 +694,93 @@ class Codegen:
     def var_type(self, name):
         kind,info=self.var_info(name)
         if kind=='local':
-            if info[0]=='param': return info[2]
+            if info[0] in ('param','expr','reg'): return info[2]
             return info[1]
         return info[1]
 
+    def reg_of(self, name):
+        """The register variable `name` lives in (REG_LOCALS), or None."""
+        info=self.cur.slots.get(name)
+        return info[1] if info is not None and info[0]=='reg' else None
+
+    def subst(self, name):
+        """The ('expr', arg node, type, caller slots) record gen_inline put in place
+        of an inlined parameter, or None for a real variable."""
+        info=self.cur.slots.get(name)
+        return info if info is not None and info[0]=='expr' else None
+
+    def in_caller(self, rec, fn, *a):
+        """fn(*a) with the scope the substituted argument rec was written in."""
+        f=self.cur; saved=f.slots; f.slots=rec[3]
+        try: return fn(*a)
+        finally: f.slots=saved
+
+    def subst_slot(self, idx, dst):
+        """(base, offset) of what node idx points at when it is a parameter
+        substituted by `&v` or an array v (no code for frame slots), else None."""
+        n=self.P.nodes[idx]
+        rec=self.subst(n['name']) if n['op']=='ident' else None
+        if rec is None: return None
+        a=self.P.nodes[rec[1]]
+        if a['op']=='unop' and a['uop']=='&': a=self.P.nodes[a['operand']]
+        elif not (a['op']=='ident' and self.in_caller(rec, self.is_array_var, a['name'])):
+            return None
+        if a['op']!='ident': return None
+        return self.in_caller(rec, self.var_addr_mode, a['name'], dst)
+
+    def frame_offset(self, info):
+        """Byte offset of a local/param slot record from the frame base (cur.base:
+        s0, or sp in a frameless leaf)."""
+        f=self.cur
+        if info[0]=='param':
+            return C.param_addr_offset(info[1], f.frame)+f.bias
+        base_index=info[0]; arrlen=info[2]; vtype=info[1]
+        if arrlen:
+            # array occupies slots [base_index .. base_index+nslots-1];
+            # element 0 sits at the most-negative offset so a[k]=base+2k
+            nslots=(self.type_size(vtype)*arrlen+WORD-1)//WORD
+        else:
+            # struct fields grow upward from the most-negative slot
+            nslots=(self.type_size(vtype)+WORD-1)//WORD
+        return C.local_addr_offset(base_index+nslots-1)+f.bias
+
     def gen_var_addr(self, name, dst="x6"):
         """address of variable -> dst"""
         kind,info=self.var_info(name)
         e=self.e
+        if self.subst(name) or self.reg_of(name):
+            raise CodegenError(f"{name} has no address (an inlined parameter or register)")
         if kind=='local':
-            if info[0]=='param':
-                off=C.param_addr_offset(info[1])
-            else:
-                base_index=info[0]; arrlen=info[2]; vtype=info[1]
-                if arrlen:
-                    # array occupies slots [base_index .. base_index+nslots-1];
-                    # element 0 sits at the most-negative offset so a[k]=base+2k
-                    nslots=(self.type_size(vtype)*arrlen+WORD-1)//WORD
-                    off=C.local_addr_offset(base_index+nslots-1)
-                else:
-                    # struct fields grow upward from the most-negative slot
-                    nslots=(self.type_size(vtype)+WORD-1)//WORD
-                    off=C.local_addr_offset(base_index+nslots-1)
-            C.addr_plus_offset(e, "x3", off, dst)
+            C.addr_plus_offset(e, self.cur.base, self.frame_offset(info), dst)
         else:
             label=info[0]
             e.emit(f"    la {dst}, {label}")
 
+    def var_addr_mode(self, name, dst):
+        """(base_reg, offset) addressing the variable: frame base+off for frame slots
+        (no code), dst+0 after `la dst` for globals."""
+        kind,info=self.var_info(name)
+        if self.subst(name) or self.reg_of(name):
+            raise CodegenError(f"{name} has no address (an inlined parameter or register)")
+        if kind=='local':
+            return self.cur.base, self.frame_offset(info)
+        self.e.emit(f"    la {dst}, {info[0]}")
+        return dst, 0
+
+    def is_array_var(self, name):
+        kind,info=self.var_info(name)
+        return bool((kind=='local' and info[0] not in ('param','expr','reg') and info[2])
+                    or (kind=='global' and info[2]))
+
     def load_from_var(self, name):
+        rec=self.subst(name)
+        if rec is not None:
+            self.in_caller(rec, self.gen_expr, rec[1]); return rec[2]
+        if self.reg_of(name):
+            self.e.emit(f"    mv x6, {self.reg_of(name)}"); return self.var_type(name)
         ty=self.var_type(name)
         # arrays evaluate to their address
-        kind,info=self.var_info(name)
-        is_array = (kind=='local' and info[0]!='param' and info[2]) or (kind=='global' and info[2])
-        if is_array:
+        if self.is_array_var(name):
             self.gen_var_addr(name,"x6"); return ty
         self.gen_var_addr(name,"x5")
         if self.is_byte(ty):
@@ -278,6 +792,12 @@ class Codegen:
     def store_to_var(self, name):
         """value in x6 -> variable"""
         ty=self.var_type(name)
+        r=self.reg_of(name)
+        if r:
+            self.e.emit(f"    mv {r}, x6"); self.cur.reg_stores[r]+=1; return
+        if REG_TEMPS:
+            base,off=self.var_addr_mode(name,"x5")
+            self.store_at(ty, "x6", base, off, "x5", self.tmp_reg()); return
         self.e.emit("    push x6")          # save value
         self.gen_var_addr(name,"x5")
         self.e.emit("    lw x6, 0(x2)")     # restore value
@@ -290,6 +810,11 @@ class Codegen:
     # ---------- expressions (result -> x6); returns type ----------
     def gen_expr(self, idx):
         n=self.P.nodes[idx]; op=n['op']; e=self.e
+        temps=self.cur.temps
+        if REG_TEMPS and self.reg_ok(idx) and self.need(idx)<=len(temps)+1:
+            return self.gen_reg(idx, "x6", list(temps))
+        if op in ('binop','unop') and self.const_val(idx) is not None:
+            C.load_const(e, self.const_val(idx)); return self.const_type(idx)
         if op=='intlit':
             C.load_const(e, n['val']); return {'base':'int','ptr':0}
         if op=='charlit':
@@ -317,31 +842,32 @@ class Codegen:
 
     def gen_binop(self, n):
         e=self.e
+        c=self.const_operand(n)
+        if c is not None:
+            return self.gen_const_arith(n, *c)
         lt=self.gen_expr(n['lhs'])     # result x6
-        C.push_x6(e)
-        rt=self.gen_expr(n['rhs'])     # result x6
-        C.pop_to(e, "x5")              # x5 = left, x6 = right
+        temps=self.cur.temps
+        if REG_TEMPS and self.reg_ok(n['rhs']) and self.need(n['rhs'])<=len(temps):
+            e.emit("    mv x5, x6")    # x5 = left; a register-only right side
+            rt=self.gen_reg(n['rhs'], "x6", list(temps[1:]))   # evaluates around it
+        else:
+            C.push_x6(e)
+            rt=self.gen_expr(n['rhs']) # result x6
+            C.pop_to(e, "x5")          # x5 = left, x6 = right
         bop=n['bop']
         unsigned = self.is_unsigned(lt) or self.is_unsigned(rt) or self.is_ptr(lt)
         # pointer arithmetic scaling: ptr +/- int  -> scale int by elem size
         if bop in ('+','-') and self.is_ptr(lt) and not self.is_ptr(rt):
-            esz=self.elem_size(lt)
-            if esz==2:
-                e.emit("    li x4, 1"); e.emit("    sll x6, x4")   # right *= 2
-            elif esz==4:
-                e.emit("    li x4, 2"); e.emit("    sll x6, x4")
-            elif esz!=1:
-                # general scale via repeated add is overkill; structs use member, arrays pow2
-                raise CodegenError("pointer step with non-pow2 element size")
+            C.mul_const(e, "x6", self.elem_size(lt), self.tmp_reg() or "x4", limit=False)
         if bop in ('+','-','*','/','%'):
             # arithmetic; ensure correct order for - and /
             if bop=='+': C.bin_op(e,'+',True)
             elif bop=='-': C.bin_op(e,'-',True)
-            elif bop=='*': C.bin_op(e,'*',True)
+            elif bop=='*': C.bin_op(e,'*',not HW_MULDIV)
             # '/' and '%' pick signed vs unsigned per C's usual arithmetic
             # conversions (either operand unsigned/pointer -> unsigned).
-            elif bop=='/': C.div_op(e, unsigned)
-            elif bop=='%': C.mod_op(e, unsigned)
+            elif bop=='/': C.div_op(e, unsigned, hw=HW_MULDIV)
+            elif bop=='%': C.mod_op(e, unsigned, hw=HW_MULDIV)
             return lt if not self.is_ptr(rt) else rt
         if bop in ('&','|','^'):
             C.bit_op(e,bop); return lt
@@ -363,6 +889,31 @@ class Codegen:
             C.bin_op(e,bop,True); return {'base':'int','ptr':0}
         raise CodegenError(f"binop {bop}")
 
+    def gen_const_arith(self, n, x, k):
+        """x * k, x / k or x % k for a constant k (see const_operand): shifts and adds
+        when k allows, else the shift-add reciprocal for / and %, else the runtime
+        routine with k loaded directly (with HW_MULDIV, the instruction instead of
+        either)."""
+        e=self.e; bop=n['bop']
+        xt=self.gen_expr(x)            # result x6
+        if x==n['lhs']: lt,rt=xt,self.const_type(n['rhs'])
+        else: lt,rt=self.const_type(n['lhs']),xt
+        unsigned=self.is_unsigned(lt) or self.is_unsigned(rt) or self.is_ptr(lt)
+        if self.arith_const(bop, lt, rt, k, "x6", "x5"): pass
+        elif HW_MULDIV:
+            e.emit("    mv x5, x6"); C.load_const(e, k, "x6")    # x5 = x, x6 = k
+            if bop=='*': C.mul_op(e, hw=True)
+            elif bop=='/': C.div_op(e, unsigned, hw=True)
+            else: C.mod_op(e, unsigned, hw=True)
+        elif k and bop=='/' and C.div_recip(e, k, unsigned): pass
+        elif k and bop=='%' and C.mod_recip(e, k, unsigned): pass
+        else:
+            e.emit("    mv x5, x6"); C.load_const(e, k, "x4")    # x5 = x, x4 = k
+            if bop=='*': C.mul_op(e, "x4")
+            elif bop=='/': C.div_op(e, unsigned, "x4")
+            else: C.mod_op(e, unsigned, "x4")
+        return self.binop_type(bop, lt, rt)
+
     def gen_unop(self, n):
         e=self.e; uop=n['uop']
         if uop=='-':
@@ -395,6 +946,16 @@ class Codegen:
         if INTRINSIC_IO and fname=='putchar' and len(n['args'])==1:
             self.gen_expr(n['args'][0]); e.emit("    ecall 0x001")
             return {'base':'int','ptr':0}
+        # __mulhu(a, b): high half of the unsigned 32-bit product (runtime __umul32,
+        # or MULHU)
+        if fname=='__mulhu' and len(n['args'])==2:
+            self.gen_expr(n['args'][0]); C.push_x6(e)
+            self.gen_expr(n['args'][1]); C.pop_to(e, "x5")
+            C.mul_hi(e, HW_MULDIV)
+            return {'base':'unsigned','ptr':0}
+        fidx=self.inline_target(n)
+        if fidx is not None:
+            return self.gen_inline(n, fidx)
         # push args right-to-left
         for a in reversed(n['args']):
             self.gen_expr(a)
@@ -419,6 +980,14 @@ class Codegen:
         e=self.e
         # compute rhs -> x6, save; compute lhs address -> x5; store
         rt=self.gen_expr(n['rhs'])
+        lv=self.P.nodes[n['lhs']]
+        if lv['op']=='ident' and self.reg_of(lv['name']):
+            self.store_to_var(lv['name']); return self.var_type(lv['name'])
+        temps=self.cur.temps
+        if REG_TEMPS and self.addr_ok(n['lhs']) and self.need(n['lhs'])<=len(temps):
+            lt,base,off=self.gen_reg_addr(n['lhs'], "x5", list(temps[1:]))
+            self.store_at(lt, "x6", base, off, "x5", self.tmp_reg())
+            return lt
         C.push_x6(e)
         lt=self.gen_addr(n['lhs'])      # address -> x6
         e.emit("    mv x5, x6")         # x5 = addr
@@ -432,26 +1001,9 @@ class Codegen:
 
     # ---------- index / member ----------
     def scale_index(self, esz):
-        """x6 (index) *= esz, using shift for powers of two, else __mul."""
-        e=self.e
-        if esz==1: return
-        if esz==2:
-            e.emit("    li x5, 1"); e.emit("    sll x6, x5")   # x6 <<= 1
-        elif esz==4:
-            e.emit("    li x5, 2"); e.emit("    sll x6, x5")
-        elif esz==8:
-            e.emit("    li x5, 3"); e.emit("    sll x6, x5")
-        else:
-            # general: __mul(x6, esz)
-            e.emit("    push x6")          # a = index
-            C.load_const(e, esz); e.emit("    push x6")  # b = esz
-            # __mul expects [sp]=a,[sp+2]=b; we pushed a then b -> [sp]=b,[sp+2]=a
-            # swap by adjusting: easier to push in right order
-            e.emit("    addi x2, 4")       # undo
-            e.emit("    push x6")          # actually redo cleanly below
-            # (esz>8 with non-pow2 is rare; do explicit)
-            # fall back: repeated handling omitted — esz here is struct size
-            raise CodegenError("non-power-of-two element size not yet supported")
+        """x6 (index) *= esz: a shift for powers of two, else shifts and adds (any
+        struct size; x5 is the scratch)."""
+        C.mul_const(self.e, "x6", esz, "x5", limit=False)
 
     def gen_index_addr(self, n):
         e=self.e
@@ -478,7 +1030,15 @@ class Codegen:
         if isinstance(b,tuple) and b[0]=='struct': return self.P.structs[b[1]]
         raise CodegenError("member of non-struct")
 
-    def gen_member_addr(self, n):
+    def field(self, st, name):
+        """(type, offset, array length or None) of struct st's field `name`."""
+        for (fname,ft,fo,fa) in st['fields']:
+            if fname==name: return ft, fo, fa
+        raise CodegenError(f"no field {name}")
+
+    def gen_member_addr(self, n, want_arr=False):
+        """Address of a member -> x6; its type (and with want_arr whether the field
+        is an array, which evaluates to that address as an array variable does)."""
         e=self.e
         if n['arrow']:
             bt=self.gen_expr(n['base'])         # pointer -> x6
@@ -486,15 +1046,13 @@ class Codegen:
         else:
             bt=self.gen_addr(n['base'])         # struct address -> x6
             st=self.struct_of(bt)
-        off=None; ftype=None
-        for (fname,ft,fo,fa) in st['fields']:
-            if fname==n['field']: off=fo; ftype=ft; break
-        if off is None: raise CodegenError(f"no field {n['field']}")
+        ftype,off,arr=self.field(st, n['field'])
         C.addr_plus_offset(e,"x6",off,"x6")
-        return ftype
+        return (ftype, bool(arr)) if want_arr else ftype
 
     def gen_member_rvalue(self, n):
-        ft=self.gen_member_addr(n)
+        ft,arr=self.gen_member_addr(n, want_arr=True)
+        if arr: return ft
         e=self.e; e.emit("    mv x5, x6")
         if self.is_byte(ft):
             e.emit(f"    {'lbu' if self.is_unsigned(ft) else 'lb'} x6, 0(x5)")
@@ -502,10 +1060,324 @@ class Codegen:
             e.emit("    lw x6, 0(x5)")
         return ft
 
+    # ---------- register-allocated expressions (REG_TEMPS) ----------
+    def reg_ok(self, idx):
+        """True if node idx can be evaluated in registers alone: no call, assignment
+        or * / % anywhere below it (those clobber the temporaries), except constant
+        expressions, * / % by a constant that inline_arith expands and, with
+        HW_MULDIV, any * / %."""
+        r=self._reg_ok.get(idx)
+        if r is None:
+            n=self.P.nodes[idx]; op=n['op']
+            if op in ('intlit','charlit','strlit','ident') or self.const_val(idx) is not None:
+                r=True
+            elif op=='cast': r=self.reg_ok(n['operand'])
+            elif op=='unop':
+                if n['uop']=='&': r=self.addr_ok(n['operand'])
+                else: r=n['uop'] in ('-','~','*') and self.reg_ok(n['operand'])
+            elif op=='binop':
+                r=((n['bop'] in _REG_BINOPS or self.inline_arith(n)
+                    or (HW_MULDIV and n['bop'] in ('*','/','%')))
+                   and self.reg_ok(n['lhs']) and self.reg_ok(n['rhs']))
+            elif op=='index': r=self.reg_ok(n['base']) and self.reg_ok(n['idx'])
+            elif op=='member':
+                r=self.reg_ok(n['base']) if n['arrow'] else self.addr_ok(n['base'])
+            else: r=False
+            self._reg_ok[idx]=r
+        return r
+
+    def addr_ok(self, idx):
+        """True if the lvalue idx's address can be formed in registers alone."""
+        n=self.P.nodes[idx]; op=n['op']
+        if op=='ident': return True
+        if op=='unop' and n['uop']=='*': return self.reg_ok(n['operand'])
+        return op in ('index','member') and self.reg_ok(idx)
+
+    def reads_mem(self, idx):
+        """True if evaluating idx loads through a pointer/array/member (such loads
+        may be MMIO, so two of them are never reordered)."""
+        r=self._reads_mem.get(idx)
+        if r is None:
+            n=self.P.nodes[idx]; op=n['op']
+            r=(op in ('index','member') or (op=='unop' and n['uop']=='*')
+               or any(self.reads_mem(n[f]) for f in _CHILD_SINGLE.get(op,()) if n.get(f) is not None))
+            self._reads_mem[idx]=r
+        return r
+
+    def may_swap(self, l, r):
+        return not (self.reads_mem(l) and self.reads_mem(r))
+
+    def need(self, idx):
+        """Sethi-Ullman number of a reg_ok node: registers needed to evaluate it."""
+        r=self._need.get(idx)
+        if r is None:
+            n=self.P.nodes[idx]; op=n['op']
+            if self.const_val(idx) is not None: r=1
+            elif op in ('cast','unop'): r=self.need(n['operand'])
+            elif op=='binop' and self.inline_arith(n):
+                r=max(self.need(self.const_operand(n)[0]), 2)   # + one scratch
+            elif op=='binop': r=self.pair_need(n['lhs'], n['rhs'])
+            elif op=='index' and self.const_val(n['idx']) is not None:
+                r=self.need(n['base'])                  # a[k]: k*size is an offset
+            elif op=='index': r=self.pair_need(n['base'], n['idx'])
+            elif op=='member': r=self.need(n['base'])
+            else: r=1
+            self._need[idx]=r
+        return r
+
+    def pair_need(self, l, r):
+        nl, nr = self.need(l), self.need(r)
+        if not self.may_swap(l, r):
+            return max(nl, nr+1)          # left always first
+        return nl+1 if nl==nr else max(nl, nr)
+
+    def gen_pair(self, l, r, dst, free):
+        """l -> dst, r -> free[0], the operand needing more registers first.
+        Returns (ltype, rtype, register holding r)."""
+        t=free[0]
+        if self.need(r)>self.need(l) and self.may_swap(l, r):
+            rt=self.gen_reg(r, t, [dst]+free[1:])
+            lt=self.gen_reg(l, dst, free[1:])
+        else:
+            lt=self.gen_reg(l, dst, free)
+            rt=self.gen_reg(r, t, free[1:])
+        return lt, rt, t
+
+    def gen_reg(self, idx, dst, free):
+        """Evaluate reg_ok node idx into dst, writing only dst and the registers in
+        `free` (need(idx) <= 1+len(free)). Returns its type, like gen_expr."""
+        n=self.P.nodes[idx]; op=n['op']; e=self.e
+        if op=='intlit':
+            C.load_const(e, n['val'], dst); return {'base':'int','ptr':0}
+        if op=='charlit':
+            C.load_const(e, n['val'], dst); return {'base':'char','ptr':0}
+        if op in ('binop','unop') and self.const_val(idx) is not None:
+            C.load_const(e, self.const_val(idx), dst); return self.const_type(idx)
+        if op=='strlit':
+            label=e.label("str"); self.strings.append((label,n['val']))
+            e.emit(f"    la {dst}, {label}"); return {'base':'char','ptr':1}
+        if op=='ident' and self.subst(n['name']):
+            rec=self.subst(n['name'])
+            self.in_caller(rec, self.gen_reg, rec[1], dst, free); return rec[2]
+        if op=='ident' and self.reg_of(n['name']):
+            e.emit(f"    mv {dst}, {self.reg_of(n['name'])}"); return self.var_type(n['name'])
+        if op=='ident' and self.is_array_var(n['name']):
+            self.gen_var_addr(n['name'], dst); return self.var_type(n['name'])
+        if op=='cast':
+            self.gen_reg(n['operand'], dst, free); return n['ctype']
+        if op=='unop' and n['uop']=='&':
+            t,base,off=self.gen_reg_addr(n['operand'], dst, free)
+            C.addr_plus_offset(e, base, off, dst, free[0] if free else None)
+            return {'base':t['base'],'ptr':t['ptr']+1}
+        if op=='unop' and n['uop'] in ('-','~'):
+            self.gen_reg(n['operand'], dst, free)
+            (C.unary_neg if n['uop']=='-' else C.bit_not)(e, dst)
+            return {'base':'int','ptr':0}
+        if op=='binop' and self.inline_arith(n):
+            x,k=self.const_operand(n)
+            xt=self.gen_reg(x, dst, free)
+            if x==n['lhs']: lt,rt=xt,self.const_type(n['rhs'])
+            else: lt,rt=self.const_type(n['lhs']),xt
+            self.arith_const(n['bop'], lt, rt, k, dst, free[0])
+            return self.binop_type(n['bop'], lt, rt)
+        if op=='binop':
+            k=self.const_val(n['rhs'])
+            if k is not None:
+                lt=self.gen_reg(n['lhs'], dst, free)
+                rt=self.const_type(n['rhs'])
+                if self.combine_imm(n['bop'], lt, rt, dst, k):
+                    return self.binop_type(n['bop'], lt, rt)
+                C.load_const(e, k, free[0]); t=free[0]
+            else:
+                lt,rt,t=self.gen_pair(n['lhs'], n['rhs'], dst, free)
+            return self.combine(n['bop'], lt, rt, dst, t)
+        if op=='member':
+            t,base,off,arr=self.gen_reg_member(n, dst, free)
+            if arr:                                      # an array field: its address
+                C.addr_plus_offset(e, base, off, dst, free[0] if free else None)
+                return t
+        else:
+            t,base,off=self.gen_reg_addr(idx, dst, free)    # ident / * / index
+        self.load_at(t, dst, base, off, free[0] if free else None)
+        return t
+
+    def gen_reg_addr(self, idx, dst, free):
+        """Address of the addr_ok lvalue idx as (type, base_reg, offset): base_reg is
+        dst or the frame base (frame slots), offset is folded into the eventual load/store."""
+        n=self.P.nodes[idx]; op=n['op']
+        if op=='ident':
+            base,off=self.var_addr_mode(n['name'], dst)
+            return self.var_type(n['name']), base, off
+        if op=='unop':                                   # *p
+            slot=self.subst_slot(n['operand'], dst)
+            if slot is not None:
+                return (self.elem_type(self.var_type(self.P.nodes[n['operand']]['name'])),)+slot
+            t=self.gen_reg(n['operand'], dst, free)
+            return self.elem_type(t), dst, 0
+        if op=='index':
+            k=self.const_val(n['idx']); bn=self.P.nodes[n['base']]
+            if k is not None:                            # a[k]: k*size is an offset
+                slot=self.subst_slot(n['base'], dst)
+                if slot is not None:
+                    bt=self.var_type(bn['name']); base,off=slot
+                elif bn['op']=='ident' and self.is_array_var(bn['name']):
+                    bt=self.var_type(bn['name']); base,off=self.var_addr_mode(bn['name'], dst)
+                else:
+                    bt=self.gen_reg(n['base'], dst, free); base,off=dst,0
+                return self.elem_type(bt), base, off+k*self.elem_size(bt)
+            bt,_,t=self.gen_pair(n['base'], n['idx'], dst, free)
+            C.mul_add(self.e, dst, t, self.elem_size(bt))   # dst += idx * size
+            return self.elem_type(bt), dst, 0
+        return self.gen_reg_member(n, dst, free)[:3]    # member
+
+    def gen_reg_member(self, n, dst, free):
+        """gen_reg_addr() of a member node, and whether the field is an array."""
+        if n['arrow']:
+            slot=self.subst_slot(n['base'], dst)
+            if slot is not None:
+                bt=self.var_type(self.P.nodes[n['base']]['name']); base,off=slot
+            else:
+                bt=self.gen_reg(n['base'], dst, free); base,off=dst,0
+            st=self.struct_of(self.elem_type(bt))
+        else:
+            bt,base,off=self.gen_reg_addr(n['base'], dst, free)
+            st=self.struct_of(bt)
+        ft,fo,arr=self.field(st, n['field'])
+        return ft, base, off+fo, bool(arr)
+
+    def tmp_reg(self):
+        """A temporary besides x5 no variable lives in, or None."""
+        t=self.cur.temps
+        return t[1] if len(t)>1 else None
+
+    def load_at(self, ty, dst, base, off, tmp=None):
+        """dst = value of type ty at base+off (tmp: a free register, if any)."""
+        e=self.e; off=((off+0x8000)&0xFFFF)-0x8000
+        if not -8<=off<=7:
+            C.addr_plus_offset(e, base, off, dst, tmp); base,off=dst,0
+        if self.is_byte(ty):
+            e.emit(f"    {'lbu' if self.is_unsigned(ty) else 'lb'} {dst}, {off}({base})")
+        else:
+            e.emit(f"    lw {dst}, {off}({base})")
+
+    def store_at(self, ty, src, base, off, scratch, tmp=None):
+        """value of type ty in src -> base+off (scratch forms far addresses)."""
+        e=self.e; off=((off+0x8000)&0xFFFF)-0x8000
+        if not -8<=off<=7:
+            C.addr_plus_offset(e, base, off, scratch, tmp); base,off=scratch,0
+        e.emit(f"    {'sb' if self.is_byte(ty) else 'sw'} {src}, {off}({base})")
+
+    def ptr_step(self, bop, lt, rt):
+        """Scale applied to the right operand of ptr +/- int (1 = none)."""
+        if bop in ('+','-') and self.is_ptr(lt) and not self.is_ptr(rt):
+            return self.elem_size(lt)
+        return 1
+
+    def const_val(self, idx):
+        """Value (mod 2^16) of node idx if it is a constant expression -- literals
+        under unary - ~ and binary operators, folded as the generated code would
+        compute them (all literals are signed) -- else None."""
+        if idx in self._const: return self._const[idx]
+        n=self.P.nodes[idx]; op=n['op']; v=None
+        if op in ('intlit','charlit'): v=n['val']
+        elif op=='unop' and n['uop'] in ('-','~'):
+            a=self.const_val(n['operand'])
+            if a is not None: v=-a if n['uop']=='-' else ~a
+        elif op=='binop':
+            a,b=self.const_val(n['lhs']),self.const_val(n['rhs'])
+            if a is not None and b is not None:
+                v=_fold(n['bop'], a-0x10000 if a&0x8000 else a, b-0x10000 if b&0x8000 else b)
+        if v is not None: v=int(v)&0xFFFF
+        self._const[idx]=v
+        return v
+
+    def const_type(self, idx):
+        """Type of the constant expression idx (as gen_expr would report it)."""
+        n=self.P.nodes[idx]
+        if n['op']=='charlit': return {'base':'char','ptr':0}
+        if n['op']=='binop':
+            return self.binop_type(n['bop'], self.const_type(n['lhs']), self.const_type(n['rhs']))
+        return {'base':'int','ptr':0}
+
+    def const_operand(self, n):
+        """(other operand, k) if binop n is * / % with a constant right operand (or
+        either operand, for *), else None."""
+        if n['bop'] not in ('*','/','%'): return None
+        k=self.const_val(n['rhs'])
+        if k is not None: return n['lhs'], k
+        k=self.const_val(n['lhs']) if n['bop']=='*' else None
+        return (n['rhs'], k) if k is not None else None
+
+    def inline_arith(self, n):
+        """True if binop n is a * / % by a constant that arith_const expands into
+        shifts and adds, so it needs no runtime call (and can join REG_TEMPS trees)."""
+        c=self.const_operand(n)
+        if c is None: return False
+        if n['bop']=='*': return C.mul_cost(c[1])<=C.MUL_INLINE_DIGITS
+        return C.is_pow2_divisor(c[1])
+
+    def arith_const(self, bop, lt, rt, k, rd, tmp):
+        """rd = rd bop k for * / % by a constant, writing only rd and tmp; False
+        (no code) if k needs __mul or a reciprocal."""
+        if bop=='*': return C.mul_const(self.e, rd, k, tmp)
+        unsigned=self.is_unsigned(lt) or self.is_unsigned(rt) or self.is_ptr(lt)
+        return (C.div_const if bop=='/' else C.mod_const)(self.e, rd, k, unsigned, tmp)
+
+    def binop_type(self, bop, lt, rt):
+        if bop in ('+','-','*','/','%'): return lt if not self.is_ptr(rt) else rt
+        if bop in ('&','|','^','<<','>>'): return lt
+        return {'base':'int','ptr':0}
+
+    def cmp_unsigned(self, lt, rt):
+        return self.is_unsigned(lt) or self.is_unsigned(rt) or self.is_ptr(lt)
+
+    def shift_op(self, lt):
+        # right shifts follow the LEFT operand's signedness (see gen_binop)
+        return '>>' if self.is_unsigned(lt) or self.is_ptr(lt) else '>>s'
+
+    def combine(self, bop, lt, rt, a, b):
+        """a = a bop b for a _REG_BINOPS operator (or * / % with HW_MULDIV); b may be
+        clobbered."""
+        esz=self.ptr_step(bop, lt, rt)
+        if esz>1:                      # a +/-= b * esz
+            C.mul_add(self.e, a, b, esz, sub=bop=='-'); return self.binop_type(bop, lt, rt)
+        if bop=='>>': C.reg_op(self.e, self.shift_op(lt), a, b)
+        elif bop in ('/','%'):         # signedness as in gen_binop
+            C.reg_op(self.e, bop if self.cmp_unsigned(lt, rt) else bop+'s', a, b)
+        elif bop=='*': C.reg_op(self.e, '*', a, b)
+        elif bop in ('+','-','&','|','^','<<'): C.reg_op(self.e, bop, a, b)
+        else: C.reg_cmp(self.e, bop, a, b, self.cmp_unsigned(lt, rt))
+        return self.binop_type(bop, lt, rt)
+
+    def combine_imm(self, bop, lt, rt, a, k):
+        """a = a bop k as one I-type op where k encodes; False if not (no code)."""
+        k*=self.ptr_step(bop, lt, rt)
+        if bop in ('*','/','%'): return False
+        if bop=='>>': return C.reg_op_imm(self.e, self.shift_op(lt), a, k)
+        if bop in ('+','-','&','|','^','<<'): return C.reg_op_imm(self.e, bop, a, k)
+        return C.reg_cmp_imm(self.e, bop, a, k, self.cmp_unsigned(lt, rt))
+
 
 def compile_src(src, base_dir='.'):
     p=zcc.parse(src, base_dir)
-    return Codegen(p).gen_program()
+    asm=Codegen(p).gen_program()
+    return peephole.optimize(asm) if PEEPHOLE else asm
+
+def compile_object(src, base_dir='.', separate=None, units=None):
+    """compile_src() as one relocatable unit (Codegen.gen_object). Includes from the
+    `separate` library directory contribute only their interface; their paths are
+    appended to `units` (see zcc.preprocess)."""
+    p=zcc.parse(src, base_dir, separate, units)
+    asm=Codegen(p).gen_object()
+    return peephole.optimize(asm) if PEEPHOLE else asm
+
+def compile_runtime():
+    """crt0 and the runtime routines as a relocatable unit, one section each."""
+    e=C.Emitter()
+    C.crt0(e, sections=True)
+    C.runtime(e, sections=True)
+    asm=e.text()
+    return peephole.optimize(asm) if PEEPHOLE else asm
 
 
 if __name__=='__main__':
@@ -8,11 +8,13 @@ building blocks the parser will drive. The patterns encode the hard-won ZX16 rul
   * Two-operand destructive ALU: `add rd, rs` means rd = rd + rs. Binary ops must
     move/arrange operands first.
   * SLT is two-operand; comparisons either use `mv` then `slt`, or branch directly.
-  * `call` clobbers ra (x1): every non-leaf function saves/restores it.
+  * `call` clobbers ra (x1): every non-leaf function saves/restores it; a leaf
+    skips that, and one that never moves sp skips the frame pointer too.
   * Loads/stores have a ±7 byte offset; larger frame offsets need address calc.
   * Branch range ±16 bytes; a direct j/call reaches only ±512 bytes (offset is
     imm[9:1], sign bit 9), so codegen always uses la+jr / la+jalr — distance never
-    bounds a jump or call.
+    bounds a jump or call. (peephole.py shortens jumps and calls whose distance is
+    known.)
 
 Evaluation model (uniform and simple, not optimal):
   Every expression evaluates with its RESULT IN x6. A binary op `L op R`:
@@ -22,20 +24,30 @@ Evaluation model (uniform and simple, not optimal):
       lw  x5, 0(sp)       # x5 = L
       addi sp, 2          # pop
       <combine x5 (L) and x6 (R) -> x6>
+  With codegen.REG_TEMPS (the default) side-effect-free subtrees skip the stack:
+  they are evaluated Sethi-Ullman style into x6 and the temporaries x5/x4/x7 with
+  the register-operand forms below (reg_op / reg_cmp / ..._imm).
 
 Register roles:
+  x7 (a1)  expression temporary / runtime second result (or a variable, see below)
   x6 (a0)  expression result / return value / first arg
   x5 (t1)  scratch for the popped left operand
+  x4 (s1)  expression temporary / far-jump scratch (or a variable)
   x3 (s0)  frame pointer
   x2 (sp)  stack pointer
   x1 (ra)  return address
+  x0 (t0)  a variable (codegen.REG_LOCALS), callee-saved: a function that uses it
+           saves it in a frame slot. x4 / x7 hold variables only in a body with no
+           call at all; there far jumps use x5 (Emitter.jump_reg).
 """
+import functools
 
 class Emitter:
     def __init__(self):
         self.lines = []
         self._label_n = 0
         self.loop_stack = []   # stack of (continue_label, break_label)
+        self.jump_reg = "x4"   # far_jump scratch (x5 where x4 holds a variable)
 
     def emit(self, s=""):
         self.lines.append(s)
@@ -67,18 +79,18 @@ class Emitter:
 # Primitive value loads (result -> x6)
 # ---------------------------------------------------------------------------
 
-def load_const(e, n):
-    """Load integer constant into x6."""
+def load_const(e, n, dst="x6"):
+    """Load integer constant into dst (default x6)."""
     n &= 0xFFFF
     sn = n - 0x10000 if n >= 0x8000 else n
     if -64 <= sn <= 63:
-        e.emit(f"    li x6, {sn}")
+        e.emit(f"    li {dst}, {sn}")
     else:
         hi = n >> 7
         lo = n & 0x7F
-        e.emit(f"    lui x6, {hi}")
+        e.emit(f"    lui {dst}, {hi}")
         if lo:
-            e.emit(f"    ori x6, {lo}")
+            e.emit(f"    ori {dst}, {lo}")
 
 def push_x6(e):
     e.emit("    push x6")
@@ -93,7 +105,8 @@ def pop_to(e, reg):
 
 def bin_op(e, op, runtime_calls):
     """Combine x5 (left) and x6 (right) per `op`, result in x6.
-    runtime_calls: set True to use __mul/__div/__mod helpers."""
+    runtime_calls: set True to use __mul/__div/__mod helpers, False for the
+    multiply/divide unit's MUL."""
     if op == '+':
         e.emit("    add x5, x6")       # x5 = L + R
         e.emit("    mv x6, x5")
@@ -101,12 +114,7 @@ def bin_op(e, op, runtime_calls):
         e.emit("    sub x5, x6")       # x5 = L - R
         e.emit("    mv x6, x5")
     elif op == '*':
-        # __mul(a,b): push b, push a
-        e.emit("    push x6")          # b = R
-        e.emit("    push x5")          # a = L
-        e.emit("    la x4, __mul")
-        e.emit("    jalr x1, x4")
-        e.emit("    addi x2, 4")
+        mul_op(e, hw=not runtime_calls)   # x6 = L * R (low 16 bits)
     # '/' and '%' are NOT handled here -- they need signed/unsigned selection and
     # go through div_op()/mod_op() (see gen_binop), which call the corrected runtime
     # (__udivmod / __div / __mod). Reaching them here is a bug.
@@ -129,31 +137,54 @@ def bin_op(e, op, runtime_calls):
     else:
         raise ValueError(f"unknown op {op}")
 
-def _divmod_call(e, routine):
-    """At entry x5=dividend (left), x6=divisor (right). Call a div/mod runtime
-    routine with the register ABI (x5=N, x4=D) -> quotient x6, remainder x7."""
-    e.emit("    mv x4, x6")            # divisor -> x4  (dividend already in x5)
+def _runtime_call(e, routine, right="x6"):
+    """At entry x5=left, `right` (x6 by default) = right. Call a mul/div/mod runtime
+    routine with the register ABI (x5=left, x4=right) -> x6 (quotient / low
+    product), x7 (remainder / high product). x4, x5, x7 are clobbered; x3 is
+    preserved."""
+    if right != "x4":
+        e.emit(f"    mv x4, {right}")   # right -> x4  (left already in x5)
     e.emit(f"    la x7, {routine}")
     e.emit("    jalr x1, x7")
 
-def div_op(e, unsigned):
+def _hw_op(e, mnem, right):
+    """x6 = x5 `mnem` right with the multiply/divide unit (codegen.HW_MULDIV)."""
+    e.emit(f"    {mnem} x5, {right}")
+    e.emit("    mv x6, x5")
+
+def mul_op(e, right="x6", hw=False):
+    """x6 = left * right (low 16 bits), left in x5."""
+    if hw: _hw_op(e, "mul", right)
+    else: _runtime_call(e, "__mul", right)
+
+def div_op(e, unsigned, right="x6", hw=False):
     """x6 = left / right. Signedness picks the (correct) runtime routine."""
-    _divmod_call(e, "__udivmod" if unsigned else "__div")
+    if hw: _hw_op(e, "divu" if unsigned else "div", right)
+    else: _runtime_call(e, "__udivmod" if unsigned else "__div", right)
     # quotient already in x6
 
-def mod_op(e, unsigned):
+def mod_op(e, unsigned, right="x6", hw=False):
     """x6 = left %% right (C truncation; remainder takes the dividend's sign)."""
-    if unsigned:
-        _divmod_call(e, "__udivmod")
+    if hw:
+        _hw_op(e, "remu" if unsigned else "rem", right)
+    elif unsigned:
+        _runtime_call(e, "__udivmod", right)
         e.emit("    mv x6, x7")        # remainder
     else:
-        _divmod_call(e, "__mod")
+        _runtime_call(e, "__mod", right)
         # remainder already in x6
 
-def unary_neg(e):
-    """x6 = -x6"""
-    e.emit("    xori x6, -1")
-    e.emit("    addi x6, 1")
+def mul_hi(e, hw=False):
+    """x6 = high 16 bits of the unsigned 32-bit product left * right (__mulhu)."""
+    if hw:
+        _hw_op(e, "mulhu", "x6"); return
+    _runtime_call(e, "__umul32")
+    e.emit("    mv x6, x7")
+
+def unary_neg(e, rd="x6"):
+    """rd = -rd"""
+    e.emit(f"    xori {rd}, -1")
+    e.emit(f"    addi {rd}, 1")
 
 def unary_not(e):
     """logical not: x6 = (x6 == 0) ? 1 : 0"""
@@ -171,9 +202,25 @@ def unary_not(e):
 
 def far_jump(e, label):
     """Unconditional jump of unbounded distance. Direct `j` only reaches +-512
-    bytes, which a large function body exceeds; la+jr is unbounded. Uses x4 scratch."""
-    e.emit(f"    la x4, {label}")
-    e.emit(f"    jr x4")
+    bytes, which a large function body exceeds; la+jr is unbounded. Uses the
+    e.jump_reg scratch (x4)."""
+    e.emit(f"    la {e.jump_reg}, {label}")
+    e.emit(f"    jr {e.jump_reg}")
+
+def near_jumps(e, start, label):
+    """Rewrite the far_jump()s to `label` emitted since e.lines[start] as `j label`
+    when the label follows within 127 lines: at most 4 bytes a line, that is inside
+    j's reach. For a jump codegen knows is short, where peephole's short_jump could
+    not prove the scratch dead at the label."""
+    lines, r = e.lines, e.jump_reg
+    out, i = lines[:start], start
+    while i < len(lines):
+        if (lines[i] == f"    la {r}, {label}" and i + 1 < len(lines)
+                and lines[i + 1] == f"    jr {r}" and 4 * (len(lines) - i) <= 510):
+            out.append(f"    j {label}"); i += 2
+        else:
+            out.append(lines[i]); i += 1
+    e.lines[:] = out
 
 def if_then_else(e, gen_cond, gen_then, gen_else=None):
     """if (cond) then [else]. gen_* are callables that emit into e.
@@ -226,27 +273,92 @@ def emit_continue(e):
 # Function prologue / epilogue
 # ---------------------------------------------------------------------------
 
-def func_prologue(e, name, n_locals):
+# A function's frame is one of three shapes (codegen.Codegen.gen_func picks it):
+#   'full'  push x1; push x3; mv x3, x2   -- anything that calls
+#   'leaf'  push x3; mv x3, x2            -- no call, so ra stays in x1
+#   'none'  no saves, x2 is the frame base -- no call and no push/pop in the body
+FRAME_SAVED = {'full': 4, 'leaf': 2, 'none': 0}   # bytes between the args and s0
+
+def func_prologue(e, name, n_locals, frame='full'):
     e.emit(f"{name}:")
-    e.emit("    push x1")        # save ra (clobbered by any call)
-    e.emit("    push x3")        # save caller's frame pointer
-    e.emit("    mv x3, x2")      # s0 = sp  (frame base = saved old s0)
+    if frame == 'full':
+        e.emit("    push x1")    # save ra (clobbered by any call)
+    if frame != 'none':
+        e.emit("    push x3")    # save caller's frame pointer
+        e.emit("    mv x3, x2")  # s0 = sp  (frame base = saved old s0)
     if n_locals:
-        e.emit(f"    addi x2, {-2*n_locals}")  # allocate locals
+        addr_plus_offset(e, "x2", -2*n_locals, "x2", "x5")   # allocate locals
 
-def func_epilogue(e):
-    e.emit("    mv x2, x3")      # free locals
-    e.emit("    pop x3")         # restore frame pointer
-    e.emit("    pop x1")         # restore ra
+def func_epilogue(e, n_locals=0, frame='full'):
+    if frame == 'none':
+        if n_locals:
+            addr_plus_offset(e, "x2", 2*n_locals, "x2", "x5")    # free locals
+    else:
+        e.emit("    mv x2, x3")  # free locals
+        e.emit("    pop x3")     # restore frame pointer
+    if frame == 'full':
+        e.emit("    pop x1")     # restore ra
     e.emit("    ret")
 
+def frame_base(frame):
+    """Register frame slots are addressed from: s0, or sp in a frameless leaf."""
+    return "x2" if frame == 'none' else "x3"
+
+def frame_bias(frame, n_locals):
+    """What to add to a local_addr_offset / param_addr_offset to address it from
+    frame_base: a frameless leaf's sp sits 2*n_locals below where s0 would be."""
+    return 2*n_locals if frame == 'none' else 0
+
+def frame_allows(frame, lines):
+    """Whether a body emitted for `frame` keeps its promises: no call (jal / jalr,
+    including the runtime's) unless it saved ra, and for 'none' nothing that moves
+    sp (push / pop / any write to x2), since sp is its frame base."""
+    for line in lines:
+        op, _, rest = line.strip().partition(' ')
+        if frame != 'full' and op in ('jal', 'jalr', 'call'):
+            return False
+        if frame == 'none' and (op in ('push', 'pop') or
+                                (op not in ('sw', 'sb') and rest.split(',')[0] == 'x2')):
+            return False
+    return True
+
+_NO_WRITE = {'sw', 'sb', 'push', 'beq', 'bne', 'blt', 'bge', 'bltu', 'bgeu', 'bz', 'bnz',
+             'j', 'jr', 'ret', 'ecall', 'nop'}
+
+def regs_allow(lines, stores):
+    """Whether a body keeps the registers codegen gave variables (stores: register ->
+    how many `mv reg, x6` stores codegen made into it): nothing else writes them, and
+    for all but x0 (callee-saved) no call (jal / jalr, the runtime's too) clobbers
+    them."""
+    seen = dict.fromkeys(stores, 0)
+    for line in lines:
+        s = line.strip()
+        if not s or s.startswith(('#', '.')) or s.endswith(':'):
+            continue
+        op, _, rest = s.partition(' ')
+        if op in ('jal', 'jalr', 'call'):
+            if any(r != 'x0' for r in stores):
+                return False
+            continue
+        dest = rest.split(',')[0].strip()
+        if op not in _NO_WRITE and dest in seen:
+            seen[dest] += 1
+    return seen == stores
+
+def frame_reach(frame, n_locals, n_params):
+    """Largest slot offset a frame gives (see frame_bias): a frameless leaf is only
+    worth it when every slot stays within lw/sw's 0..7 byte offsets."""
+    offs = ([local_addr_offset(0)] if n_locals else []) + \
+        ([param_addr_offset(n_params - 1, frame)] if n_params else [])
+    return max(offs, default=0) + frame_bias(frame, n_locals)
+
 def local_addr_offset(i):
     """byte offset of local i relative to s0 (negative)."""
     return -2 - 2*i
 
-def param_addr_offset(i):
-    """byte offset of param i relative to s0 (positive: above saved s0/ra)."""
-    return 4 + 2*i
+def param_addr_offset(i, frame='full'):
+    """byte offset of param i relative to s0 (positive: above the saved s0 / ra)."""
+    return FRAME_SAVED[frame] + 2*i
 
 def load_local(e, i):
     off = local_addr_offset(i)
@@ -271,7 +383,9 @@ def call_function(e, name, n_args):
     """Args already pushed right-to-left. Uses a far-call (la + jalr) so the target
     is reachable regardless of distance — a direct `call` (JAL) only reaches ±512 bytes,
     which a large program (e.g. the self-hosted compiler) exceeds. Result in x6.
-    x5 is scratch (the evaluation model treats it as clobberable across a call)."""
+    x5 is scratch (the evaluation model treats it as clobberable across a call), and
+    no compiled function reads it before writing it: peephole's short_call relies on
+    that to turn a near call into `jal x1, name`."""
     e.emit(f"    la x5, {name}")
     e.emit("    jalr x1, x5")
     if n_args:
@@ -285,9 +399,11 @@ def return_value(e):
 # Member / pointer / array address computation
 # ---------------------------------------------------------------------------
 
-def addr_plus_offset(e, base_reg, off, dst_reg):
+def addr_plus_offset(e, base_reg, off, dst_reg, tmp=None):
     """dst_reg = base_reg + off, choosing the cheapest sequence.
-    Leaves an address in dst_reg suitable for 0(dst_reg) access."""
+    Leaves an address in dst_reg suitable for 0(dst_reg) access. A large offset
+    added in place (dst_reg == base_reg) goes through `tmp` when given, else a chain
+    of ADDIs (li16 into dst_reg would overwrite the base)."""
     if off == 0 and dst_reg == base_reg:
         return
     if -64 <= off <= 63:
@@ -295,9 +411,17 @@ def addr_plus_offset(e, base_reg, off, dst_reg):
             e.emit(f"    mv {dst_reg}, {base_reg}")
         if off:
             e.emit(f"    addi {dst_reg}, {off}")
-    else:
+    elif dst_reg != base_reg:
         e.emit(f"    li16 {dst_reg}, {off & 0xFFFF}")
         e.emit(f"    add {dst_reg}, {base_reg}")
+    elif tmp and abs(off) > 2 * 63:
+        e.emit(f"    li16 {tmp}, {off & 0xFFFF}")
+        e.emit(f"    add {dst_reg}, {tmp}")
+    else:
+        while off:
+            step = max(-64, min(63, off))
+            e.emit(f"    addi {dst_reg}, {step}")
+            off -= step
 
 def load_word_at(e, base_reg, off, dst="x6"):
     """dst = *(int*)(base_reg + off)"""
@@ -351,9 +475,9 @@ def bit_op(e, op):
     else:
         raise ValueError(f"unknown bit op {op}")
 
-def bit_not(e):
-    """x6 = ~x6"""
-    e.emit("    xori x6, -1")
+def bit_not(e, rd="x6"):
+    """rd = ~rd"""
+    e.emit(f"    xori {rd}, -1")
 
 # unsigned comparison variants (left x5, right x6 -> 0/1 in x6)
 def cmp_unsigned(e, op):
@@ -366,14 +490,343 @@ def cmp_unsigned(e, op):
     e.emit("    li x6, 0"); e.emit(f"    j {d}")
     e.emit(f"{t}:"); e.emit("    li x6, 1"); e.emit(f"{d}:")
 
+# ---------------------------------------------------------------------------
+# Register-operand forms (codegen.REG_TEMPS): rd op= rs / rd op= imm, result in rd.
+# Only rd (and, for compares, rs) is written, so a caller can keep other
+# temporaries live across them.
+# ---------------------------------------------------------------------------
+
+_REG_OPS = {'+': 'add', '-': 'sub', '&': 'and', '|': 'or', '^': 'xor',
+            '<<': 'sll', '>>': 'srl', '>>s': 'sra',
+            # the multiply/divide unit (codegen.HW_MULDIV); /s %s are the signed forms
+            '*': 'mul', '/': 'divu', '/s': 'div', '%': 'remu', '%s': 'rem'}
+_SHIFT_IMM = {'<<': 'slli', '>>': 'srli', '>>s': 'srai'}
+
+def _simm7(n):
+    """n (any int) as a sign-extended imm7, or None if it doesn't fit."""
+    n &= 0xFFFF
+    sn = n - 0x10000 if n >= 0x8000 else n
+    return sn if -64 <= sn <= 63 else None
+
+def reg_op(e, op, rd, rs):
+    """rd = rd op rs for + - & | ^ << >> (logical) >>s (arithmetic), and with the
+    multiply/divide unit * / % (unsigned) /s %s (signed)."""
+    e.emit(f"    {_REG_OPS[op]} {rd}, {rs}")
+
+def reg_op_imm(e, op, rd, k):
+    """rd = rd op k with an I-type instruction; False (nothing emitted) if k has no
+    encoding. ORI zero-extends imm7; ADDI/ANDI/XORI sign-extend it."""
+    k &= 0xFFFF
+    if op in ('+', '-'):
+        sk = _simm7(k if op == '+' else -k)
+        if sk is None: return False
+        if sk: e.emit(f"    addi {rd}, {sk}")
+    elif op in ('&', '^'):
+        sk = _simm7(k)
+        if sk is None: return False
+        e.emit(f"    {'andi' if op == '&' else 'xori'} {rd}, {sk}")
+    elif op == '|':
+        if k > 0x7F: return False
+        e.emit(f"    ori {rd}, {k}")
+    elif op in _SHIFT_IMM:
+        if k > 15: return False
+        if k: e.emit(f"    {_SHIFT_IMM[op]} {rd}, {k}")
+    else:
+        return False
+    return True
+
+def reg_cmp(e, op, rd, rs, unsigned):
+    """rd = (rd op rs) ? 1 : 0 via SLT/SLTU, no branches. rs may be clobbered."""
+    slt = "sltu" if unsigned else "slt"
+    if op == '<':
+        e.emit(f"    {slt} {rd}, {rs}")
+    elif op == '>=':
+        e.emit(f"    {slt} {rd}, {rs}"); e.emit(f"    xori {rd}, 1")
+    elif op == '>':
+        e.emit(f"    {slt} {rs}, {rd}"); e.emit(f"    mv {rd}, {rs}")
+    elif op == '<=':
+        e.emit(f"    {slt} {rs}, {rd}"); e.emit(f"    xori {rs}, 1"); e.emit(f"    mv {rd}, {rs}")
+    elif op == '==':
+        e.emit(f"    xor {rd}, {rs}"); e.emit(f"    sltui {rd}, 1")
+    elif op == '!=':
+        e.emit(f"    xor {rd}, {rs}"); e.emit(f"    sltui {rd}, 1"); e.emit(f"    xori {rd}, 1")
+    else:
+        raise ValueError(f"unknown compare {op}")
+
+def reg_cmp_imm(e, op, rd, k, unsigned):
+    """rd = (rd op k) ? 1 : 0 with SLTI/SLTUI; False if k has no encoding.
+    <= and > use k+1 (never wrapping past the type's maximum)."""
+    k &= 0xFFFF
+    if op in ('<=', '>'):
+        top = 0xFFFF if unsigned else 0x7FFF
+        if k == top: return False
+        k = (k + 1) & 0xFFFF
+    elif op in ('==', '!='):
+        sk = _simm7(k)
+        if sk is None: return False
+        if sk: e.emit(f"    xori {rd}, {sk}")
+        e.emit(f"    sltui {rd}, 1")
+        if op == '!=': e.emit(f"    xori {rd}, 1")
+        return True
+    elif op not in ('<', '>='):
+        return False
+    sk = _simm7(k)          # SLTUI: sext(imm7) as unsigned, i.e. 0..63 or 0xFFC0..0xFFFF
+    if sk is None: return False
+    e.emit(f"    {'sltui' if unsigned else 'slti'} {rd}, {sk}")
+    if op in ('>=', '>'):
+        e.emit(f"    xori {rd}, 1")
+    return True
+
+# ---------------------------------------------------------------------------
+# Constant multiply / divide (strength reduction). x * k becomes shifts and
+# adds over the canonical signed-digit form of k; / and % by a power of two
+# become shifts and masks; other divisors multiply by the reciprocal, expanded
+# into shifts and adds too (ZX16 has no multiplier, so a multiply-high would be a
+# __umul32 loop no faster than __udivmod's 16 steps).
+# ---------------------------------------------------------------------------
+
+# x * k is inlined when k has at most this many nonzero signed digits (about two
+# instructions each); denser constants call __mul, which is shorter.
+MUL_INLINE_DIGITS = 4
+
+def _s16(k):
+    k &= 0xFFFF
+    return k - 0x10000 if k & 0x8000 else k
+
+def _csd(k):
+    """Nonzero digits of k mod 2^16 in canonical signed-digit (non-adjacent) form,
+    as (bit, +1/-1) pairs, lowest first: 7 -> [(0, -1), (3, +1)]."""
+    k &= 0xFFFF; out = []; i = 0
+    while k:
+        if k & 1:
+            d = 2 - (k & 3)
+            k -= d; out.append((i, d))
+        k >>= 1; i += 1
+    return [(b, d) for b, d in out if b < 16]
+
+def _shift(e, op, rd, n):
+    """rd op= n for any n >= 0 (SLLI/SRLI/SRAI take 0..15)."""
+    while n > 0:
+        reg_op_imm(e, op, rd, min(n, 15)); n -= 15
+
+def mul_cost(k):
+    """Number of signed digits of k: mul_const inlines k when <= MUL_INLINE_DIGITS."""
+    return len(_csd(k))
+
+def is_pow2_divisor(k):
+    """k (mod 2^16) is a power of two whether read as unsigned or signed, so x / k
+    and x % k compile to div_const / mod_const inline in both signednesses."""
+    return _pow2(k, True) is not None and _pow2(k, False) is not None
+
+def mul_add(e, rd, rs, k, sub=False):
+    """rd += rs * k (rd -= rs * k if sub), mod 2^16. rs is clobbered (shifted up
+    through the digit positions of k); no other register is touched."""
+    at = 0
+    for b, d in _csd(k):
+        _shift(e, '<<', rs, b - at); at = b
+        reg_op(e, '-' if (d < 0) != sub else '+', rd, rs)
+
+def mul_const(e, rd, k, tmp, limit=True):
+    """rd *= k using only tmp (False with nothing emitted if k has more than
+    MUL_INLINE_DIGITS signed digits and limit is set)."""
+    digits = _csd(k)
+    if limit and len(digits) > MUL_INLINE_DIGITS:
+        return False
+    if not digits:
+        e.emit(f"    li {rd}, 0"); return True
+    neg = all(d < 0 for b, d in digits)       # e.g. 0xFFFF = -1: negate at the end
+    if neg:
+        digits = [(b, 1) for b, d in digits]
+    if len(digits) > 1:
+        e.emit(f"    mv {tmp}, {rd}")
+    top = next(b for b, d in digits if d > 0)  # applied to rd in place
+    _shift(e, '<<', rd, top)
+    at = 0
+    for b, d in digits:
+        if b == top: continue
+        _shift(e, '<<', tmp, b - at); at = b
+        reg_op(e, '+' if d > 0 else '-', rd, tmp)
+    if neg:
+        unary_neg(e, rd)
+    return True
+
+def _pow2(k, unsigned):
+    """(s, negative) if k is +-2^s in the given signedness, else None."""
+    v = k & 0xFFFF if unsigned else abs(_s16(k))
+    if v == 0 or v & (v - 1):
+        return None
+    return v.bit_length() - 1, not unsigned and _s16(k) < 0
+
+def div_const(e, rd, k, unsigned, tmp):
+    """rd /= k for k = +-2^s (False, nothing emitted, otherwise; is_pow2_divisor
+    holds for the k accepted either way). Signed division truncates toward zero: a
+    negative dividend is biased by 2^s - 1 before the arithmetic shift (rd >> 15
+    >>> (16 - s) is that bias or 0), and a negative k negates the quotient."""
+    p = _pow2(k, unsigned)
+    if p is None:
+        return False
+    s, neg = p
+    if unsigned:
+        _shift(e, '>>', rd, s); return True
+    if s:
+        e.emit(f"    mv {tmp}, {rd}")
+        _shift(e, '>>s', tmp, 15)
+        _shift(e, '>>', tmp, 16 - s)
+        reg_op(e, '+', rd, tmp)
+        _shift(e, '>>s', rd, s)
+    if neg:
+        unary_neg(e, rd)
+    return True
+
+def mod_const(e, rd, k, unsigned, tmp):
+    """rd %= k for k = +-2^s (False otherwise). The signed remainder takes the
+    dividend's sign: rd - ((rd + bias) >> s << s), bias as in div_const."""
+    p = _pow2(k, unsigned)
+    if p is None:
+        return False
+    s = p[0]
+    if s == 0:
+        e.emit(f"    li {rd}, 0"); return True
+    if unsigned:
+        if s <= 6:
+            e.emit(f"    andi {rd}, {(1 << s) - 1}")
+        else:
+            _shift(e, '<<', rd, 16 - s); _shift(e, '>>', rd, 16 - s)
+        return True
+    e.emit(f"    mv {tmp}, {rd}")
+    _shift(e, '>>s', tmp, 15)
+    _shift(e, '>>', tmp, 16 - s)
+    reg_op(e, '+', tmp, rd)
+    _shift(e, '>>', tmp, s)
+    _shift(e, '<<', tmp, s)
+    reg_op(e, '-', rd, tmp)
+    return True
+
+@functools.lru_cache(maxsize=None)
+def recip_shifts(o, ymax):
+    """Shift-and-add reciprocal of an odd o > 1 over 0 <= y <= ymax, or None.
+    1/o = P / (2^L - 1) for the period L of 2 mod o, so y / o is approximated from
+    below by q = sum(y >> a for a in terms), then q += q >> sh for sh in doubling
+    (y * P / 2^L * (1 + 2^-L)(1 + 2^-2L)...), all in 16 bits. Returns
+    (terms, doubling, fix): at most `fix` steps of "q += 1, r -= o while r >= o"
+    on r = y - q * o make q exact (checked for every y). None when the period is
+    over 16 bits (25, 100, 1000, ...) or the sequence would come near the cost of
+    the __udivmod call."""
+    L = next((n for n in range(1, 17) if pow(2, n, o) == 1), None)
+    if L is None:
+        return None
+    best = None
+    for base in range(L, 17, L):
+        pm = ((1 << base) - 1) // o
+        terms = [base - j for j in range(base) if pm >> j & 1]
+        doubling = []
+        sh = base
+        while sh <= 15:
+            doubling.append(sh); sh *= 2
+        fix = 0
+        for y in range(ymax + 1):
+            q = 0
+            for a in terms: q += y >> a
+            for sh in doubling: q += q >> sh
+            fix = max(fix, y // o - q)
+        cost = 3 * (len(terms) + len(doubling) + fix) - 1
+        if cost <= 40 and (best is None or cost < best[0]):
+            best = (cost, tuple(terms), tuple(doubling), fix)
+    return best[1:] if best else None
+
+def _recip_plan(d, xmax):
+    sz = (d & -d).bit_length() - 1
+    return sz, d >> sz, recip_shifts(d >> sz, xmax >> sz)
+
+def _udiv(e, d, xmax, rem=False):
+    """x6 = x6 // d (x6 % d if rem) for unsigned x6 <= xmax and a d that is not a
+    power of two: d = 2^s * o, and y = x >> s is divided by o per recip_shifts,
+    the remainder coming out of the correction steps. False (nothing emitted) when
+    o has no short expansion. Clobbers x4, x5, x7."""
+    sz, o, rs = _recip_plan(d, xmax)
+    if rs is None:
+        return False
+    terms, doubling, fix = rs
+    if rem and sz:
+        push_x6(e)                            # x's low sz bits rejoin the remainder
+    _shift(e, '>>', "x6", sz)                 # y
+    for i, a in enumerate(terms):             # x5 = q
+        dst = "x5" if i == 0 else "x4"
+        e.emit(f"    mv {dst}, x6")
+        _shift(e, '>>', dst, a)
+        if i: e.emit("    add x5, x4")
+    for sh in doubling:
+        e.emit("    mv x4, x5")
+        _shift(e, '>>', "x4", sh)
+        e.emit("    add x5, x4")
+    e.emit("    mv x4, x5")
+    mul_const(e, "x4", o, "x7", limit=False)
+    e.emit("    sub x6, x4")                  # r = y - q * o
+    load_const(e, o, "x7")
+    for i in range(fix):
+        lab = e.label("dq")
+        e.emit(f"    bltu x6, x7, {lab}")
+        if not rem: e.emit("    addi x5, 1")
+        if rem or i < fix - 1: e.emit("    sub x6, x7")
+        e.emit(f"{lab}:")
+    if not rem:
+        e.emit("    mv x6, x5")
+    elif sz:
+        pop_to(e, "x5")
+        mod_const(e, "x5", 1 << sz, True, None)
+        _shift(e, '<<', "x6", sz)
+        e.emit("    or x6, x5")
+    return True
+
+def _abs_x5(e, sign):
+    """x5 = |x5|, with sign = x5 >> 15 (0 or -1) left in `sign`."""
+    e.emit(f"    mv {sign}, x5")
+    e.emit(f"    srai {sign}, 15")
+    e.emit(f"    xor x5, {sign}")
+    e.emit(f"    sub x5, {sign}")
+
+def _signed_udiv(e, k, rem):
+    """x6 = x6 / k or x6 % k (signed) via _udiv on |x| <= 32768 and |k|; the
+    quotient's sign is x's flipped for k < 0, the remainder's is x's."""
+    sk = _s16(k)
+    if _recip_plan(abs(sk), 0x8000)[2] is None:
+        return False
+    push_x6(e)
+    e.emit("    mv x5, x6")
+    _abs_x5(e, "x4")
+    e.emit("    mv x6, x5")
+    _udiv(e, abs(sk), 0x8000, rem)
+    pop_to(e, "x5")
+    e.emit("    srai x5, 15")                 # 0 or -1: the dividend's sign
+    if sk < 0 and not rem:
+        e.emit("    xori x5, -1")
+    e.emit("    xor x6, x5")                  # negate when x5 = -1
+    e.emit("    sub x6, x5")
+    return True
+
+def div_recip(e, k, unsigned):
+    """x6 = x6 / k for a constant k that is neither 0 nor is_pow2_divisor, by a
+    reciprocal (see _udiv) instead of the 16-step __udivmod; False (nothing
+    emitted) if k has no short expansion. Clobbers x4, x5, x7."""
+    if unsigned: return _udiv(e, k & 0xFFFF, 0xFFFF)
+    return _signed_udiv(e, k, False)
+
+def mod_recip(e, k, unsigned):
+    """x6 = x6 % k like div_recip; the signed remainder takes the dividend's sign."""
+    if unsigned: return _udiv(e, k & 0xFFFF, 0xFFFF, True)
+    return _signed_udiv(e, k, True)
+
 def load_abs_addr(e, addr, dst="x6"):
     """dst = constant absolute address (for (int*)0xF000 style casts)."""
     e.emit(f"    li16 {dst}, {addr & 0xFFFF}")
 
 def emit_asm(e, text):
-    """asm("...") passthrough: emit verbatim."""
+    """asm("...") passthrough: emit verbatim, bracketed by comment markers so the
+    peephole pass leaves it alone."""
+    e.emit("    # asm")                       # = peephole.ASM_BEGIN / ASM_END
     for line in text.splitlines():
         e.emit("    " + line.strip())
+    e.emit("    # endasm")
 
 # ---------------------------------------------------------------------------
 # Program skeleton
@@ -381,33 +834,123 @@ def emit_asm(e, text):
 
 STACK_TOP = 0xF000   # initial SP; SoC builds lower this below the peripheral window
 
-def crt0(e):
-    e.emit(".text")
-    e.emit(".org 0x0020")
-    e.emit("__start:")
+def _routine(e, name, sections):
+    """Start a crt0/runtime routine; `sections` gives it a .section of its own and
+    exports it, for codegen.compile_runtime()'s relocatable unit."""
+    if sections:
+        e.emit(f".section .text.{name}")
+        e.emit(f".global {name}")
+    e.emit(f"{name}:")
+
+def crt0(e, sections=False, handlers=None):
+    """The entry at 0x0020; `handlers` ({vector: function}, #pragma interrupt) fills
+    their vector-table entries in front of it and puts the trampolines after it,
+    within a j of the table."""
+    if not sections:
+        e.emit(".text")
+        for vec in sorted(handlers or {}):
+            e.emit(f".org 0x{vec * 2:04X}")
+            e.emit(f"    j __isr{vec}")
+        e.emit(".org 0x0020")
+    _routine(e, "__start", sections)
     e.emit(f"    li16 x2, 0x{STACK_TOP:04X}")
     e.emit("    la x5, main")
     e.emit("    jalr x1, x5")
     e.emit("    ecall 0x3FF")
+    if not sections:
+        for vec, name in sorted((handlers or {}).items()):
+            isr_trampoline(e, vec, name)
 
-def runtime(e):
-    # Helpers preserve x3 and x4 (callee-saved: x3 is the caller's frame pointer).
-    # They read args relative to a temporarily adjusted view of the stack.
-    # On entry [sp]=a, [sp+2]=b. After we push x3,x4 the args shift by 4.
-    e.emit("__mul:")
-    e.emit("    push x3")
-    e.emit("    push x4")
-    e.emit("    lw x3, 4(x2)")     # a  (args shifted by the 2 pushes = 4 bytes)
-    e.emit("    lw x4, 6(x2)")     # b
+# Registers an interrupt trampoline saves: the ones a call may clobber (ra, the
+# temporaries and the result). x0 and x3 are callee-saved by the handler itself.
+ISR_SAVES = ("x1", "x4", "x5", "x6", "x7")
+
+def isr_trampoline(e, vec, name, sections=False):
+    """__isr<vec>: save ISR_SAVES, call the C handler `name`, restore, reti (IE back
+    on). In a relocatable unit the vector entry is a .vectors.irq<vec> section of
+    its own, which zx16ld places at vec * 2."""
+    if sections:
+        e.emit(f".section .vectors.irq{vec}")
+        e.emit(f"    j __isr{vec}")
+    _routine(e, f"__isr{vec}", sections)
+    groups = [ISR_SAVES[i:i + 4] for i in range(0, len(ISR_SAVES), 4)]   # sw reaches 6(sp)
+    for g in reversed(groups):
+        e.emit(f"    addi x2, {-2 * len(g)}")
+        for i, r in enumerate(g):
+            e.emit(f"    sw {r}, {2 * i}(x2)")
+    e.emit(f"    la x5, {name}")
+    e.emit("    jalr x1, x5")
+    for g in groups:
+        for i, r in enumerate(g):
+            e.emit(f"    lw {r}, {2 * i}(x2)")
+        e.emit(f"    addi x2, {2 * len(g)}")
+    e.emit("    reti")
+
+def runtime(e, sections=False):
+    # Helpers take their operands in registers (x5 = left, x4 = right; see
+    # _runtime_call), return in x6 (and x7), and preserve x3 (the caller's frame
+    # pointer).
+    #
+    # __mul: x6 = x5 * x4, low 16 bits (the same for signed and unsigned).
+    # Shift-and-add over the smaller operand, LSB first, stopping when its
+    # remaining bits are zero: at most 16 iterations, and 1000*3 takes two.
+    # The previous routine added b to itself a times (1000*3 = 1000 iterations).
+    # Clobbers x4, x5, x7.
+    _routine(e, "__mul", sections)
+    e.emit("    bgeu x4, x5, __mul_go")   # multiplier = the smaller (unsigned) operand
+    e.emit("    mv x7, x5")
+    e.emit("    mv x5, x4")
+    e.emit("    mv x4, x7")
+    e.emit("__mul_go:")
     e.emit("    li x6, 0")
+    e.emit("    bz x5, __mul_done")
     e.emit("__mul_lp:")
-    e.emit("    bz x3, __mul_done")
-    e.emit("    add x6, x4")
-    e.emit("    addi x3, -1")
-    e.emit("    j __mul_lp")
+    e.emit("    mv x7, x5")
+    e.emit("    andi x7, 1")
+    e.emit("    bz x7, __mul_sk")
+    e.emit("    add x6, x4")          # bit set: acc += multiplicand
+    e.emit("__mul_sk:")
+    e.emit("    add x4, x4")          # multiplicand <<= 1
+    e.emit("    srli x5, 1")          # next multiplier bit
+    e.emit("    bnz x5, __mul_lp")
     e.emit("__mul_done:")
-    e.emit("    pop x4")
+    e.emit("    ret")
+    # __umul32: full unsigned product, x6 = low 16 bits, x7 = high 16 bits of
+    # x5 * x4 (the __mulhu intrinsic; u32.c's mul32 is built on it). Same loop
+    # with a 32-bit multiplicand in x3:x4 and a 32-bit accumulator in x7:x6;
+    # x1 is the per-step carry. Clobbers x4, x5.
+    _routine(e, "__umul32", sections)
+    e.emit("    push x1")
+    e.emit("    push x3")
+    e.emit("    bgeu x4, x5, __um32_go")
+    e.emit("    mv x7, x5")
+    e.emit("    mv x5, x4")
+    e.emit("    mv x4, x7")
+    e.emit("__um32_go:")
+    e.emit("    li x6, 0")
+    e.emit("    li x7, 0")
+    e.emit("    li x3, 0")            # multiplicand high half
+    e.emit("__um32_lp:")
+    e.emit("    mv x1, x5")
+    e.emit("    andi x1, 1")
+    e.emit("    bz x1, __um32_sk")
+    e.emit("    add x6, x4")          # acc += multiplicand, with carry
+    e.emit("    mv x1, x6")
+    e.emit("    sltu x1, x4")         # carry = (acc.lo < multiplicand.lo)
+    e.emit("    add x7, x1")
+    e.emit("    add x7, x3")
+    e.emit("__um32_sk:")
+    e.emit("    mv x1, x4")           # multiplicand <<= 1 across both halves
+    e.emit("    srli x1, 15")
+    e.emit("    add x4, x4")
+    e.emit("    add x3, x3")
+    e.emit("    add x3, x1")
+    e.emit("    srli x5, 1")
+    e.emit("    bz x5, __um32_done")  # loop back via j: the body is beyond branch range
+    e.emit("    j __um32_lp")
+    e.emit("__um32_done:")
     e.emit("    pop x3")
+    e.emit("    pop x1")
     e.emit("    ret")
     # ---- division / modulo --------------------------------------------------
     # The previous routines used a SIGNED compare (blt) in a repeated-subtraction
@@ -422,7 +965,7 @@ def runtime(e):
     # N is consumed MSB-first: each step shifts N left (its top bit feeds the
     # remainder) and shifts a quotient bit into N's freed LSB, so x5 finishes
     # holding the quotient.
-    e.emit("__udivmod:")
+    _routine(e, "__udivmod", sections)
     e.emit("    push x3")            # x3 reused as the per-bit carry; restored below
     e.emit("    li x6, 0")           # remainder = 0
     e.emit("    li x7, 16")          # bit counter
@@ -446,7 +989,7 @@ def runtime(e):
     e.emit("    ret")
     # __div: signed divide, truncation toward zero (quotient negative iff exactly
     # one of N,D is negative). in x5=N, x4=D -> x6 = N/D.
-    e.emit("__div:")
+    _routine(e, "__div", sections)
     e.emit("    push x1")            # __div calls __udivmod
     e.emit("    push x3")            # save frame ptr; reuse x3 as the sign flag
     e.emit("    mv x3, x5")
@@ -472,7 +1015,7 @@ def runtime(e):
     e.emit("    ret")
     # __mod: signed remainder; result takes the sign of the dividend N (C99:
     # a == (a/b)*b + a%b). in x5=N, x4=D -> x6 = N % D.
-    e.emit("__mod:")
+    _routine(e, "__mod", sections)
     e.emit("    push x1")
     e.emit("    push x3")
     e.emit("    mv x3, x5")
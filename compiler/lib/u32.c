@@ -121,21 +121,15 @@ int eq32(struct u32 *a, struct u32 *b){
     return 1;
 }
 
-// ---- multiply: r = a * b  (low 32 bits), shift-and-add, 32 iterations ----
+// ---- multiply: r = a * b  (low 32 bits) ----
+// Schoolbook on 16-bit halves: a.lo*b.lo contributes its full 32-bit product
+// (__mulhu is the compiler intrinsic for the high half); the cross terms only
+// reach the high word, and a.hi*b.hi lies entirely above bit 31.
 void mul32(struct u32 *r, struct u32 *a, struct u32 *b){
-    struct u32 acc; struct u32 addend; struct u32 mul;
-    int i;
-    acc.lo = 0; acc.hi = 0;
-    addend.lo = a->lo; addend.hi = a->hi;           // a << i
-    mul.lo = b->lo; mul.hi = b->hi;                 // remaining bits of b
-    i = 0;
-    while (i < 32){
-        if (mul.lo & 1) add32(&acc, &acc, &addend);
-        shl32(&addend, &addend, 1);
-        shr32(&mul, &mul, 1);
-        i = i + 1;
-    }
-    r->lo = acc.lo; r->hi = acc.hi;
+    unsigned lo; unsigned hi;
+    lo = a->lo * b->lo;
+    hi = __mulhu(a->lo, b->lo) + a->lo * b->hi + a->hi * b->lo;
+    r->lo = lo; r->hi = hi;
 }
 
 // ---- unsigned divide: q = a / b, rem = a % b  (binary long division) ----
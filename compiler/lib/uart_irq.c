@@ -0,0 +1,154 @@
+// uart_irq.c -- interrupt-driven, ring-buffered nc_uart driver (SoC vector 3).
+//
+// stdio_si.c's putchar spins on SR.TXE for every byte, so a printed line costs its
+// whole serial time (160 PCLK a byte at BRR 0). Here a write only copies the bytes
+// into a RAM ring and returns; the UART's TX interrupt (FIFO level <= UQ_TXTH)
+// tops the 16-deep TX FIFO up from the ring as it drains, and its RX interrupt
+// moves arrived bytes into a second ring. A writer waits only while the TX ring is
+// full, a reader only while the RX ring is empty.
+//
+// ZC has no extern and a separately compiled library unit cannot define globals,
+// so the rings are a struct uart_q the program owns, and the program names the
+// handler (docs/INTERRUPTS.md, #pragma interrupt in docs/SPEC.md):
+//
+//   #include "uart_irq.c"
+//   struct uart_q con;
+//   #pragma interrupt 3 on_uart
+//   void on_uart(void){ uq_isr(&con); }
+//   int main(void){ uq_init(&con); uq_puts(&con, "hi"); uq_flush(&con); return 0; }
+//
+// uq_init() turns interrupts on (ei). Don't write from a handler: the writers
+// re-enable interrupts, and a full ring would wait forever with them off.
+#include "stdlib.c"                  // itoa / itohex for uq_putint / uq_puthex
+
+#define UART_CR       0xC000         // bit0 EN, bit8 TXEN, bit9 RXEN
+#define UART_SR       0xC004         // bit1 RXNE, bit5 TC (FIFO empty, shifter idle)
+#define UART_DR       0xC008
+#define UART_IM       0xC020         // bit0 TX, bit1 RX
+#define UART_ICR      0xC02C         // write 1 to clear a RIS flag
+#define UART_FIFOCTRL 0xC050         // [3:0] TXTH, [7:4] RXTH, bit8/9 flush TX/RX
+#define UART_FIFOSTR  0xC054         // low half: TX FIFO level
+#define UART_BRR      0xC100
+
+#define UQ_SIZE   64                 // ring bytes (a power of two; holds UQ_SIZE - 1)
+#define UQ_MASK   63
+#define UQ_TXFIFO 16                 // nc_uart TX_FIFO_DEPTH
+#define UQ_TXTH   4                  // refill at 4 left: 4 frames for the handler to run
+
+struct uart_q {
+    int th; int tt;                  // TX ring: the writer moves th, the handler tt
+    int rh; int rt;                  // RX ring: the handler moves rh, the reader rt
+    int lost;                        // RX bytes dropped on a full ring
+    unsigned char tx[UQ_SIZE];
+    unsigned char rx[UQ_SIZE];
+};
+
+void uq_init(struct uart_q *q){
+    q->th = 0; q->tt = 0; q->rh = 0; q->rt = 0; q->lost = 0;
+    *(volatile unsigned *)UART_BRR = 0;                          // 16 clocks/bit (sim)
+    *(volatile unsigned *)UART_FIFOCTRL = 0x300 | 0x10 | UQ_TXTH;  // flush; RXTH 1
+    *(volatile unsigned *)UART_CR = 0x301;                       // EN | TXEN | RXEN
+    *(volatile unsigned *)UART_ICR = 0xFF;
+    *(volatile unsigned *)UART_IM = 3;                           // TX | RX
+    asm("ei");
+}
+
+// Move TX ring bytes into the FIFO while both have some. Runs with interrupts off
+// (in the handler, or bracketed by uq_kick).
+void uq_fill(struct uart_q *q){
+    int n; int t; int h; unsigned char *tx;
+    n = UQ_TXFIFO - *(volatile unsigned *)UART_FIFOSTR;
+    t = q->tt; h = q->th; tx = q->tx;
+    while (n != 0){
+        if (t == h) break;
+        *(volatile unsigned *)UART_DR = tx[t];
+        t = (t + 1) & UQ_MASK;
+        n = n - 1;
+    }
+    q->tt = t;
+}
+
+// Start the transmitter on what was queued: the TX interrupt only comes when the
+// FIFO level falls to UQ_TXTH, and an idle FIFO is there already.
+void uq_kick(struct uart_q *q){
+    asm("di");
+    uq_fill(q);
+    asm("ei");
+}
+
+// The vector 3 handler's body: drain the RX FIFO into the RX ring, refill the TX
+// FIFO. Clearing the flags first means a byte arriving meanwhile raises them again.
+void uq_isr(struct uart_q *q){
+    int h; int n; int c;
+    *(volatile unsigned *)UART_ICR = 3;                          // TX | RX
+    h = q->rh;
+    while ((*(volatile unsigned *)UART_SR & 2) != 0){            // RXNE
+        c = *(volatile unsigned *)UART_DR;
+        n = (h + 1) & UQ_MASK;
+        if (n == q->rt) q->lost = q->lost + 1;                   // full: dropped
+        else { q->rx[h] = c; h = n; }
+    }
+    q->rh = h;
+    uq_fill(q);
+}
+
+// Copy from s into the TX ring's free space, as far as the ring's end; returns the
+// bytes copied (0 only when the ring is full). No calls, so the loop runs in
+// registers.
+int uq_copy(struct uart_q *q, char *s){
+    int h; int k; unsigned char *d; char *p;
+    h = q->th;
+    k = (q->tt - h - 1) & UQ_MASK;
+    if (k > UQ_SIZE - h) k = UQ_SIZE - h;
+    d = q->tx + h; p = s;
+    while (k != 0){
+        if (*p == 0) break;
+        *d = *p;
+        d = d + 1; p = p + 1; k = k - 1;
+    }
+    q->th = (h + (p - s)) & UQ_MASK;
+    return p - s;
+}
+
+// Queue s and return; wait only while the ring is full (the handler empties it at
+// the line rate meanwhile).
+void uq_putstr(struct uart_q *q, char *s){
+    int n;
+    while (*s != 0){
+        n = uq_copy(q, s);
+        s = s + n;
+        uq_kick(q);
+        if (n == 0){
+            while (((q->tt - q->th - 1) & UQ_MASK) == 0) { }
+        }
+    }
+}
+
+int uq_putc(struct uart_q *q, int c){
+    int n;
+    n = (q->th + 1) & UQ_MASK;
+    while (n == q->tt) { }                                       // full: the handler drains it
+    q->tx[q->th] = c;
+    q->th = n;
+    uq_kick(q);
+    return c;
+}
+
+void uq_puts(struct uart_q *q, char *s){ uq_putstr(q, s); uq_putc(q, 10); }
+void uq_putint(struct uart_q *q, int v){ char b[7]; uq_putstr(q, itoa(v, b)); }
+void uq_puthex(struct uart_q *q, unsigned v){ char b[5]; uq_putstr(q, itohex(v, b)); }
+
+// Wait until everything queued has left the shifter (before a halt or a reset).
+void uq_flush(struct uart_q *q){
+    while (q->tt != q->th) { }
+    while ((*(volatile unsigned *)UART_SR & 0x20) == 0) { }     // TC
+}
+
+int uq_haschar(struct uart_q *q){ return q->rt != q->rh; }
+int uq_getc(struct uart_q *q){
+    int c;
+    while (q->rt == q->rh) { }                                   // empty: wait for the handler
+    c = q->rx[q->rt];
+    q->rt = (q->rt + 1) & UQ_MASK;
+    return c;
+}
@@ -0,0 +1,739 @@
+#!/usr/bin/env python3
+"""
+Peephole optimizer over the assembly text codegen emits (codegen.PEEPHOLE).
+
+codegen.compile_src() runs optimize() between gen_program() and the assembler.
+Every rule is a local rewrite that never grows the code; the rules are applied in
+table order, round after round, until a whole round changes nothing.
+
+  rule         rewrite                                              guard
+  -----------  ---------------------------------------------------  -------------------------
+  dead_code    drop instructions after j / jr / ret up to the next  -
+               label
+  dead_label   drop an unreferenced compiler label (__name<N>:)     no reference anywhere,
+               that code falls into                                 not after j/jr/ret
+  jump_next    j L / Bcc .., L / la r,L; jr r  directly before L:   r dead at L
+               -> (nothing)
+  branch_over  Bcc .., T; j L (or la r,L; jr r); T:                 L in branch range,
+               -> Binv .., L                                        r dead at L
+  short_jump   la r, L; jr r -> j L                                 L in j range, r dead at L
+  short_call   la r, F; jalr x1, r -> jal x1, F                     F in j range, r dead at F
+                                                                    (x5: any non-__ F)
+  push_pop     push a; <S>; pop b          -> mv b, a; <S>          S straight-line, no x2,
+               push a; <S>; lw b,0(x2); addi x2,2                   no use of b
+               (b == a: both deleted, needs S not to write a)
+  reload       sw a, k(x3) ... lw b, k(x3) -> mv b, a (or nothing)  same block, no store or
+               lw a, k(x3) ... lw b, k(x3) -> mv b, a (or nothing)  call between, a and x3
+               li r, k ... li r, k         -> (second deleted)      unchanged (x2 for x3
+                                                                    in a frameless leaf)
+  cmp_branch   slt/sltu/xor a, b [; sltui a,1 | xori a,1]*; bnz/bz  a dead at both successors
+               a, T -> blt/bge/bltu/bgeu/bne/beq a, b, T
+               sltui a, 1; bnz/bz a, T   -> bz/bnz a, T
+               Bcc .., t; li x6,0; j d; t: li x6,1; d: bnz/bz x6, T  t, d referenced only
+               -> Bcc (or Binv) .., T                               there; x6 dead
+  forward_mv   <def a, ..>; mv b, a        -> <def b, ..>           a dead after; def is
+                                                                    li/lui/la/li16/mv/load
+  fold_mv      add/and/or/xor b, a; mv a, b -> add/and/or/xor a, b  b dead after
+  copy_prop    mv a, b; <I reading a>        -> <I reading b>       a dead after I (or I
+               mv a, b; <op a, ..>; mv b, a  -> <op b, ..>          writes it); a dead after
+  dead_mv      mv/li/ALU op writing a dead register -> (nothing)    never loads, x1-x3
+               mv a, a -> (nothing)
+
+"Dead" is a forward scan: the register is written before it is read on every path,
+following j, la+jr and both sides of a branch for a bounded number of steps. A call,
+ecall, directive or asm() block counts as a read of everything; at ret only x4 and x5
+(the far-jump scratches, never a return value) are dead. Ranges use the assembler's sizes for
+the unmodified text, and no rule ever lengthens the code, so a distance measured in
+one round only shrinks later. asm() passthrough (between the "# asm" / "# endasm"
+markers codegen_patterns.emit_asm writes) is never touched.
+
+Each rule has a module switch of the same name in capitals (PUSH_POP = False, ...)
+and ZX16_PEEPHOLE_OFF=rule,rule (or "all") turns rules off without editing code, so a
+miscompile can be bisected against the simulator: `python3 peephole.py prog.c
+--bisect` reports which rule changes the program's output. Switches and the
+variable are part of compiler/buildcache.py's key.
+"""
+import os, re, sys
+from collections import Counter
+from functools import lru_cache
+
+DEAD_CODE = True
+DEAD_LABEL = True
+JUMP_NEXT = True
+BRANCH_OVER = True
+SHORT_JUMP = True
+SHORT_CALL = True
+PUSH_POP = True
+RELOAD = True
+CMP_BRANCH = True
+FORWARD_MV = True
+FOLD_MV = True
+COPY_PROP = True
+DEAD_MV = True
+
+ASM_BEGIN, ASM_END = "# asm", "# endasm"
+_MAX_ROUNDS = 16
+_SCAN_STEPS = 64                       # liveness budget, instructions per query
+
+_ABI = {'t0': 'x0', 'ra': 'x1', 'sp': 'x2', 's0': 'x3', 's1': 'x4', 't1': 'x5',
+        'a0': 'x6', 'a1': 'x7'}
+_REGS = {f"x{i}" for i in range(8)}
+_ALU_RR = {'add', 'sub', 'slt', 'sltu', 'sll', 'srl', 'sra', 'or', 'and', 'xor',
+           'mul', 'mulh', 'mulhu', 'div', 'divu', 'rem', 'remu'}   # + the mul/div unit
+_ALU_RI = {'addi', 'slti', 'sltui', 'ori', 'andi', 'xori', 'slli', 'srli', 'srai',
+           'inc', 'dec', 'neg', 'not'}
+_DEFS = {'li', 'lui', 'auipc', 'li16', 'la', 'clr'}
+_LOADS = {'lw', 'lb', 'lbu'}
+_STORES = {'sw', 'sb'}
+_BRANCH = {'beq', 'bne', 'blt', 'bge', 'bltu', 'bgeu', 'bz', 'bnz'}
+_INVERSE = {'beq': 'bne', 'bne': 'beq', 'blt': 'bge', 'bge': 'blt',
+            'bltu': 'bgeu', 'bgeu': 'bltu', 'bz': 'bnz', 'bnz': 'bz'}
+_DEAD_AT_RET = {'x4', 'x5'}
+_LABEL_RE = re.compile(r'^([A-Za-z_.$][\w.$]*):$')
+_LOCAL_LABEL_RE = re.compile(r'^__[A-Za-z_]+\d+$')
+_WORD_RE = re.compile(r'[A-Za-z_.$][\w.$]*')
+_MEM_RE = re.compile(r'^(-?(?:0x[0-9A-Fa-f]+|\d+))\((\w+)\)$')
+
+# ---------------------------------------------------------------------------
+# Parsed lines: (text, kind, op, args). kind is 'ins', 'label' (op = name),
+# 'dir' (directive, data, opaque asm: a barrier to every rule) or 'blank'.
+# ---------------------------------------------------------------------------
+
+@lru_cache(maxsize=None)
+def _parse(text):
+    s = text.strip()
+    if not s or s.startswith('#'):
+        return (text, 'blank', None, ())
+    m = _LABEL_RE.match(s)
+    if m:
+        return (text, 'label', m.group(1), ())
+    if s.startswith('.') or any(c in s for c in '#;"\':'):
+        return (text, 'dir', None, ())
+    op, _, rest = s.partition(' ')
+    args = tuple(_ABI.get(a.strip(), a.strip()) for a in rest.split(',')) if rest.strip() else ()
+    return (text, 'ins', op.lower(), args)
+
+def _ins(op, *args):
+    return _parse(f"    {op} {', '.join(args)}" if args else f"    {op}")
+
+def _mem(arg):
+    """'k(xN)' -> (k, 'xN'), else None."""
+    m = _MEM_RE.match(arg)
+    return (int(m.group(1), 0), m.group(2)) if m and m.group(2) in _REGS else None
+
+def _int(s):
+    try:
+        return int(s, 0)
+    except ValueError:
+        return None
+
+@lru_cache(maxsize=None)
+def _effects(item):
+    """(kind, reads, writes) of an 'ins' line. kind: alu, def, load, store, push, pop,
+    branch, j, jr, ret, call, sys (anything unknown: a barrier)."""
+    _, _, op, a = item
+    regs = [r for r in a if r in _REGS]
+    if op in _ALU_RR and len(a) == 2 and len(regs) == 2:
+        return 'alu', {a[0], a[1]}, {a[0]}
+    if op == 'mv' and len(regs) == 2:
+        return 'alu', {a[1]}, {a[0]}
+    if op in _ALU_RI and a and a[0] in _REGS:
+        return 'alu', {a[0]}, {a[0]}
+    if op in _DEFS and a and a[0] in _REGS:
+        return 'def', set(), {a[0]}
+    if (op in _LOADS or op in _STORES) and len(a) == 2 and a[0] in _REGS and _mem(a[1]):
+        base = _mem(a[1])[1]
+        if op in _LOADS:
+            return 'load', {base}, {a[0]}
+        return 'store', {a[0], base}, set()
+    if op == 'push' and regs == list(a) and len(a) == 1:
+        return 'push', {a[0], 'x2'}, {'x2'}
+    if op == 'pop' and regs == list(a) and len(a) == 1:
+        return 'pop', {'x2'}, {a[0], 'x2'}
+    if op in ('bz', 'bnz') and len(a) == 2 and a[0] in _REGS:
+        return 'branch', {a[0]}, set()
+    if op in _BRANCH and len(a) == 3 and len(regs) == 2:
+        return 'branch', {a[0], a[1]}, set()
+    if op == 'j' and len(a) == 1:
+        return 'j', set(), set()
+    if op == 'jr' and len(a) == 1 and a[0] in _REGS:
+        return 'jr', {a[0]}, set()
+    if op == 'ret' and not a:
+        return 'ret', set(), set()
+    if op == 'nop' and not a:
+        return 'alu', set(), set()
+    if op in ('jal', 'jalr', 'call'):
+        return 'call', set(_REGS), set(_REGS)
+    return 'sys', set(_REGS), set(_REGS)
+
+def _target(item):
+    return item[3][-1]
+
+# ---------------------------------------------------------------------------
+# Program walking helpers (prog is a list of parsed lines; None = deleted)
+# ---------------------------------------------------------------------------
+
+def _next(prog, i):
+    """Index of the first live, non-blank line at or after i (len(prog) at the end)."""
+    while i < len(prog) and (prog[i] is None or prog[i][1] == 'blank'):
+        i += 1
+    return i
+
+def _next_ins(prog, i):
+    """Index of the instruction that directly follows i with no label in between."""
+    j = _next(prog, i)
+    return j if j < len(prog) and prog[j][1] == 'ins' else None
+
+def _labels_from(prog, i):
+    """Names of the labels that start at line i (up to the next non-label line)."""
+    names = set()
+    i = _next(prog, i)
+    while i < len(prog) and prog[i][1] == 'label':
+        names.add(prog[i][2]); i = _next(prog, i + 1)
+    return names
+
+def _la_before(prog, i, reg):
+    """The label L when the instruction just before jr at i is `la reg, L`."""
+    j = i - 1
+    while j >= 0 and (prog[j] is None or prog[j][1] == 'blank'):
+        j -= 1
+    if j >= 0 and prog[j][1] == 'ins' and prog[j][2] == 'la' and prog[j][3][0] == reg:
+        return prog[j][3][1]
+    return None
+
+def _dead(prog, i, reg, lab, budget=None, depth=0):
+    """True when reg is written before it is read on every path from line i."""
+    budget = budget if budget is not None else [_SCAN_STEPS]
+    if depth > 6:
+        return False
+    while i < len(prog):
+        item = prog[i]
+        if item is None or item[1] in ('blank', 'label'):
+            i += 1; continue
+        if item[1] != 'ins' or budget[0] <= 0:
+            return False
+        budget[0] -= 1
+        kind, reads, writes = _effects(item)
+        if reg in reads:
+            return False
+        if kind == 'branch':
+            t = lab.get(_target(item))
+            if t is None or not _dead(prog, t, reg, lab, budget, depth + 1):
+                return False
+        if reg in writes:
+            return True
+        if kind == 'j':
+            i = lab.get(_target(item))
+            if i is None:
+                return False
+            continue
+        if kind == 'jr':
+            dest = _la_before(prog, i, item[3][0])
+            if dest is None or dest not in lab:
+                return False
+            i = lab[dest]; continue
+        if kind == 'ret':
+            return reg in _DEAD_AT_RET
+        i += 1
+    return False
+
+def _addresses(prog):
+    """Byte address of every line, as the assembler lays out the unmodified text.
+    Anything of unknown size (directives, asm blocks) opens a far-away segment so
+    no range check can succeed across it."""
+    addr, pc = [], 0
+    for item in prog:
+        addr.append(pc)
+        if item is None or item[1] in ('blank', 'label'):
+            continue
+        if item[1] == 'dir':
+            pc += 1 << 20; continue
+        op, a = item[2], item[3]
+        if op == 'li':
+            k = _int(a[1]) if len(a) == 2 else None
+            pc += 2 if k is not None and -64 <= k <= 63 else 4
+        elif op in ('li16', 'la', 'push', 'pop', 'neg'):
+            pc += 4
+        else:
+            pc += 2
+    return addr
+
+def _in_range(addr, i, lab, name, lo, hi):
+    """Whether a 2-byte jump/branch at line i reaches label name."""
+    t = lab.get(name)
+    return t is not None and lo <= addr[t] - (addr[i] + 2) <= hi
+
+_BR_RANGE, _J_RANGE = (-16, 14), (-512, 510)   # the assembler's checks
+_FRAME_BASES = ('x3', 'x2')
+
+# ---------------------------------------------------------------------------
+# Rules. Each takes (prog, lab, refs), edits prog in place (replace a line or set
+# it to None; never insert) and returns the number of rewrites.
+# ---------------------------------------------------------------------------
+
+def _rule_dead_code(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or _effects(item)[0] not in ('j', 'jr', 'ret'):
+            continue
+        j = _next(prog, i + 1)
+        while j < len(prog) and prog[j][1] == 'ins':
+            prog[j] = None; n += 1
+            j = _next(prog, j + 1)
+    return n
+
+def _rule_dead_label(prog, lab, refs):
+    """Only labels control falls into: an unreferenced label after a jump may still
+    name a routine reached from outside the text (e.g. an intrinsic's runtime)."""
+    n = 0
+    for i, item in enumerate(prog):
+        if item and item[1] == 'label' and _LOCAL_LABEL_RE.match(item[2]) and not refs[item[2]]:
+            j = _prev_ins(prog, i)
+            if j is not None and _effects(prog[j])[0] not in ('j', 'jr', 'ret'):
+                prog[i] = None; n += 1
+    return n
+
+def _rule_jump_next(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins':
+            continue
+        kind = _effects(item)[0]
+        if kind in ('j', 'branch') and _target(item) in _labels_from(prog, i + 1):
+            prog[i] = None; n += 1
+        elif item[2] == 'la' and len(item[3]) == 2:
+            j = _next_ins(prog, i + 1)
+            if (j is not None and prog[j][2] == 'jr' and prog[j][3] == (item[3][0],)
+                    and item[3][1] in _labels_from(prog, j + 1)
+                    and _dead(prog, j + 1, item[3][0], lab)):
+                prog[i] = prog[j] = None; n += 1
+    return n
+
+def _jump_at(prog, i, lab):
+    """(label, last line of the jump, scratch reg or None) for `j L` or `la r, L; jr r`
+    at line i."""
+    item = prog[i]
+    if item[2] == 'j' and len(item[3]) == 1:
+        return item[3][0], i, None
+    if item[2] == 'la' and len(item[3]) == 2:
+        j = _next_ins(prog, i + 1)
+        if j is not None and prog[j][2] == 'jr' and prog[j][3] == (item[3][0],):
+            return item[3][1], j, item[3][0]
+    return None
+
+def _rule_branch_over(prog, lab, refs):
+    n, addr = 0, _addresses(prog)
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] not in _BRANCH:
+            continue
+        j = _next_ins(prog, i + 1)
+        jump = j is not None and _jump_at(prog, j, lab)
+        if not jump:
+            continue
+        dest, last, scratch = jump
+        if _target(item) not in _labels_from(prog, last + 1):
+            continue
+        if not _in_range(addr, i, lab, dest, *_BR_RANGE):
+            continue
+        if scratch and not _dead(prog, lab[dest], scratch, lab):
+            continue
+        prog[i] = _ins(_INVERSE[item[2]], *item[3][:-1], dest)
+        for k in range(j, last + 1):
+            prog[k] = None
+        n += 1
+    return n
+
+def _rule_short_jump(prog, lab, refs):
+    n, addr = 0, _addresses(prog)
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] != 'la':
+            continue
+        jump = _jump_at(prog, i, lab)
+        if not jump:
+            continue
+        dest, last, scratch = jump
+        if _in_range(addr, i, lab, dest, *_J_RANGE) and _dead(prog, lab[dest], scratch, lab):
+            prog[i] = _ins('j', dest); prog[last] = None; n += 1
+    return n
+
+def _rule_short_call(prog, lab, refs):
+    """x5 is codegen_patterns.call_function's scratch: no compiled function reads it
+    before writing it, so for them it need not be dead at the callee; the runtime
+    (__mul etc., which take arguments in x5) gets the liveness scan."""
+    n, addr = 0, _addresses(prog)
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] != 'la' or len(item[3]) != 2:
+            continue
+        r, dest = item[3]
+        j = _next_ins(prog, i + 1)
+        if j is None or prog[j][2] != 'jalr' or prog[j][3] != ('x1', r):
+            continue
+        if not _in_range(addr, i, lab, dest, *_J_RANGE):
+            continue
+        if (r == 'x5' and not dest.startswith('__')) or _dead(prog, lab[dest], r, lab):
+            prog[i] = _ins('jal', 'x1', dest); prog[j] = None; n += 1
+    return n
+
+def _pop_at(prog, i):
+    """(reg, last line) for `pop b` or `lw b, 0(x2); addi x2, 2` starting at line i."""
+    item = prog[i]
+    if item[2] == 'pop' and _effects(item)[0] == 'pop':
+        return item[3][0], i
+    if item[2] == 'lw' and len(item[3]) == 2 and _mem(item[3][1]) == (0, 'x2'):
+        j = _next_ins(prog, i + 1)
+        if j is not None and prog[j][2] == 'addi' and prog[j][3] == ('x2', '2'):
+            return item[3][0], j
+    return None
+
+def _rule_push_pop(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] != 'push' or _effects(item)[0] != 'push':
+            continue
+        a = item[3][0]
+        written, touched = set(), set()        # by the instructions in between
+        j = _next_ins(prog, i + 1)
+        while j is not None:
+            pop = _pop_at(prog, j)
+            if pop:
+                b, last = pop
+                if b == a and a not in written:
+                    prog[i] = None
+                elif b != a and b not in touched:
+                    prog[i] = _ins('mv', b, a)
+                else:
+                    break
+                for k in range(j, last + 1):
+                    prog[k] = None
+                n += 1
+                break
+            kind, reads, writes = _effects(prog[j])
+            if kind not in ('alu', 'def', 'load') or 'x2' in reads | writes:
+                break
+            written |= writes; touched |= reads | writes
+            j = _next_ins(prog, j + 1)
+    return n
+
+def _rule_reload(prog, lab, refs):
+    """Frame slots are k(x3), or k(x2) in a frameless leaf (codegen_patterns frame
+    'none'); a store through one base may alias the other's slots, any other store
+    anything."""
+    n = 0
+    slots, consts = {}, {}            # (base, frame offset) -> reg holding that word; reg -> k
+    def forget(reg):
+        consts.pop(reg, None)
+        for k in [k for k, r in slots.items() if r == reg or k[0] == reg]:
+            del slots[k]
+    for i, item in enumerate(prog):
+        if item is None or item[1] == 'blank':
+            continue
+        if item[1] != 'ins':
+            slots.clear(); consts.clear(); continue
+        kind, reads, writes = _effects(item)
+        op, a = item[2], item[3]
+        if kind == 'store':
+            off, base = _mem(a[1])
+            if base not in _FRAME_BASES:
+                slots.clear()
+            else:
+                for k in [k for k in slots if k[0] != base or abs(k[1] - off) < 2]:
+                    del slots[k]
+                if op == 'sw':
+                    slots[(base, off)] = a[0]
+            continue
+        if kind == 'load' and op == 'lw' and _mem(a[1])[1] in _FRAME_BASES:
+            (off, base), b = _mem(a[1]), a[0]
+            if b == base:
+                forget(b); continue
+            held = slots.get((base, off))
+            if held == b:
+                prog[i] = None; n += 1; continue
+            if held is not None:
+                prog[i] = _ins('mv', b, held); n += 1
+            forget(b); slots[(base, off)] = b; continue
+        if op == 'li' and kind == 'def' and _int(a[1]) is not None:
+            if consts.get(a[0]) == _int(a[1]):
+                prog[i] = None; n += 1; continue
+            forget(a[0]); consts[a[0]] = _int(a[1]); continue
+        if kind in ('call', 'sys', 'j', 'jr', 'ret'):
+            slots.clear(); consts.clear(); continue
+        for r in writes:
+            forget(r)
+    return n
+
+_CMP_BASE = {'slt': ('blt', True), 'sltu': ('bltu', True), 'xor': ('bne', False),
+             'sub': ('bne', False)}
+
+def _rule_cmp_branch(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] not in _BRANCH:
+            continue
+        if item[2] in ('bz', 'bnz'):
+            n += _fuse_flag(prog, i, lab)
+        else:
+            n += _fuse_branchy(prog, i, lab, refs)
+    return n
+
+def _prev_ins(prog, i):
+    """The instruction directly before i with no label in between, or None."""
+    j = i - 1
+    while j >= 0 and (prog[j] is None or prog[j][1] == 'blank'):
+        j -= 1
+    return j if j >= 0 and prog[j][1] == 'ins' else None
+
+def _fuse_flag(prog, i, lab):
+    """[slt/sltu/xor/sub a, b]; [sltui a, 1 | xori a, 1]*; bnz/bz a, T -> one branch."""
+    a, target = prog[i][3]
+    chain, j = [], _prev_ins(prog, i)
+    while j is not None and prog[j][3] in ((a, '1'),) and prog[j][2] in ('sltui', 'xori'):
+        chain.append(j); j = _prev_ins(prog, j)
+    base = None
+    if j is not None and prog[j][2] in _CMP_BASE and len(prog[j][3]) == 2 \
+            and prog[j][3][0] == a and prog[j][3][1] in _REGS and prog[j][3][1] != a:
+        base = j
+    if base is None and not chain:
+        return 0
+    if base is None:
+        br, boolean, b = 'bnz', False, None
+    else:
+        br, boolean = _CMP_BASE[prog[base][2]]; b = prog[base][3][1]
+    for k in reversed(chain):                     # apply in program order
+        if prog[k][2] == 'xori' and not boolean:
+            return 0
+        br, boolean = _INVERSE[br], True
+    if prog[i][2] == 'bz':
+        br = _INVERSE[br]
+    if target not in lab or not _dead(prog, lab[target], a, lab) \
+            or not _dead(prog, i + 1, a, lab):
+        return 0
+    args = (a, target) if b is None else (a, b, target)
+    prog[i] = _ins(br, *args)
+    for k in chain + ([base] if base is not None else []):
+        prog[k] = None
+    return 1
+
+def _fuse_branchy(prog, i, lab, refs):
+    """Bcc .., t; li x6,0; j d; t: li x6,1; d: bnz/bz x6, T -> Bcc/Binv .., T."""
+    seq, j = [], i
+    for _ in range(6):
+        j = _next(prog, j + 1)
+        if j >= len(prog):
+            return 0
+        seq.append(j)
+    z, jd, tl, one, dl, last = [prog[k] for k in seq]
+    tname = _target(prog[i])
+    if not (z[1] == jd[1] == one[1] == last[1] == 'ins'
+            and tl[1] == dl[1] == 'label' and tl[2] == tname
+            and z[2] == 'li' and z[3] == ('x6', '0') and jd[2] == 'j' and len(jd[3]) == 1
+            and one[2] == 'li' and one[3] == ('x6', '1') and dl[2] == jd[3][0]
+            and last[2] in ('bz', 'bnz') and last[3][0] == 'x6'):
+        return 0
+    target = last[3][1]
+    if refs[tname] != 1 or refs[dl[2]] != 1 or target not in lab:
+        return 0
+    if not _dead(prog, lab[target], 'x6', lab) or not _dead(prog, seq[5] + 1, 'x6', lab):
+        return 0
+    br = prog[i][2] if last[2] == 'bnz' else _INVERSE[prog[i][2]]
+    prog[i] = _ins(br, *prog[i][3][:-1], target)
+    for k in seq:
+        prog[k] = None
+    return 1
+
+def _rule_forward_mv(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins':
+            continue
+        kind, reads, writes = _effects(item)
+        if not (kind in ('def', 'load') or item[2] == 'mv') or len(writes) != 1:
+            continue
+        j = _next_ins(prog, i + 1)
+        if j is None or prog[j][2] != 'mv' or _effects(prog[j])[0] != 'alu':
+            continue
+        b, a = prog[j][3]
+        if a != item[3][0] or b == a or not _dead(prog, j + 1, a, lab):
+            continue
+        prog[i] = _ins(item[2], b, *item[3][1:]); prog[j] = None; n += 1
+    return n
+
+def _rule_fold_mv(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] not in ('add', 'and', 'or', 'xor') \
+                or len(item[3]) != 2 or _effects(item)[0] != 'alu':
+            continue
+        b, a = item[3]
+        j = _next_ins(prog, i + 1)
+        if j is None or prog[j][2] != 'mv' or prog[j][3] != (a, b) or a == b:
+            continue
+        if _dead(prog, j + 1, b, lab):
+            prog[i] = _ins(item[2], a, b); prog[j] = None; n += 1
+    return n
+
+def _reads_from(item, a, b):
+    """item with its reads of register a made reads of b, or None when a is also
+    an operand it writes (or item is not a plain register instruction)."""
+    kind, reads, writes = _effects(item)
+    op, args = item[2], item[3]
+    if kind in ('alu', 'load'):
+        first, rest = args[:1], args[1:]
+        if first == (a,) and (kind == 'load' or op != 'mv'):
+            return None if kind == 'alu' else _ins(op, a, rest[0].replace(f"({a})", f"({b})"))
+    elif kind in ('store', 'branch', 'push', 'jr'):
+        first, rest = (), args
+    else:
+        return None
+    new = tuple(b if x == a else x.replace(f"({a})", f"({b})") if _mem(x) else x for x in rest)
+    return _ins(op, *(first + new))
+
+def _rule_copy_prop(prog, lab, refs):
+    """Register variables (codegen.REG_LOCALS) are copied into the temporaries before
+    use and back after an update; these forms read and update them in place."""
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins' or item[2] != 'mv' or _effects(item)[0] != 'alu':
+            continue
+        a, b = item[3]
+        j = _next_ins(prog, i + 1)
+        if a == b or j is None:
+            continue
+        nxt = prog[j]
+        kind, reads, writes = _effects(nxt)
+        if kind == 'alu' and nxt[2] != 'mv' and nxt[3][:1] == (a,):
+            k = _next_ins(prog, j + 1)
+            if k is None or prog[k][2] != 'mv' or prog[k][3] != (b, a) \
+                    or not _dead(prog, k + 1, a, lab):
+                continue
+            prog[i] = prog[k] = None
+            prog[j] = _ins(nxt[2], b, *(b if x == a else x for x in nxt[3][1:]))
+            n += 1
+            continue
+        if a not in reads:
+            continue
+        new = _reads_from(nxt, a, b)
+        if new is None:
+            continue
+        prog[j] = new
+        if _dead(prog, j, a, lab):
+            prog[i] = None; n += 1
+        else:
+            prog[j] = nxt
+    return n
+
+def _rule_dead_mv(prog, lab, refs):
+    n = 0
+    for i, item in enumerate(prog):
+        if item is None or item[1] != 'ins':
+            continue
+        kind, reads, writes = _effects(item)
+        if kind not in ('alu', 'def') or len(writes) != 1:
+            continue
+        (r,) = writes
+        if item[2] == 'mv' and item[3][0] == item[3][1]:
+            prog[i] = None; n += 1
+        elif r not in ('x1', 'x2', 'x3') and _dead(prog, i + 1, r, lab):
+            prog[i] = None; n += 1
+    return n
+
+RULES = [
+    ("dead_code", _rule_dead_code),
+    ("dead_label", _rule_dead_label),
+    ("jump_next", _rule_jump_next),
+    ("branch_over", _rule_branch_over),
+    ("short_jump", _rule_short_jump),
+    ("short_call", _rule_short_call),
+    ("push_pop", _rule_push_pop),
+    ("reload", _rule_reload),
+    ("cmp_branch", _rule_cmp_branch),
+    ("forward_mv", _rule_forward_mv),
+    ("fold_mv", _rule_fold_mv),
+    ("copy_prop", _rule_copy_prop),
+    ("dead_mv", _rule_dead_mv),
+]
+
+def enabled():
+    """Names of the rules that are on: module switch set and not listed in
+    ZX16_PEEPHOLE_OFF."""
+    off = {s.strip().lower() for s in os.environ.get("ZX16_PEEPHOLE_OFF", "").split(",")}
+    if "all" in off:
+        return []
+    return [name for name, _ in RULES if globals()[name.upper()] and name not in off]
+
+def _index(prog):
+    lab, refs = {}, Counter()
+    for i, item in enumerate(prog):
+        if item[1] == 'label':
+            lab[item[2]] = i
+        else:
+            refs.update(_WORD_RE.findall(item[0]))
+    return lab, refs
+
+def _load(text):
+    prog, opaque = [], False
+    for line in text.splitlines():
+        s = line.strip()
+        if s == ASM_BEGIN:
+            opaque = True
+        elif s == ASM_END:
+            opaque = False
+        prog.append((line, 'dir', None, ()) if opaque else _parse(line))
+    return prog
+
+def optimize(text, stats=None, rules=None):
+    """Rewrite assembly text to a fixed point of the enabled rules. stats, if given,
+    is a dict that receives rule name -> number of rewrites."""
+    active = set(enabled() if rules is None else rules)
+    prog = _load(text)
+    for _ in range(_MAX_ROUNDS):
+        changed = 0
+        for name, fn in RULES:
+            if name not in active:
+                continue
+            lab, refs = _index(prog)
+            k = fn(prog, lab, refs)
+            if k:
+                prog = [p for p in prog if p is not None]
+                changed += k
+                if stats is not None:
+                    stats[name] = stats.get(name, 0) + k
+        if not changed:
+            break
+    return "\n".join(p[0] for p in prog) + "\n"
+
+
+def bisect(src, base_dir=".", pre_run=None):
+    """Run src with the peephole off, all rules on, and each rule alone; returns
+    (reference output, {"all" | rule: output}) for the runs that differ."""
+    import codegen
+    sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+                                    "simulator"))
+    import zx16sim
+    raw = codegen.Codegen(codegen.zcc.parse(src, base_dir)).gen_program()
+    def out(asm):
+        o, sim = zx16sim.assemble_and_run(asm, pre_run=pre_run)
+        return o, sim.mmio_writes
+    ref = out(raw)
+    bad = {}
+    for name, rules in [("all", enabled())] + [(r, [r]) for r in enabled()]:
+        got = out(optimize(raw, rules=rules))
+        if got != ref:
+            bad[name] = got
+    return ref, bad
+
+
+if __name__ == "__main__":
+    import codegen
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    for path in args:
+        src, base = open(path).read(), os.path.dirname(os.path.abspath(path))
+        if "--bisect" in sys.argv:
+            ref, bad = bisect(src, base)
+            print(f"{path}: " + (", ".join(f"{k} changes the output" for k in bad)
+                                 if bad else "every rule preserves the output"))
+            continue
+        raw = codegen.Codegen(codegen.zcc.parse(src, base)).gen_program()
+        stats = {}
+        opt = optimize(raw, stats)
+        print(f"{path}: {len(raw.splitlines())} -> {len(opt.splitlines())} lines  "
+              + " ".join(f"{k}={v}" for k, v in stats.items()))
@@ -0,0 +1,65 @@
+"""Parallel case runner shared by the compiler test suites.
+
+A suite builds a list of (name, thunk) cases; thunk() returns True/False, an
+(ok, detail) pair, an (ok, detail, data) triple whose picklable `data` is handed back
+to the suite, or None (assert-style: passes unless it raises). run() spreads the
+list over a fork()ed process pool, one worker per core. Workers inherit the suite's
+module state, so only the case index crosses the process boundary and thunks may be
+closures or lambdas. Results come back in case order, each with its wall time.
+
+ZX16_JOBS=N overrides the worker count; ZX16_JOBS=1 runs everything in-process
+(handy under a debugger). Thunks must not print: workers' output would interleave.
+"""
+import os, sys, time
+import multiprocessing as mp
+
+def jobs():
+    n = os.environ.get("ZX16_JOBS")
+    return max(1, int(n)) if n else (os.cpu_count() or 1)
+
+_CASES = []
+
+def _run_one(i):
+    thunk = _CASES[i][1]
+    t0 = time.perf_counter()
+    data = None
+    try:
+        r = thunk()
+        if isinstance(r, tuple): ok, detail, data = (r + (None,))[:3]
+        else: ok, detail = r is None or bool(r), ""
+        status = "PASS" if ok else "FAIL"
+    except AssertionError as ex:
+        status, detail = "FAIL", str(ex)
+    except Exception as ex:
+        status, detail = "ERROR", f"{type(ex).__name__}: {ex}"
+    return status, detail, time.perf_counter() - t0, data
+
+def run(cases, workers=None):
+    """Run every case and print one line per case, in order. Returns a list of
+    (name, status, detail, seconds, data) with status PASS/FAIL/ERROR."""
+    global _CASES
+    _CASES = list(cases)
+    n = min(workers or jobs(), len(_CASES))
+    t0 = time.perf_counter()
+    if n > 1 and "fork" in mp.get_all_start_methods():
+        sys.stdout.flush()                     # don't duplicate buffered output in children
+        with mp.get_context("fork").Pool(n) as pool:
+            outcomes = pool.imap(_run_one, range(len(_CASES)))
+            results = [_report(name, o) for (name, _), o in zip(_CASES, outcomes)]
+    else:
+        n = 1
+        results = [_report(name, _run_one(i)) for i, (name, _) in enumerate(_CASES)]
+    busy = sum(r[3] for r in results)
+    print(f"  [{len(results)} cases on {n} worker{'s' if n > 1 else ''}: "
+          f"{time.perf_counter() - t0:.2f}s wall, {busy:.2f}s in cases]")
+    return results
+
+def _report(name, outcome):
+    status, detail, secs, data = outcome
+    line = f"{status} {name}"
+    if detail and status != "PASS": line += f": {detail}"
+    print(f"{line}  ({secs:.2f}s)", flush=True)
+    return name, status, detail, secs, data
+
+def passed(results):
+    return sum(1 for r in results if r[1] == "PASS")
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Single-pass assembly (ZX16Assembler.single_pass): tokenize_array() yields the same
+tokens as tokenize(); every example, dhrystone, the SoC firmware and
+assembler/examples assemble to the same sections and symbols in one pass as in two;
+forward references of every operand kind are backpatched; unknown symbols report
+as pass 2 reports them; pass 1 sizes `li rd, SYMBOL` as pass 2 emits it.
+"""
+import os, sys, glob
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER)
+import buildcache, codegen                             # noqa: E402
+import zx16asm as A                                    # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def image(text, single):
+    a = A.ZX16Assembler()
+    a.single_pass_mode = single
+    ok = a.assemble(text)
+    return a, (ok, {k: bytes(v) for k, v in a.sections.items()}, dict(a.section_addresses),
+               {n: s.value for n, s in a.symbols.items()},
+               [(e.message, e.line) for e in a.errors])
+
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+corpus = [(os.path.basename(p), buildcache.compile_src(open(p).read(), LIB)) for p in progs]
+save = codegen.INTRINSIC_IO
+codegen.INTRINSIC_IO = False                           # as soc_run.compile_firmware
+try:
+    corpus += [(os.path.basename(p), buildcache.compile_src(open(p).read(), LIB))
+               for p in sorted(glob.glob(os.path.join(ROOT, "rtl", "soc", "fw", "*.c")))]
+finally:
+    codegen.INTRINSIC_IO = save
+corpus += [(os.path.basename(p), open(p).read())
+           for p in sorted(glob.glob(os.path.join(ROOT, "assembler", "examples", "*.s")))]
+
+# 1) the array lexer against the per-character one, on the corpus and on odd input
+ODD = ["", "x", "'a' '\\n' '' 'b", '"ab\\"c\\\\d\n e" 1', "/* a\n b */ li x1, 0x1F\n/* open",
+       "lbl :\n .word -0x10, 0b101, 0o17, 0123\n x1: a_b1 +- -x", "\t\r\n\n#c\n(x2)", "/*/", '"abc']
+bad = [n for n, t in corpus + [(repr(o), o) for o in ODD]
+       if A.ZX16Lexer(t).tokenize() != A.ZX16Lexer(t).tokenize_array().to_tokens()]
+toks = A.ZX16Lexer(corpus[0][1]).tokenize_array()
+check(f"tokenize_array() == tokenize() on {len(corpus)} sources and {len(ODD)} odd inputs",
+      not bad and isinstance(toks.kinds, bytearray) and len(toks) == len(toks.values), bad)
+
+# 2) one pass == two passes, byte for byte
+bad = [n for n, t in corpus if image(t, True)[1] != image(t, False)[1]]
+lines = sum(len(t.splitlines()) for _, t in corpus)
+check(f"{len(corpus)} sources ({lines} lines): single pass == two passes", not bad, bad)
+b = buildcache.assemble(corpus[0][1])
+check("buildcache images come from the single pass",
+      b.binary == A.assemble(corpus[0][1]).binary())
+
+# 3) forward references: every operand kind, and .equ values defined after use
+FWD = """
+.text
+.org 0x0020
+main:
+    la   x5, msg
+    li16 x4, LATE
+    call sub
+    jal  x1, sub
+    bnz  x6, fwd
+    li   x3, SMALL
+    lw   x3, SMALL(x2)
+fwd:
+    j    main
+sub:
+    ret
+.equ LATE, 0x1234
+.equ SMALL, 5
+.data
+msg: .string "hi"
+"""
+one, r1 = image(FWD, True)
+two, r2 = image(FWD, False)
+check("branch, la, li16, call, jal, li and a load offset: 7 backpatched, == two passes",
+      r1 == r2 and r1[0] and one.patched == 7 and not one.fixups, (one.patched, r1, r2))
+
+# 4) what never gets defined
+UNDEF = "main:\n  j nowhere\n  la x1, msg\n  beq x1, x2, gone\nmsg: .word 1\n"
+_, r1 = image(UNDEF, True)
+_, r2 = image(UNDEF, False)
+want = [("Unknown symbol 'nowhere'", 2), ("Unknown symbol 'gone'", 4)]
+check("undefined symbols: the same errors at the same lines",
+      not r1[0] and r1[4] == want and all(e in r2[4] for e in want), (r1[4], r2[4]))
+
+# 5) a forward LI immediate that turns out not to fit its 2 bytes
+_, r1 = image("  li x1, BIG\n  ret\n.equ BIG, 300\n", True)
+check("forward `li` that needs LI16 is an error naming the symbol",
+      not r1[0] and len(r1[4]) == 1 and "'BIG'" in r1[4][0][0], r1[4])
+
+# 6) pass 1 used to count `li rd, SYMBOL`'s symbol as a second instruction
+LI_SYM = ".equ K, 5\n.equ W, 0x123\nmain:\n  li x1, K\n  li x2, W\nnext:\n  ret\n"
+_, r2 = image(LI_SYM, False)
+check("two passes: `li rd, SYMBOL` sized by its value (label after it at 0x26)",
+      r2[0] and r2[3]["next"] == 0x26 and r2 == image(LI_SYM, True)[1], r2)
+
+print(f"\n{npass}/{ntot} single-pass assembler checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""compiler/bench/bench_suite.py: the suite's table on the targets that run without an
+HDL simulator (golden sim, the AHB cycle model, the SoC model), and the baseline
+machinery. Every program prints what the golden simulator prints on every target and
+configuration; nothing regresses against compiler/bench/baseline.json (a change that
+costs instructions, cycles or bytes past the thresholds fails here, one that wins
+clears it with `bench_suite.py --update`); the JSON round-trips; compare() flags
+growth past a threshold only, CPI and compile time only when asked; merge() keeps rows of
+targets this run did not reach; unbaselined() names the rows --update has yet to record.
+With an HDL simulator the RTL targets run too.
+"""
+import os, sys
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+sys.path.insert(0, os.path.join(ROOT, "compiler", "bench"))
+import json, bench_suite as B                   # noqa: E402
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+MODELS = ("sim", "ahb-model", "soc-model")
+rows = B.collect(MODELS, repeat=1)
+names = [n for n, _ in B.PROGRAMS]
+want = {(n, t, c) for n in names for t, cs in
+        (("sim", ["-"]), ("soc-model", ["-"]),
+         ("ahb-model", [f"fwd={f} ws={w}" for f in (0, 1) for w in (0, 2)])) for c in cs}
+check(f"{len(rows)} rows: every program x target x configuration, each printing what "
+      "the golden simulator prints",
+      {B.key(r) for r in rows} == want and len(rows) == len(want)
+      and all(r["ok"] for r in rows), [B.key(r) for r in rows if not r["ok"]])
+by = {B.key(r): r for r in rows}
+check("the table's figures: CPI = cycles / instructions, FWD=1 below FWD=0, wait states "
+      "cost cycles, the model retires what the simulator retires",
+      all(by[n, "ahb-model", "fwd=1 ws=0"]["cycles"] < by[n, "ahb-model", "fwd=0 ws=0"]["cycles"]
+          < by[n, "ahb-model", "fwd=0 ws=2"]["cycles"]
+          and by[n, "ahb-model", "fwd=0 ws=2"]["instructions"] == by[n, "sim", "-"]["instructions"]
+          and abs(by[n, "ahb-model", "fwd=0 ws=2"]["cpi"] * by[n, "sim", "-"]["instructions"]
+                  - by[n, "ahb-model", "fwd=0 ws=2"]["cycles"]) < 1
+          and by[n, "sim", "-"]["text_bytes"] > 0 and by[n, "sim", "-"]["compile_ms"] > 0
+          for n in names))
+
+base = B.load(B.BASELINE)
+regressions, lines = B.compare(rows, base)
+check(f"no regression against {os.path.relpath(B.BASELINE, ROOT)} "
+      f"({len(base)} rows; +1% instructions / cycles / bytes is the limit)",
+      not regressions and all(B.key(r) in {B.key(b) for b in base} for r in rows),
+      regressions or [l for l in lines if "new" in l])
+
+check("--json: the rows round-trip, one row a line", json.loads(B.dump(rows))["rows"] == rows
+      and B.dump(rows).count("\n") == len(rows) + 2)
+
+one = [dict(by["fft", "ahb-model", "fwd=0 ws=0"])]
+def scaled(m, f):
+    r = dict(one[0]); r[m] = int(r[m] * f); return [r]
+slow, _ = B.compare(scaled("cycles", 1.05), one)
+noise, _ = B.compare(scaled("cycles", 1.005), one)
+faster, flines = B.compare(scaled("cycles", 0.9), one)
+win = dict(one[0], instructions=one[0]["instructions"] - 400, cycles=one[0]["cycles"] - 400)
+win["cpi"] = round(win["cycles"] / win["instructions"], 4)
+t = [dict(by["fft", "sim", "-"])]
+t2 = [dict(t[0], compile_ms=t[0]["compile_ms"] * 3)]
+check("compare(): +5% cycles regresses, +0.5% and -10% do not (-10% reported better); "
+      "fewer instructions and cycles at a higher CPI is no regression; CPI and compile "
+      "time are gated only with a threshold",
+      len(slow) == 1 and slow[0][1] == "cycles" and not noise and not faster
+      and win["cpi"] > one[0]["cpi"] and not B.compare([win], one)[0]
+      and B.compare([win], one, B.parse_thresholds(["cpi=0.01"]))[0]
+      and any("better" in l for l in flines) and not B.compare(t2, t)[0]
+      and B.compare(t2, t, B.parse_thresholds(["compile_ms=0.5"]))[0], (slow, noise, faster))
+
+rtl = B.row("fft", "ahb", "fwd=1 ws=2", instructions=4946, cycles=17000)
+merged = B.merge(base + [rtl], rows[:3])
+check("--update merges: this run's rows replace theirs, other targets' rows stay",
+      len(merged) == len(base) + 1 and rtl in merged
+      and all(r in merged for r in rows[:3]))
+check("a row with no baseline row is reported as ungated (the run fails until --update)",
+      B.unbaselined(rows + [rtl], base) == [B.key(rtl)] and not B.unbaselined([rtl], merged))
+
+if B.hdlsim.available():
+    rtl_rows = B.collect(("core", "ahb", "soc"), ws_list=(0,), repeat=1)
+    check(f"RTL targets: {len(rtl_rows)} rows, outputs match, CYCLES reported",
+          rtl_rows and all(r["ok"] and r["cycles"] for r in rtl_rows),
+          [B.key(r) for r in rtl_rows if not r["ok"]])
+else:
+    print(f"SKIP RTL targets ({B.hdlsim.backend()} not on the PATH)")
+
+print(f"\n{npass}/{ntot} benchmark suite checks passed")
+sys.exit(0 if npass == ntot else 1)
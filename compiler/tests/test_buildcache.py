@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Content-addressed build cache (compiler/buildcache.py): a warm build returns the
+same .s / image / .mem without compiling; a codegen flag, the set of peephole rules or
+a source edit misses; ZX16_CACHE=off bypasses the cache; assembly errors raise and
+are never stored.
+"""
+import os, sys, tempfile, shutil
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, codegen_patterns, zcc, codegen      # noqa: E402
+for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
+import buildcache                                      # noqa: E402
+import zx16sim as Z                                    # noqa: E402
+importlib.reload(buildcache)
+LIB = os.path.join(COMPILER, "lib")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+TMP = tempfile.mkdtemp(prefix="zx16cache_")
+os.environ["ZX16_CACHE"] = os.path.join(TMP, "a")
+SRC = '''#include "string.c"
+char s[8];
+int main(void){ strcpy(s, "cache"); putint(strlen(s)); putchar(s[0]); return 0; }
+'''
+def misses(): return buildcache.STATS["miss"]
+
+# 1) cold then warm: one miss, then a hit with byte-identical outputs
+m0 = misses()
+cold = buildcache.build(SRC, LIB)
+warm = buildcache.build(SRC, LIB)
+check("cold build misses, warm build hits", misses() - m0 == 1 and buildcache.STATS["hit"] >= 1,
+      buildcache.STATS)
+check("warm build returns the same asm/binary/mem", cold == warm)
+check("cached image runs", [v for _, v in Z.run_image(warm.binary)[0]] == [5, ord('c')])
+check("image matches a fresh compile + assemble",
+      warm.asm == codegen.compile_src(SRC, LIB) and len(warm.binary) == 0x10000
+      and warm.mem.count("\n") > 0)
+
+# 2) codegen flags are part of the key
+m0 = misses()
+codegen.INTRINSIC_IO = False
+try:
+    try:
+        buildcache.compile_src(SRC, LIB)
+    except Exception:
+        pass                      # no putint/putchar defined without intrinsics: fine
+finally:
+    codegen.INTRINSIC_IO = True
+check("INTRINSIC_IO change misses", misses() - m0 == 1)
+m0 = misses()
+save = codegen_patterns.STACK_TOP
+codegen_patterns.STACK_TOP = 0xC000
+try:
+    low = buildcache.build(SRC, LIB)
+finally:
+    codegen_patterns.STACK_TOP = save
+check("STACK_TOP change misses and changes the output", misses() - m0 == 1 and low.asm != warm.asm)
+m0 = misses()
+os.environ["ZX16_PEEPHOLE_OFF"] = "all"
+try:
+    raw = buildcache.build(SRC, LIB)
+finally:
+    del os.environ["ZX16_PEEPHOLE_OFF"]
+check("ZX16_PEEPHOLE_OFF change misses and changes the output",
+      misses() - m0 == 1 and raw.asm != warm.asm)
+
+# 3) an edit to an #included file changes the preprocessed source
+inc_dir = os.path.join(TMP, "inc"); os.makedirs(inc_dir)
+with open(os.path.join(inc_dir, "k.c"), "w") as f: f.write("#define K 1\n")
+prog = '#include "k.c"\nint main(void){ putint(K); return 0; }\n'
+a = buildcache.build(prog, inc_dir)
+with open(os.path.join(inc_dir, "k.c"), "w") as f: f.write("#define K 2\n")
+b = buildcache.build(prog, inc_dir)
+check("edited include is rebuilt", [v for _, v in Z.run_image(a.binary)[0]] == [1]
+      and [v for _, v in Z.run_image(b.binary)[0]] == [2])
+
+# 4) bypass + errors
+os.environ["ZX16_CACHE"] = "off"
+m0 = misses()
+check("ZX16_CACHE=off builds without the cache", buildcache.build(SRC, LIB) == cold
+      and misses() == m0)
+os.environ["ZX16_CACHE"] = os.path.join(TMP, "b")
+raised = 0
+for _ in range(2):
+    try:
+        buildcache.assemble(".text\n    bogus x1, x2\n")
+    except RuntimeError as ex:
+        raised += "assembly failed" in str(ex)
+check("assembly errors raise every time (never cached)", raised == 2)
+check("failed assembly left nothing in the cache", not os.path.exists(os.path.join(TMP, "b")))
+shutil.rmtree(TMP, ignore_errors=True)
+
+print(f"\n{npass}/{ntot} build-cache checks passed")
+sys.exit(0 if npass == ntot else 1)
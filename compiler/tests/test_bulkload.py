@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""The debug monitor's framed 'B' load (rtl/soc/fw/monitor.c) against soc_run's host
+side, on the UART model. A payload's populated blocks go out as CRC-16/CCITT frames,
+each acked 'K'; zero blocks and .bss are fill frames with no data; the end frame jumps
+to the payload. A host at the full line rate never overruns the RX FIFO; a corrupted
+byte or a dropped byte gets 'N' and the frame is resent; an oversized frame is
+refused; a link that never acks fails after the retries. A scripted run (no waiting
+for acks) loads the same way.
+"""
+import os, sys
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+SOC = os.path.join(ROOT, "rtl", "soc")
+sys.path.insert(0, os.path.join(ROOT, "simulator")); sys.path.insert(0, SOC)
+import importlib, zx16sim as Z, zx16soc as S      # noqa: E402
+importlib.reload(Z); importlib.reload(S)
+import soc_run, zx16asm                           # noqa: E402
+MON = os.path.join(SOC, "fw", "monitor.c")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+# the payload: print the word at 0xA000 and halt; a 512-byte table, a 600-byte hole of
+# zeros inside .text, and a .bss that must come out zero over dirty memory
+PAY = """
+.text
+.org 0x9000
+    li16 x5, 0xA000
+    lw   x6, 0(x5)
+    li16 x5, 0xC008
+    sw   x6, 0(x5)
+    ecall 0x3FF
+.org 0x9800
+tbl: .space 512
+hole: .space 600
+    .word 0x4B4B
+.data
+.org 0xA000
+    .word 0x5A
+.bss
+.org 0xA400
+buf: .space 1024
+"""
+img = zx16asm.assemble(PAY, "payload.s").check()
+flat = bytearray(img.binary()); flat[0x9800:0x9A00] = bytes(range(256)) * 2
+flat = bytes(flat)
+segs = zx16asm.image_segments(flat, [(img.section_addresses[name], len(data))
+                                     for name, data in img.sections.items() if data])
+mon = soc_run.compile_firmware(MON)
+
+def monitor():
+    sim = Z.ZX16(); sim.load(mon, 0); sim.max_cycles = 10**7
+    uart, _ = S.attach(sim)
+    sim.mem[0xA400:0xA800] = b"\xAA" * 0x400              # a previous program's .bss
+    return sim, uart
+def loaded(sim):
+    return all(bytes(sim.mem[a:a + n]) == flat[a:a + n] for a, n, _ in segs)
+def load(mangle=None, retries=3, image=segs):
+    sim, uart = monitor()
+    send, recv = soc_run.model_link(sim, uart, mangle=mangle)
+    while recv() != ord(">"): pass
+    c0 = sim.cycles
+    try:
+        st = soc_run.host_load(send, recv, image, go=0x9000, retries=retries)
+    except RuntimeError as e:
+        st = e
+    sim.run(until=sim.cycles + 20000)
+    return sim, uart, st, sim.cycles - c0
+
+# 1) the frames
+frames = soc_run.load_frames(segs, go=0x9000)
+kinds = [(hex(int.from_bytes(f[:2], "little")), int.from_bytes(f[2:4], "little"))
+         for f in frames]
+check("CRC-16/CCITT check value; frames: data blocks of <= 256 bytes, the zero hole and "
+      "the .bss as fills, the end frame to 0x9000",
+      soc_run.crc16(b"123456789") == 0x29B1 and kinds[-1] == ("0x9000", 0)
+      and ("0xa400", 0x8400) in kinds and any(n & 0x8000 and 0x9A00 <= int(a, 16) < 0x9C58
+                                              for a, n in kinds)
+      and all(n <= 256 for _, n in kinds if not n & 0x8000), kinds)
+
+# 2) at the full line rate, acked frame by frame
+sim, uart, st, cyc = load()
+raw = len(b"L 9000 XXXX\n") + 0xA002 - 0x9000 + len(b"L A400 400\n") + 0x400
+check(f"host_load(): {st['frames']} frames, {st['bytes']} bytes on the wire (an 'L' "
+      f"load of the same ranges: {raw}, >= {raw * 160} cycles) in {cyc} cycles; no overrun; "
+      f"then the payload runs",
+      st["resent"] == 0 and loaded(sim) and bytes(uart.drain()).endswith(b">" + b"K" *
+      st["frames"] + b"\nZ") and sim.halted and not sim.lw(0xC090) & 1
+      and st["bytes"] * 4 < raw and cyc * 4 < raw * 160, (st, cyc))
+
+# 3) errors on the line
+def corrupt(at, kind):                    # send number `at` (1 is the "B")
+    n = [0]
+    def mangle(data):
+        n[0] += 1
+        if n[0] != at: return data
+        d = bytearray(data)
+        if kind == "flip": d[10] ^= 0x40
+        else: del d[10]
+        return bytes(d)
+    return mangle
+for kind, what in (("flip", "a flipped bit fails the CRC"),
+                   ("drop", "a dropped byte times out mid-frame")):
+    sim, uart, st, _ = load(corrupt(4, kind))
+    check(f"{what}: 'N', the frame is resent and the load completes",
+          not isinstance(st, Exception) and st["resent"] == 1 and loaded(sim)
+          and b"KN" in bytes(uart.drain()) and sim.halted, st)
+sim, uart, st, _ = load(lambda d: d[:-1] + bytes([d[-1] ^ 1]) if len(d) > 1 else d,
+                        retries=2)
+check("a link that corrupts every frame fails after the retries, nothing written",
+      isinstance(st, RuntimeError) and "frame 0" in str(st)
+      and bytes(sim.mem[0x9000:0x9010]) == bytes(16)
+      and bytes(uart.drain()).endswith(b">NNN"), st)
+sim, uart = monitor()
+send, recv = soc_run.model_link(sim, uart)
+while recv() != ord(">"): pass
+send(b"B" + soc_run.load_frame(0xB000, bytes(range(256)) + b"x"))
+nak = recv()
+send(soc_run.load_frame(0)); end = bytes([recv(), recv()])
+send(b"q\n"); sim.run()
+check("a frame over LOAD_BLOCK is refused ('N') and writes nothing; the load goes on",
+      (nak, end) == (ord("N"), b"K\n") and bytes(sim.mem[0xB000:0xB101]) == bytes(257)
+      and bytes(uart.drain()).endswith(b"K\n>bye\n"), (nak, end, bytes(uart.sent)))
+
+# 4) scripted, without waiting for the acks (what run() can give the RTL testbench)
+r = soc_run.run_model(MON, rx=soc_run.bulk_load(flat, go=0x9000), max_cycles=10**6)
+n = len(soc_run.load_frames(flat))
+check(f"scripted bulk_load() of the flat image ({n} frames): acked, then the payload "
+      f"prints 'Z'", r["halted"] and r["text"] == "ZX16MON\n>" + "K" * n + "\nZ", r["text"])
+
+print(f"\n{npass}/{ntot} bulk-load checks passed")
+sys.exit(0 if npass == ntot else 1)
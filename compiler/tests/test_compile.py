@@ -10,10 +10,10 @@ import importlib
 import codegen_patterns, zcc, codegen
 importlib.reload(codegen_patterns); importlib.reload(zcc); importlib.reload(codegen)
 import zx16sim as Z
+import harness, buildcache
 
 def run(src):
-    asm=codegen.compile_src(src)
-    out,sim=Z.assemble_and_run(asm)
+    out,sim=Z.run_image(buildcache.build(src).binary)
     return [v for (k,v) in out]
 
 CASES=[]
@@ -112,6 +112,22 @@ int main(void){
 }
 ''', [42])
 
+# an array field evaluates to its address, as an array variable does
+case("struct_array_field", '''
+struct Q { int n; unsigned char b[4]; int w[3]; };
+struct Q g;
+int sum(int *v, int k){ int s; s = 0; while (k > 0){ k = k - 1; s = s + v[k]; } return s; }
+int main(void){
+  struct Q *q; struct Q l; int i;
+  q = &g; i = 2;
+  q->b[i] = 7; g.b[1] = 5; q->n = 9;
+  q->w[0] = 100; q->w[i] = 300; g.w[1] = 200; l.w[1] = 40; l.b[3] = 2;
+  putint(q->b[2]); putint(*(q->b + 1)); putint(q->n);
+  putint(sum(q->w, 3)); putint(l.w[1] + l.b[3]);
+  return 0;
+}
+''', [7, 5, 9, 600, 42])
+
 case("unsigned_cmp", '''
 int main(void){
   unsigned a; unsigned b;
@@ -131,15 +147,13 @@ int main(void){
 }
 ''', [65,66])
 
+def check_case(src, expect):
+    got=run(src)
+    return got==expect, f"got {got} expected {expect}"
+
 if __name__=='__main__':
-    passed=0
-    for (name,src,expect) in CASES:
-        try:
-            got=run(src)
-            if got==expect:
-                print(f"PASS {name}"); passed+=1
-            else:
-                print(f"FAIL {name}: got {got} expected {expect}")
-        except Exception as ex:
-            print(f"ERROR {name}: {type(ex).__name__}: {ex}")
+    results=harness.run([(name, lambda src=src, expect=expect: check_case(src, expect))
+                         for (name,src,expect) in CASES])
+    passed=harness.passed(results)
     print(f"\n{passed}/{len(CASES)} end-to-end programs compiled and ran correctly")
+    sys.exit(0 if passed==len(CASES) else 1)
@@ -14,6 +14,7 @@ sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator")
 import importlib, codegen_patterns, zcc, codegen      # noqa: E402
 for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
 import zx16sim as Z                                    # noqa: E402
+import harness                                         # noqa: E402
 
 def s16(x): x &= 0xFFFF; return x - 0x10000 if x & 0x8000 else x
 def u16(x): return x & 0xFFFF
@@ -45,34 +46,35 @@ def run(src):
     out, _ = Z.assemble_and_run(codegen.compile_src(src))
     return [v for k, v in out]
 
-npass = nfail = 0
-def section(name, decl, avals, bvals, refdiv, refmod):
-    global npass, nfail
-    got = run(gen(decl, avals, bvals)); k = 0; fails = []
+def section(decl, avals, bvals, refdiv, refmod):
+    got = run(gen(decl, avals, bvals)); k = 0; fails = []; ok = 0
     for a in avals:
         for b in bvals:
             eq, em = s16(refdiv(a, b)), s16(refmod(a, b))
             gq, gm = got[k], got[k + 1]; k += 2
-            if gq == eq and gm == em: npass += 1
-            else:
-                nfail += 1
-                if len(fails) < 6: fails.append(f"{a}/{b}: q {gq}!={eq} or r {gm}!={em}")
-    print(f"  {name:<26} {('PASS' if not fails else 'FAIL')}  ({len(avals)*len(bvals)} pairs)")
-    for f in fails: print("      " + f)
-
-print("divide/modulo correctness:")
-section("signed",   "int",      AV, BV, cdiv, cmod)
-section("unsigned", "unsigned", UV, UD, lambda a, b: u16(a) // u16(b),
-        lambda a, b: u16(a) % u16(b))
+            if gq == eq and gm == em: ok += 1
+            elif len(fails) < 6: fails.append(f"{a}/{b}: q {gq}!={eq} or r {gm}!={em}")
+    n = len(avals) * len(bvals)
+    return not fails, "\n      " + "\n      ".join(fails) if fails else "", (ok, n)
 
 # spot cases that used to fail outright
-spot = run("int main(void){ unsigned u; int a; u=65535; a=-7;"
-           " putint(u/10); putint(u%10); putint(a/2); putint(a%2);"
-           " putint(7/a); putint(7%a); return 0; }")
-exp = [6553, 5, -3, -1, -1, 0]   # ...; 7/-7=-1; 7%-7 = 7-(-1)(-7) = 0
-ok = spot == exp
-npass += ok; nfail += (not ok)
-print(f"  {'regression spot-cases':<26} {'PASS' if ok else 'FAIL'}   got={spot} exp={exp}")
+def spot():
+    got = run("int main(void){ unsigned u; int a; u=65535; a=-7;"
+              " putint(u/10); putint(u%10); putint(a/2); putint(a%2);"
+              " putint(7/a); putint(7%a); return 0; }")
+    exp = [6553, 5, -3, -1, -1, 0]   # ...; 7/-7=-1; 7%-7 = 7-(-1)(-7) = 0
+    return got == exp, f"got={got} exp={exp}", (int(got == exp), 1)
+
+print("divide/modulo correctness:")
+results = harness.run([
+    (f"signed ({len(AV)*len(BV)} pairs)",
+     lambda: section("int", AV, BV, cdiv, cmod)),
+    (f"unsigned ({len(UV)*len(UD)} pairs)",
+     lambda: section("unsigned", UV, UD, lambda a, b: u16(a) // u16(b),
+                     lambda a, b: u16(a) % u16(b))),
+    ("regression spot-cases", spot)])
+npass = sum(r[4][0] for r in results if r[4]); ntot = sum(r[4][1] for r in results if r[4])
+nfail = ntot - npass + sum(1 for r in results if r[4] is None)
 
 print(f"\n{npass}/{npass+nfail} divide/modulo cases correct")
 sys.exit(0 if nfail == 0 else 1)
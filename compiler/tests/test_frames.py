@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Leaf frames (codegen.LEAF_FRAMES) and direct calls (peephole short_call). A leaf
+that never moves sp gets no frame at all, one that pushes keeps only the frame
+pointer, and a runtime call, an asm() block or slots beyond lw/sw's reach keep the
+full frame; near calls become jal and far ones stay la + jalr. Every example +
+dhrystone must print the same values and leave the same MMIO write log with leaf
+frames on and off. Reports the code-size and cycle deltas on md5 / fft / dhrystone.
+"""
+import os, sys, glob, re
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+sys.path.insert(0, os.path.join(ROOT, "assembler"))
+import importlib, codegen_patterns, zcc, peephole, codegen    # noqa: E402
+for m in (codegen_patterns, zcc, peephole, codegen): importlib.reload(m)
+import zx16asm as A                                            # noqa: E402
+import zx16sim as Z                                            # noqa: E402
+import harness                                                 # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+def compile_with(src, leaf=True, short_call=True, reg_temps=True):
+    """Inlining off: the frames and calls under test stay where the source has them."""
+    codegen.LEAF_FRAMES, peephole.SHORT_CALL, codegen.REG_TEMPS = leaf, short_call, reg_temps
+    codegen.INLINE = False
+    try:
+        return codegen.compile_src(src, LIB)
+    finally:
+        codegen.LEAF_FRAMES, peephole.SHORT_CALL, codegen.REG_TEMPS = True, True, True
+        codegen.INLINE = True
+
+def func(asm, name):
+    """The instructions of function `name` (up to the next global label)."""
+    lines = asm[asm.index(f"\n{name}:") + 1:].splitlines()[1:]
+    end = next((i for i, l in enumerate(lines) if re.match(r"[A-Za-z]\w*:$", l)), len(lines))
+    return [l.strip() for l in lines[:end] if l.strip() and not l.endswith(":")]
+
+def run(asm):
+    return [v for _, v in Z.assemble_and_run(asm)[0]]
+
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+
+CASES = []
+# 1) which frame each kind of function gets
+SHAPES = """
+int isdig(int c) { return c >= 48 & c <= 57; }
+int sum(int *a, int n) { int s; int i; s = 0; i = 0;
+  while (i < n) { s = s + a[i]; i = i + 1; } return s; }
+int mul(int a, int b) { return a * b; }
+int many(int a, int b, int c, int d, int e) { return a + e; }
+int main(void) { int v[3]; v[0] = 5; v[1] = 6; v[2] = isdig(55);
+  putint(sum(v, 3)); putint(mul(6, 7)); putint(many(1, 2, 3, 4, 5)); putint(nop());
+  return 0; }
+int nop(void) { asm("nop"); return 1; }
+"""
+WANT = [12, 42, 6, 1]
+def shapes_case():
+    asm = compile_with(SHAPES)
+    f = {n: func(asm, n) for n in ("isdig", "sum", "mul", "many", "nop", "main")}
+    bad = []
+    if any(l.startswith(("push", "pop", "mv x3")) or "x3" in l for l in f["isdig"]):
+        bad.append("isdig has a frame")
+    if any("x1" in l for l in f["sum"]) or f["sum"][:2] != ["push x3", "mv x3, x2"]:
+        bad.append("sum should be a frameless leaf or an fp-only leaf")
+    for n in ("mul", "nop", "main"):
+        if f[n][:3] != ["push x1", "push x3", "mv x3, x2"]:
+            bad.append(f"{n} lost its full frame")
+    if f["many"][:2] != ["push x3", "mv x3, x2"]:
+        bad.append("many: param 4 is out of sp's reach, wants the fp-only leaf")
+    out = run(asm)
+    return out == WANT and not bad, (bad, out)
+CASES.append(("frames: none for isdig, fp-only for sum / many, full for mul, asm, main",
+              shapes_case))
+def stack_leaf_case():
+    asm = compile_with(SHAPES, reg_temps=False)
+    f = func(asm, "isdig")
+    return (f[:2] == ["push x3", "mv x3, x2"] and "push x1" not in f
+            and run(asm) == WANT), f
+CASES.append(("a leaf that pushes (stack machine) keeps x3 and drops the ra save",
+              stack_leaf_case))
+
+# 2) direct calls only when the assembler would take them
+def calls_case():
+    asm = compile_with(SHAPES)
+    near = [l for l in func(asm, "main") if l.startswith(("jal ", "jalr"))]
+    pad = "int pad(void) { " + "putint(1); " * 200 + "return 0; }\n"
+    far_asm = compile_with(SHAPES.replace("int main(void) {", pad + "int main(void) {")
+                           .replace("putint(nop());", "putint(nop()); pad();"))
+    m = [l for l in func(far_asm, "main") if l.startswith(("jal ", "jalr", "la x5"))]
+    ok = (near == ["jal x1, isdig", "jal x1, sum", "jal x1, mul", "jal x1, many",
+                   "jal x1, nop"]                       # nop's asm() is after its label
+          and m[:2] == ["la x5, isdig", "jalr x1, x5"] and "jal x1, nop" in m
+          and run(far_asm) == WANT + [1] * 200)
+    return ok, (near, m)
+CASES.append(("short_call: jal within ±512 bytes, la + jalr past an 800-byte function", calls_case))
+
+# 3) differential over the examples and dhrystone
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+def differential(path):
+    src = open(path).read()
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    old, new = compile_with(src, False, False), compile_with(src)
+    (o0, s0), (o1, s1) = Z.assemble_and_run(old, pre_run=pre), Z.assemble_and_run(new, pre_run=pre)
+    size = [len(A.assemble(t).check().sections[".text"]) for t in (old, new)]
+    ok = o0 == o1 and s0.mmio_writes == s1.mmio_writes
+    return ok, f"cycles {s0.cycles} -> {s1.cycles}", (os.path.basename(path), s0.cycles,
+                                                      s1.cycles, *size)
+for p in progs:
+    CASES.append((f"{os.path.basename(p)}: leaf frames + short calls == full frames + la/jalr",
+                  lambda p=p: differential(p)))
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data and data[0] in ("08_md5.c", "09_fft.c", "dhrystone.c"):
+        print(f"  {data[0]:<14} cycles {data[1]:>9} -> {data[2]:>9} "
+              f"({100.0 * (data[2] - data[1]) / data[1]:+.1f}%)   .text {data[3]:>5} -> "
+              f"{data[4]:>5} B")
+print(f"\n{npass}/{len(CASES)} frame checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""Idle-loop skipping in ZX16.run() (self.idle_skip). A polling loop that neither
+stores nor prints and comes back to its head with the same registers is
+fast-forwarded to the next cycle anything it reads can change: a device's
+idle_until(), the next device event (an interrupt) or the run's limit. Every example
++ dhrystone, the SoC firmware on the peripheral models and an interrupt-driven soak
+end in the same state (cycles, pc, registers, memory, output, the cycle each IRQ is
+taken on) with it on and off; scripted MMIO reads and a read of the running timer's
+CNT are never skipped over, run(until) and the cycle limit still stop exactly, and a
+loop whose registers change is just run.
+"""
+import os, sys, glob, time
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+SOC = os.path.join(ROOT, "rtl", "soc")
+sys.path.insert(0, os.path.join(ROOT, "compiler"))
+sys.path.insert(0, os.path.join(ROOT, "simulator")); sys.path.insert(0, SOC)
+import importlib, buildcache, zx16sim as Z, zx16soc as S     # noqa: E402
+importlib.reload(Z); importlib.reload(S)
+import soc_run, test_irq_soc                                 # noqa: E402
+FW = os.path.join(SOC, "fw")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def state(sim):
+    return (sim.out, sim.cycles, sim.pc, sim.reg, bytes(sim.mem), sim.halted)
+
+def both(make, until=None):
+    """Run the simulator make() builds with idle skipping off, then on; return the
+    two (sim, extra) pairs and the seconds each took."""
+    runs = []
+    for skip in (False, True):
+        sim, extra = make()
+        sim.idle_skip = skip
+        t0 = time.time()
+        try:
+            sim.run(until)
+        except Exception as ex:                  # the cycle limit: part of the state
+            extra = (extra, str(ex))
+        runs.append((sim, extra, time.time() - t0))
+    return runs
+
+# 1) the examples and dhrystone: nothing changes (they compute, not wait)
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+progs = sorted(glob.glob(os.path.join(ROOT, "compiler", "examples", "*.c")))
+progs.append(os.path.join(ROOT, "compiler", "bench", "dhrystone.c"))
+bad = []
+for path in progs:
+    binary = buildcache.build(open(path).read()).binary
+    def make():
+        sim = Z.ZX16(); sim.load(binary, 0)
+        if os.path.basename(path).startswith("02_"): script02(sim)
+        return sim, None
+    (off, *_), (on, *_) = both(make)
+    if state(off) != state(on) or off.mmio_writes != on.mmio_writes:
+        bad.append(os.path.basename(path))
+check(f"{len(progs)} examples + dhrystone: the same state with idle skipping on and off",
+      not bad, bad)
+
+# 2) SoC firmware on the peripheral models
+def soc(image, rx=None, taken=None, limit=150000):
+    def make():
+        sim = Z.ZX16(); sim.load(image, 0); sim.max_cycles = limit
+        uart, tmr = S.attach(sim)
+        if rx: uart.feed(rx, at=5000)
+        if taken is not None:
+            log = []; real = sim.step
+            def step():                         # the cycle each interrupt is taken on
+                if sim.ie and sim.irq_pending: log.append(sim.cycles)
+                real()
+            sim.step = step
+            return sim, (uart, log)
+        return sim, (uart, None)
+    return make
+def same(runs):
+    (off, (u0, l0), _), (on, (u1, l1), _) = runs
+    return (state(off) == state(on) and u0.drain() == u1.drain() and l0 == l1
+            and off.idle_cycles == 0)
+for name, rx, want in [("hello.c", None, 0.3), ("tmr.c", None, 0.3),
+                       ("monitor.c", "w A000 ABCD\nr A000\nd A000 2\nq\n", 0.5),
+                       ("monitor.c", None, 0.99)]:
+    runs = both(soc(soc_run.compile_firmware(os.path.join(FW, name)), rx), 150000)
+    on = runs[1][0]
+    frac = on.idle_cycles / on.cycles
+    check(f"{name}{' with input' if rx else ''}: the same transcript and cycles "
+          f"({on.cycles}), {100 * frac:.1f}% of them skipped waiting on the UART / timer",
+          same(runs) and frac > want, (frac, runs[1][1][0].sent))
+
+# 3) an interrupt-driven soak: test_irq_soc.ASM with a 60000-PCLK timer, 50 IRQs
+ASM = (test_irq_soc.ASM.replace("li16 x6, 99\n", "li16 x6, 60000\n")
+       .replace("li16 x4, 3\n", "li16 x4, 50\n"))
+image = soc_run.assemble_image(ASM, "soak.s")
+runs = both(soc(image, taken=True, limit=10**7))
+(off, (u0, l0), t0), (on, (u1, l1), t1) = runs
+check(f"timer-IRQ soak: 50 interrupts on the same cycles, {on.cycles} cycles in "
+      f"{t1:.3f}s instead of {t0:.3f}s ({100 * on.idle_cycles / on.cycles:.2f}% skipped)",
+      same(runs) and len(l1) == 50 and on.mem[0xA000] == 50
+      and on.idle_cycles > 0.99 * on.cycles, (len(l1), on.idle_cycles, on.cycles))
+
+# 4) what is not skipped, and the limits
+POLL = """
+.text
+.org 0x0020
+    li16 x5, 0xF020
+wait:
+    lb   x6, 0(x5)
+    bz   x6, wait
+    li16 x6, 7
+    ecall 0x000
+spin:
+    lb   x6, 0(x5)
+    j    spin
+"""
+poll = Z.load_assembler().assemble(POLL).check().binary()
+def scripted():
+    sim = Z.ZX16(); sim.load(poll, 0); sim.max_cycles = 200000
+    sim.mmio_read_script[0xF020] = [0] * 40 + [1]
+    sim.mmio_regs[0xF020] = 0
+    return sim, None
+runs = both(scripted)
+(off, e0, _), (on, e1, t1) = runs
+check("scripted MMIO: the 41 queued reads are all taken, then the endless poll on a "
+      "plain register hits the cycle limit on the same cycle, skipped",
+      state(off) == state(on) and e0 == e1 and "cycle limit" in str(e1)
+      and [v for _, v in on.out] == [7] and on.idle_cycles > 0.99 * on.cycles
+      and not on.mmio_read_script[0xF020], (e1, on.idle_cycles, on.cycles))
+
+CNT = """
+.text
+.org 0x0020
+    li16 x5, 0xD108
+    li16 x6, 999
+    sw   x6, 0(x5)
+    li16 x5, 0xD000
+    li16 x6, 1
+    sw   x6, 0(x5)
+    li16 x5, 0xD100
+    li16 x4, 900
+wait:
+    lw   x6, 0(x5)
+    bltu x6, x4, wait
+    ecall 0x3FF
+"""
+cnt = Z.load_assembler().assemble(CNT).check().binary()
+def counter():
+    sim = Z.ZX16(); sim.load(cnt, 0); S.attach(sim)
+    return sim, None
+(off, *_), (on, *_) = both(counter)
+check("a loop reading the running timer's CNT is run, not skipped",
+      state(off) == state(on) and on.halted and on.idle_cycles == 0, on.idle_cycles)
+
+COUNT = """
+.text
+.org 0x0020
+    li16 x6, 3000
+loop:
+    addi x6, -1
+    bnz  x6, loop
+    ecall 0x3FF
+"""
+count = Z.load_assembler().assemble(COUNT).check().binary()
+def counting():
+    sim = Z.ZX16(); sim.load(count, 0)
+    return sim, None
+(off, *_), (on, *_) = both(counting)
+check("a loop whose registers change is run, not skipped",
+      state(off) == state(on) and on.halted and on.idle_cycles == 0, on.idle_cycles)
+
+mon = soc_run.compile_firmware(os.path.join(FW, "monitor.c"))
+(off, (u0, _), _), (on, (u1, _), _) = both(soc(mon), 12345)
+check("run(until) inside a skipped wait stops on that exact cycle",
+      state(off) == state(on) and on.cycles == 12345 and on.idle_cycles > 0, on.cycles)
+
+print(f"\n{npass}/{ntot} idle-skip checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Segment-list images and sparse memh (zx16asm -f zxi / --mem-sparse). For every
+example, dhrystone and a zx16ld-linked build the .zxi file and the sparse $readmemh
+text (16-bit words, and the SoC's 32-bit words from soc_run.pack_memh) describe
+exactly the flat 64 KB image in a fraction of its size; .bss and .org gaps are
+zero-fill records that clear memory on load; ZX16.load_image_file() mmaps the file
+and runs the same as load(); malformed files are rejected; the zx16asm and zx16ld
+command lines write the format.
+"""
+import os, sys, glob, subprocess, tempfile
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+ASMDIR = os.path.join(ROOT, "assembler")
+sys.path.insert(0, os.path.join(ROOT, "compiler")); sys.path.insert(0, ASMDIR)
+sys.path.insert(0, os.path.join(ROOT, "simulator"))
+sys.path.insert(0, os.path.join(ROOT, "rtl", "soc"))
+import importlib, zx16asm as A, zx16sim as Z     # noqa: E402
+importlib.reload(A); importlib.reload(Z)
+import buildcache, soc_run                       # noqa: E402
+LIB = os.path.join(ROOT, "compiler", "lib")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def readmemh(text, width=16):
+    """What $readmemh leaves in a cleared memory: the flat image back."""
+    wb, out, at = width // 8, bytearray(0x10000), 0
+    for line in text.splitlines():
+        line = line.split("#")[0].strip()
+        if not line: continue
+        if line.startswith("@"):
+            at = int(line[1:], 16); continue
+        out[at * wb:(at + 1) * wb] = int(line, 16).to_bytes(wb, "little")
+        at += 1
+    return bytes(out)
+
+TMP = tempfile.mkdtemp(prefix="zx16image_")
+
+# 1) every example + dhrystone, and a linked build
+progs = sorted(glob.glob(os.path.join(ROOT, "compiler", "examples", "*.c")))
+progs.append(os.path.join(ROOT, "compiler", "bench", "dhrystone.c"))
+bad, zsize, msize, dsize = [], 0, 0, 0
+for path in progs:
+    asm = buildcache.build(open(path).read(), LIB).asm
+    img = A.assemble(asm, path, single_pass=True).check()
+    flat, zxi, mem = img.binary(), img.image_file(), img.memory_file(sparse=True)
+    if (A.segments_to_flat(A.unpack_image(zxi)) != flat or readmemh(mem) != flat
+            or readmemh(soc_run.pack_memh(flat, sparse=True), 32) != flat):
+        bad.append(os.path.basename(path))
+    zsize += len(zxi); msize += len(mem); dsize += len(img.memory_file())
+check(f"{len(progs)} examples + dhrystone: .zxi, sparse memh and 32-bit memh give the "
+      f"flat image back ({zsize} B of .zxi for {len(progs)} x 64 KB, {msize} B of sparse "
+      f"memh instead of {dsize} B)", not bad and zsize * 50 < len(progs) * 0x10000
+      and msize * 50 < dsize, bad)
+linked = buildcache.build_linked(open(os.path.join(ROOT, "compiler", "examples",
+                                                   "04_checksum.c")).read(), LIB)
+limg = A.segments_to_flat(A.unpack_image(A.pack_image(A.image_segments(linked.binary))))
+check("a zx16ld-linked build: the Build's sparse .mem and its segments are the image",
+      limg == linked.binary and readmemh(linked.mem) == linked.binary
+      and "@10\n" in linked.mem)
+
+# 2) .bss and .org gaps: zero fill, loaded over dirty memory
+BSS = """
+.text
+.org 0x0020
+    li16 x5, buf
+    lw   x6, 0(x5)
+    ecall 0x000
+    ecall 0x3FF
+.org 0x0200
+tail: .word 0x1234
+.data
+msg: .byte 1, 2, 3
+.bss
+buf: .space 512
+"""
+img = A.assemble(BSS, "bss.s").check()
+segs = img.segments()
+kinds = [(hex(a), n, d is None) for a, n, d in segs]
+sim = Z.ZX16(); sim.mem[:] = b"\xAA" * 0x10000; sim.load_segments(segs)
+flat = img.binary()
+check("a .org gap inside .text and the .bss are zero-fill records; loading them over "
+      "dirty memory clears exactly those ranges",
+      sum(1 for k in kinds if k[2]) == 2 and (hex(0x9000), 512, True) in kinds
+      and bytes(sim.mem[0x9000:0x9200]) == bytes(512) and sim.mem[0x9200] == 0xAA
+      and all(sim.mem[a:a + n] == flat[a:a + n] for a, n, _ in segs), kinds)
+check("sparse memh leaves the zero fill out, words addressed by word index",
+      img.memory_file(sparse=True).splitlines()[:2] == ["# ZX16 Sparse Memory File", "@10"]
+      and readmemh(img.memory_file(sparse=True)) == flat
+      and all(not L.startswith("@48") for L in img.memory_file(sparse=True).splitlines()))
+
+# 3) the mmap loader
+dhry = buildcache.build(open(progs[-1]).read(), LIB)
+path = os.path.join(TMP, "dhry.zxi")
+with open(path, "wb") as f:
+    f.write(A.pack_image(A.image_segments(dhry.binary)))
+a = Z.ZX16(); a.load_image_file(path); out_a = a.run()
+b = Z.ZX16(); b.load(dhry.binary, 0); out_b = b.run()
+check(f"load_image_file() (mmapped, {os.path.getsize(path)} B) runs dhrystone as load() "
+      f"does", out_a == out_b and a.cycles == b.cycles and a.mem == b.mem
+      and a.image == b.image, (a.cycles, b.cycles))
+
+# 4) malformed files
+def rejects(data):
+    try:
+        A.unpack_image(data)
+    except ValueError:
+        return True
+    return False
+good = A.pack_image(A.image_segments(dhry.binary))
+check("bad magic, a truncated file and a segment past 64 KB are ValueErrors",
+      rejects(b"ZX16IMG0" + good[8:]) and rejects(good[:-1]) and rejects(good[:5])
+      and rejects(A.pack_image([(0xFF00, 0x200, None)])))
+
+# 5) the command lines
+src = os.path.join(TMP, "bss.s")
+with open(src, "w") as f: f.write(BSS)
+r = subprocess.run([sys.executable, os.path.join(ASMDIR, "zx16asm.py"), src, "-f", "zxi"],
+                   capture_output=True, text=True)
+zxi = open(os.path.join(TMP, "bss.zxi"), "rb").read() if r.returncode == 0 else b""
+r2 = subprocess.run([sys.executable, os.path.join(ASMDIR, "zx16asm.py"), src, "-f", "mem",
+                     "--mem-sparse", "-o", os.path.join(TMP, "bss.mem")],
+                    capture_output=True, text=True)
+mem = open(os.path.join(TMP, "bss.mem")).read() if r2.returncode == 0 else ""
+obj = os.path.join(TMP, "obj.s")
+with open(obj, "w") as f:
+    f.write(BSS.replace(".org 0x0020\n", ".global __start\n__start:\n").replace(".org 0x0200\n", ""))
+r3 = subprocess.run([sys.executable, os.path.join(ASMDIR, "zx16asm.py"), obj, "-c"],
+                    capture_output=True, text=True)
+r4 = subprocess.run([sys.executable, os.path.join(ASMDIR, "zx16ld.py"),
+                     os.path.join(TMP, "obj.zo"),
+                     "-f", "zxi", "-o", os.path.join(TMP, "ld.zxi")],
+                    capture_output=True, text=True)
+ld = open(os.path.join(TMP, "ld.zxi"), "rb").read() if r4.returncode == 0 else b""
+check("zx16asm -f zxi / --mem-sparse and zx16ld -f zxi write the same images",
+      zxi == img.image_file() and mem == img.memory_file(sparse=True)
+      and ld[:8] == A.IMAGE_MAGIC and A.unpack_image(ld),
+      (r.stderr, r2.stderr, r3.stderr, r4.stderr))
+
+for f in os.listdir(TMP): os.remove(os.path.join(TMP, f))
+os.rmdir(TMP)
+print(f"\n{npass}/{ntot} image checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Inlining (codegen.INLINE): small functions' calls are expanded in place, `#pragma
+inline` forces and `#pragma noinline` forbids it, and a forced recursive or asm()
+function is an error. A constant or `&v` argument is substituted into the body (p->f
+is then v's slot), a variable argument shares its slot unless the callee assigns the
+parameter, and arguments still run right to left. Every example + dhrystone must
+print the same values and leave the same MMIO write log with inlining on and off.
+Reports the code-size and cycle deltas on tea / md5 / dhrystone.
+"""
+import os, sys, glob, re
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+sys.path.insert(0, os.path.join(ROOT, "assembler"))
+import importlib, codegen_patterns, zcc, peephole, codegen    # noqa: E402
+for m in (codegen_patterns, zcc, peephole, codegen): importlib.reload(m)
+import zx16asm as A                                            # noqa: E402
+import zx16sim as Z                                            # noqa: E402
+import harness                                                 # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+def compile_with(src, inline=True):
+    codegen.INLINE = inline
+    try:
+        return codegen.compile_src(src, LIB)
+    finally:
+        codegen.INLINE = True
+
+def funcs(asm):
+    return [l[:-1] for l in asm.splitlines() if re.match(r"[a-z]\w*:$", l)]
+
+def body(asm, name):
+    """The instructions of function `name` (up to the next global label)."""
+    lines = asm[asm.index(f"\n{name}:") + 1:].splitlines()[1:]
+    end = next((i for i, l in enumerate(lines) if re.match(r"[A-Za-z]\w*:$", l)), len(lines))
+    return [l.strip() for l in lines[:end] if l.strip() and not l.endswith(":")]
+
+def run(asm):
+    return [v for _, v in Z.assemble_and_run(asm)[0]]
+
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+
+def compile_error(src):
+    try:
+        compile_with(src)
+    except (codegen.CodegenError, zcc.ParseError) as ex:
+        return str(ex)
+    return None
+
+CASES = []
+# 1) what is expanded, what stays a call
+PROG = """
+#pragma noinline twice
+#pragma inline big, sub
+struct P { int a; int b; };
+int twice(int x) { return x + x; }
+int sq(int x) { return x * x; }
+void set(struct P *p, int a, int b) { p->a = a; p->b = b; }
+int big(int a, int b) { int t; t = 0; while (a > 0) { t = t + b; a = a - 1; }
+  if (t > 100) return 100; return t; }
+int bump(int a) { a = a + 1; return a; }
+int sub(int a, int b) { return a - b; }
+int main(void) { struct P q; int x;
+  set(&q, 3, 4); putint(q.a + q.b);
+  x = 5; putint(bump(x)); putint(x);
+  putint(twice(21)); putint(big(x, x + 1)); putint(sq(sq(3)));
+  x = 2; putint(sub(x, x = 7));
+  return 0; }
+"""
+WANT = [7, 6, 5, 42, 30, 81, 0]
+def pragma_case():
+    asm = compile_with(PROG)
+    m = body(asm, "main")
+    calls = [l for l in m if l.startswith(("jal ", "la x5"))]
+    ok = (funcs(asm) == ["twice", "sq", "main"]            # set/bump/big/sub all expanded
+          and calls == ["jal x1, twice", "jal x1, sq"]      # noinline; sq(<call>) far arg
+          and run(asm) == WANT == run(compile_with(PROG, False)))
+    return ok, (funcs(asm), calls)
+CASES.append(("pragma inline expands past the size limit, noinline keeps the call; "
+              "the same output as real calls", pragma_case))
+def subst_case():
+    m = body(compile_with(PROG), "main")
+    return m[4:8] == ["li x6, 3", "sw x6, -4(x3)", "li x6, 4", "sw x6, -2(x3)"], m[:8]
+CASES.append(("set(&q, 3, 4): constants and &q substituted, p->a / p->b store to q's slots",
+              subst_case))
+def copy_case():
+    m = body(compile_with(PROG), "main")
+    i = m.index("li x6, 5")
+    return m[i:i + 4] == ["li x6, 5", "sw x6, -6(x3)", "sw x6, -8(x3)", "addi x6, 1"], m[i:i + 4]
+CASES.append(("bump(x) assigns its parameter: a copy, x itself untouched", copy_case))
+
+# 2) functions that cannot be inlined, and malformed pragmas
+ERRORS = [
+    ("#pragma inline f\nint f(int n){ if (n) return f(n - 1); return 0; }\n"
+     "int main(void){ return f(2); }", "#pragma inline f: it is recursive"),
+    ("#pragma inline f\nint f(void){ asm(\"nop\"); return 1; }\n"
+     "int main(void){ return f(); }", "#pragma inline f: it contains asm()"),
+    ("#pragma once\nint main(void){ return 0; }", "unsupported #pragma 'once'"),
+    ("int main(void){\n#pragma inline f\nreturn 0; }", "only allowed at file scope"),
+]
+def errors_case():
+    got = [compile_error(src) for src, _ in ERRORS]
+    return all(g and want in g for g, (_, want) in zip(got, ERRORS)), got
+CASES.append(("forced inline of a recursive / asm() function, a bad or nested #pragma: errors",
+              errors_case))
+def recursive_case():
+    src = ERRORS[0][0].replace("#pragma inline f\n", "")
+    return "f" in funcs(compile_with(src)) and run(compile_with(src)) == []
+CASES.append(("an unforced recursive function just stays a call", recursive_case))
+
+# 3) differential over the examples and dhrystone
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+def differential(path):
+    src = open(path).read()
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    old, new = compile_with(src, False), compile_with(src)
+    (o0, s0), (o1, s1) = Z.assemble_and_run(old, pre_run=pre), Z.assemble_and_run(new, pre_run=pre)
+    size = [len(A.assemble(t).check().sections[".text"]) for t in (old, new)]
+    ok = o0 == o1 and s0.mmio_writes == s1.mmio_writes
+    return ok, f"cycles {s0.cycles} -> {s1.cycles}", (os.path.basename(path), s0.cycles,
+                                                      s1.cycles, *size)
+for p in progs:
+    CASES.append((f"{os.path.basename(p)}: inlined == real calls", lambda p=p: differential(p)))
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data and data[0] in ("07_tea.c", "08_md5.c", "dhrystone.c"):
+        print(f"  {data[0]:<14} cycles {data[1]:>9} -> {data[2]:>9} "
+              f"({100.0 * (data[2] - data[1]) / data[1]:+.1f}%)   .text {data[3]:>5} -> "
+              f"{data[4]:>5} B")
+print(f"\n{npass}/{len(CASES)} inlining checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
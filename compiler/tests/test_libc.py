@@ -10,16 +10,15 @@ sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator")
 import importlib, codegen_patterns, zcc, codegen      # noqa: E402
 for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
 import zx16sim as Z                                    # noqa: E402
+import harness, buildcache                             # noqa: E402
 LIB = os.path.join(COMPILER, "lib")
 
-npass = ntot = 0
+CASES = []
 def check(label, cond):
-    global npass, ntot
-    ntot += 1; npass += bool(cond)
-    print(("PASS " if cond else "FAIL ") + label)
+    CASES.append((label, cond))       # cond: thunk, run by the harness
 
 def out(src):
-    o, _ = Z.assemble_and_run(codegen.compile_src(src, base_dir=LIB))
+    o, _ = Z.run_image(buildcache.build(src, base_dir=LIB).binary)
     return o
 def ints(src): return [v for k, v in out(src) if k == 'int']
 def chars(src): return [v for k, v in out(src) if k == 'char']
@@ -39,7 +38,7 @@ int main(void){
   p="hello"; putint(strchr(p,'l') - p);
   return 0; }'''
 check("string.c: len/cpy/cat/cmp/ncmp/memcmp/ncpy/memset/chr",
-      ints(S) == [5, 3,97,99, 5,101, 0,-1,1, 0, -1, 104,105,0,0, 65,65, 2])
+      lambda: ints(S) == [5, 3,97,99, 5,101, 0,-1,1, 0, -1, 104,105,0,0, 65,65, 2])
 
 # ---- string.c: memmove overlap (both directions) ------------------------------
 MM = '''#include "string.c"
@@ -51,7 +50,47 @@ int main(void){ int i;
   memmove(buf, buf+2, 4); i=0; while(i<6){ putint(buf[i]); i=i+1; }
   return 0; }'''
 check("string.c: memmove fwd+bwd overlap",
-      ints(MM) == [97,98,97,98,99,100, 99,100,101,102,101,102])
+      lambda: ints(MM) == [97,98,97,98,99,100, 99,100,101,102,101,102])
+
+# ---- string.c: the word loops at every parity and length -------------------------
+# Each call runs against a byte pattern with a guard around it: the word paths must
+# agree with the byte loops whatever the pointers' parity, and touch nothing outside.
+W = '''#include "string.c"
+char src[40]; char dst[40]; char z[40];
+int sum(char *b){ int i; int h; h = 0; i = 0; while (i < 40){ h = h * 31 + b[i]; i = i + 1; } return h; }
+int main(void){
+  int so; int doff; int n; int i;
+  i = 0; while (i < 40){ src[i] = 100 + i; i = i + 1; }
+  so = 0; while (so < 2){ doff = 0; while (doff < 2){ n = 0; while (n < 20){
+    memset(dst, 7, 40); memcpy(dst + 4 + doff, src + 4 + so, n); putint(sum(dst));
+    memset(dst + 4 + doff, 200 + n, n); putint(sum(dst));
+    memcpy(z, dst, 40); z[4 + doff + n - 1] = 1;
+    putint(memcmp(dst + 4 + doff, z + 4 + doff, n));
+    putint(memcmp(src + 4 + so, dst + 4 + doff, n) > 0);
+    z[4 + doff + n] = 0; putint(strlen(z + 4 + doff));
+    n = n + 1; } doff = doff + 1; } so = so + 1; }
+  return 0; }'''
+def word_ref():
+    def h(b):                         # sum(): 16-bit, over signed chars
+        v = 0
+        for c in b: v = (v * 31 + (c - 256 if c > 127 else c)) & 0xFFFF
+        return v - 65536 if v > 32767 else v
+    def diff(a, b): return next((x - y for x, y in zip(a, b) if x != y), 0)
+    out, src = [], [100 + i for i in range(40)]
+    for so in range(2):
+        for do in range(2):
+            for n in range(20):
+                d = [7] * 40; d[4+do:4+do+n] = src[4+so:4+so+n]; out.append(h(d))
+                d[4+do:4+do+n] = [(200 + n) & 255] * n; out.append(h(d))
+                z = list(d)
+                if n: z[4+do+n-1] = 1
+                else: z[3+do] = 1
+                out.append(diff(d[4+do:4+do+n], z[4+do:4+do+n]))
+                out.append(int(diff(src[4+so:4+so+n], d[4+do:4+do+n]) > 0))
+                z[4+do+n] = 0; out.append(z[4+do:].index(0))
+    return out
+check("string.c: word memcpy/memset/memcmp/strlen == bytewise, any parity, n 0..19",
+      lambda: ints(W) == word_ref())
 
 # ---- ctype.c ------------------------------------------------------------------
 C = '''#include "ctype.c"
@@ -64,7 +103,7 @@ int main(void){
   putint(toupper('a')); putint(tolower('A')); putint(toupper('5'));
   return 0; }'''
 check("ctype.c: isdigit/alpha/alnum/space/upper/lower/toupper/tolower",
-      ints(C) == [1,0, 1,1,0, 1,1,0, 1,1,0, 1,0, 65,97,53])
+      lambda: ints(C) == [1,0, 1,1,0, 1,1,0, 1,1,0, 1,0, 65,97,53])
 
 # ---- stdlib.c: atoi -----------------------------------------------------------
 A = '''#include "stdlib.c"
@@ -73,7 +112,7 @@ int main(void){
   putint(atoi("12ab")); putint(atoi("")); putint(atoi("0"));
   return 0; }'''
 check("stdlib.c: atoi (sign, leading ws, trailing junk)",
-      ints(A) == [123, -45, 7, 12, 0, 0])
+      lambda: ints(A) == [123, -45, 7, 12, 0, 0])
 
 # ---- stdlib.c: itoa/utoa/itohex (printed strings, '\n'-delimited) --------------
 C2 = '''#include "stdlib.c"
@@ -88,26 +127,29 @@ int main(void){
   putstr(itohex(0,b)); putchar(10); putstr(itohex(255,b)); putchar(10);
   putstr(itohex(16,b)); putchar(10); putstr(itohex(43981,b)); putchar(10);
   return 0; }'''
-words = ''.join(chr(c) for c in chars(C2)).split('\n')[:-1]
+def words(src): return ''.join(chr(c) for c in chars(src)).split('\n')[:-1]
 check("stdlib.c: itoa/utoa/itohex (incl INT_MIN, 0xABCD)",
-      words == ["0","123","-456","-32768","32767","0","65535","40000","0","ff","10","abcd"])
+      lambda: words(C2) == ["0","123","-456","-32768","32767","0","65535","40000","0","ff","10","abcd"])
 
 # ---- stdio.c ------------------------------------------------------------------
 IO = '''#include "stdio.c"
 int main(void){ putstr("hi"); putchar(10); puts("ok"); puthex(255); putchar(10); puthex(0);
   return 0; }'''
 check("stdio.c: putstr / puts(+newline) / puthex",
-      chars(IO) == [104,105,10, 111,107,10, 102,102,10, 48])
+      lambda: chars(IO) == [104,105,10, 111,107,10, 102,102,10, 48])
 
 # ---- libc.c: include-once + dead-function elimination -------------------------
 L = '''#include "libc.c"
 #include "libc.c"
+#pragma noinline strlen
 int main(void){ putint(strlen("test")); return 0; }'''
-asm = codegen.compile_src(L, base_dir=LIB)
-check("libc.c: include-once compiles + strlen works", ints(L) == [4])
-check("libc.c: dead-fn elim keeps strlen, drops unused",
-      ('strlen:' in asm) and not any(f in asm for f in
-        ('memmove:','itoa:','itohex:','isspace:','strcat:','atoi:')))
+def dead_fn_elim():
+    asm = codegen.compile_src(L, base_dir=LIB)
+    return ('strlen:' in asm) and not any(f in asm for f in
+        ('memmove:','itoa:','itohex:','isspace:','strcat:','atoi:'))
+check("libc.c: include-once compiles + strlen works", lambda: ints(L) == [4])
+check("libc.c: dead-fn elim keeps strlen, drops unused", dead_fn_elim)
 
-print(f"\n{npass}/{ntot} libc tests passed")
-sys.exit(0 if npass == ntot else 1)
+npass = harness.passed(harness.run(CASES))
+print(f"\n{npass}/{len(CASES)} libc tests passed")
+sys.exit(0 if npass == len(CASES) else 1)
@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""Separate compilation: relocatable objects (zx16asm.assemble_object), the linker
+(assembler/zx16ld.py) and buildcache.build_linked(). Objects carry la / li16 / .word
+and cross-section branch relocations, and .zo files round-trip; three hand-written
+objects link to the image of the same code assembled as one file; undefined,
+duplicate and out-of-range symbols are link errors (undefined ones only where a
+kept section needs them); every example, dhrystone and a libc / u32 program run
+the same linked as compiled whole, and each keeps exactly the functions
+dead-function elimination keeps (inlining off, as it cannot cross units); the SoC firmware links; library objects are
+compiled once and shared, and a library body edit recompiles only that library.
+"""
+import os, sys, glob, shutil, tempfile
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import buildcache, codegen, codegen_patterns           # noqa: E402
+import zx16asm as A, zx16ld as L                       # noqa: E402
+import zx16sim as Z                                    # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def obj(text, name="t.s"):
+    return A.assemble_object(text, name)
+
+CRT = """
+.section .text.__start
+.global __start
+__start:
+    li16 x2, 0xF000
+    la   x5, main
+    jalr x1, x5
+    ecall 0x3FF
+"""
+PROG = """
+.section .text.main
+.global main
+main:
+    la   x5, helper
+    jalr x1, x5
+    la   x6, msg
+    li16 x4, table
+    bz   x6, main
+    bnz  x6, done
+    j    main
+done:
+    ret
+.section .data.table
+table: .word main, 3, tail
+.section .data.msg
+msg: .byte 104, 105, 0
+"""
+HELP = """
+.text
+.global helper
+.global tail
+helper:
+    li   x6, 7
+    ecall 0x000
+    ret
+tail:
+    ret
+.section .text.unused
+unused:
+    j    nowhere
+"""
+WHOLE = """
+.text
+.org 0x0020
+__start:
+    li16 x2, 0xF000
+    la   x5, main
+    jalr x1, x5
+    ecall 0x3FF
+main:
+    la   x5, helper
+    jalr x1, x5
+    la   x6, msg
+    li16 x4, table
+    bz   x6, main
+    bnz  x6, done
+    j    main
+done:
+    ret
+helper:
+    li   x6, 7
+    ecall 0x000
+    ret
+tail:
+    ret
+.data
+table: .word main, 3, tail
+msg: .byte 104, 105, 0
+"""
+
+# 1) the object: what resolves in place, what is left to the linker
+p = obj(PROG, "prog.s")
+kinds = sorted((r.mnemonic, r.symbol) for r in p.relocations)
+check("relocations: cross-section la, li16 and .word; same-section branches / j resolve",
+      p.ok and kinds == [(".word", "main"), (".word", "tail"), ("la", "helper"),
+                         ("la", "msg"), ("li16", "table")]
+      and p.symbols["done"].section == ".text.main" and p.symbols["main"].global_symbol
+      and not p.symbols["done"].global_symbol, (p.report(), kinds))
+back = A.ObjectFile.from_json(p.to_json())
+check(".zo JSON round-trips sections, symbols and relocations",
+      (back.sections, back.symbols, back.relocations) == (p.sections, p.symbols,
+                                                           p.relocations))
+bad = obj(".org 0x20\nli x1, lab\nlab: lw x1, lab(x2)\n").errors
+check(".org, and a label where no address fits (li, a load offset), are object errors",
+      len(bad) == 3 and ".org" in bad[0].message and "'li'" in bad[1].message
+      and "'lw'" in bad[2].message, [e.message for e in bad])
+check(".section is refused outside object mode",
+      not A.assemble(".section .text.x\nnop\n", single_pass=True).ok)
+
+# 2) three objects == one file, the unreferenced section stripped
+objs = [obj(CRT, "crt.s"), p, obj(HELP, "help.s")]
+img = L.link(objs)
+whole = A.assemble(WHOLE).check()
+check("crt + prog + helper link to the image of the same code assembled whole",
+      img.ok and img.binary() == whole.binary() and img.symbols["tail"] == whole.symbols["tail"],
+      img.report())
+check("the section nothing reaches is stripped (and its undefined 'nowhere' ignored)",
+      img.stripped == [("help.s", ".text.unused")] and "0x8006" in img.map(), img.stripped)
+img = L.link(objs, strip=False)
+check("... and without stripping, 'nowhere' is undefined",
+      not img.ok and "Undefined symbol 'nowhere'" in img.report(), img.report())
+
+# 3) link errors
+dup = L.link(objs + [obj(".global helper\nhelper: ret\n", "dup.s")])
+check("a global defined twice", not dup.ok and "'helper' already defined in help.s"
+      in dup.report(), dup.report())
+check("a missing entry symbol", not L.link(objs[1:]).ok)
+far = obj(".global main\nmain:\n  bz x6, helper\n  ret\n", "far.s")
+r = L.link([objs[0], far, obj(".space 40\n.global helper\nhelper: ret\n", "pad.s")])
+check("a relocated branch out of range at its final address",
+      not r.ok and "Branch offset out of range" in r.report(), r.report())
+
+# 4) compiled programs: the same run, the same functions kept
+def program_funcs(asm):
+    return {l[:-1] for l in asm.splitlines() if l.endswith(":") and not l.startswith("__")}
+
+def linked_funcs(src):
+    """The linked image and the program functions it keeps, and those a whole build
+    keeps, both with inlining off: a whole build also inlines library functions,
+    which separate compilation cannot."""
+    codegen.INLINE = False
+    try:
+        _, objects = buildcache.link_objects(src, LIB)
+        image = L.link(objects).check()
+        whole = program_funcs(buildcache.build(src, LIB).asm)
+    finally:
+        codegen.INLINE = True
+    return image, {s[len(".text."):] for _, s, _, _ in image.placed
+                   if s.startswith(".text.") and not s.startswith(".text.__")}, whole
+
+LIBC = '''#include "libc.c"
+#include "u32.c"
+char b[12]; struct u32 x; struct u32 y;
+int main(void){
+  strcpy(b, "zx16"); putint(strlen(b)); puts(b);
+  putint(atoi("-321")); putstr(itohex(48879, b)); putchar(10);
+  putint(toupper('q')); putint(strchr(b, '1') - b);
+  set32(&x, 1, 65535); set32(&y, 0, 1); add32(&x, &x, &y);
+  putint(x.hi); putint(x.lo); putint(7 * strlen(b) / 3);
+  return 0; }
+'''
+progs = [p for p in sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))]
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+corpus = [(os.path.basename(p), open(p).read()) for p in progs] + [("libc+u32", LIBC)]
+for name, src in corpus:
+    whole, linked = buildcache.build(src, LIB), buildcache.build_linked(src, LIB)
+    image, kept, want = linked_funcs(src)
+    same = True
+    if not name.startswith('02'):                      # waits on UART input
+        same = Z.run_image(whole.binary)[0] == Z.run_image(linked.binary)[0]
+    check(f"{name}: linked runs as compiled whole, keeping {len(kept)} functions "
+          f"({sum(s for *_, s in image.placed)} B)",
+          same and kept == want, (same, kept ^ want))
+
+save = codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP
+codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP = False, 0xC000   # as soc_run
+try:
+    bad = []
+    for path in sorted(glob.glob(os.path.join(ROOT, "rtl", "soc", "fw", "*.c"))):
+        src = open(path).read()
+        image, kept, want = linked_funcs(src)
+        if kept != want or \
+                image.binary()[0x20:0x24] != A.assemble("li16 x2, 0xC000").binary()[0x20:0x24]:
+            bad.append(os.path.basename(path))
+finally:
+    codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP = save
+check("SoC firmware links (UART stdio, SP 0xC000) with the functions whole builds keep",
+      not bad, bad)
+
+# 5) incremental builds: library objects shared, a body edit recompiles one unit
+TMP = tempfile.mkdtemp(prefix="zx16link_")
+os.environ["ZX16_CACHE"] = os.path.join(TMP, "cache")
+lib = os.path.join(TMP, "lib")
+shutil.copytree(LIB, lib)
+def build_counts(src):
+    h, m = buildcache.STATS["hit"], buildcache.STATS["miss"]
+    b = buildcache.build_linked(src, lib, lib)
+    return b, buildcache.STATS["hit"] - h, buildcache.STATS["miss"] - m
+first, _, cold = build_counts(LIBC)
+other = LIBC.replace("putint(x.lo);", "putint(x.lo + 1);")
+second, hits, miss = build_counts(other)
+check("a second program compiles only itself: the library objects are hits",
+      miss == 2 and hits == cold - 2 and Z.run_image(second.binary)[0][-2:]
+      != Z.run_image(first.binary)[0][-2:], (cold, hits, miss))
+path = os.path.join(lib, "string.c")
+text = open(path).read()
+open(path, "w").write(text.replace("int strlen(char *s){", "int strlen(char *s){ int z; z = 0;"))
+third, hits, miss = build_counts(LIBC)
+check("editing a library function's body recompiles only that library unit",
+      miss == 2 and Z.run_image(third.binary)[0] == Z.run_image(first.binary)[0]
+      and third.binary != first.binary, (hits, miss))
+shutil.rmtree(TMP, ignore_errors=True)
+
+print(f"\n{npass}/{ntot} linker checks passed")
+sys.exit(0 if npass == ntot else 1)
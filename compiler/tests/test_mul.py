@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""ZC multiply codegen + runtime against C semantics: `*` (low 16 bits, signed and
+unsigned, every pair of edge values) and the __mulhu intrinsic (high half of the
+unsigned 32-bit product), plus the bound on __mul's running time.
+
+History: __mul used to add b to itself a times, so 1000*3 was 1000 iterations and
+a negative left operand (a = 0xFFFF..) looped up to 65535 times. It is now a
+shift-and-add over the smaller operand (at most 16 steps) with the register ABI of
+the div/mod routines (x5 = left, x4 = right)."""
+import os, sys
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, codegen_patterns, zcc, codegen      # noqa: E402
+for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
+import zx16sim as Z                                    # noqa: E402
+import harness                                         # noqa: E402
+
+def s16(x): x &= 0xFFFF; return x - 0x10000 if x & 0x8000 else x
+def u16(x): return x & 0xFFFF
+
+SV = [0,1,-1,2,-2,3,-3,7,-7,10,-10,100,-100,127,-128,255,-256,1000,-1000,
+      12345,-12345,32767,-32768]
+UV = [0,1,2,3,10,255,256,1000,4095,12345,32767,32768,40000,54321,65534,65535]
+
+def gen(decl, vals, body):
+    n = len(vals)
+    lines = [f"{decl} av[{n}];", "int main(void){ int i; int j;"]
+    for i, v in enumerate(vals): lines.append(f" av[{i}]={v};")
+    lines.append(" i=0; while(i<%d){ j=0; while(j<%d){ %s j=j+1; } i=i+1; }" % (n, n, body))
+    lines.append(" return 0; }")
+    return "\n".join(lines)
+
+def run(src):
+    out, sim = Z.assemble_and_run(codegen.compile_src(src))
+    return [v for k, v in out], sim.cycles
+
+def section(decl, vals, body, refs):
+    got, _ = run(gen(decl, vals, body))
+    k = 0; fails = []; ok = 0
+    for a in vals:
+        for b in vals:
+            want = [s16(r(a, b)) for r in refs]
+            if got[k:k + len(refs)] == want: ok += 1
+            elif len(fails) < 6: fails.append(f"{a}*{b}: {got[k:k + len(refs)]} != {want}")
+            k += len(refs)
+    n = len(vals) ** 2
+    return not fails, "\n      " + "\n      ".join(fails) if fails else "", (ok, n)
+
+def bounded():
+    """1000*3 and 3*1000 take a few steps; the worst case (every bit set) stays
+    within 16 iterations, far from the old 65535."""
+    def cost(a, b):
+        base = run("int main(void){ unsigned x; unsigned y; x=%d; y=%d; putint(x); return 0; }"
+                   % (a, b))[1]
+        got, c = run("int main(void){ unsigned x; unsigned y; x=%d; y=%d; putint(x*y); return 0; }"
+                     % (a, b))
+        return got == [s16(a * b)], c - base
+    (ok1, c1), (ok2, c2), (ok3, c3) = cost(1000, 3), cost(3, 1000), cost(65535, 65535)
+    ok = ok1 and ok2 and ok3 and c1 < 40 and c2 < 40 and c3 < 150
+    return ok, f"1000*3: {c1}, 3*1000: {c2}, 65535*65535: {c3} cycles", (int(ok), 1)
+
+print("multiply correctness:")
+results = harness.run([
+    (f"signed * ({len(SV)**2} pairs)",
+     lambda: section("int", SV, "putint(av[i]*av[j]);", [lambda a, b: a * b])),
+    (f"unsigned * and __mulhu ({len(UV)**2} pairs)",
+     lambda: section("unsigned", UV, "putint(av[i]*av[j]); putint(__mulhu(av[i], av[j]));",
+                     [lambda a, b: u16(a) * u16(b), lambda a, b: (u16(a) * u16(b)) >> 16])),
+    ("bounded running time", bounded)])
+npass = sum(r[4][0] for r in results if r[4]); ntot = sum(r[4][1] for r in results if r[4])
+nfail = ntot - npass + sum(1 for r in results if r[4] is None)
+print(f"  {results[-1][2]}")
+
+print(f"\n{npass}/{npass+nfail} multiply cases correct")
+sys.exit(0 if nfail == 0 else 1)
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""The optional multiply/divide unit (R-type funct4 0xD, the operation in func3: MUL
+MULH MULHU DIV DIVU REM REMU; rtl/zx16_muldiv.v, the cores' MULDIV=1) in the
+assembler, the simulator and codegen.HW_MULDIV.
+
+Differential throughout: every * / % over pairs of edge values, __mulhu, the
+examples and dhrystone print the same with the instructions as with the runtime
+routines (__mul / __udivmod / __div / __mod / __umul32), division by zero included;
+the translated-block engine matches step() on the instructions; the profiler charges
+them the unit's 17 cycles. rtl/verify.py and rtl/ahb/verify_ahb.py run the corpus
+the same way on the RTL built with the unit."""
+import os, sys, glob
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, codegen_patterns, zcc, codegen, peephole   # noqa: E402
+for m in (codegen_patterns, zcc, codegen, peephole): importlib.reload(m)
+import zx16sim as Z, zx16prof as P                 # noqa: E402
+import buildcache                                  # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def s16(x): x &= 0xFFFF; return x - 0x10000 if x & 0x8000 else x
+
+def build(src, hw):
+    save = codegen.HW_MULDIV
+    codegen.HW_MULDIV = hw
+    try:
+        return buildcache.build(src, LIB)
+    finally:
+        codegen.HW_MULDIV = save
+
+def run(b, pre=None, fast=True):
+    sims = []
+    def setup(sim):
+        sim.fast = fast; sims.append(sim)
+        if pre: pre(sim)
+    out, sim = Z.run_image(b.binary, pre_run=setup)
+    return out, sim
+
+# 1) encodings
+OPS = (("mul", 0), ("mulh", 1), ("mulhu", 2), ("div", 4), ("divu", 5), ("rem", 6),
+       ("remu", 7))
+asm = ".text\n.org 0x0020\n" + "".join(f"    {m} x{i}, x{7 - i}\n" for i, (m, _) in
+                                        enumerate(OPS)) + "    ecall 0x3FF\n"
+img = buildcache.assemble(asm).binary
+words = [img[0x20 + 2 * i] | img[0x21 + 2 * i] << 8 for i in range(len(OPS))]
+want = [0xD << 12 | (7 - i) << 9 | i << 6 | f3 << 3 for i, (_, f3) in enumerate(OPS)]
+check("assembler: " + " ".join(m for m, _ in OPS) + " encode as R-type funct4 0xD, "
+      "the operation in func3", words == want, [hex(w) for w in words])
+
+# 2) the simulator's results (MULH has no C operator: against its definition here)
+V = [0, 1, 2, 3, 7, 100, 12345, 0x7FFF, 0x8000, 0x8001, 0xCFC7, 0xFF9C, 0xFFFE, 0xFFFF]
+bad = [(a, b) for a in V for b in V
+       if Z.muldiv(1, a, b) != ((s16(a) * s16(b)) >> 16) & 0xFFFF
+       or Z.muldiv(2, a, b) != (a * b) >> 16 or Z.muldiv(0, a, b) != (a * b) & 0xFFFF]
+check("MUL / MULH / MULHU: the low, signed high and unsigned high halves", not bad, bad[:4])
+prog = (".text\n.org 0x0020\n    li x1, -7\n    li x2, 3\n"
+        + "".join(f"    mv {r}, x1\n    {m} {r}, x2\n" for r, m in
+                  (("x3", "mul"), ("x4", "mulh"), ("x5", "div"), ("x7", "rem"),
+                   ("x0", "divu"), ("x6", "remu")))
+        + "    ecall 0x3FF\n")
+b = buildcache.assemble(prog)
+(_, step), (_, fast) = run(b, fast=False), run(b)
+check("step() and the translated blocks agree on the instructions (-7 op 3)",
+      step.reg == fast.reg and step.cycles == fast.cycles
+      and [s16(step.reg[r]) for r in (3, 4, 5, 7, 0, 6)] == [-21, -1, -2, -1, 21843, 0],
+      (step.reg, fast.reg))
+try:
+    run(buildcache.assemble(".text\n.org 0x0020\n    .word 0xD098\n    ecall 0x3FF\n"))
+    check("func3 3 (reserved) is an illegal instruction", False, "ran")
+except Exception as e:
+    check("func3 3 (reserved) is an illegal instruction", "bad R funct4" in str(e), str(e))
+
+# 3) codegen: * / % over every pair of edge values, both ways
+SV = [0, 1, -1, 2, -2, 3, -3, 7, -7, 10, -10, 100, -100, 255, -256, 1000, -1000,
+      12345, -12345, 32767, -32768]
+UV = [0, 1, 2, 3, 10, 255, 256, 1000, 12345, 32767, 32768, 40000, 54321, 65534, 65535]
+def grid(decl, vals):
+    n = len(vals)
+    lines = [f"{decl} av[{n}];", "int main(void){ int i; int j;"]
+    lines += [f" av[{i}]={v};" for i, v in enumerate(vals)]
+    lines.append(f" i=0; while(i<{n}){{ j=0; while(j<{n}){{ {decl} a; {decl} b;"
+                 " a=av[i]; b=av[j]; putint(a*b); putint(a/b); putint(a%b);"
+                 " putint(__mulhu(a, b)); j=j+1; } i=i+1; }")
+    return "\n".join(lines + [" return 0; }"])
+for decl, vals in (("int", SV), ("unsigned", UV)):
+    soft, hard = (run(build(grid(decl, vals), hw))[0] for hw in (False, True))
+    ref = []
+    for a in vals:
+        for b in vals:
+            q = (abs(a) // abs(b) * (-1 if (a < 0) != (b < 0) else 1)) if b else None
+            ref += [s16(a * b), None if q is None else s16(q),
+                    None if q is None else s16(a - q * b), s16((a & 0xFFFF) * (b & 0xFFFF) >> 16)]
+    got = [v for _, v in hard]
+    bad = [(k // 4, got[k], r) for k, r in enumerate(ref) if r is not None and got[k] != r]
+    check(f"{decl}: * / % __mulhu with the instructions = the runtime's, x/0 and x%0 "
+          f"included, = C for every {len(vals)}x{len(vals)} pair",
+          hard == soft and not bad and len(got) == len(ref), (bad[:4], len(got), len(ref)))
+
+# 4) the code: no runtime calls, register temporaries, leaf frames
+SRC = """
+#pragma noinline f
+#pragma noinline g
+int f(int a, int b, int c){ return (a * b + c) / (b - c) + a % c; }
+unsigned g(unsigned x, unsigned y){ return x / y + x % 10 + x / 7; }
+int main(void){ putint(f(300, -7, 5)); putint(g(60000, 9)); return 0; }
+"""
+soft, hard = build(SRC, False), build(SRC, True)
+body = lambda a, fn: a.split(f"\n{fn}:\n", 1)[1].split("\n    ret\n", 1)[0]
+calls = [r for r in ("__mul", "__udivmod", "__div", "__mod") if f"la x7, {r}\n" in hard.asm]
+check("HW_MULDIV: no runtime call; operands stay in the temporaries (mul / div / rem / "
+      "divu / remu between registers), constant divisors too, in frameless leaves; the "
+      "same output",
+      not calls and all(f"    {m} " in hard.asm for m in ("mul", "div", "rem", "divu", "remu"))
+      and not any("push" in body(hard.asm, fn) for fn in "fg")
+      and "push x1" in body(soft.asm, "f") and run(soft)[0] == run(hard)[0]
+      == [("int", 174), ("int", 6666 + 0 + 8571)],
+      (calls, run(hard)[0], body(hard.asm, "f")))
+
+# 5) the examples and dhrystone: same output; instructions and modeled core cycles
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+rows = []; same = True; blocks = True
+for path in progs:
+    src = open(path).read()
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    res = []
+    for hw in (False, True):
+        b = build(src, hw)
+        out, sim = run(b, pre)
+        ref, slow = run(b, pre, fast=False)
+        blocks &= (out, sim.cycles, sim.reg) == (ref, slow.cycles, slow.reg)
+        image = Z.load_assembler().assemble(b.asm, "<asm>")
+        _, _, prof = P.profile_image(image, pre)
+        res.append((out, sim.cycles, prof.cycles))
+    same &= res[0][0] == res[1][0]
+    rows.append((os.path.basename(path), res[0][1:], res[1][1:]))
+check("every example and dhrystone prints the same with the instructions; the block "
+      "engine matches step() on those builds", same and blocks)
+for name, (si, sc), (hi, hc) in rows:
+    if (si, sc) != (hi, hc):
+        print(f"      {name:<18} instructions {si:>7} -> {hi:>7}   "
+              f"AHB core cycles {sc:>7} -> {hc:>7} ({sc / hc:.2f}x)")
+gain = {n: (s[1], h[1]) for n, s, h in rows}
+check("the instructions pay for their 17 cycles: FFT and matmul take fewer modeled "
+      "core cycles", gain["09_fft.c"][1] < gain["09_fft.c"][0]
+      and gain["06_matmul.c"][1] < gain["06_matmul.c"][0], gain)
+
+# 6) the profiler's charge
+one, two = (P.profile_asm(".text\n.org 0x0020\n    li x1, 5\n    li x2, 3\n"
+                          + ("    mul x1, x2\n" * k) + "    ecall 0x3FF\n")[2]
+            for k in (1, 2))
+fone, ftwo = (P.profile_asm(".text\n.org 0x0020\n    li x1, 5\n    li x2, 3\n"
+                            + ("    divu x1, x2\n" * k) + "    ecall 0x3FF\n", fwd=True)[2]
+              for k in (1, 2))
+check("profiler: a MUL / DIV costs 1 + 17 cycles (either pipeline)",
+      two.cycles - one.cycles == 18 and ftwo.cycles - fone.cycles == 18,
+      (two.cycles - one.cycles, ftwo.cycles - fone.cycles))
+
+print(f"\n{npass}/{ntot} multiply/divide unit checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -12,6 +12,7 @@ sys.path.insert(0, os.path.join(os.path.dirname(_COMPILER), "simulator"))
 import importlib
 import codegen_patterns as C
 import zx16sim as Z
+import harness
 
 def run(asm):
     out, sim = Z.assemble_and_run(asm)
@@ -186,15 +187,33 @@ def t_continue():
     C.load_local(e,0); e.emit("    ecall 0x000"); C.func_epilogue(e)
     assert run(e.text()) == [('int',5)]
 
+def t_reg_forms():
+    # register-operand forms: results land in rd, the bystander x7 is untouched;
+    # SLT compares (signed -1 < 1, unsigned 0xFFFF > 1), immediates, far in-place add
+    e = C.Emitter(); C.crt0(e); C.runtime(e)
+    C.func_prologue(e, "main", 40)                                   # 80-byte frame
+    C.load_const(e, 77, "x7")
+    def show(reg): e.emit(f"    mv x6, {reg}"); e.emit("    ecall 0x000")
+    C.load_const(e, -1, "x4"); C.load_const(e, 1, "x5")
+    C.reg_cmp(e, '<', "x4", "x5", False); show("x4")                 # 1
+    C.load_const(e, -1, "x4"); C.load_const(e, 1, "x5")
+    C.reg_cmp(e, '>', "x4", "x5", True); show("x4")                  # 1
+    C.load_const(e, 5, "x4"); C.load_const(e, 5, "x5")
+    C.reg_cmp(e, '!=', "x4", "x5", False); show("x4")                # 0
+    C.load_const(e, 50, "x4"); assert C.reg_cmp_imm(e, '<=', "x4", 50, False); show("x4")    # 1
+    C.load_const(e, 6, "x4"); C.load_const(e, 2, "x5")
+    C.reg_op(e, '<<', "x4", "x5"); show("x4")                        # 24
+    C.load_const(e, -32, "x4"); assert C.reg_op_imm(e, '>>s', "x4", 2); show("x4")  # -8
+    assert not C.reg_op_imm(e, '+', "x4", 64)                        # no imm7 encoding
+    C.load_const(e, 1, "x4"); C.addr_plus_offset(e, "x4", 300, "x4"); show("x4")   # 301
+    show("x7")                                                       # 77
+    C.func_epilogue(e)
+    assert run(e.text()) == [('int', v) for v in (1, 1, 0, 1, 24, -8, 301, 77)]
+
 if __name__ == '__main__':
     tests = [t_arith, t_divmod, t_recursion, t_while, t_ifelse, t_bigconst,
-             t_bitwise, t_struct, t_unsigned_cmp, t_break_nested, t_continue]
-    passed = 0
-    for t in tests:
-        try:
-            t(); print(f"PASS {t.__name__}"); passed += 1
-        except AssertionError as ex:
-            print(f"FAIL {t.__name__}: {ex}")
-        except Exception as ex:
-            print(f"ERROR {t.__name__}: {ex}")
+             t_bitwise, t_struct, t_unsigned_cmp, t_break_nested, t_continue, t_reg_forms]
+    results = harness.run([(t.__name__, t) for t in tests])
+    passed = harness.passed(results)
     print(f"\n{passed}/{len(tests)} patterns validated")
+    sys.exit(0 if passed == len(tests) else 1)
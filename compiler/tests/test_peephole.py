@@ -0,0 +1,396 @@
+#!/usr/bin/env python3
+"""Peephole pass (compiler/peephole.py): each rule on a hand-written fragment, the
+liveness/aliasing guards that must block a rewrite, asm() blocks left verbatim, the
+per-rule switches and ZX16_PEEPHOLE_OFF, and a differential over every example +
+dhrystone (stack machine and REG_TEMPS; all rules on and each rule alone) against
+the unoptimized text in the simulator. Reports the md5 / fft / dhrystone deltas.
+"""
+import os, sys, glob
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, codegen_patterns, zcc, peephole, codegen    # noqa: E402
+for m in (codegen_patterns, zcc, peephole, codegen): importlib.reload(m)
+import zx16sim as Z                                            # noqa: E402
+import harness                                                 # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+def body(text):
+    return [l.strip() for l in text.splitlines() if l.strip()]
+
+def rewrite(rule, src, want):
+    """Only `rule` on: the fragment must become `want` exactly."""
+    got = body(peephole.optimize(src, rules=[rule]))
+    return got == body(want), got
+
+CASES = []
+def case(name, fn): CASES.append((name, fn))
+
+# 1) one fragment per rule (and the blocked variant next to it)
+case("push_pop: push a; pop b -> mv b, a", lambda: rewrite("push_pop", """
+    push x6
+    li x6, 3
+    lw x5, 0(x2)
+    addi x2, 2
+    sub x5, x6""", """
+    mv x5, x6
+    li x6, 3
+    sub x5, x6"""))
+case("push_pop: push a; pop a cancels", lambda: rewrite("push_pop", """
+    push x6
+    lw x5, -2(x3)
+    pop x6""", """
+    lw x5, -2(x3)"""))
+case("push_pop: blocked when the window uses the pop target or x2", lambda: rewrite(
+    "push_pop", """
+    push x6
+    lw x5, 4(x3)
+    pop x5
+    push x6
+    lw x4, 0(x2)
+    pop x7""", """
+    push x6
+    lw x5, 4(x3)
+    pop x5
+    push x6
+    lw x4, 0(x2)
+    pop x7"""))
+case("reload: store then reload of a frame slot", lambda: rewrite("reload", """
+    sw x6, -4(x3)
+    li x5, 1
+    lw x6, -4(x3)
+    lw x4, -4(x3)
+    li x5, 1""", """
+    sw x6, -4(x3)
+    li x5, 1
+    mv x4, x6"""))
+case("reload: blocked by a store through another base, a label or a call",
+     lambda: rewrite("reload", """
+    sw x6, -4(x3)
+    sw x7, 0(x5)
+    lw x6, -4(x3)
+L1:
+    lw x6, -4(x3)
+    la x5, f
+    jalr x1, x5
+    lw x6, -4(x3)
+    sb x7, -3(x3)
+    lw x6, -4(x3)""", """
+    sw x6, -4(x3)
+    sw x7, 0(x5)
+    lw x6, -4(x3)
+L1:
+    lw x6, -4(x3)
+    la x5, f
+    jalr x1, x5
+    lw x6, -4(x3)
+    sb x7, -3(x3)
+    lw x6, -4(x3)"""))
+case("cmp_branch: slt [+ xori 1] + bnz/bz -> blt/bge", lambda: rewrite("cmp_branch", """
+    slt x6, x5
+    bnz x6, T
+    li x6, 0
+T:
+    li x6, 2
+    sltu x6, x5
+    xori x6, 1
+    bnz x6, U
+    li x6, 0
+U:
+    li x6, 1""", """
+    blt x6, x5, T
+    li x6, 0
+T:
+    li x6, 2
+    bgeu x6, x5, U
+    li x6, 0
+U:
+    li x6, 1"""))
+case("cmp_branch: == / != and sltui 1", lambda: rewrite("cmp_branch", """
+    xor x6, x5
+    sltui x6, 1
+    bz x6, T
+    li x6, 0
+T:
+    sltui x7, 1
+    bnz x7, U
+    li x7, 0
+U:
+    li x6, 1
+    li x7, 1""", """
+    bne x6, x5, T
+    li x6, 0
+T:
+    bz x7, U
+    li x7, 0
+U:
+    li x6, 1
+    li x7, 1"""))
+case("cmp_branch: blocked while the flag is still read", lambda: rewrite("cmp_branch", """
+    slt x6, x5
+    bnz x6, T
+    ecall 0x000
+T:
+    li x6, 1""", """
+    slt x6, x5
+    bnz x6, T
+    ecall 0x000
+T:
+    li x6, 1"""))
+case("cmp_branch: xori 1 is not a negation of a non-boolean", lambda: rewrite("cmp_branch", """
+    xor x6, x5
+    xori x6, 1
+    bnz x6, T
+    li x6, 0
+T:
+    li x6, 1""", """
+    xor x6, x5
+    xori x6, 1
+    bnz x6, T
+    li x6, 0
+T:
+    li x6, 1"""))
+case("cmp_branch: stack-machine 0/1 materialisation feeding bz", lambda: rewrite(
+    "cmp_branch", """
+    blt x5, x6, __cmp1
+    li x6, 0
+    j __cmpd2
+__cmp1:
+    li x6, 1
+__cmpd2:
+    bz x6, __else3
+    li x6, 7
+__else3:
+    li x6, 8""", """
+    bge x5, x6, __else3
+    li x6, 7
+__else3:
+    li x6, 8"""))
+case("forward_mv / fold_mv / dead_mv", lambda: rewrite("forward_mv", """
+    lw x6, 6(x3)
+    mv x5, x6
+    li x6, 1
+    add x5, x6""", """
+    lw x5, 6(x3)
+    li x6, 1
+    add x5, x6""") and rewrite("fold_mv", """
+    add x5, x6
+    mv x6, x5
+    li x5, 0""", """
+    add x6, x5
+    li x5, 0""") and rewrite("dead_mv", """
+    mv x6, x6
+    mv x5, x6
+    li x5, 3
+    lw x7, 0(x5)
+    li x7, 1""", """
+    li x5, 3
+    lw x7, 0(x5)
+    li x7, 1"""))
+case("copy_prop: reads of a copy read the register, an update in place", lambda: rewrite(
+    "copy_prop", """
+    mv x6, x7
+    mv x5, x4
+    blt x6, x5, __w1
+    mv x5, x0
+    lbu x6, 0(x5)
+    mv x6, x7
+    addi x6, 1
+    mv x7, x6
+__w1:
+    li x6, 0
+    li x5, 0
+    ret""", """
+    blt x7, x4, __w1
+    lbu x6, 0(x0)
+    addi x7, 1
+__w1:
+    li x6, 0
+    li x5, 0
+    ret"""))
+case("copy_prop: blocked while the copy is read later or the reader writes it", lambda: rewrite(
+    "copy_prop", """
+    mv x6, x7
+    sw x6, 0(x5)
+    add x5, x6
+    mv x5, x0
+    add x5, x7
+    lw x6, 0(x5)
+    ret""", """
+    mv x6, x7
+    sw x6, 0(x5)
+    add x5, x6
+    mv x5, x0
+    add x5, x7
+    lw x6, 0(x5)
+    ret"""))
+case("jump_next / dead_code / dead_label", lambda: rewrite("jump_next", """
+    la x4, __epi1
+    jr x4
+__epi1:
+    ret""", """
+__epi1:
+    ret""") and rewrite("dead_code", """
+    j L
+    li x6, 1
+L:
+    ret""", """
+    j L
+L:
+    ret""") and rewrite("dead_label", """
+    li x6, 1
+__then4:
+main:
+    ret
+__umul32:
+    ret""", """
+    li x6, 1
+main:
+    ret
+__umul32:
+    ret"""))
+case("branch_over / short_jump only within range", lambda: rewrite("branch_over", """
+    bnz x6, __t1
+    la x4, __e2
+    jr x4
+__t1:
+    li x6, 1
+__e2:
+    li x4, 0""", """
+    bz x6, __e2
+__t1:
+    li x6, 1
+__e2:
+    li x4, 0""") and rewrite("short_jump", """
+    la x4, L
+    jr x4
+    .space 600
+L:
+    li x4, 0""", """
+    la x4, L
+    jr x4
+    .space 600
+L:
+    li x4, 0""") and rewrite("short_jump", """
+L:
+    li x4, 0
+    la x4, L
+    jr x4""", """
+L:
+    li x4, 0
+    j L"""))
+case("short_call: a near call becomes jal; runtime scratch must be dead at the callee",
+     lambda: rewrite("short_call", """
+f:
+    ret
+    la x5, f
+    jalr x1, x5
+    la x7, __mul
+    jalr x1, x7
+    la x5, g
+    jalr x1, x5
+    .space 600
+g:
+    ret
+__mul:
+    mv x6, x7
+    ret""", """
+f:
+    ret
+    jal x1, f
+    la x7, __mul
+    jalr x1, x7
+    la x5, g
+    jalr x1, x5
+    .space 600
+g:
+    ret
+__mul:
+    mv x6, x7
+    ret"""))
+case("reload: sp-based slots of a frameless leaf, forgotten when sp moves",
+     lambda: rewrite("reload", """
+    sw x6, 2(x2)
+    lw x5, 2(x2)
+    push x6
+    lw x5, 2(x2)""", """
+    sw x6, 2(x2)
+    mv x5, x6
+    push x6
+    lw x5, 2(x2)"""))
+
+# 2) asm() passthrough, switches, fixed point
+ASM = '''int main(void){ int a; a = 1; asm("push x6\\npop x6\\nmv x5, x5"); putint(a); return 0; }'''
+def asm_case():
+    asm = codegen.compile_src(ASM)
+    lines = body(asm)
+    i = lines.index(peephole.ASM_BEGIN)
+    return lines[i + 1:i + 5] == ["push x6", "pop x6", "mv x5, x5", peephole.ASM_END], lines[i:i + 5]
+case("asm() blocks are left verbatim", asm_case)
+def switches():
+    src = open(os.path.join(COMPILER, "bench", "dhrystone.c")).read()
+    raw = codegen.Codegen(zcc.parse(src, LIB)).gen_program()
+    save = os.environ.get("ZX16_PEEPHOLE_OFF")
+    try:
+        os.environ["ZX16_PEEPHOLE_OFF"] = "all"
+        off_all = peephole.optimize(raw) == raw and peephole.enabled() == []
+        os.environ["ZX16_PEEPHOLE_OFF"] = "push_pop, RELOAD"
+        env = [r for r, _ in peephole.RULES if r not in ("push_pop", "reload")] == peephole.enabled()
+    finally:
+        if save is None: os.environ.pop("ZX16_PEEPHOLE_OFF", None)
+        else: os.environ["ZX16_PEEPHOLE_OFF"] = save
+    peephole.CMP_BRANCH = False
+    try:
+        stats = {}
+        peephole.optimize(raw, stats)
+        switch = "cmp_branch" not in stats and bool(stats)
+    finally:
+        peephole.CMP_BRANCH = True
+    codegen.PEEPHOLE = False
+    try:
+        bypass = codegen.compile_src(src, LIB) == raw
+    finally:
+        codegen.PEEPHOLE = True
+    once = peephole.optimize(raw)
+    fixed = peephole.optimize(once) == once
+    return off_all and env and switch and bypass and fixed, (off_all, env, switch, bypass, fixed)
+case("switches, ZX16_PEEPHOLE_OFF, PEEPHOLE=False and the fixed point", switches)
+
+# 3) differential against the unoptimized text
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+def differential(path, reg_temps, solo):
+    src = open(path).read()
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    codegen.REG_TEMPS = reg_temps
+    try:
+        raw = codegen.Codegen(zcc.parse(src, LIB)).gen_program()
+    finally:
+        codegen.REG_TEMPS = True
+    o0, s0 = Z.assemble_and_run(raw, pre_run=pre)
+    runs = [peephole.enabled()] + ([[r] for r in peephole.enabled()] if solo else [])
+    cycles, bad = None, []
+    for rules in runs:
+        o1, s1 = Z.assemble_and_run(peephole.optimize(raw, rules=rules), pre_run=pre)
+        if o1 != o0 or s1.mmio_writes != s0.mmio_writes:
+            bad.append(",".join(rules) if len(rules) == 1 else "all")
+        cycles = s1.cycles if cycles is None else cycles
+    return not bad, f"output differs with {bad}", (os.path.basename(path), reg_temps,
+                                                   s0.cycles, cycles)
+for p in progs:
+    CASES.append((f"{os.path.basename(p)}: optimized == unoptimized (REG_TEMPS, each rule alone)",
+                  lambda p=p: differential(p, True, True)))
+    CASES.append((f"{os.path.basename(p)}: optimized == unoptimized (stack machine)",
+                  lambda p=p: differential(p, False, False)))
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data and data[0] in ("08_md5.c", "09_fft.c", "dhrystone.c"):
+        print(f"  {data[0]:<14} {'REG_TEMPS' if data[1] else 'stack    '} cycles "
+              f"{data[2]:>9} -> {data[3]:>9}  ({100.0 * (data[3] - data[2]) / data[2]:+.1f}%)")
+print(f"\n{npass}/{len(CASES)} peephole checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
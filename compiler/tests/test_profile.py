@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Profiler (simulator/zx16prof.py): exact per-PC / per-class / branch counts and the
+AHB core cycle model on a hand-counted fragment at several wait-state settings (and
+for the FWD=1 pipeline, with a load-use stall), an interrupt charged to its handler's frame, function folding and call stacks for
+compiled C (runtime routines, recursion, no local labels), the profile leaving
+every example + dhrystone unchanged, and the CLI's collapsed-stack file.
+"""
+import os, sys, subprocess, tempfile
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, glob, codegen_patterns, zcc, codegen   # noqa: E402
+for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
+import zx16sim as Z, zx16prof as P                       # noqa: E402
+import harness                                            # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+PROF = os.path.join(ROOT, "simulator", "zx16prof.py")
+
+CASES = []
+def case(name, fn): CASES.append((name, fn))
+
+# 1) hand-counted: 16 instructions, 3 loads + 3 stores, bnz taken twice / not once,
+#    4 redirects (2 taken branches, the call, the ret)
+LOOP = """
+.text
+.org 0x0020
+main:
+    li   x6, 3
+__loop1:
+    sw   x6, -2(x2)
+    lw   x5, -2(x2)
+    addi x6, -1
+    bnz  x6, __loop1
+    call leaf
+    ecall 0x3FF
+leaf:
+    ret
+"""
+def counts(iws, dws):
+    _, sim, p = P.profile_asm(LOOP, iws=iws, dws=dws)
+    f = 1 + iws
+    want = 16 * f + 6 * (3 + dws) + 4 * f
+    got = (p.instructions, sim.cycles, p.cycles, p.loads, p.stores, p.flushes,
+           dict(p.classes), sum(p.taken.values()), sum(p.not_taken.values()))
+    ref = (16, 16, want, 3, 3, 4, {"I": 4, "S": 3, "L": 3, "B": 3, "J": 1, "SYS": 1, "R": 1},
+           2, 1)
+    st = p.stacks()
+    names = [r[0] for r in p.functions_table()]
+    ok = (got == ref and st == {("main",): want - 2 * f, ("main", "leaf"): 2 * f}
+          and names == ["main", "leaf"] and p.insns[0x22] == 3 and p.insns[0x20] == 1)
+    return ok, f"{got} vs {ref}; stacks {dict(st)}; functions {names}"
+for iws, dws in ((0, 0), (1, 0), (0, 3), (2, 1)):
+    case(f"counts and modeled cycles (iws={iws}, dws={dws})",
+         lambda iws=iws, dws=dws: counts(iws, dws))
+
+# 1b) the FWD=1 core: each store / load issues after its own fetch, the next waits for
+#     the D-bus only while the previous access is on it (lw after sw), the load's
+#     data is forwarded to a use in the cycle its data phase completes, and ECALL
+#     waits for an idle D-bus. Timelines counted by hand: LOOP 23 / 60 cycles
+#     (serialized 38 / 84); LU: li 1, sw 2 -> 4, lw 4 -> 6, add forwarded at 6,
+#     addi 7, ecalls 8 and 9 = 9 at (0, 0); 3, 6 -> 9, 9 -> 12, 12, 15, 18, 21 at (2, 1).
+LU = """
+.text
+.org 0x0020
+main:
+    li   x5, 9
+    sw   x5, -2(x2)
+    lw   x6, -2(x2)
+    add  x6, x6
+    addi x7, 1
+    ecall 0x000
+    ecall 0x3FF
+"""
+def fwd_counts(iws, dws, loop, lu):
+    _, _, p = P.profile_asm(LOOP, iws=iws, dws=dws, fwd=True)
+    out, _, q = P.profile_asm(LU, iws=iws, dws=dws, fwd=True)
+    ok = ((p.cycles, q.cycles) == (loop, lu) and [v for _, v in out] == [18]
+          and sum(p.pc_cycles.values()) == p.cycles and sum(q.pc_cycles.values()) == q.cycles)
+    return ok, f"LOOP {p.cycles} (want {loop}), LU {q.cycles} (want {lu}), out {out}"
+for iws, dws, loop, lu in ((0, 0, 23, 9), (2, 1, 60, 21)):
+    case(f"FWD=1 overlap and load-use interlock (iws={iws}, dws={dws})",
+         lambda a=(iws, dws, loop, lu): fwd_counts(*a))
+
+# 2) a hardware interrupt: squash + refill charged to the handler, which sits in a
+#    frame over the interrupted function
+IRQ = """
+.text
+.org 0x0004
+    j isr
+.org 0x0020
+main:
+    ei
+    li   x6, 5
+__w1:
+    addi x6, -1
+    bnz  x6, __w1
+    ecall 0x3FF
+isr:
+    li   x5, 7
+    reti
+"""
+def irq_case():
+    out, sim, p = P.profile_asm(IRQ, pre_run=lambda s: s.raise_irq(2))
+    st = p.stacks()
+    ok = (p.instructions == 16 and p.cycles == 16 + 6 + 2
+          and st == {("main",): 13 + 4, ("main", "<vectors>"): 4, ("main", "isr"): 3})
+    return ok, f"{p.instructions} insns, {p.cycles} cycles, stacks {dict(st)}"
+case("interrupt entry is charged to the handler's frame", irq_case)
+
+# 3) compiled C: runtime calls, recursion, emitter labels never named
+CPROG = """
+#pragma noinline g
+int g(int a, int b){ return a * b + 1; }
+int f(int n){ int i; int s; s = 0; i = 0; while (i < n) { s = s + g(i, n); i = i + 1; } return s; }
+int fact(int n){ if (n < 2) { return 1; } return n * fact(n - 1); }
+int main(void){ putint(f(9)); putint(fact(6)); return 0; }
+"""
+def c_case():
+    codegen.REG_TEMPS = True
+    out, sim, p = P.profile_asm(codegen.compile_src(CPROG, LIB))
+    st = p.stacks(); names = {r[0] for r in p.functions_table()}
+    tbl = {r[0]: r for r in p.functions_table()}
+    ok = ([v for _, v in out] == [sum(i * 9 + 1 for i in range(9)), 720]
+          and ("__start", "main", "f", "g", "__mul") in st
+          and ("__start", "main", "fact", "__mul") in st
+          and not any(len([n for n in s if n == "fact"]) > 1 for s in st)
+          and names <= {"__start", "main", "f", "g", "fact", "__mul"}
+          and tbl["main"][2] + tbl["__start"][1] == p.cycles
+          and tbl["f"][2] > tbl["g"][2] > tbl["g"][1])
+    return ok, f"{names}; {sorted(st)}"
+case("C functions fold by symbol; call stacks through __mul and recursion", c_case)
+
+# 4) profiling changes nothing architectural and accounts for every cycle
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+def transparent(path):
+    asm = codegen.compile_src(open(path).read(), LIB)
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    o0, s0 = Z.assemble_and_run(asm, pre_run=pre)
+    o1, s1, p = P.profile_asm(asm, pre_run=pre, iws=1, dws=2)
+    _, _, pf = P.profile_asm(asm, pre_run=pre, iws=1, dws=2, fwd=True)
+    tbl = p.functions_table()
+    ok = (o0 == o1 and s0.mmio_writes == s1.mmio_writes and s0.reg == s1.reg
+          and p.instructions == s0.cycles == s1.cycles
+          and sum(p.pc_cycles.values()) == sum(p.stacks().values())
+          == sum(r[1] for r in tbl) == p.cycles
+          and sum(r[3] for r in tbl) == p.instructions
+          and sum(pf.pc_cycles.values()) == pf.cycles < p.cycles)
+    return ok, f"{p.instructions} insns / {p.cycles} cycles", (os.path.basename(path),
+                                                                p.instructions, p.cycles,
+                                                                pf.cycles)
+for pth in progs:
+    case(f"{os.path.basename(pth)}: profiled run == plain run, every cycle attributed",
+         lambda pth=pth: transparent(pth))
+
+# 5) the CLI: flat profile on stdout, collapsed stacks in the --folded file
+def cli_case():
+    with tempfile.TemporaryDirectory() as tmp:
+        folded = os.path.join(tmp, "md5.folded")
+        r = subprocess.run([sys.executable, PROF, os.path.join(COMPILER, "examples", "08_md5.c"),
+                            "--lib", LIB, "--top", "5", "--folded", folded],
+                           capture_output=True, text=True)
+        lines = open(folded).read().splitlines() if os.path.exists(folded) else []
+    total = int(r.stdout.split("cycles ")[1].split()[0]) if "cycles " in r.stdout else -1
+    ok = (r.returncode == 0 and lines and all(l.rsplit(" ", 1)[1].isdigit() for l in lines)
+          and sum(int(l.rsplit(" ", 1)[1]) for l in lines) == total
+          and all(l.startswith("__start") for l in lines))
+    return ok, r.stdout[-300:] + r.stderr[-300:]
+case("CLI: flat profile + collapsed-stack file", cli_case)
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data and data[0] in ("08_md5.c", "09_fft.c", "dhrystone.c"):
+        print(f"  {data[0]:<14} {data[1]:>8} instructions  {data[2]:>9} cycles at iws=1 dws=2 "
+              f"(CPI {data[2] / data[1]:.2f}; FWD=1 {data[3] / data[1]:.2f})")
+print(f"\n{npass}/{len(CASES)} profiler checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+"""Scalar locals in registers (codegen.REG_LOCALS) and copy propagation (peephole
+copy_prop). A call-free function keeps its hottest loop scalars in x7 / x4 / x0,
+one that calls keeps them in x0 only (saved and restored by the callee, never by
+main); an address-taken variable stays in the frame, variables whose live ranges
+do not overlap share a register, a far jump in a body holding x4 goes through x5,
+and every choice is a `# regs:` comment in the assembly. Every example + dhrystone
+must print the same values and leave the same MMIO write log with register locals
+on and off. Reports the code-size and cycle deltas on checksum / matmul / dhrystone.
+"""
+import os, sys, glob, re
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+sys.path.insert(0, os.path.join(ROOT, "assembler"))
+import importlib, codegen_patterns, zcc, peephole, codegen    # noqa: E402
+for m in (codegen_patterns, zcc, peephole, codegen): importlib.reload(m)
+import zx16asm as A                                            # noqa: E402
+import zx16sim as Z                                            # noqa: E402
+import harness                                                 # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+def compile_with(src, reg_locals=True, inline=False):
+    """Inlining off by default: the functions under test keep their own frames."""
+    codegen.REG_LOCALS, codegen.INLINE = reg_locals, inline
+    try:
+        return codegen.compile_src(src, LIB)
+    finally:
+        codegen.REG_LOCALS, codegen.INLINE = True, True
+
+def func(asm, name):
+    """The instructions of function `name` (up to the next global label)."""
+    lines = asm[asm.index(f"\n{name}:") + 1:].splitlines()[1:]
+    end = next((i for i, l in enumerate(lines) if re.match(r"[A-Za-z]\w*:$", l)), len(lines))
+    return [l.strip() for l in lines[:end] if l.strip() and not l.endswith(":")]
+
+def note(asm, name):
+    return next((l for l in func(asm, name) if l.startswith("# regs:")), None)
+
+def run(asm):
+    return [v for _, v in Z.assemble_and_run(asm)[0]]
+
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+
+CASES = []
+# 1) what goes where
+PROG = """
+int xorsum(int *a, int n) { int s; int i; s = 0; i = 0;
+  while (i < n) { s = s ^ a[i]; i = i + 1; } return s; }
+int viaptr(int n) { int i; int *p; int t; p = &t; i = 0; t = 0;
+  while (i < n) { *p = *p + i; i = i + 1; } return t; }
+int twice(int n) { int i; int j; int s; s = 0;
+  i = 0; while (i < n) { s = s + i; i = i + 1; }
+  j = 0; while (j < n) { s = s + j; j = j + 1; } return s; }
+int g(int n) { int k; int s; s = 0; k = 0; while (k < n) { s = s + k * 3; k = k + 1; } return s; }
+int quot(int n, int d) { int i; int s; s = 0; i = 0; while (i < n) { s = s + i / d; i = i + 1; }
+  return s; }
+int main(void) { int v[3]; int i; int t; v[0] = 5; v[1] = 6; v[2] = 9;
+  putint(xorsum(v, 3)); putint(viaptr(5)); putint(twice(4));
+  t = 0; i = 0; while (i < 4) { t = t + g(i); i = i + 1; } putint(t);
+  putint(quot(10, 3)); return 0; }
+"""
+WANT = [10, 10, 12, 12, 12]
+def leaf_case():
+    asm = compile_with(PROG)
+    f = func(asm, "xorsum")
+    ok = (note(asm, "xorsum").startswith("# regs: i=x7 s=x4 n=x0; in the frame: a")
+          and "blt x7, x0, __wbody4" in f and "xor x4, x5" in f and "addi x7, 1" in f
+          and f[f.index("# regs: i=x7 s=x4 n=x0; in the frame: a (4 hot scalars, at most 4 "
+                        "live at once, 3 registers)") + 1] == "sw x0, -2(x3)"
+          and f[-5:] == ["mv x6, x4", "lw x0, -2(x3)", "mv x2, x3", "pop x3", "ret"]
+          and run(asm) == WANT)
+    return ok, f
+CASES.append(("a call-free loop: i / s / n in x7 / x4 / x0, x0 saved and restored, "
+              "the array parameter in the frame", leaf_case))
+def addr_case():
+    asm = compile_with(PROG)
+    n = note(asm, "viaptr")
+    return n.startswith("# regs: i=x7 p=x4 n=x0 ") and " t" not in n.split("(")[0], n
+CASES.append(("an address-taken variable (t, via p = &t) stays in its slot", addr_case))
+def share_case():
+    asm = compile_with(PROG)
+    f = func(asm, "twice")
+    return (note(asm, "twice").startswith("# regs: s=x7 i=x4 j=x4 n=x0 ")
+            and "at most 3 live at once" in note(asm, "twice")
+            and f.count("add x7, x4") == 2), note(asm, "twice")
+CASES.append(("two loops one after the other: i and j share x4", share_case))
+def calls_case():
+    asm = compile_with(PROG)
+    m, g, q = func(asm, "main"), func(asm, "g"), func(asm, "quot")
+    ok = (note(asm, "main").startswith("# regs: i=x0; in the frame: t ")
+          and not any(re.match(r"(sw|lw) x0, ", l) for l in m)      # main never returns
+          and "sw x0, -2(x3)" in g and "lw x0, -2(x3)" in g          # g uses x0 too
+          and note(asm, "quot").startswith("# regs: i=x0; in the frame: s n d ")
+          and "1 register)" in note(asm, "quot")
+          and "la x7, __div" in q and "addi x0, 1" in q)
+    return ok, (note(asm, "main"), note(asm, "quot"))
+CASES.append(("with calls only x0 holds a variable; main's i survives g, which "
+              "saves x0 itself, and a runtime __div call", calls_case))
+def off_case():
+    asm = compile_with(PROG, reg_locals=False)
+    return ("# regs:" not in asm and "x0" not in asm.replace("0x0", "")
+            and run(asm) == WANT), note(asm, "xorsum")
+CASES.append(("REG_LOCALS off: no x0, no notes, the same output", off_case))
+
+# 2) a loop too long for a branch: the far jumps use x5 while x4 holds a variable
+BIG = ("int mix(int n) { int s; int i; s = 0; i = 0; while (i < n) { "
+       + "s = s ^ (i + 3); s = s + 7; " * 60
+       + "i = i + 1; } return s; }\nint main(void) { putint(mix(5)); return 0; }\n")
+def far_case():
+    asm = compile_with(BIG)
+    f = func(asm, "mix")
+    ok = ("# regs: s=x7 i=x4 n=x0 " in note(asm, "mix") or
+          "# regs: i=x7 s=x4 n=x0 " in note(asm, "mix")) \
+        and "jr x5" in f and "jr x4" not in f \
+        and run(asm) == run(compile_with(BIG, reg_locals=False))
+    return ok, (note(asm, "mix"), [l for l in f if l.startswith(("la ", "jr "))])
+CASES.append(("a body past the branch range: x4 in use, far jumps through la x5 / jr x5",
+              far_case))
+
+# 3) differential over the examples and dhrystone
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+def differential(path):
+    src = open(path).read()
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    old = compile_with(src, reg_locals=False, inline=True)
+    new = compile_with(src, inline=True)
+    (o0, s0), (o1, s1) = Z.assemble_and_run(old, pre_run=pre), Z.assemble_and_run(new, pre_run=pre)
+    size = [len(A.assemble(t).check().sections[".text"]) for t in (old, new)]
+    ok = o0 == o1 and s0.mmio_writes == s1.mmio_writes
+    return ok, f"cycles {s0.cycles} -> {s1.cycles}", (os.path.basename(path), s0.cycles,
+                                                      s1.cycles, *size)
+for p in progs:
+    CASES.append((f"{os.path.basename(p)}: register locals == every local in the frame",
+                  lambda p=p: differential(p)))
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data and data[0] in ("04_checksum.c", "06_matmul.c", "dhrystone.c"):
+        print(f"  {data[0]:<14} cycles {data[1]:>9} -> {data[2]:>9} "
+              f"({100.0 * (data[2] - data[1]) / data[1]:+.1f}%)   .text {data[3]:>5} -> "
+              f"{data[4]:>5} B")
+print(f"\n{npass}/{len(CASES)} register-local checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
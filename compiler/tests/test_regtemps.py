@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Register-allocated expression codegen (codegen.REG_TEMPS) vs the stack machine.
+Every example + dhrystone must print the same values and leave the same MMIO write
+log in both modes; targeted programs cover I-type immediates at their encoding
+edges, trees deep enough to spill, far struct/array offsets, pointer scaling and
+MMIO read order. Reports the cycle-count delta on md5 / fft / dhrystone.
+"""
+import os, sys, glob
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, codegen_patterns, zcc, codegen      # noqa: E402
+for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
+import zx16sim as Z                                    # noqa: E402
+import harness                                         # noqa: E402
+
+def s16(v): v &= 0xFFFF; return v - 0x10000 if v & 0x8000 else v
+
+def run(src, on, pre=None):
+    codegen.REG_TEMPS = on
+    try:
+        out, sim = Z.assemble_and_run(codegen.compile_src(src, os.path.join(COMPILER, "lib")),
+                                      pre_run=pre)
+    finally:
+        codegen.REG_TEMPS = True
+    return out, sim
+
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+
+CASES = []
+# 1) differential over the examples and dhrystone
+progs = sorted(glob.glob(os.path.join(COMPILER, "examples", "*.c")))
+progs.append(os.path.join(COMPILER, "bench", "dhrystone.c"))
+def differential(path):
+    src = open(path).read()
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    (o0, s0), (o1, s1) = run(src, False, pre), run(src, True, pre)
+    ok = o0 == o1 and s0.mmio_writes == s1.mmio_writes
+    return ok, f"cycles {s0.cycles} -> {s1.cycles}", (os.path.basename(path), s0.cycles, s1.cycles)
+for p in progs:
+    CASES.append((f"{os.path.basename(p)}: REG_TEMPS output == stack machine",
+                  lambda p=p: differential(p)))
+
+# 2) immediates at their encoding edges (I-type ranges differ per opcode)
+VALS = [0, 1, -1, 5, 62, 63, 64, -64, -65, 127, 128, 0x7FFF, -0x8000, 0x1234, -300]
+KS = [0, 1, 15, 16, 63, 64, 127, 128, -1, -63, -64, -65, 0x7FFF, -0x8000, 0xFF]
+def imm_prog(unsigned):
+    ty = "unsigned" if unsigned else "int"
+    body, want = [], []
+    for op in ("<", "<=", ">", ">=", "==", "!=", "+", "-", "&", "|", "^"):
+        for k in KS:
+            body.append(f"putint(x {op} {k & 0xFFFF});")
+    for op in ("<<", ">>"):
+        for k in (0, 1, 4, 15):
+            body.append(f"putint(x {op} {k});")
+    for v in VALS:
+        for op in ("<", "<=", ">", ">=", "==", "!=", "+", "-", "&", "|", "^"):
+            for k in KS:
+                a, b = (v & 0xFFFF, k & 0xFFFF) if unsigned else (s16(v), s16(k))
+                r = {"<": a < b, "<=": a <= b, ">": a > b, ">=": a >= b, "==": a == b,
+                     "!=": a != b, "+": a + b, "-": a - b, "&": a & b, "|": a | b,
+                     "^": a ^ b}[op]
+                want.append(s16(int(r)))
+        for op in ("<<", ">>"):
+            for k in (0, 1, 4, 15):
+                a = v & 0xFFFF if unsigned else s16(v)
+                want.append(s16(a << k if op == "<<" else a >> k))
+    inits = "".join(f"vals[{i}] = {v & 0xFFFF};" for i, v in enumerate(VALS))
+    src = f"""{ty} vals[{len(VALS)}];
+int main(void){{ {ty} x; int i; {inits}
+  i = 0;
+  while (i < {len(VALS)}) {{ x = vals[i]; {" ".join(body)} i = i + 1; }}
+  return 0; }}"""
+    return src, want
+def imm_case(unsigned):
+    src, want = imm_prog(unsigned)
+    got = [v for _, v in run(src, True)[0]]
+    ok = got == want and got == [v for _, v in run(src, False)[0]]
+    bad = next((i for i, (g, w) in enumerate(zip(got, want)) if g != w), None)
+    return ok, f"first mismatch at #{bad}" if bad is not None else f"{len(got)} vs {len(want)}"
+CASES.append(("immediates at encoding edges (signed)", lambda: imm_case(False)))
+CASES.append(("immediates at encoding edges (unsigned)", lambda: imm_case(True)))
+
+# 3) expressions deeper than x6+x5/x4/x7 (Sethi-Ullman spill) and mixed register/stack
+def deep(depth, n=[0]):
+    if depth == 0:
+        n[0] += 1
+        return f"v{n[0] % 6}"
+    op = "+-^|&"[depth % 5]
+    return f"({deep(depth - 1)} {op} {deep(depth - 1)})"
+DEEP = deep(6)
+def py_eval(expr, env):
+    return s16(eval(expr, {}, env))
+def deep_case():
+    env = {f"v{i}": x for i, x in enumerate([3, -7, 100, 0x1234, -1, 42])}
+    decl = "".join(f"int v{i}; " for i in range(6))
+    init = "".join(f"v{i} = {x & 0xFFFF}; " for i, x in enumerate(env.values()))
+    src = f"""int sq(int x){{ return x * x; }}
+int main(void){{ {decl} {init}
+  putint({DEEP});
+  putint(sq(v1) + ({DEEP}));
+  putint(({DEEP}) - sq(v2) * v3);
+  putint(v5 % 5 - (v2 / v0 + (v3 & v1)));
+  return 0; }}"""
+    want = [py_eval(DEEP, env), s16(49 + py_eval(DEEP, env)),
+            s16(py_eval(DEEP, env) - 10000 * 0x1234), s16(42 % 5 - (100 // 3 + (0x1234 & -7)))]
+    got = [v for _, v in run(src, True)[0]]
+    return got == want and got == [v for _, v in run(src, False)[0]], got
+CASES.append(("trees deeper than the register pool spill correctly", deep_case))
+
+# 4) addressing: far struct fields, far constant indices (local + global), pointer
+#    scaling, address-of, nested members, signed/unsigned bytes
+ADDR = """
+struct in { int x; int y; };
+struct big { int a; char pad[100]; int far; struct in in; };
+struct big G;
+int garr[200];
+int main(void){
+  struct big L; int larr[80]; int *p; struct big *q; char c; unsigned char uc; char cb[4];
+  G.far = 11; G.in.y = 12; L.far = 13; L.in.y = 14; q = &G;
+  garr[150] = 150; garr[0] = 1; larr[79] = 79; larr[2] = 2;
+  p = garr; p = p + 150;
+  putint(G.far + L.far); putint(q->in.y + L.in.y); putint(q->far);
+  putint(garr[150] + larr[79]); putint(*p); putint(*(p - 150) + larr[2]);
+  p = &larr[79]; putint(*p);
+  p = &garr[0]; putint(p[150] - p[0]);
+  cb[0] = 200; cb[1] = 65; c = cb[0]; uc = cb[0];
+  putint(c); putint(uc); putint(cb[1] + cb[0]);
+  return 0; }
+"""
+def addr_case():
+    want = [24, 26, 11, 229, 150, 3, 79, 149, -56, 200, 9]
+    got = [v for _, v in run(ADDR, True)[0]]
+    return got == want and got == [v for _, v in run(ADDR, False)[0]], got
+CASES.append(("reg+offset addressing (far fields/indices, bytes, pointers)", addr_case))
+
+# 5) two MMIO reads in one expression are never reordered, even when Sethi-Ullman
+#    would prefer the deeper right operand first
+MMIO = """int main(void){
+  putint(*(volatile int *)0xF020 - (*(volatile int *)0xF020 + *(volatile int *)0xF020));
+  return 0; }"""
+def mmio_case():
+    pre = lambda sim: sim.mmio_read_script.__setitem__(0xF020, [1, 2, 3])
+    got = [v for _, v in run(MMIO, True, pre)[0]]
+    return got == [1 - (2 + 3)], got
+CASES.append(("MMIO reads stay in source order", mmio_case))
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data and data[0] in ("08_md5.c", "09_fft.c", "dhrystone.c"):
+        print(f"  {data[0]:<14} cycles {data[1]:>9} -> {data[2]:>9}  "
+              f"({100.0 * (data[2] - data[1]) / data[1]:+.1f}%)")
+print(f"\n{npass}/{len(CASES)} register-temporary codegen checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
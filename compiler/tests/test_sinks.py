@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Record sinks for the MMIO write log and program output (ZX16.log_to). A
+framebuffer-style program that stores every pixel through MMIO and prints a char
+per frame is logged to each sink and compared with the default lists: RingSink keeps
+the last N (and counts all) in bounded memory, FilterSink keeps the chosen
+addresses / output kinds, CallbackSink sees every record, BinarySink writes
+fixed-width records that read_records() decodes back. Sinks take part in snapshots
+(a rewound run leaves the same ring and the same file), and the UART model's `sent`
+takes the same sinks.
+"""
+import os, sys, collections, tempfile, tracemalloc
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+SOC = os.path.join(ROOT, "rtl", "soc")
+sys.path.insert(0, os.path.join(ROOT, "compiler"))
+sys.path.insert(0, os.path.join(ROOT, "simulator")); sys.path.insert(0, SOC)
+import importlib, zx16sim as Z, zx16soc as S     # noqa: E402
+importlib.reload(Z); importlib.reload(S)
+import soc_run                                   # noqa: E402
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+FB = """
+.text
+.org 0x0020
+    li16 x4, 0                # frame
+frame:
+    li16 x5, 0xF100           # 256 byte "pixels"
+    li16 x7, 0xF200
+pix:
+    sb   x4, 0(x5)
+    addi x5, 1
+    bltu x5, x7, pix
+    li16 x5, 0xF010           # a status word per frame
+    sw   x4, 0(x5)
+    mv   x6, x4
+    ecall 0x000               # the frame number ...
+    li16 x6, 46
+    ecall 0x001               # ... and a '.'
+    addi x4, 1
+    li16 x6, FRAMES
+    bge  x4, x6, done
+    j    frame
+done:
+    ecall 0x3FF
+"""
+def image(frames):
+    return Z.load_assembler().assemble(FB.replace("FRAMES", str(frames))).check().binary()
+IMG = image(120)
+
+def run(mmio=None, out=None, img=IMG):
+    sim = Z.ZX16(); sim.load(img, 0)
+    sim.log_to(mmio, out)
+    sim.run()
+    return sim
+
+ref = run()
+full, out = list(ref.mmio_writes), list(ref.out)
+check(f"the default sinks are lists: {len(full)} MMIO writes, {len(out)} output records",
+      type(ref.mmio_writes) is list and type(ref.out) is list and len(full) == 120 * 257
+      and len(out) == 240)
+
+# 1) ring, filter, callback
+sim = run(Z.RingSink(100), Z.RingSink(6))
+check("RingSink keeps the last N records and counts them all",
+      list(sim.mmio_writes) == full[-100:] and sim.mmio_writes.total == len(full)
+      and list(sim.out) == out[-6:] and sim.out.total == len(out)
+      and sim.mmio_writes is sim.mmio.writes)
+sim = run(Z.RingSink(0), Z.RingSink(0))
+check("RingSink(0) keeps only the count", not sim.mmio_writes and sim.out.total == len(out))
+sim = run(Z.FilterSink([], range(0xF100, 0xF104)), Z.FilterSink([], {'int'}))
+check("FilterSink passes on the chosen addresses / output kinds",
+      list(sim.mmio_writes) == [r for r in full if 0xF100 <= r[0] < 0xF104]
+      and list(sim.out) == [r for r in out if r[0] == 'int'] and len(sim.mmio_writes) == 480)
+hist = collections.Counter()
+sim = run(Z.CallbackSink(lambda r: hist.update([r[0]])),
+          Z.FilterSink(Z.RingSink(1), lambda r: r[0] == 'int' and r[1] % 7 == 0))
+check("CallbackSink sees every record; FilterSink takes a predicate",
+      hist == collections.Counter(a for a, _, _ in full) and list(sim.out) == [('int', 119)])
+
+# 2) binary files
+TMP = tempfile.mkdtemp(prefix="zx16sinks_")
+mpath, opath = os.path.join(TMP, "mmio.bin"), os.path.join(TMP, "out.bin")
+sim = run(Z.BinarySink(mpath), Z.BinarySink(opath, 'out'))
+sim.mmio_writes.close(); sim.out.close()
+check(f"BinarySink: fixed-width records ({os.path.getsize(mpath)} B for {len(full)} writes), "
+      f"read back as logged",
+      os.path.getsize(mpath) == 5 * len(full) and os.path.getsize(opath) == 3 * len(out)
+      and list(Z.read_records(mpath)) == full and list(Z.read_records(opath, 'out')) == out)
+
+# 3) memory stays bounded with a ring, not with the list
+def peak(sinks, img):
+    tracemalloc.start()
+    try:
+        run(*sinks(), img=img)
+        return tracemalloc.get_traced_memory()[1]
+    finally:
+        tracemalloc.stop()
+for frames in (100, 400):
+    big = image(frames)
+    lst = peak(lambda: (None, None), big)
+    ring = peak(lambda: (Z.RingSink(256), Z.RingSink(64)), big)
+    if frames == 100: ring100 = ring
+check(f"a {frames}-frame run: {lst // 1024} KB logging to lists, {ring // 1024} KB to "
+      f"rings (the same as for 100 frames, within 64 KB)",
+      ring < lst / 20 and abs(ring - ring100) < 65536, (lst, ring, ring100))
+
+# 4) snapshots: a ring resumed elsewhere, a file rewound
+def rings():
+    sim = Z.ZX16(); sim.load(IMG, 0); sim.log_to(Z.RingSink(50), Z.RingSink(10))
+    return sim
+base = run(Z.RingSink(50), Z.RingSink(10))
+snaps = rings().run_checkpointed(10**6, 9000)
+other = rings()
+other.restore(Z.Snapshot.from_bytes(snaps[len(snaps) // 2].to_bytes(IMG), IMG))
+other.run()
+check(f"rings resume from a checkpoint (of {len(snaps)}) to the uninterrupted run's",
+      list(other.mmio_writes) == list(base.mmio_writes) == full[-50:]
+      and list(other.out) == out[-10:] and other.out.total == len(out))
+sim = Z.ZX16(); sim.load(IMG, 0); sim.log_to(out=Z.BinarySink(opath, 'out'))
+snaps = sim.run_checkpointed(10**6, 9000)
+sim.restore(snaps[2]); sim.out.flush(); data_at = os.path.getsize(opath)
+sim.run(); sim.out.close()
+check("a rewound run truncates its file back to the snapshot and writes the same records",
+      data_at == 3 * snaps[2].cpu['out']['total'] > 0
+      and list(Z.read_records(opath, 'out')) == out, data_at)
+
+# 5) the UART model's transmit log
+mon = soc_run.compile_firmware(os.path.join(SOC, "fw", "monitor.c"))
+def monitor(sent):
+    sim = Z.ZX16(); sim.load(mon, 0); sim.max_cycles = 150000
+    uart, _ = S.attach(sim); uart.sent = sent
+    uart.feed("w A000 ABCD\nr A000\nd A000 2\nq\n", at=5000)
+    sim.run(9000); snap = sim.save(); sim.run(); uart.drain()
+    sim.restore(snap); sim.run()
+    got = uart.drain()
+    if hasattr(sent, 'flush'): sent.flush()
+    return got
+bpath = os.path.join(TMP, "uart.bin")
+tail, binary = monitor(Z.RingSink(8)), monitor(Z.BinarySink(bpath, 'byte'))
+check("the UART model logs to a ring or a file, across a snapshot restore",
+      tail == b"0 \n>bye\n" and binary is None
+      and bytes(Z.read_records(bpath, 'byte')).endswith(b">abcd 0 \n>bye\n"),
+      (tail, bytes(Z.read_records(bpath, 'byte'))))
+
+for f in os.listdir(TMP): os.remove(os.path.join(TMP, f))
+os.rmdir(TMP)
+print(f"\n{npass}/{ntot} sink checks passed")
+sys.exit(0 if npass == ntot else 1)
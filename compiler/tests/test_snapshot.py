@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Simulator snapshots (ZX16.save / restore / run_checkpointed). A run checkpointed
+every N cycles can be resumed from any checkpoint, in this or a fresh simulator, to
+the same final state (output, cycles, registers, memory, MMIO write log and
+remaining scripted reads) as the uninterrupted run; run(until) stops on the exact
+cycle in both engines; a snapshot holds only the pages that differ from the loaded
+image, round-trips through to_bytes(), and is refused by a simulator holding another
+image. Mid-interrupt state (IE, EPC, a pending IRQ) survives a restore, and a
+failure is bisected from the nearest checkpoint instead of from reset.
+"""
+import os, sys, glob
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+sys.path.insert(0, os.path.join(ROOT, "compiler"))
+sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, buildcache, zx16sim as Z       # noqa: E402
+import harness                                  # noqa: E402
+importlib.reload(Z)
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+def ints(out): return [v for k, v in out]
+
+def state(sim):
+    return (sim.out, sim.cycles, sim.reg, sim.pc, bytes(sim.mem), sim.mmio_writes,
+            {a: list(q) for a, q in sim.mmio_read_script.items()})
+
+def script02(sim):
+    sim.mmio_read_script[0xF020] = [0, 0, 1]; sim.mmio_regs[0xF021] = 99
+
+def fresh(binary, pre_run=None, fast=True):
+    sim = Z.ZX16(); sim.load(binary, 0x0000); sim.fast = fast
+    if pre_run: pre_run(sim)
+    return sim
+
+# 1) resume from every checkpoint == the uninterrupted run
+progs = sorted(glob.glob(os.path.join(ROOT, "compiler", "examples", "*.c")))
+progs.append(os.path.join(ROOT, "compiler", "bench", "dhrystone.c"))
+def resume(path):
+    binary = buildcache.build(open(path).read()).binary
+    pre = script02 if os.path.basename(path).startswith("02_") else None
+    ref = fresh(binary, pre); ref.run()
+    sim = fresh(binary, pre)
+    snaps = sim.run_checkpointed(ref.cycles + 1, max(ref.cycles // 7, 1))
+    if state(sim) != state(ref):
+        return False, "checkpointed run differs"
+    for s in snaps[1:-1]:
+        other = fresh(binary)                   # the saved script replaces pre_run's
+        other.restore(Z.Snapshot.from_bytes(s.to_bytes(binary), other.image))
+        other.run()
+        if state(other) != state(ref):
+            return False, f"resumed from cycle {s.cycles}: state differs"
+    return True, f"{len(snaps)} checkpoints"
+for r in harness.run([(f"{os.path.basename(p)}: resumed from each checkpoint == run from reset",
+                       lambda p=p: resume(p)) for p in progs]):
+    ntot += 1; npass += r[1] == "PASS"
+
+DHRY = buildcache.build(open(os.path.join(ROOT, "compiler", "bench", "dhrystone.c")).read()).binary
+
+# 2) run(until) is exact in both engines
+stops = []
+for fast in (False, True):
+    sim = fresh(DHRY, fast=fast)
+    sim.run(12345)
+    stops.append(state(sim))
+check("run(until) stops on that cycle, step() and translated blocks alike",
+      stops[0] == stops[1] and stops[1][1] == 12345, [s[1] for s in stops])
+
+# 3) the delta: only dirty pages, compact bytes, tied to the image
+sim = fresh(DHRY); sim.run(50000)
+snap = sim.save()
+blob = snap.to_bytes(sim.image)
+back = Z.Snapshot.from_bytes(blob, sim.image)
+check(f"a snapshot keeps {len(snap.pages)} dirty pages of 240 RAM pages, {len(blob)} bytes "
+      f"serialized", 0 < len(snap.pages) < 16 and len(blob) < 4096
+      and (back.pages, back.cpu, back.devices) == (snap.pages, snap.cpu, snap.devices),
+      (len(snap.pages), len(blob)))
+sim.run()
+end = state(sim)
+sim.restore(snap); sim.run()
+check("rewinding the same simulator and running again ends the same way",
+      state(sim) == end)
+other = Z.ZX16(); other.load(DHRY[:0x100], 0x0000)
+try:
+    other.restore(snap); refused = False
+except ValueError as ex:
+    refused = "different image" in str(ex)
+check("restoring into a simulator with another image is refused", refused)
+
+# 4) interrupt state: saved between EI and the pending IRQ being taken
+IRQ = Z.load_assembler().assemble("""
+.text
+.org 0x0004
+    j irq_handler
+.org 0x0020
+main:
+    li16 x6, 1
+    ecall 0x000
+    ei
+    li16 x6, 3
+    ecall 0x000
+    ecall 0x3FF
+irq_handler:
+    li16 x6, 2
+    ecall 0x000
+    mfepc x6
+    ecall 0x000
+    reti
+""").check().binary()
+sim = fresh(IRQ); sim.run(3)
+snap = sim.save()
+sim.raise_irq(2)
+snap_irq = sim.save()
+sim.run()
+other = fresh(IRQ); other.restore(snap_irq); other.run()
+quiet = fresh(IRQ); quiet.restore(snap); quiet.run()
+check("IE and a pending IRQ survive restore; a snapshot before raise_irq has none",
+      ints(other.out) == ints(sim.out) == [1, 2, 0x28, 3] and ints(quiet.out) == [1, 3],
+      (ints(other.out), ints(quiet.out)))
+
+# 5) bisect a "failure" (the last putint) from checkpoints, not from reset
+ref = fresh(DHRY)
+snaps = ref.run_checkpointed(10**7, 20000)
+def failed(sim): return len(sim.out) >= len(ref.out)
+lo, hi = 0, ref.cycles          # find the first cycle where failed() holds
+replayed = from_reset = 0
+while lo < hi:
+    mid = (lo + hi) // 2
+    sim = fresh(DHRY); base = Z.checkpoint_before(snaps, mid)
+    sim.restore(base); sim.run(mid)
+    replayed += mid - base.cycles; from_reset += mid
+    if failed(sim): hi = mid
+    else: lo = mid + 1
+scan = fresh(DHRY); scan.fast = False
+while not failed(scan): scan.step()
+check(f"bisect finds the first failing cycle ({lo}) replaying {replayed} cycles "
+      f"instead of {from_reset}", lo == scan.cycles and replayed * 10 < from_reset,
+      (lo, scan.cycles, replayed, from_reset))
+
+print(f"\n{npass}/{ntot} snapshot checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""SoC peripheral models (simulator/zx16soc.py) in the golden simulator. The SoC
+firmware runs through soc_run.run_model() and transmits what rtl/soc/test_soc.py
+expects of the RTL (hello, the timer, the debug monitor over RX: read / write / dump,
+'g', the raw loader, load + go), and test_irq_soc.py's timer-interrupt program takes
+its three IRQs; at register level the timer's PSC is shadowed to the update event,
+one-pulse mode stops the counter (a long advance() as clock-by-clock steps do, RCR
+> 0 included), down-counting and the repetition counter space
+the updates, and the UART's FIFOSTR / SR / RIS follow the line (thresholds, TC,
+loopback, overrun, W1C). The translated and stepped engines take an interrupt on
+the same cycle, and a snapshot mid-session resumes to the same transcript.
+"""
+import os, sys, random
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+SOC = os.path.join(ROOT, "rtl", "soc")
+sys.path.insert(0, os.path.join(ROOT, "simulator")); sys.path.insert(0, SOC)
+import importlib, zx16sim as Z, zx16soc as S      # noqa: E402
+importlib.reload(Z); importlib.reload(S)
+import soc_run, test_irq_soc                      # noqa: E402
+FW = os.path.join(SOC, "fw")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+# 1) the firmware, with test_soc.py's expectations
+def fw(name, rx=None):
+    return soc_run.run_model(os.path.join(FW, name), rx=rx)
+def ends(r, text):
+    return r["halted"] and not r["timeout"] and r["text"] == text
+r = fw("hello.c")
+check("hello: stdio_si through the UART model", ends(r, "Hello, ZX16 SoC!\n1234\nbeef\n"), r)
+r = fw("tmr.c")
+check("tmr: polled timer overflows", ends(r, "timer: 5 overflows\n"), r)
+r = fw("monitor.c", "w A000 ABCD\nr A000\nw A002 1234\nd A000 2\nq\n")
+check("monitor: read / write / dump over RX",
+      ends(r, "ZX16MON\n>ok\n>abcd\n>ok\n>abcd 1234 \n>bye\n"), r["text"])
+r = fw("monitor.c", "g 20\nq\n")
+check("monitor: 'g 20' restarts (the banner twice)", ends(r, "ZX16MON\n>ZX16MON\n>bye\n"),
+      r["text"])
+r = fw("monitor.c", b"L A000 4\n" + bytes([0xDE, 0xAD, 0xBE, 0xEF]) + b"d A000 2\nq\n")
+check("monitor: raw load, read back", ends(r, "ZX16MON\n>ok\n>adde efbe \n>bye\n"), r["text"])
+pl = soc_run.assemble_image(".text\n li16 x6,75\n li16 x5,0xC008\n sw x6,0(x5)\n"
+                            " ecall 0x3FF\n")[0x20:].rstrip(b"\0")
+r = fw("monitor.c", b"L 9000 " + format(len(pl), "X").encode() + b"\n" + pl + b"g 9000\n")
+check("monitor: load + go (the payload prints 'K')", r["halted"] and r["bytes"][-1] == 75,
+      r["text"])
+r = fw("monitor.c")
+check("monitor without input: waits, and times out at 150000 cycles",
+      r["timeout"] and r["text"] == "ZX16MON\n>", r)
+
+# 2) test_irq_soc.py's program: timer -> vector 2 -> ISR clears UIF -> RETI, x3
+IRQ = soc_run.assemble_image(test_irq_soc.ASM, "irq.s")
+def irq_run(fast):
+    sim = Z.ZX16(); sim.load(IRQ, 0); sim.fast = fast; sim.max_cycles = 150000
+    uart, tmr = S.attach(sim)
+    taken = []
+    real = sim.step
+    def step():                             # record where each interrupt lands
+        if sim.ie and sim.irq_pending: taken.append(sim.cycles)
+        real()
+    sim.step = step
+    sim.run()
+    return sim, bytes(uart.drain()), taken
+(a, out_a, ta), (b, out_b, tb) = irq_run(True), irq_run(False)
+check("test_irq_soc.ASM: three timer IRQs, then 'K' and halt",
+      a.halted and out_a == b"K" and len(ta) == 3 and a.mem[0xA000] == 3, (out_a, ta))
+check("translated blocks and step() take each IRQ on the same cycle, 100 PCLK apart",
+      ta == tb and a.cycles == b.cycles and ta[1] - ta[0] == ta[2] - ta[1] == 100
+      and a.reg == b.reg, (ta, tb))
+
+# 3) register level, poking the models directly
+def bare():
+    sim = Z.ZX16(); sim.load(b"\x00" * 0x40, 0)
+    return (sim, *S.attach(sim))
+def tick(sim, n): sim.cycles += n
+sim, uart, tmr = bare()
+sim.sw(0xD104, 3); sim.sw(0xD108, 9); sim.sw(0xD000, 1)      # PSC 3 (not yet), ARR 9
+tick(sim, 10); c0 = sim.lw(0xD100)                          # PSC 0 until the update
+tick(sim, 5); r0 = sim.lw(0xD024)
+tick(sim, 30); c1 = sim.lw(0xD100)                          # now 4 clocks per count
+sim.sw(0xD02C, 1); r1 = sim.lw(0xD024)
+check("timer: PSC loads at the update event, RIS.UIF sets there, ICR clears it",
+      (c0, r0, c1, r1, sim.lw(0xD104), sim.lw(0xDFFC), sim.lw(0xDFFE)) ==
+      (0, 1, 8, 0, 3, 0x10, 0x10), (c0, r0, c1, r1))
+sim, uart, tmr = bare()
+sim.sw(0xD108, 4); sim.sw(0xD000, 0x5)                      # OPM | CEN
+tick(sim, 100)
+check("timer: one-pulse mode clears CEN at the update and stops",
+      (sim.lw(0xD000), sim.lw(0xD100), sim.lw(0xD024), sim.lw(0xD004)) == (4, 0, 1, 0),
+      (sim.lw(0xD000), sim.lw(0xD100)))
+def timer_state(psc, arr, rcr, cr, n, steps):
+    """A running timer's registers after n PCLK, advanced in one call or clock by clock."""
+    _, _, t = bare()
+    t.psc = t.psc_sh = t.pscc = psc; t.arr = t.arr_sh = arr; t.rcr = t.rcr_c = rcr
+    t.cr = cr
+    for now in (range(1, n + 1) if steps else (n,)):
+        t.advance(now); t.t = now
+    return tuple(getattr(t, k) for k in t._STATE if k != "plain")
+rng = random.Random(7)
+cases = [(0, 3, 2, 0x5, 100)] + [(rng.randrange(3), rng.randrange(1, 8), rng.randrange(1, 4),
+                                  rng.choice((0x5, 0x45)), rng.randrange(1, 200))
+                                 for _ in range(300)]
+bad = [c for c in cases if timer_state(*c, False) != timer_state(*c, True)]
+check(f"timer: one-pulse mode with RCR > 0, {len(cases)} configurations: one advance(n) "
+      "== n one-clock steps (CEN clears at the update)", not bad, bad[:3])
+sim, uart, tmr = bare()
+sim.sw(0xD108, 9); sim.sw(0xD10C, 2); sim.sw(0xD020, 1)
+sim.sw(0xD000, 0x41)                                         # DIR (down) | CEN
+tick(sim, 3); down = sim.lw(0xD100)                          # 0 -> wraps to ARR, counts down
+ups = []
+for _ in range(4):
+    sim.sw(0xD02C, 1); sim.cycles = tmr.next_edge(); ups.append(sim.cycles)
+long = 10**6 + 7; tick(sim, long)                            # whole periods skipped
+check("timer: down-counting, an update every RCR+1 = 3 wraps (30 PCLK), a long wait "
+      "in constant time", down == 7 and [u - ups[0] for u in ups] == [0, 30, 60, 90]
+      and sim.lw(0xD024) == 1 and sim.lw(0xD100) == (9 - long) % 10,
+      (down, ups, sim.lw(0xD100)))
+
+sim, uart, tmr = bare()
+sim.sw(0xC050, 0x21); sim.sw(0xC000, 0x301)                  # TXTH 1, RXTH 2; EN|TXEN|RXEN
+for ch in b"abc": sim.sw(0xC008, ch)
+fst = sim.lw(0xC054); sr = sim.lw(0xC004)
+tick(sim, 160); mid = sim.lw(0xC054); ris_tx = sim.lw(0xC024) & 1
+tick(sim, 400); sr2 = sim.lw(0xC004); ris = sim.lw(0xC024)
+check("uart: 160 PCLK frames at BRR 0, FIFOSTR levels, SR BUSY then TC, RIS TX at "
+      "TXTH and TC once the line is idle",
+      (fst & 0xFFFF, sr & 7, mid & 0xFFFF, ris_tx, sr2 & 0x35, ris & 0x45) ==
+      (2, 4, 1, 1, 0x31, 0x45) and uart.sent == list(b"abc"),
+      (hex(fst), hex(sr), hex(mid), hex(sr2), hex(ris), uart.sent))
+sim.sw(0xC02C, 0xFF); sim.sw(0xC090, 0x02)
+uart.feed(b"xyz"); tick(sim, 3 * 400)
+rx = sim.lw(0xC056); ris = sim.lw(0xC024)
+got = [sim.lw(0xC008) & 0xFF for _ in range(4)]
+check("uart: RX bytes land in the FIFO, RIS RX at RXTH, DR pops (0 once empty)",
+      (rx, ris & 2, got) == (3, 2, [120, 121, 122, 0]), (rx, hex(ris), got))
+sim.sw(0xC000, 0x305)                                        # MODE 01: loopback
+for i in range(34): sim.sw(0xC008, i)
+tick(sim, 34 * 160 + 1)
+check("uart: loopback fills the 32-deep RX FIFO, the 33rd byte is an overrun (ERRCR "
+      "OVR, RIS bit 5), ERRCR and ICR are W1C",
+      sim.lw(0xC056) == 32 and sim.lw(0xC090) & 1 and sim.lw(0xC024) & 0x20
+      and (sim.sw(0xC090, 1), sim.sw(0xC02C, 0x20))
+      and not sim.lw(0xC090) & 1 and not sim.lw(0xC024) & 0x20
+      and sim.lw(0xCFF8) & 0xFF == 0xFF and sim.lw(0xC104) == 3, hex(sim.lw(0xC056)))
+check("free APB slots 0xE000-0xFFFF read 0 and ignore writes",
+      (sim.sw(0xE010, 0x1234), sim.lw(0xE010), sim.lw(0xFFFE))[1:] == (0, 0))
+
+# 4) a snapshot mid-session resumes to the same transcript
+CMDS = "w A000 ABCD\nr A000\nw A002 1234\nd A000 2\nq\n"
+image = soc_run.compile_firmware(os.path.join(FW, "monitor.c"))
+def monitor():
+    sim = Z.ZX16(); sim.load(image, 0); sim.max_cycles = 150000
+    uart, _ = S.attach(sim); uart.feed(CMDS, at=5000)
+    return sim, uart
+sim, uart = monitor(); sim.run(); whole = bytes(uart.drain())
+sim, uart = monitor(); sim.run(9000)
+snap = Z.Snapshot.from_bytes(sim.save().to_bytes(image), image)
+sim.run(); first = bytes(uart.drain())
+other, ou = monitor(); other.restore(snap); other.run()
+check(f"a snapshot at cycle 9000 ({len(snap.devices[0]['sent'])} bytes out, "
+      f"{len(snap.devices[0]['rx_in'])} still on the line) resumes to the same transcript",
+      first == whole == bytes(ou.drain()) and other.cycles == sim.cycles
+      and whole.endswith(b">bye\n"), (whole, bytes(ou.sent)))
+
+print(f"\n{npass}/{ntot} SoC model checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Constant folding and strength reduction of * / % by constants (codegen.const_val,
+codegen_patterns.mul_const / div_const / mod_const / div_recip / mod_recip): every
+operator against C semantics for a spread of constants and edge-value operands,
+signed and unsigned, in registers (REG_TEMPS) and on the stack machine; which
+constants stay runtime calls; folded constant trees; struct arrays and pointer
+steps with non-power-of-two element sizes. Reports the utoa() cycle delta against
+the same loop dividing by a variable.
+"""
+import os, sys, re
+HERE = os.path.dirname(os.path.abspath(__file__))
+COMPILER = os.path.dirname(HERE); ROOT = os.path.dirname(COMPILER)
+sys.path.insert(0, COMPILER); sys.path.insert(0, os.path.join(ROOT, "simulator"))
+import importlib, codegen_patterns, zcc, codegen      # noqa: E402
+for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
+import zx16sim as Z                                    # noqa: E402
+import harness                                         # noqa: E402
+LIB = os.path.join(COMPILER, "lib")
+
+def s16(x): x &= 0xFFFF; return x - 0x10000 if x & 0x8000 else x
+def u16(x): return x & 0xFFFF
+def cdiv(a, b): q = abs(a) // abs(b); return -q if (a < 0) != (b < 0) else q
+def cmod(a, b): return a - cdiv(a, b) * b
+
+SV = [0, 1, -1, 2, -2, 3, -3, 7, -7, 9, 10, -10, 99, 100, -100, 127, -128, 255, -256,
+      999, 1000, -1000, 12345, -12345, 32766, 32767, -32767, -32768]
+UV = [0, 1, 2, 3, 9, 10, 99, 100, 255, 256, 999, 1000, 4095, 12345, 32767, 32768,
+      40000, 54321, 65533, 65534, 65535]
+KS = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 15, 16, 24, 25, 60, 100, 127, 128,
+      255, 256, 1000, 0x4000, 0x7FFF, 0x8000, 0xCCCD, 0xFFFF,
+      -1, -2, -3, -7, -10, -16, -100, -32767]
+
+def run(src, reg_temps=True):
+    codegen.REG_TEMPS = reg_temps
+    try:
+        asm = codegen.compile_src(src, LIB)
+    finally:
+        codegen.REG_TEMPS = True
+    out, sim = Z.assemble_and_run(asm)
+    return [v for _, v in out], sim.cycles, asm
+
+def lit(k, signed):
+    return str(s16(k)) if signed else str(u16(k))
+
+# 1) x*k, x/k, x%k (and k*x) for every k, over every value, both codegen modes
+def ops_case(signed, reg_temps):
+    ty, vals = ("int", SV) if signed else ("unsigned", UV)
+    body, refs = [], []
+    for k in KS:
+        K = lit(k, signed); kv = s16(k) if signed else u16(k)
+        body.append(f"putint(x*{K}); putint({K}*x);"); refs += [lambda x, kv=kv: x * kv] * 2
+        if kv:
+            body.append(f"putint(x/{K}); putint(x%{K});")
+            refs += [lambda x, kv=kv: (cdiv if signed else (lambda a, b: a // b))(x, kv),
+                     lambda x, kv=kv: (cmod if signed else (lambda a, b: a % b))(x, kv)]
+    # inside a larger register tree, next to other temporaries
+    body.append("putint((x - x*10) + (x/8 ^ x%16) - 7*(x+1));")
+    refs.append(lambda x: (x - x * 10) + ((cdiv(x, 8) if signed else x // 8)
+                                          ^ (cmod(x, 16) if signed else x % 16)) - 7 * (x + 1))
+    src = (f"{ty} av[{len(vals)}];\nint main(void){{ {ty} x; int i;\n"
+           + "".join(f" av[{i}]={u16(v)};" for i, v in enumerate(vals))
+           + f"\n i=0; while(i<{len(vals)}){{ x=av[i];\n  " + "\n  ".join(body)
+           + "\n  i=i+1; }\n return 0; }")
+    got = run(src, reg_temps)[0]
+    want = [s16(r(x)) for x in vals for r in refs]
+    bad = next((j for j, (g, w) in enumerate(zip(got, want)) if g != w), None)
+    return got == want, (f"x={vals[bad // len(refs)]}, check #{bad % len(refs)}: "
+                         f"{got[bad]} != {want[bad]}" if bad is not None
+                         else f"{len(got)} vs {len(want)} values")
+CASES = []
+for signed in (True, False):
+    for rt in (True, False):
+        CASES.append((f"{'signed' if signed else 'unsigned'} * / % by {len(KS)} constants "
+                      f"({'REG_TEMPS' if rt else 'stack machine'})",
+                      lambda signed=signed, rt=rt: ops_case(signed, rt)))
+
+# 2) what becomes inline code and what stays a runtime call
+def calls(expr, ty="int"):
+    asm = run(f"int main(void){{ {ty} x; x=12; putint({expr}); return 0; }}")[2]
+    main = asm[asm.index("main:"):]
+    main = main[:main.index("__mul:")] if "__mul:" in main else main
+    return set(re.findall(r"(?:la x[0-9]|jal x1), (__mul|__umul32|__udivmod|__div|__mod)\b",
+                          main))
+def inline_case():
+    inline = ["x*10", "10*x", "x*-3", "x*0x4000", "x/8", "x%8", "x%64", "x/10", "x%10",
+              "x/7", "x%3", "x*0", "x/1", "x%1"]
+    runtime = {"x*0xCCCD": "__mul", "x/1000": "__div", "x%100": "__mod", "x/25": "__div",
+               "x/0": "__div"}
+    bad = [e for e in inline + ["x/-16", "x/-10", "x%-7"] if calls(e)]
+    bad += [e for e in inline if calls(e, "unsigned")]
+    bad += [e for e, r in runtime.items() if calls(e) != {r}]
+    bad += [e for e in ("x/1000", "x%100") if calls(e, "unsigned") != {"__udivmod"}]
+    return not bad, f"unexpected code for {bad}"
+CASES.append(("cheap constants inline, dense multipliers / long-period divisors call", inline_case))
+
+# 3) constant trees fold to one load (signed C semantics, shifts outside 0..15 and
+#    / 0 stay runtime operations)
+FOLD = ["(3+4)*5 - 100/7 % 3", "-(1<<15)", "~0 >> 1", "-7/2", "-7%2", "7/-2", "7%-2",
+        "(0-32767-1)/-1", "1000*1000", "'a'*2 + 1", "(5 > 3) + (2 == 2) * 4 - (1 >= 9)",
+        "0x7FFF + 1", "-(-32768) / 3", "(100 ^ 0x55) & (7 | 8)"]
+REF = [35 - (100 // 7) % 3, -32768, -1, -3, -1, -3, 1, -32768, s16(1000000), 195, 5, -32768,
+       cdiv(-32768, 3), (100 ^ 0x55) & 15]
+def fold_case():
+    src = "int main(void){ " + " ".join(f"putint({e});" for e in FOLD) + " return 0; }"
+    got, _, asm = run(src)
+    main = asm[asm.index("main:"):asm.index("__mul:")]
+    alu = [l.strip() for l in main.splitlines()
+           if re.match(r"\s+(add|sub|sll|srl|sra|slli|srli|srai|xor|and|or|slt|sltu|jalr)\b", l)]
+    ok = got == [s16(v) for v in REF] and len(alu) <= 6          # just the frame set-up
+    return ok, f"got {got}, ALU ops left in main: {alu}"
+CASES.append(("constant expressions fold (signed C semantics)", fold_case))
+def fold_edge_case():
+    src = "int main(void){ int z; z = 0; putint(1 << 16 >> 16); putint((0-1) >> 15); return 0; }"
+    return run(src)[0] == [1, -1], run(src)[0]
+CASES.append(("over-wide shift counts are left to the shifter", fold_edge_case))
+
+# 4) non-power-of-two element sizes: struct arrays and pointer steps
+STRUCTS = """
+struct s3 { char a; char b; char c; };
+struct s6 { int a; int b; int c; };
+struct s10 { int v0; int v1; int v2; int v3; int v4; };
+struct big { int a; char pad[100]; int z; };
+struct s6 g6[12]; struct s10 g10[7]; struct s3 g3[9]; struct big gb[3];
+int main(void){
+  struct s6 l6[5]; struct s6 *p; struct s10 *q; struct s3 *r; struct big *b;
+  int i; int j; int sum;
+  i = 0; while (i < 12) { g6[i].a = i; g6[i].b = i * 7; g6[i].c = 0 - i; i = i + 1; }
+  i = 0; while (i < 7) { g10[i].v0 = i * 10; g10[i].v3 = i * 10 + 3; g10[i].v4 = i * 10 + 4; i = i + 1; }
+  i = 0; while (i < 9) { g3[i].a = i; g3[i].b = i + 100; g3[i].c = i * 2; i = i + 1; }
+  i = 0; while (i < 3) { gb[i].a = i + 1; gb[i].z = (i + 1) * 1000; i = i + 1; }
+  i = 0; while (i < 5) { l6[i].b = g6[i + 7].b; i = i + 1; }
+  i = 4; putint(g6[i].b + g6[i + 1].c); putint(g10[i + 2].v3); putint(g3[i].b);
+  putint(gb[i - 2].z + gb[i - 4].a); putint(l6[i].b);
+  p = g6; p = p + i; putint(p->b); p = p - 3; putint(p->b); p = &g6[11]; putint(p->c);
+  q = &g10[0]; q = q + 6; putint(q->v4); q = q - i; putint(q->v0);
+  r = g3; r = r + 8; putint(r->b); r = r - i; putint(r->c);
+  b = gb; b = b + 2; putint(b->z); b = b - 1; putint(b->a);
+  sum = 0; i = 0; while (i < 12) { sum = sum + g6[i].b; i = i + 1; } putint(sum);
+  return 0; }
+"""
+STRUCT_WANT = [28 - 5, 63, 104, 3001, 77, 28, 7, -11, 64, 20, 108, 8, 3000, 2, 7 * 66]
+def struct_case(reg_temps):
+    got = run(STRUCTS, reg_temps)[0]
+    return got == STRUCT_WANT, got
+CASES.append(("non-pow2 struct arrays and pointer steps (REG_TEMPS)", lambda: struct_case(True)))
+CASES.append(("non-pow2 struct arrays and pointer steps (stack machine)", lambda: struct_case(False)))
+
+# 5) utoa()'s x % 10, x / 10 loop vs the same code dividing by a variable
+UTOA = """#include "stdlib.c"
+char buf[8];
+int main(void){ unsigned v; v = 1; while (v < 60000) { utoa(v, buf); putint(buf[0]); v = v * 3 + 1; }
+  return 0; }"""
+def utoa_case():
+    got, c_const, _ = run(UTOA)
+    src_var = UTOA.replace('#include "stdlib.c"', open(os.path.join(LIB, "stdlib.c")).read()
+                           .replace("% 10", "% ten").replace("/ 10", "/ ten")
+                           .replace("char *utoa(unsigned v, char *buf){",
+                                    "char *utoa(unsigned v, char *buf){ unsigned ten; ten = 10;"))
+    got_var, c_var, _ = run(src_var)
+    ok = got == got_var and c_const < c_var // 2
+    return ok, f"cycles {c_var} (divide by a variable) -> {c_const}", (c_var, c_const)
+CASES.append(("utoa: constant / and % beat the runtime divide", utoa_case))
+
+results = harness.run(CASES)
+npass = harness.passed(results)
+print()
+for name, status, detail, secs, data in results:
+    if data:
+        print(f"  utoa loop cycles {data[0]:>7} -> {data[1]:>7}  "
+              f"({100.0 * (data[1] - data[0]) / data[0]:+.1f}%)")
+print(f"\n{npass}/{len(CASES)} strength-reduction checks passed")
+sys.exit(0 if npass == len(CASES) else 1)
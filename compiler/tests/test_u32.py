@@ -14,6 +14,7 @@ sys.path.insert(0, os.path.join(_ROOT, "simulator"))
 import importlib, codegen_patterns, zcc, codegen          # noqa: E402
 for m in (codegen_patterns, zcc, codegen): importlib.reload(m)
 import zx16sim as Z                                        # noqa: E402
+import harness                                             # noqa: E402
 
 LIB = os.path.join(_COMPILER, "lib", "u32.c")
 M = 0xFFFFFFFF
@@ -85,21 +86,40 @@ for a, b in [(5, 5), (5, 6), (0x12340000, 0x12340000), (0x12340000, 0x12340001)]
 for a, b in [(0x12345678, 3), (0x10000, 0x10000), (0xFFFF, 0x10001), (123456, 654321), (0xFFFFFFFF, 2), (7, 0)]: t_bin('mul32', a, b)
 for a, b in [(100, 7), (0xFFFFFFFF, 0x10000), (0x12345678, 0x1000), (42, 1), (5, 10), (0xABCDEF12, 0x1234), (1000000, 3)]: t_div(a, b)
 
-main = ("int main(void){\n  struct u32 a; struct u32 b; struct u32 r; struct u32 q; struct u32 m;\n"
-        + "\n".join(stmts) + "\n  return 0;\n}\n")
-src = open(LIB).read() + "\n" + main
+def program(sel):
+    main = ("int main(void){\n  struct u32 a; struct u32 b; struct u32 r; struct u32 q; struct u32 m;\n"
+            + "\n".join(stmts[i] for i in sel) + "\n  return 0;\n}\n")
+    return open(LIB).read() + "\n" + main
 
-asm = codegen.compile_src(src)
-out, _ = Z.assemble_and_run(asm)
-vals = [v for _, v in out]
+def run_chunk(sel):
+    """Compile+run the vectors `sel`; returns (ok, detail, (npass, fail lines))."""
+    out, _ = Z.assemble_and_run(codegen.compile_src(program(sel)))
+    vals = [v for _, v in out]
+    idx = npass = 0; fails = []
+    for i in sel:
+        label, exp = tests[i]
+        got = vals[idx:idx + len(exp)]; idx += len(exp)
+        if got == exp: npass += 1
+        else: fails.append(f"FAIL {label}: got {got} exp {exp}")
+    if idx != len(vals):
+        fails.append(f"(!! output count {len(vals)} != expected {idx})")
+    return not fails, f"{len(fails)} mismatches", (npass, fails)
 
-idx = npass = 0
-for label, exp in tests:
-    got = vals[idx:idx + len(exp)]; idx += len(exp)
-    if got == exp:
-        npass += 1
-    else:
-        print(f"FAIL {label}: got {got} exp {exp}")
-extra = "" if idx == len(vals) else f"  (!! output count {len(vals)} != expected {idx})"
-print(f"\n{npass}/{len(tests)} u32 ops match Python references{extra}")
-sys.exit(0 if npass == len(tests) and idx == len(vals) else 1)
+# one program per worker: whole op groups (add32, mul32, ...) are dealt out round-robin
+groups = {}
+for i, (label, _) in enumerate(tests):
+    groups.setdefault(label.split("(")[0], []).append(i)
+nchunks = min(harness.jobs(), len(groups))
+chunks = [[] for _ in range(nchunks)]
+for k, idxs in enumerate(groups.values()):
+    chunks[k % nchunks].extend(idxs)
+results = harness.run([(f"u32 vectors {', '.join(sorted({tests[i][0].split('(')[0] for i in c}))}",
+                        lambda c=c: run_chunk(c)) for c in chunks])
+
+npass = 0; clean = True
+for r in results:
+    if r[4] is None: clean = False; continue
+    npass += r[4][0]
+    for line in r[4][1]: print(line); clean = False
+print(f"\n{npass}/{len(tests)} u32 ops match Python references")
+sys.exit(0 if npass == len(tests) and clean else 1)
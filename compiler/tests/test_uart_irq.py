@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""#pragma interrupt and the interrupt-driven UART driver (compiler/lib/uart_irq.c) on
+the SoC models. The pragma fills a vector with a j to a trampoline that saves the
+scratch registers around the C handler and returns with reti, in a whole build and in
+a zx16ld link (a .vectors.irqN section); bad pragmas are errors. The driver's
+uq_puts() queues a line in a fraction of the cycles stdio_si's polled puts() spends
+on it (rtl/soc/fw/uartlog.c, timed with timer_si.c), keeps the line busy when the
+output outruns the ring, and receives a burst at the full line rate without losing
+bytes while the program is busy.
+"""
+import os, sys
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(os.path.dirname(HERE))
+SOC = os.path.join(ROOT, "rtl", "soc")
+sys.path.insert(0, os.path.join(ROOT, "simulator")); sys.path.insert(0, SOC)
+import importlib, zx16sim as Z, zx16soc as S      # noqa: E402
+importlib.reload(Z); importlib.reload(S)
+import soc_run, buildcache, codegen, codegen_patterns, zcc, zx16ld   # noqa: E402
+LIB = os.path.join(ROOT, "compiler", "lib")
+LOG = os.path.join(SOC, "fw", "uartlog.c")
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def soc_build(src, linked=False):
+    """A firmware image as soc_run.compile_firmware() builds it (or linked)."""
+    save = codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP
+    codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP = False, 0xC000
+    try:
+        return (buildcache.build_linked if linked else buildcache.build)(src, LIB)
+    finally:
+        codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP = save
+
+def run(image, rx=None, gap=None, limit=10**6):
+    sim = Z.ZX16(); sim.load(image, 0); sim.max_cycles = limit
+    uart, _ = S.attach(sim)
+    if rx is not None:
+        uart.feed(rx, at=2000, gap=gap)
+    sim.run()
+    return sim, uart, bytes(uart.drain())
+
+# 1) the pragma
+TICK = """
+#include "stdio_si.c"
+int n;
+#pragma interrupt 2 on_tick
+void on_tick(void){ n = n + 1; *(volatile unsigned *)0xD02C = 1; }
+int main(void){
+    int x; int y;
+    uart_init();
+    x = 3; y = 4;
+    *(volatile unsigned *)0xD108 = 99;
+    *(volatile unsigned *)0xD020 = 1;
+    *(volatile unsigned *)0xD000 = 1;
+    asm("ei");
+    while (n < 5) { x = x + y; y = y + 1; }
+    asm("di");
+    putint(n); putchar(32); putint((x + y) > 7);
+    return 0;
+}
+"""
+whole = soc_build(TICK)
+outs = [run(b.binary)[2] for b in (whole, soc_build(TICK, linked=True))]
+check("#pragma interrupt 2: vector 2 jumps to a trampoline (saves, calls the handler, "
+      "reti); the handler is kept though nothing calls it; the interrupted loop's "
+      "registers survive",
+      ".org 0x0004\n    j __isr2\n" in whole.asm and "reti" in whole.asm
+      and "on_tick:" in whole.asm and outs[0] == b"5 1", outs)
+_, objects = buildcache.link_objects(TICK, LIB)
+image = zx16ld.link(objects)
+check("zx16ld: the program's .vectors.irq2 section lands at 0x0004, kept as a root; "
+      "linked runs the same",
+      image.ok and ("<program>", ".vectors.irq2", 4, 2) in image.placed
+      and outs[1] == outs[0], (image.placed[:3], outs))
+
+bad = []
+for pragma, body, want in (
+        ("#pragma interrupt 0 f", "void f(void){ }", "1..15"),
+        ("#pragma interrupt 16 f", "void f(void){ }", "1..15"),
+        ("#pragma interrupt 3 f\n#pragma interrupt 3 g", "void f(void){ } void g(void){ }",
+         "already has handler f"),
+        ("#pragma interrupt 3", "void f(void){ }", "interrupt VECTOR NAME"),
+        ("#pragma interrupt 3 h", "void f(void){ }", "no such function"),
+        ("#pragma interrupt 3 f", "void f(int a){ }", "takes no parameters")):
+    try:
+        codegen.Codegen(zcc.parse(pragma + "\n" + body + "\nint main(void){ return 0; }")
+                        ).gen_program()
+        bad.append((pragma, "accepted"))
+    except (zcc.ParseError, codegen.CodegenError) as e:
+        if want not in str(e): bad.append((pragma, str(e)))
+check("bad pragmas: vector 0 or past 15, a vector given twice, no name, an undefined "
+      "or parameterised handler", not bad, bad)
+
+# 2) cycles per printed line (fw/uartlog.c)
+res = soc_run.run_model(LOG)
+text = res["text"].splitlines()
+nums = [int(w.rstrip(",")) for w in text[-1].split() if w.rstrip(",").isdigit()] \
+    if len(text) == 3 else []
+check(f"uartlog: a {len(text[0]) + 1}-byte line costs {nums[0] if nums else '?'} clocks "
+      f"through puts() and {nums[1] if len(nums) > 1 else '?'} through uq_puts()",
+      res["halted"] and text[:2] == ["log: polled puts()", "log: queued uq_puts()"]
+      and len(nums) == 2 and nums[1] * 3 < nums[0] and nums[0] >= (len(text[0]) - 1) * 160,
+      res["text"])
+linked = run(soc_build(open(LOG).read(), linked=True).binary)[2].decode().splitlines()
+check("uartlog links (zx16ld) and prints the same lines",
+      linked[:2] == text[:2] and len(linked) == 3 and "clocks a line" in linked[2], linked)
+
+# 3) more output than the ring holds
+FLOOD = """
+#include "uart_irq.c"
+struct uart_q con;
+#pragma interrupt 3 on_uart
+void on_uart(void){ uq_isr(&con); }
+int main(void){
+    int i;
+    uq_init(&con);
+    i = 0;
+    while (i < 10){
+        uq_putstr(&con, "0123456789abcdefghijklmnopqrstuvwxyz");
+        uq_putint(&con, i);
+        uq_putc(&con, 10);
+        i = i + 1;
+    }
+    uq_flush(&con);
+    return 0;
+}
+"""
+sim, uart, out = run(soc_build(FLOOD).binary)
+want = "".join(f"0123456789abcdefghijklmnopqrstuvwxyz{i}\n" for i in range(10)).encode()
+check(f"{len(want)} bytes through the 64-byte ring: in order, the writer waiting only "
+      f"while it is full, the line kept busy ({sim.cycles} cycles, "
+      f"{len(want) * 160} of serial time)",
+      out == want and sim.halted and sim.cycles < len(want) * 160 * 1.05 + 2000,
+      (out[:80], sim.cycles))
+
+# 4) RX at the full line rate while the program is busy
+ECHO = """
+#include "uart_irq.c"
+struct uart_q con;
+#pragma interrupt 3 on_uart
+void on_uart(void){ uq_isr(&con); }
+int main(void){
+    char line[80]; int c; int k; int n;
+    uq_init(&con);
+    k = 0;
+    while (k < 400) { k = k + 1; }           // busy: about 40 bytes arrive meanwhile
+    n = 0;
+    c = uq_getc(&con);
+    while (c != 46){                         // '.'
+        if ((c >= 97) & (c <= 122)) c = c - 32;
+        line[n] = c;
+        n = n + 1;
+        c = uq_getc(&con);
+    }
+    line[n] = 0;
+    uq_puts(&con, line);
+    uq_putint(&con, n); uq_putc(&con, 32); uq_putint(&con, con.lost);
+    uq_flush(&con);
+    return 0;
+}
+"""
+msg = b"the quick brown fox jumps over a lazy dog, twice: the quick brown fox."
+sim, uart, out = run(soc_build(ECHO).binary, rx=msg, gap=160)
+check(f"{len(msg)} bytes received back to back, the first ones while the program is "
+      f"busy: none lost, no overrun",
+      out == msg[:-1].upper() + b"\n%d 0" % (len(msg) - 1) and not sim.lw(0xC090) & 1,
+      out)
+
+print(f"\n{npass}/{ntot} interrupt-driven UART checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -19,7 +19,7 @@ import os, re
 
 # token kinds (strings for readability; in ZC these become int constants)
 T_EOF='eof'; T_ID='id'; T_INT='int'; T_CHAR='char'; T_STR='str'
-T_KW='kw'; T_PUNCT='punct'
+T_KW='kw'; T_PUNCT='punct'; T_PRAGMA='pragma'
 
 KEYWORDS = {
     'int','char','unsigned','void','struct','if','else','while',
@@ -55,6 +55,11 @@ def lex(src):
         if c=='/' and i+1<n and src[i+1]=='/':
             while i<n and src[i]!='\n': i+=1
             continue
+        # `#pragma ...` (the one directive preprocess() passes through): one token
+        if c=='#' and src.startswith('#pragma', i):
+            j=src.find('\n', i)
+            j=n if j<0 else j
+            toks.append(Token(T_PRAGMA, src[i+7:j].strip(), line)); i=j; continue
         # identifiers / keywords
         if is_id_start(c):
             j=i+1
@@ -128,6 +133,9 @@ class Parser:
         self.structs={}          # tag -> {'fields':[(name,type,off)], 'size':n}
         self.funcs=[]            # list of function node indices
         self.globals=[]          # list of (name, type, init) 
+        self.protos={}           # name -> return type of a prototype `int f(int a);`
+        self.inline={}           # name -> True / False from #pragma inline / noinline
+        self.interrupts={}       # vector -> handler name from #pragma interrupt
 
     # ---- node allocation ----
     def node(self, **kw):
@@ -181,12 +189,44 @@ class Parser:
     # ---- top level ----
     def parse_program(self):
         while not self.at_end():
+            if self.cur().kind==T_PRAGMA:
+                self.parse_pragma()
+                continue
             if self.is_kw('struct') and self.toks[self.p+2].kind==T_PUNCT and self.toks[self.p+2].val=='{':
                 self.parse_struct_decl()
                 continue
             self.parse_toplevel_decl()
         return self
 
+    def parse_pragma(self):
+        """`#pragma inline f [g ...]` forces (and `#pragma noinline f ...` forbids)
+        inlining the named functions' calls (codegen.Codegen.plan_inlines).
+        `#pragma interrupt N f` makes f (void, no parameters) the handler of vector N
+        (1..15): the vector jumps to a trampoline that saves the scratch registers,
+        calls f and returns with reti (codegen_patterns.vectors)."""
+        t=self.advance()
+        words=t.val.replace(',',' ').split()
+        if words[:1]==['interrupt']:
+            if len(words)!=3 or not re.match(r'(0x[0-9A-Fa-f]+|\d+)$', words[1]) or \
+                    not re.match(r'[A-Za-z_]\w*$', words[2]):
+                raise ParseError(f"line {t.line}: unsupported #pragma {t.val!r} "
+                                 f"(use #pragma interrupt VECTOR NAME)")
+            vec=int(words[1], 0)
+            if not 1<=vec<=15:
+                raise ParseError(f"line {t.line}: #pragma interrupt: vector {vec} is not "
+                                 f"1..15 (0 is reset)")
+            if self.interrupts.get(vec, words[2])!=words[2]:
+                raise ParseError(f"line {t.line}: #pragma interrupt: vector {vec} already "
+                                 f"has handler {self.interrupts[vec]}")
+            self.interrupts[vec]=words[2]
+            return
+        if len(words)<2 or words[0] not in ('inline','noinline') or \
+                not all(re.match(r'[A-Za-z_]\w*$', w) for w in words[1:]):
+            raise ParseError(f"line {t.line}: unsupported #pragma {t.val!r} "
+                             f"(use #pragma inline|noinline NAME ... or interrupt N NAME)")
+        for w in words[1:]:
+            self.inline[w]=words[0]=='inline'
+
     def parse_struct_decl(self):
         self.eat_kw('struct')
         tag=self.advance().val
@@ -249,11 +289,15 @@ class Parser:
         else:
             while not self.is_punct(')'):
                 pty=self.parse_type()
-                pname=self.advance().val
+                pname=None if self.is_punct(',') or self.is_punct(')') else self.advance().val
                 params.append((pname,pty))
                 if self.is_punct(','): self.advance()
                 else: break
         self.eat_punct(')')
+        if self.is_punct(';'):
+            # prototype: only the return type matters (calls are not checked)
+            self.advance(); self.protos[name]=ret
+            return
         body=self.parse_block()
         idx=self.node(op='func',name=name,ret=ret,params=params,body=body)
         self.funcs.append(idx)
@@ -268,6 +312,7 @@ class Parser:
         return self.node(op='block',stmts=stmts)
 
     def parse_stmt(self):
+        if self.cur().kind==T_PRAGMA: self.err("#pragma is only allowed at file scope")
         if self.is_punct('{'): return self.parse_block()
         if self.is_kw('if'):
             self.advance(); self.eat_punct('(')
@@ -397,16 +442,22 @@ class Parser:
 
 class PreprocError(Exception): pass
 
-def preprocess(text, base_dir='.'):
+def preprocess(text, base_dir='.', separate=None, units=None):
     """Resolve `#include "file"` (recursive; each file included at most once) and
     collect object-like `#define NAME value`. Returns (expanded_text, defines).
-    Macro *expansion* is done at the token level in parse(). Only `#include "..."`
-    and object-like `#define` are supported (no <system> headers, no function-like
-    macros, no conditionals)."""
+    Macro *expansion* is done at the token level in parse(). Only `#include "..."`,
+    object-like `#define` and `#pragma` (left in the text for the parser) are
+    supported (no <system> headers, no function-like macros, no conditionals).
+
+    separate = a library directory compiled on its own (codegen.compile_object):
+    a file from it is not inlined but contributes its #defines and its interface()
+    -- struct declarations and a prototype per function -- and its path is appended
+    to `units`, the objects the program must be linked with."""
     defines = {}
     included = set()
     out = []
-    def go(txt, cur_dir):
+    lib = os.path.abspath(separate) if separate else None
+    def go(txt, cur_dir, out):
         for raw in txt.split('\n'):
             s = raw.strip()
             if s.startswith('#'):
@@ -426,7 +477,15 @@ def preprocess(text, base_dir='.'):
                     raise PreprocError(f'#include file not found: {inc}')
                 included.add(ap)
                 with open(ap) as f:
-                    go(f.read(), os.path.dirname(ap))
+                    src = f.read()
+                if lib and os.path.dirname(ap) == lib:
+                    body = []
+                    go(src, lib, body)                  # its own includes come first
+                    out.append(interface('\n'.join(body), ap))
+                    if units is not None:
+                        units.append(ap)
+                else:
+                    go(src, os.path.dirname(ap), out)
             elif s.startswith('#define'):
                 m = re.match(r'#define\s+([A-Za-z_]\w*)(\(?)(.*)$', s)
                 if not m:
@@ -434,13 +493,56 @@ def preprocess(text, base_dir='.'):
                 if m.group(2) == '(':
                     raise PreprocError(f'function-like #define not supported: {s}')
                 defines[m.group(1)] = m.group(3).strip()
+            elif s.startswith('#pragma'):
+                out.append(s)                           # for the parser (lex: T_PRAGMA)
             elif s.startswith('#'):
                 raise PreprocError(f'unsupported preprocessor directive: {s}')
             else:
                 out.append(raw)
-    go(text, base_dir)
+    go(text, base_dir, out)
     return '\n'.join(out), defines
 
+def _decl_text(toks):
+    return ' '.join(str(t.val) for t in toks)
+
+def interface(text, path='<unit>'):
+    """The declarations another unit needs from `text` (preprocessed, macros not yet
+    expanded): every struct declaration as written and `ret name(params);` for every
+    function, one per line. A library unit compiled on its own may not define
+    globals (ZC has no extern to declare them with)."""
+    toks = lex(text)
+    decls = []; i = 0
+    def skip_braces(i):
+        depth = 0
+        while True:
+            t = toks[i]
+            if t.kind == T_EOF: raise PreprocError(f'{path}: unbalanced braces')
+            if t.kind == T_PUNCT and t.val == '{': depth += 1
+            if t.kind == T_PUNCT and t.val == '}':
+                depth -= 1
+                if depth == 0: return i + 1
+            i += 1
+    while toks[i].kind != T_EOF:
+        if toks[i].kind == T_PRAGMA:                 # about bodies, which stay behind
+            i += 1; continue
+        j = i
+        while toks[j].kind != T_EOF and not (toks[j].kind == T_PUNCT and toks[j].val in ';{'):
+            j += 1
+        if toks[j].kind == T_EOF:
+            raise PreprocError(f'{path}: unterminated declaration at line {toks[i].line}')
+        is_struct = toks[i].kind == T_KW and toks[i].val == 'struct' and j == i + 2
+        if toks[j].val == '{' and is_struct:
+            k = skip_braces(j)
+            decls.append(_decl_text(toks[i:k + 1])); i = k + 1     # through the ';'
+        elif toks[j].val == '{':
+            decls.append(_decl_text(toks[i:j]) + ' ;'); i = skip_braces(j)
+        elif any(t.kind == T_PUNCT and t.val == '(' for t in toks[i:j]):
+            decls.append(_decl_text(toks[i:j + 1])); i = j + 1      # a prototype already
+        else:
+            raise PreprocError(f'{path}: global at line {toks[i].line} in a separately '
+                               f'compiled library unit')
+    return '\n'.join(decls)
+
 def expand_macros(tokens, defines):
     """Object-like macro expansion over a token stream. Supports nested macros; a
     macro never expands itself (prevents infinite recursion). Expanded tokens keep
@@ -459,8 +561,8 @@ def expand_macros(tokens, defines):
         emit(t, frozenset(), t.line)
     return out
 
-def parse(src, base_dir='.'):
-    text, defines = preprocess(src, base_dir)
+def parse(src, base_dir='.', separate=None, units=None):
+    text, defines = preprocess(src, base_dir, separate, units)
     toks = expand_macros(lex(text), defines)
     return Parser(toks).parse_program()
 
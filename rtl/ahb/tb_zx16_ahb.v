@@ -1,8 +1,15 @@
 // tb_zx16_ahb.v -- SoC testbench: the AHB-Lite core + two AHB-Lite SRAM slaves
 // (instruction bus + data bus). Loads the same $readmemh image into both, emulates
 // the ECALL print/halt services, and supports wait-state injection via +ws=<n>.
-// Output is machine-parseable for rtl/ahb/verify_ahb.py.
-module tb_zx16_ahb;
+// Output is machine-parseable for rtl/ahb/verify_ahb.py. +list=<file> runs a batch
+// of "<memfile> <ws>" lines in one process, resetting between programs. +trace=<file>
+// streams the core's retirements in tb_zx16.v's binary format (see rtl/cosim.py).
+// +icache / +dcache enable a zx16_ahb_cache on that bus (geometry below); each
+// prints "OUT ICACHE <hits> <misses>" / "OUT DCACHE ..." after "OUT HALT".
+// FWD (a parameter: iverilog -Ptb_zx16_ahb.FWD=1, verilator -GFWD=1) selects the
+// core's overlapped load/store pipeline; a cycle retiring two instructions writes
+// two records, the older first. MULDIV=1 adds the core's multiply/divide unit.
+module tb_zx16_ahb #(parameter FWD = 0, parameter MULDIV = 0);
     reg  HCLK = 1'b0;
     reg  HRESETn = 1'b0;
     reg  [3:0] WAITS;
@@ -15,9 +22,21 @@ module tb_zx16_ahb;
     wire [1:0]  D_HTRANS;  wire D_HWRITE;  wire [2:0] D_HSIZE, D_HBURST;
     wire [3:0]  D_HPROT;   wire D_HREADY, D_HRESP;
 
+    // memory side of the (optional) caches
+    wire [15:0] IM_HADDR, IM_HWDATA;  wire [1:0] IM_HTRANS;  wire IM_HWRITE;
+    wire [2:0]  IM_HSIZE, IM_HBURST;  wire [3:0] IM_HPROT;
+    wire [15:0] DM_HADDR, DM_HWDATA;  wire [1:0] DM_HTRANS;  wire DM_HWRITE;
+    wire [2:0]  DM_HSIZE, DM_HBURST;  wire [3:0] DM_HPROT;
+    wire [15:0] IM_HRDATA, DM_HRDATA;  wire IM_HREADY, IM_HRESP, DM_HREADY, DM_HRESP;
+    wire [31:0] ic_hits, ic_misses, dc_hits, dc_misses;
+    reg         IC_EN, DC_EN;
+
     wire halt, ecall_valid;  wire [9:0] ecall_svc;  wire [15:0] dbg_a0;
+    wire rt_valid, rt_we, rt_mwe, rt_mword;  wire [2:0] rt_rd;
+    wire [15:0] rt_pc, rt_wdata, rt_maddr, rt_mdata;
+    wire rt2_valid, rt2_we;  wire [2:0] rt2_rd;  wire [15:0] rt2_pc, rt2_wdata;
 
-    zx16_core_ahb cpu(
+    zx16_core_ahb #(.FWD(FWD), .MULDIV(MULDIV)) cpu(
         .HCLK(HCLK), .HRESETn(HRESETn),
         .irq_req(1'b0), .irq_num(4'd0),       // no interrupts in the standalone core TB
         .I_HADDR(I_HADDR), .I_HTRANS(I_HTRANS), .I_HWRITE(I_HWRITE), .I_HSIZE(I_HSIZE),
@@ -26,38 +45,118 @@ module tb_zx16_ahb;
         .D_HADDR(D_HADDR), .D_HTRANS(D_HTRANS), .D_HWRITE(D_HWRITE), .D_HSIZE(D_HSIZE),
         .D_HBURST(D_HBURST), .D_HPROT(D_HPROT), .D_HWDATA(D_HWDATA),
         .D_HRDATA(D_HRDATA), .D_HREADY(D_HREADY), .D_HRESP(D_HRESP),
-        .ecall_valid(ecall_valid), .ecall_svc(ecall_svc), .dbg_a0(dbg_a0), .halted(halt));
+        .ecall_valid(ecall_valid), .ecall_svc(ecall_svc), .dbg_a0(dbg_a0), .halted(halt),
+        .rt_valid(rt_valid), .rt_pc(rt_pc), .rt_we(rt_we), .rt_rd(rt_rd), .rt_wdata(rt_wdata),
+        .rt_mwe(rt_mwe), .rt_mword(rt_mword), .rt_maddr(rt_maddr), .rt_mdata(rt_mdata),
+        .rt2_valid(rt2_valid), .rt2_pc(rt2_pc), .rt2_we(rt2_we), .rt2_rd(rt2_rd),
+        .rt2_wdata(rt2_wdata));
+
+    // caches: 16 sets x 2 ways x 4 halfwords (256 B) each; MMIO (>= 0xF000) uncached.
+    // Keep verify_ahb.TB_CACHE in step with these parameters.
+    zx16_ahb_cache #(.SET_BITS(4), .WORD_BITS(2), .WAYS(2)) icache(
+        .HCLK(HCLK), .HRESETn(HRESETn), .en(IC_EN),
+        .S_HADDR(I_HADDR), .S_HTRANS(I_HTRANS), .S_HWRITE(I_HWRITE), .S_HSIZE(I_HSIZE),
+        .S_HPROT(I_HPROT), .S_HWDATA(I_HWDATA), .S_HRDATA(I_HRDATA), .S_HREADY(I_HREADY),
+        .S_HRESP(I_HRESP),
+        .M_HADDR(IM_HADDR), .M_HTRANS(IM_HTRANS), .M_HWRITE(IM_HWRITE), .M_HSIZE(IM_HSIZE),
+        .M_HBURST(IM_HBURST), .M_HPROT(IM_HPROT), .M_HWDATA(IM_HWDATA),
+        .M_HRDATA(IM_HRDATA), .M_HREADY(IM_HREADY), .M_HRESP(IM_HRESP),
+        .hits(ic_hits), .misses(ic_misses));
+
+    zx16_ahb_cache #(.SET_BITS(4), .WORD_BITS(2), .WAYS(2)) dcache(
+        .HCLK(HCLK), .HRESETn(HRESETn), .en(DC_EN),
+        .S_HADDR(D_HADDR), .S_HTRANS(D_HTRANS), .S_HWRITE(D_HWRITE), .S_HSIZE(D_HSIZE),
+        .S_HPROT(D_HPROT), .S_HWDATA(D_HWDATA), .S_HRDATA(D_HRDATA), .S_HREADY(D_HREADY),
+        .S_HRESP(D_HRESP),
+        .M_HADDR(DM_HADDR), .M_HTRANS(DM_HTRANS), .M_HWRITE(DM_HWRITE), .M_HSIZE(DM_HSIZE),
+        .M_HBURST(DM_HBURST), .M_HPROT(DM_HPROT), .M_HWDATA(DM_HWDATA),
+        .M_HRDATA(DM_HRDATA), .M_HREADY(DM_HREADY), .M_HRESP(DM_HRESP),
+        .hits(dc_hits), .misses(dc_misses));
 
     ahb_sram #(.MMIO(0)) imem(
         .HCLK(HCLK), .HRESETn(HRESETn), .WAITS(WAITS),
-        .HADDR(I_HADDR), .HTRANS(I_HTRANS), .HWRITE(I_HWRITE), .HSIZE(I_HSIZE),
-        .HWDATA(I_HWDATA), .HRDATA(I_HRDATA), .HREADYOUT(I_HREADY), .HRESP(I_HRESP));
+        .HADDR(IM_HADDR), .HTRANS(IM_HTRANS), .HWRITE(IM_HWRITE), .HSIZE(IM_HSIZE),
+        .HWDATA(IM_HWDATA), .HRDATA(IM_HRDATA), .HREADYOUT(IM_HREADY), .HRESP(IM_HRESP));
 
     ahb_sram #(.MMIO(1)) dmem(
         .HCLK(HCLK), .HRESETn(HRESETn), .WAITS(WAITS),
-        .HADDR(D_HADDR), .HTRANS(D_HTRANS), .HWRITE(D_HWRITE), .HSIZE(D_HSIZE),
-        .HWDATA(D_HWDATA), .HRDATA(D_HRDATA), .HREADYOUT(D_HREADY), .HRESP(D_HRESP));
+        .HADDR(DM_HADDR), .HTRANS(DM_HTRANS), .HWRITE(DM_HWRITE), .HSIZE(DM_HSIZE),
+        .HWDATA(DM_HWDATA), .HRDATA(DM_HRDATA), .HREADYOUT(DM_HREADY), .HRESP(DM_HRESP));
 
     always #5 HCLK = ~HCLK;
 
-    reg [1023:0] memfile;
-    integer cyc, wsval;
-    initial begin
-        if (!$value$plusargs("mem=%s", memfile)) begin $display("ERROR: no +mem"); $finish; end
-        WAITS = $value$plusargs("ws=%d", wsval) ? wsval[3:0] : 4'd0;
-        $readmemh(memfile, imem.mem);
-        $readmemh(memfile, dmem.mem);
-        @(posedge HCLK); @(negedge HCLK); HRESETn = 1'b1;
-        for (cyc = 0; cyc < 60000000; cyc = cyc + 1) begin
-            @(negedge HCLK);
-            if (ecall_valid) begin
-                if      (ecall_svc == 10'h000) $display("OUT INT %0d", $signed(dbg_a0));
-                else if (ecall_svc == 10'h001) $display("OUT CHR %0d", dbg_a0[7:0]);
-                else if (ecall_svc == 10'h3FF) begin
-                    $display("OUT HALT"); $display("CYCLES %0d", cyc); $finish;
+    reg [1023:0] memfile, listfile, tracefile;
+    integer cyc, i, fd, n, wsval, done, tfd;
+
+    // Clear both SRAMs and load one $readmemh image into each (HRESETn held low).
+    task load_image;
+        begin
+            for (i = 0; i < 32768; i = i + 1) begin imem.mem[i] = 16'd0; dmem.mem[i] = 16'd0; end
+            $readmemh(memfile, imem.mem);
+            $readmemh(memfile, dmem.mem);
+        end
+    endtask
+
+    // Release reset and run the loaded image until ECALL 0x3FF or the cycle cap.
+    task run_image;
+        begin
+            @(posedge HCLK); @(negedge HCLK); HRESETn = 1'b1;
+            done = 0;
+            for (cyc = 0; cyc < 60000000 && !done; cyc = cyc + 1) begin
+                @(negedge HCLK);
+                if (tfd != 0 && rt_valid)
+                    $fwrite(tfd, "%u%u%u", {rt_wdata, rt_pc}, {rt_mdata, rt_maddr},
+                            {26'd0, rt_mword, rt_mwe, rt_rd, rt_we});
+                if (tfd != 0 && rt2_valid)
+                    $fwrite(tfd, "%u%u%u", {rt2_wdata, rt2_pc}, 32'd0,
+                            {28'd0, rt2_rd, rt2_we});
+                if (ecall_valid) begin
+                    if      (ecall_svc == 10'h000) $display("OUT INT %0d", $signed(dbg_a0));
+                    else if (ecall_svc == 10'h001) $display("OUT CHR %0d", dbg_a0[7:0]);
+                    else if (ecall_svc == 10'h3FF) begin
+                        $display("OUT HALT"); $display("CYCLES %0d", cyc); done = 1;
+                    end
                 end
             end
+            if (!done) $display("OUT TIMEOUT");
+            else begin
+                // one more edge: the halting ECALL's fetch is counted as it completes
+                @(negedge HCLK);
+                if (IC_EN) $display("OUT ICACHE %0d %0d", ic_hits, ic_misses);
+                if (DC_EN) $display("OUT DCACHE %0d %0d", dc_hits, dc_misses);
+            end
+            HRESETn = 1'b0;
+        end
+    endtask
+
+    initial begin
+        tfd = 0;
+        IC_EN = $test$plusargs("icache");
+        DC_EN = $test$plusargs("dcache");
+        if ($value$plusargs("trace=%s", tracefile)) tfd = $fopen(tracefile, "wb");
+        if ($value$plusargs("list=%s", listfile)) begin
+            // batch mode: one "<memfile> <ws>" line per program, each preceded by
+            // "OUT BEGIN <n>"; the wait states are set per program
+            fd = $fopen(listfile, "r");
+            if (fd == 0) begin $display("ERROR: cannot open %0s", listfile); $finish; end
+            n = 0;
+            while ($fscanf(fd, "%s %d\n", memfile, wsval) == 2) begin
+                $display("OUT BEGIN %0d", n);
+                WAITS = wsval[3:0];
+                load_image;
+                run_image;
+                n = n + 1;
+            end
+            $fclose(fd);
+            $display("OUT DONE");
+        end else if (!$value$plusargs("mem=%s", memfile)) begin
+            $display("ERROR: no +mem or +list");
+        end else begin
+            WAITS = $value$plusargs("ws=%d", wsval) ? wsval[3:0] : 4'd0;
+            load_image;
+            run_image;
         end
-        $display("OUT TIMEOUT"); $finish;
+        if (tfd != 0) $fclose(tfd);
+        $finish;
     end
 endmodule
@@ -1,12 +1,14 @@
 #!/usr/bin/env python3
 """Differential check of the trap + single-step mechanism on the 2-stage AHB-Lite core
 vs. the golden sim, at zero and two wait states (the pipeline + registered D-bus make
-the trap/step paths interact with HREADY stalls). Programs: EBREAK round-trip, and a
-debug ISR single-stepping the debuggee one instruction at a time."""
+the trap/step paths interact with HREADY stalls), for FWD=0 and FWD=1. Programs:
+EBREAK round-trip, a debug ISR single-stepping the debuggee one instruction at a
+time, and the same over a store and two loads (FWD=1 serializes a stepped access)."""
 import os, sys
 HERE = os.path.dirname(os.path.abspath(__file__))
 sys.path.insert(0, HERE)
 import verify_ahb as VA                         # noqa: E402
+import buildcache                               # noqa: E402
 
 EBREAK_PROG = """
 .text
@@ -58,17 +60,52 @@ isr_go:
     reti
 """
 
-vvp = VA.build()
+STEP_MEM_PROG = """
+.text
+.org 0x0002
+    j isr
+.org 0x0020
+main:
+    li16 x6, 7
+    ebreak
+    sw   x6, -2(x2)
+    lw   x5, -2(x2)
+    add  x6, x5
+    lw   x4, -2(x2)
+    add  x6, x4
+    ecall 0x000
+    ecall 0x3FF
+isr:
+    addi x7, 1
+    li16 x3, 1
+    bne  x7, x3, isr_go
+    mfepc x3
+    addi  x3, 2
+    mtepc x3
+isr_go:
+    li16 x3, 5
+    bge  x7, x3, isr_out
+    step
+isr_out:
+    reti
+"""
+
 npass = ntot = 0
-for label, prog, want_vals in [("EBREAK round-trip", EBREAK_PROG, [100, 150, 200]),
-                               ("single-step a0 0->1->2->3", STEP_PROG, [0, 1, 2, 3, 3])]:
-    want = VA.sim_output(prog)
-    mem = VA.mem_image(prog)
-    for ws in (0, 2):
-        got = VA.rtl_output(vvp, mem, ws=ws)
-        ok = (got == want) and ([v for _, v in got] == want_vals)
-        ntot += 1; npass += ok
-        print(f"{'PASS' if ok else 'FAIL'}  {label:<26} ws={ws}  rtl={[v for _,v in got]}")
+for fwd in (0, 1):
+    vvp = VA.build(fwd=fwd)
+    for label, prog, want_vals in [("EBREAK round-trip", EBREAK_PROG, [100, 150, 200]),
+                                   ("single-step a0 0->1->2->3", STEP_PROG, [0, 1, 2, 3, 3]),
+                                   ("single-step sw / lw / lw", STEP_MEM_PROG, [21])]:
+        b = buildcache.assemble(prog)
+        want = VA.sim_output(b)
+        mem = VA.mem_image(b)
+        for ws in (0, 2):
+            got = VA.rtl_output(vvp, mem, ws=ws)
+            ok = (got == want) and ([v for _, v in got] == want_vals)
+            ntot += 1; npass += ok
+            print(f"{'PASS' if ok else 'FAIL'}  {label:<26} FWD={fwd} ws={ws}  "
+                  f"rtl={[v for _,v in got]}")
+        os.unlink(mem)
 
 print(f"\n{npass}/{ntot} AHB-core trap/step checks match the sim (ws 0 & 2)")
 sys.exit(0 if npass == ntot else 1)
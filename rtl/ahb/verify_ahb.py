@@ -1,63 +1,66 @@
 #!/usr/bin/env python3
 """Differential verification of the AHB-Lite 2-stage ZX16 core against the Python
-golden simulator. Runs every ZC example through the AHB SoC (iverilog) and zx16sim.py
+golden simulator. Runs every ZC example through the AHB SoC (iverilog, or Verilator with
+ZX16_SIM=verilator) and zx16sim.py
 and compares console output -- at zero wait states and with AHB wait states injected
-(proving the master's HREADY/stall handling).
-
-Usage:  python3 rtl/ahb/verify_ahb.py [ws ...]      (default: 0 2)
+(proving the master's HREADY/stall handling) -- for both pipelines: FWD=0 (serialized
+loads/stores) and FWD=1 (overlapped, load-use interlock). Every (program, ws) pair is
+one job of a single batch (../vvp_batch.py): one vvp process per host core, each
+resetting the SoC testbench between the jobs dealt to it. As in ../verify.py, each
+pipeline is also built with the multiply/divide unit (MULDIV=1) and runs the corpus
+compiled for it, which must print what the runtime-routine build prints.
+
+Usage:  python3 rtl/ahb/verify_ahb.py [--fwd 0|1] [--muldiv 0|1] [ws ...]
+                                      (default: both, both, 0 2)
 """
-import sys, os, glob, subprocess, re, tempfile
+import sys, os, glob, subprocess, tempfile
 HERE = os.path.dirname(os.path.abspath(__file__))
 ROOT = os.path.dirname(os.path.dirname(HERE))     # rtl/ahb -> rtl -> root
-for d in ('compiler', 'simulator', 'assembler'):
+for d in ('compiler', 'simulator', 'assembler', 'rtl'):
     sys.path.insert(0, os.path.join(ROOT, d))
-import codegen          # noqa: E402
 import zx16sim as Z     # noqa: E402
-import zx16asm          # noqa: E402
+import hdlsim           # noqa: E402
+import vvp_batch        # noqa: E402
+from verify import first_divergence, build_prog, muldiv_choice     # noqa: E402
 
 EXAMPLES = os.path.join(ROOT, 'compiler', 'examples')
 SRCS = [os.path.join(ROOT, 'rtl', 'zx16_alu.v'),
+        os.path.join(ROOT, 'rtl', 'zx16_muldiv.v'),
         os.path.join(HERE, 'zx16_core_ahb.v'),
+        os.path.join(HERE, 'zx16_ahb_cache.v'),
         os.path.join(HERE, 'ahb_sram.v'),
         os.path.join(HERE, 'tb_zx16_ahb.v')]
 
+TB_CACHE = "16x2x4"     # tb_zx16_ahb's +icache / +dcache geometry (zx16cache.Cache.parse)
+
+
+def build(sim=None, fwd=0, muldiv=0):
+    """The testbench with the FWD=`fwd` core (MULDIV=`muldiv`)."""
+    params = {k: v for k, v in (('FWD', fwd), ('MULDIV', muldiv)) if v}
+    return hdlsim.build(SRCS, 'tb_zx16_ahb', os.path.join(
+        tempfile.gettempdir(), 'zx16ahb_verify' + ('_fwd' if fwd else '')
+        + ('_md' if muldiv else '')), sim, params=params or None)
 
-def build():
-    vvp = os.path.join(tempfile.gettempdir(), 'zx16ahb_verify.vvp')
-    subprocess.run(['iverilog', '-o', vvp] + SRCS, check=True)
-    return vvp
 
+def golden(b, pre=None):
+    """(console output, retired instructions) of the image on the Python sim."""
+    out, sim = Z.run_image(b.binary, pre_run=pre)
+    return [('INT' if k == 'int' else 'CHR', v) for k, v in out], sim.cycles
 
-def sim_output(asm, pre=None):
-    out, _ = Z.assemble_and_run(asm, pre_run=pre)
-    return [('INT' if k == 'int' else 'CHR', v) for k, v in out]
 
+def sim_output(b, pre=None):
+    return golden(b, pre)[0]
 
-def mem_image(asm):
-    a = zx16asm.ZX16Assembler()
-    if not a.assemble(asm, '<v>'):
-        raise RuntimeError('assemble failed')
-    lines = [L for L in a.get_memory_file_output().splitlines() if not L.startswith('#')]
-    fd, p = tempfile.mkstemp(suffix='.mem')
-    with os.fdopen(fd, 'w') as f:
-        f.write("\n".join(lines) + "\n")
-    return p
 
+mem_image = vvp_batch.mem_image
 
-def rtl_output(vvp, mem, ws=0):
-    args = ['vvp', vvp, '+mem=' + mem] + (['+ws=%d' % ws] if ws else [])
+
+def rtl_output(vvp, mem, ws=0, plusargs=()):
+    """One program in its own vvp process (the batch path is vvp_batch.run_batch)."""
+    args = (hdlsim.command(vvp) + ['+mem=' + mem] + (['+ws=%d' % ws] if ws else [])
+            + list(plusargs))
     r = subprocess.run(args, capture_output=True, text=True, timeout=900)
-    res = []
-    for line in r.stdout.splitlines():
-        m = re.match(r'OUT INT (-?\d+)', line)
-        if m:
-            res.append(('INT', int(m.group(1)))); continue
-        m = re.match(r'OUT CHR (\d+)', line)
-        if m:
-            res.append(('CHR', int(m.group(1)))); continue
-        if 'OUT TIMEOUT' in line:
-            res.append(('TIMEOUT', 0))
-    return res
+    return vvp_batch.parse_output(r.stdout)
 
 
 def setup_poll(sim):
@@ -66,27 +69,57 @@ def setup_poll(sim):
 
 
 def main():
-    ws_list = [int(x) for x in sys.argv[1:]] or [0, 2]
-    vvp = build()
+    args = sys.argv[1:]
+    fwds = [0, 1]
+    if '--fwd' in args:
+        i = args.index('--fwd')
+        fwds = [int(args[i + 1])]
+        del args[i:i + 2]
+    mds = muldiv_choice(args)
+    ws_list = [int(x) for x in args] or [0, 2]
+    overall = True
+    for md in mds:
+        for fwd in fwds:
+            overall &= verify_core(fwd, ws_list, md)
+    sys.exit(0 if overall else 1)
+
+
+def verify_core(fwd, ws_list, muldiv=0):
+    vvp = build(fwd=fwd, muldiv=muldiv)
     progs = sorted(glob.glob(os.path.join(EXAMPLES, '*.c')))
+    builds, wants, mems, jobs, soft = [], [], [], [], []
+    for c in progs:
+        src = open(c).read()
+        b = build_prog(src, muldiv)
+        pre = setup_poll if os.path.basename(c).startswith('02') else None
+        want, cycles = golden(b, pre)
+        # MULDIV=1: the runtime-routine build is the reference for the output
+        soft.append(sim_output(build_prog(src), pre) if muldiv else want)
+        builds.append((b, pre)); wants.append(want); mems.append(mem_image(b))
+        # the core needs ~2 cycles per instruction, plus the wait states of each transfer
+        jobs += [(mems[-1], ws, cycles * (2 + ws)) for ws in ws_list]
+    try:
+        gots = vvp_batch.run_batch(vvp, jobs, timeout=900)
+    finally:
+        for mem in mems: os.unlink(mem)
     overall = True
-    for ws in ws_list:
-        print(f"\n=== wait states = {ws} ===")
+    for j, ws in enumerate(ws_list):
+        print(f"\n=== FWD={fwd}, MULDIV={muldiv}, wait states = {ws} ===")
         npass = 0
-        for c in progs:
+        for i, c in enumerate(progs):
             name = os.path.basename(c)
-            asm = codegen.compile_src(open(c).read())
-            pre = setup_poll if name.startswith('02') else None
-            want = sim_output(asm, pre)
-            got = rtl_output(vvp, mem_image(asm), ws)
-            ok = (got == want); npass += ok
+            want, got = wants[i], gots[i * len(ws_list) + j]
+            ok = (got == want == soft[i]); npass += ok
             print(f"  {'PASS' if ok else 'FAIL'}  {name:<20} sim={len(want)} rtl={len(got)}")
             if not ok:
+                if soft[i] != want:
+                    print(f"        runtime build={soft[i]}")
                 print(f"        sim={want}")
                 print(f"        rtl={got}")
+                print(first_divergence(vvp, *builds[i], ['+ws=%d' % ws], late_mem=fwd))
         overall &= (npass == len(progs))
-        print(f"  {npass}/{len(progs)} match (ws={ws})")
-    sys.exit(0 if overall else 1)
+        print(f"  {npass}/{len(progs)} match (FWD={fwd}, MULDIV={muldiv}, ws={ws})")
+    return overall
 
 
 if __name__ == '__main__':
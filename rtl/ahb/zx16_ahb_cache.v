@@ -0,0 +1,165 @@
+// zx16_ahb_cache.v -- optional cache between one ZX16 AHB-Lite master port and its
+// bus (Verilog-2001). An AHB-Lite slave towards the core, a master towards the memory
+// (ahb_sram.v, or zx16_ahb16to32.v in the SoC). Used on either bus of zx16_core_ahb:
+//
+//   I-cache  reads only; a hit completes the fetch's data phase with no wait state
+//   D-cache  the same for loads; stores are write-through, no write-allocate (a hit
+//            also updates the line), so memory is always current
+//
+// Lines are 2^WORD_BITS halfwords, filled word 0 first by back-to-back pipelined
+// SINGLE reads, the first issued in the cycle the miss is seen. 2^SET_BITS sets of
+// WAYS (1 = direct-mapped, 2 = LRU) lines. Stores and addresses at or above UNCACHED
+// (MMIO) pass through: the core's address phase goes to the bus in the same cycle
+// and its data phase is the bus's. The data-phase length seen by the core ('ws' =
+// the bus's wait states per transfer):
+//   hit 1          miss 2 + 2^WORD_BITS*(1+ws)          store / MMIO 1 + ws
+// simulator/zx16cache.py models the same hits, misses and timing.
+//
+// `en`=0 wires the ports straight through; change it only in reset. hits/misses
+// count cacheable reads since reset; the refill does not count as a second access.
+// Instruction fetch does not snoop the D-bus: code that writes instructions (the
+// on-chip debugger's breakpoints) needs the I-cache off.
+module zx16_ahb_cache #(
+    parameter SET_BITS  = 4,               // 2^SET_BITS sets
+    parameter WORD_BITS = 2,               // 2^WORD_BITS halfwords per line (>= 1)
+    parameter WAYS      = 1,               // 1 or 2
+    parameter [15:0] UNCACHED = 16'hF000   // addresses >= this bypass the cache
+)(
+    input             HCLK,
+    input             HRESETn,
+    input             en,
+    // ---- slave port (from the core's master) ----
+    input      [15:0] S_HADDR,
+    input      [1:0]  S_HTRANS,
+    input             S_HWRITE,
+    input      [2:0]  S_HSIZE,
+    input      [3:0]  S_HPROT,
+    input      [15:0] S_HWDATA,
+    output     [15:0] S_HRDATA,
+    output            S_HREADY,
+    output            S_HRESP,
+    // ---- master port (to the memory) ----
+    output     [15:0] M_HADDR,
+    output     [1:0]  M_HTRANS,
+    output            M_HWRITE,
+    output     [2:0]  M_HSIZE,
+    output     [2:0]  M_HBURST,
+    output     [3:0]  M_HPROT,
+    output     [15:0] M_HWDATA,
+    input      [15:0] M_HRDATA,
+    input             M_HREADY,
+    input             M_HRESP,
+    // ---- hit / miss counters (cacheable reads) ----
+    output reg [31:0] hits,
+    output reg [31:0] misses
+);
+    localparam SETS  = 1 << SET_BITS;
+    localparam WORDS = 1 << WORD_BITS;
+    localparam TAGW  = 15 - SET_BITS - WORD_BITS;
+    localparam TRANS_IDLE=2'b00, TRANS_NONSEQ=2'b10;
+
+    // ---- arrays (way 1 unused when WAYS=1) ----
+    reg [TAGW-1:0] tag0 [0:SETS-1];
+    reg [TAGW-1:0] tag1 [0:SETS-1];
+    reg [15:0]     dat0 [0:SETS*WORDS-1];
+    reg [15:0]     dat1 [0:SETS*WORDS-1];
+    reg [SETS-1:0] vld0, vld1;
+    reg [SETS-1:0] lru;                    // way to replace next (WAYS=2)
+
+    // ---- the core's transfer in its data phase (captured address phase) ----
+    reg        a_valid;                    // a cacheable read
+    reg        a_pass;                     // a store / MMIO access, on the bus now
+    reg        a_write;
+    reg        a_miss;                     // this read missed (its fill completed)
+    reg [15:0] a_addr;
+    reg [2:0]  a_size;
+    // ---- line fill ----
+    reg        fill;
+    reg        way;                        // way being filled
+    reg [WORD_BITS:0]   ab;                // address beats issued
+    reg [WORD_BITS-1:0] db;                // data beats received
+    reg        dph;                        // a beat's data phase is in progress
+
+    wire [SET_BITS-1:0]           a_set  = a_addr[SET_BITS+WORD_BITS:WORD_BITS+1];
+    wire [TAGW-1:0]               a_tag  = a_addr[15:SET_BITS+WORD_BITS+1];
+    wire [SET_BITS+WORD_BITS-1:0] a_word = a_addr[SET_BITS+WORD_BITS:1];
+    wire h0   = vld0[a_set] && (tag0[a_set] == a_tag);
+    wire h1   = (WAYS == 2) && vld1[a_set] && (tag1[a_set] == a_tag);
+    wire hit  = a_valid && !fill && (h0 || h1);
+    wire miss = a_valid && !fill && !a_miss && !(h0 || h1);
+    wire victim = (WAYS == 1) ? 1'b0 : !vld0[a_set] ? 1'b0 : !vld1[a_set] ? 1'b1 : lru[a_set];
+    wire [15:0] wmask = (a_size == 3'b001) ? 16'hFFFF : a_addr[0] ? 16'hFF00 : 16'h00FF;
+
+    // the core's address phase: a cacheable read is looked up in its data phase;
+    // anything else goes to the bus now, unless a fill owns it
+    wire s_req  = S_HTRANS[1];
+    wire s_pass = S_HWRITE || (S_HADDR >= UNCACHED);
+    wire fwd    = !fill && !miss;          // the bus is free for the core's request
+
+    // ---- slave side ----
+    wire c_ready = a_pass ? M_HREADY : (!a_valid || hit);
+    assign S_HREADY = en ? c_ready : M_HREADY;
+    assign S_HRDATA = (!en || a_pass) ? M_HRDATA : h1 ? dat1[a_word] : dat0[a_word];
+    assign S_HRESP  = en ? 1'b0 : M_HRESP;
+
+    // ---- master side: the fill's address beats, or the core's pass-through request ----
+    wire fill_a  = miss || (fill && !ab[WORD_BITS]);
+    wire [WORD_BITS-1:0] beat = miss ? {WORD_BITS{1'b0}} : ab[WORD_BITS-1:0];
+    wire pass_a  = fwd && s_req && s_pass;
+    assign M_HADDR  = (!en || !fill_a) ? S_HADDR : {a_addr[15:WORD_BITS+1], beat, 1'b0};
+    assign M_HTRANS = !en ? S_HTRANS : (fill_a || pass_a) ? TRANS_NONSEQ : TRANS_IDLE;
+    assign M_HWRITE = !en ? S_HWRITE : pass_a && S_HWRITE;
+    assign M_HSIZE  = (!en || !fill_a) ? S_HSIZE : 3'b001;
+    assign M_HBURST = 3'b000;
+    assign M_HPROT  = S_HPROT;
+    assign M_HWDATA = S_HWDATA;
+
+    // tags/data are write-before-read (guarded by vld0/vld1) and are not reset
+    always @(posedge HCLK or negedge HRESETn) begin
+        if (!HRESETn) begin
+            a_valid <= 1'b0; a_pass <= 1'b0; a_write <= 1'b0; a_miss <= 1'b0;
+            fill <= 1'b0; dph <= 1'b0;
+            vld0 <= {SETS{1'b0}}; vld1 <= {SETS{1'b0}}; lru <= {SETS{1'b0}};
+            hits <= 32'd0; misses <= 32'd0;
+        end else if (en) begin
+            // a store that hits updates the line as its bus data phase completes
+            if (a_pass && a_write && M_HREADY && a_addr < UNCACHED) begin
+                if (h0) dat0[a_word] <= (dat0[a_word] & ~wmask) | (S_HWDATA & wmask);
+                if (h1) dat1[a_word] <= (dat1[a_word] & ~wmask) | (S_HWDATA & wmask);
+            end
+            if (hit && !a_miss) begin
+                hits <= hits + 32'd1;
+                if (WAYS == 2) lru[a_set] <= h0;    // used way 0 -> replace way 1 next
+            end
+            // next address phase, accepted as the current data phase completes
+            if (c_ready) begin
+                a_valid <= s_req && !s_pass;
+                a_pass  <= s_req && s_pass;
+                a_write <= S_HWRITE;
+                a_addr  <= S_HADDR;
+                a_size  <= S_HSIZE;
+                a_miss  <= 1'b0;
+            end
+            if (miss) begin                        // beat 0's address phase is out now
+                misses <= misses + 32'd1; a_miss <= 1'b1;
+                way <= victim; fill <= 1'b1; db <= 0;
+                ab  <= M_HREADY ? 1 : 0;
+                dph <= M_HREADY;
+            end else if (fill && M_HREADY) begin
+                if (dph) begin
+                    if (way) dat1[{a_set, db}] <= M_HRDATA;
+                    else     dat0[{a_set, db}] <= M_HRDATA;
+                    db <= db + 1'b1;
+                end
+                dph <= fill_a;
+                if (fill_a) ab <= ab + 1'b1;
+                if (dph && db == WORDS-1) begin
+                    if (way) begin vld1[a_set] <= 1'b1; tag1[a_set] <= a_tag; end
+                    else     begin vld0[a_set] <= 1'b1; tag0[a_set] <= a_tag; end
+                    if (WAYS == 2) lru[a_set] <= ~way;
+                    fill <= 1'b0;
+                end
+            end
+        end
+    end
+endmodule
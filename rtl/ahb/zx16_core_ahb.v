@@ -15,11 +15,28 @@
 // (the former critical path). Memory ops cost one extra cycle; they were already
 // serialized, so the throughput cost is negligible.
 //
-// Hazard policy (simple, no forwarding): taken branch/jump = 1-cycle flush;
+// Hazard policy (FWD=0, simple, no forwarding): taken branch/jump = 1-cycle flush;
 // loads/stores serialize; HREADY low = freeze. Reuses zx16_alu.v. ECALL: svc 0x3FF
 // halts; svc/a0 exposed. Reset PC=RESET_PC, SP(x2)=0xF000.
+//
+// FWD=1 overlaps loads/stores with execution: a load/store leaves EXECUTE as soon as
+// its address phase is registered, and fetch and execute carry on while the D-bus
+// does its address and data phases. A load's data is forwarded from D_HRDATA to the
+// instruction in EXECUTE in the cycle its data phase completes. EXECUTE holds its
+// instruction (the I-bus idles) only for
+//   - a use of an in-flight load's destination (read or write) before that cycle,
+//   - a load/store while the D-bus is still busy with the previous one,
+//   - SYS instructions and interrupt entry, which wait for the D-bus to be idle.
+// A single-stepped load/store is still serialized, so its trap follows its data phase.
+//
+// MULDIV=1 adds the multi-cycle multiply/divide unit (../zx16_muldiv.v, R-type funct4
+// 0xD). A MUL/DIV starts when it would otherwise execute and holds EXECUTE (as a
+// stall, with either FWD) until the unit is done, 17 cycles later; an interrupt is
+// not taken once it has started.
 module zx16_core_ahb #(
-    parameter RESET_PC = 16'h0020
+    parameter RESET_PC = 16'h0020,
+    parameter FWD      = 0,         // 1 = overlapped loads/stores, load-use interlock
+    parameter MULDIV   = 0          // 1 = MUL/MULH/MULHU/DIV/DIVU/REM/REMU
 )(
     input             HCLK,
     input             HRESETn,
@@ -52,7 +69,26 @@ module zx16_core_ahb #(
     output            ecall_valid,
     output     [9:0]  ecall_svc,
     output     [15:0] dbg_a0,
-    output            halted
+    output            halted,
+    // ---- retirement trace (verification only; rtl/cosim.py) ----
+    // valid when the instruction at rt_pc commits at the coming edge (a load/store
+    // when its data phase completes), with its register and memory writes
+    output            rt_valid,
+    output     [15:0] rt_pc,
+    output            rt_we,      // writes rt_wdata to register rt_rd
+    output     [2:0]  rt_rd,
+    output     [15:0] rt_wdata,
+    output            rt_mwe,     // stores rt_mdata (a word, or the byte in [7:0])
+    output            rt_mword,
+    output     [15:0] rt_maddr,
+    output     [15:0] rt_mdata,
+    // FWD=1: a second, younger retirement in the same cycle (an instruction in
+    // EXECUTE while a load/store's data phase completes; never a load/store)
+    output            rt2_valid,
+    output     [15:0] rt2_pc,
+    output            rt2_we,
+    output     [2:0]  rt2_rd,
+    output     [15:0] rt2_wdata
 );
     localparam ALU_ADD=4'd0, ALU_SUB=4'd1, ALU_SLT=4'd2, ALU_SLTU=4'd3,
                ALU_SLL=4'd4, ALU_SRL=4'd5, ALU_SRA=4'd6, ALU_OR=4'd7,
@@ -82,8 +118,13 @@ module zx16_core_ahb #(
     reg        d_load_r;
     reg [2:0]  d_rd_r;     // load destination register
     reg [2:0]  d_func3_r;  // for load byte/word + sign select
+    reg [15:0] d_pc_r;     // PC of the load/store on the D-bus
+    reg        d_ser;      // serialized access: EXECUTE waits, then the pipeline refills
+    // ---- FWD=1: instruction held in EXECUTE while it stalls ----
+    reg        heldE;
+    reg [15:0] instH;
 
-    wire [15:0] inst   = I_HRDATA;     // EXECUTE instruction (I-bus data phase)
+    wire [15:0] inst   = heldE ? instH : I_HRDATA;  // EXECUTE instruction (I-bus data phase)
     wire [2:0]  opcode = inst[2:0];
     wire [2:0]  func3  = inst[5:3];
     wire [2:0]  a_field= inst[8:6];
@@ -92,8 +133,21 @@ module zx16_core_ahb #(
     wire [6:0]  imm7   = inst[15:9];
     wire [9:0]  svc    = inst[15:6];
 
-    wire [15:0] ra = regs[a_field];
-    wire [15:0] rb = regs[b_field];
+    // ---- load result (data phase) from the REGISTERED controls ----
+    wire [7:0]  dbyte = d_addr_r[0] ? D_HRDATA[15:8] : D_HRDATA[7:0];
+    wire [15:0] load_data = (d_func3_r==3'd1) ? D_HRDATA :
+                            (d_func3_r==3'd0) ? {{8{dbyte[7]}}, dbyte} :
+                                                {8'b0, dbyte};
+
+    // ---- D-bus occupancy; FWD=1 forwards a load's data as its data phase completes ----
+    wire d_free  = !d_req && (!memph || D_HREADY);   // a new access may be issued now
+    wire ld_done = memph && D_HREADY && d_load_r;
+    wire ld_wait = d_load_r && (d_req || (memph && !D_HREADY));
+    wire fwd_a   = FWD && ld_done && (a_field == d_rd_r);
+    wire fwd_b   = FWD && ld_done && (b_field == d_rd_r);
+
+    wire [15:0] ra = fwd_a ? load_data : regs[a_field];
+    wire [15:0] rb = fwd_b ? load_data : regs[b_field];
     assign dbg_a0 = regs[6];
     assign halted = halt_r;
 
@@ -154,7 +208,11 @@ module zx16_core_ahb #(
     wire is_mfepc  = is_sys && (func3==3'd5);
     wire is_mtepc  = is_sys && (func3==3'd6);
     wire is_step   = is_sys && (func3==3'd7);
-    wire take_irq  = ie && irq_req && ~step_armed; // gated by exec_avail; not mid-single-step
+    // gated by exec_avail; not mid-single-step, nor while the D-bus or MUL/DIV is busy
+    wire is_md     = MULDIV && (opcode==OP_R) && (funct4==4'hD);
+    wire md_busy, md_done;
+    wire [15:0] md_y;
+    wire take_irq  = ie && irq_req && ~step_armed && !d_req && !memph && !md_busy && !md_done;
     wire [15:0] vec_irq = {11'b0, irq_num, 1'b0};  // irq_num * 2
     wire [15:0] pc_plus2 = pcE + 16'd2;
 
@@ -164,12 +222,6 @@ module zx16_core_ahb #(
     wire [15:0] sdata_w  = (func3==3'd1) ? rb :     // SW: full word
                            daddr_w[0] ? {rb[7:0],8'b0} : {8'b0,rb[7:0]}; // SB byte lane
 
-    // ---- load result (data phase) from the REGISTERED controls ----
-    wire [7:0]  dbyte = d_addr_r[0] ? D_HRDATA[15:8] : D_HRDATA[7:0];
-    wire [15:0] load_data = (d_func3_r==3'd1) ? D_HRDATA :
-                            (d_func3_r==3'd0) ? {{8{dbyte[7]}}, dbyte} :
-                                                {8'b0, dbyte};
-
     // ---- branch / next sequential PC ----
     wire sgn_lt = ($signed(ra) < $signed(rb));
     wire usn_lt = (ra < rb);
@@ -198,6 +250,7 @@ module zx16_core_ahb #(
     // ---- writeback (non-memory; loads write back in the data phase) ----
     wire [15:0] wb_data =
         is_mfepc          ? epc       :  // MFEPC rd <- EPC
+        is_md             ? md_y      :
         (is_jal||is_jalr) ? pc_plus2  :
         is_lui            ? uimm      :
         is_auipc          ? (pcE + uimm) :
@@ -213,10 +266,23 @@ module zx16_core_ahb #(
 
     // ---- control ----
     wire exec_avail = validE && I_HREADY;
-    wire mem_begin  = exec_avail && is_mem && !d_req && !memph;
+    wire ser_busy   = (d_req || memph) && d_ser;     // FWD=0: every access
+    wire mem_begin  = exec_avail && is_mem && !d_req && !memph && (!FWD || step_armed);
+    // FWD=1 hazards: EXECUTE holds its instruction
+    wire uses_b  = (opcode==OP_R) || (opcode==OP_B) || is_mem;
+    wire ld_use  = ld_wait && ((a_field == d_rd_r) || (uses_b && (b_field == d_rd_r)));
+    wire stallF  = FWD && ((is_mem && !d_free) || (is_sys && (d_req || memph)) || ld_use);
+    // MUL/DIV: start once nothing else holds it, then wait for done
+    wire md_wait = is_md && !md_done && !(take_irq && !stallF);
+    wire stallE  = stallF || md_wait;
+    wire go_exec = exec_avail && !ser_busy && !stallE;
+    zx16_muldiv u_md(.clk(HCLK), .rst(!HRESETn),
+                     .start(exec_avail && !ser_busy && !stallF && md_wait && !md_busy),
+                     .ack(go_exec && is_md), .op(func3), .a(ra), .b(rb),
+                     .busy(md_busy), .done(md_done), .y(md_y));
 
-    // I-bus: fetch unless halted or servicing a data access
-    wire do_fetch = !halt_r && !memph && !d_req && !mem_begin;
+    // I-bus: fetch unless halted, servicing a serialized data access, or stalled
+    wire do_fetch = !halt_r && !ser_busy && !mem_begin && !(exec_avail && stallE);
     assign I_HADDR  = pcF;
     assign I_HTRANS = do_fetch ? TRANS_NONSEQ : TRANS_IDLE;
     assign I_HWRITE = 1'b0;
@@ -237,76 +303,110 @@ module zx16_core_ahb #(
     assign ecall_valid = exec_avail && is_ecall && !d_req && !memph && !take_irq;
     assign ecall_svc   = svc;
 
+    // ---- retirement trace: EXECUTE for everything but loads/stores, which retire
+    //      when their data phase completes ----
+    wire rt_exec = !halt_r && go_exec && !take_irq && !is_mem;
+    wire rt_mem  = !halt_r && memph && D_HREADY;
+    assign rt_valid = rt_exec || rt_mem;
+    assign rt_pc    = rt_mem ? d_pc_r : pcE;
+    assign rt_we    = rt_mem ? d_load_r : wr_en;
+    assign rt_rd    = rt_mem ? d_rd_r : wr_addr;
+    assign rt_wdata = rt_mem ? load_data : wb_data;
+    assign rt_mwe   = rt_mem && d_write_r;
+    assign rt_mword = (d_size_r == 3'b001);
+    assign rt_maddr = d_addr_r;
+    assign rt_mdata = rt_mword ? d_wdata_r : {8'b0, d_addr_r[0] ? d_wdata_r[15:8] : d_wdata_r[7:0]};
+    assign rt2_valid = rt_mem && rt_exec;
+    assign rt2_pc    = pcE;
+    assign rt2_we    = wr_en;
+    assign rt2_rd    = wr_addr;
+    assign rt2_wdata = wb_data;
+
     // ---- sequential ----
     always @(posedge HCLK or negedge HRESETn) begin
         if (!HRESETn) begin
             pcF <= RESET_PC; pcE <= 16'd0; validE <= 1'b0; halt_r <= 1'b0;
-            d_req <= 1'b0; memph <= 1'b0; ie <= 1'b0; epc <= 16'd0;
+            d_req <= 1'b0; memph <= 1'b0; d_ser <= 1'b1; heldE <= 1'b0;
+            ie <= 1'b0; epc <= 16'd0;
             step_req <= 1'b0; step_armed <= 1'b0;
-            // d_addr_r/d_write_r/d_size_r/d_wdata_r/d_load_r/d_rd_r/d_func3_r are
-            // write-before-read (loaded in EXECUTE, consumed only in the later address/
-            // data phases, which cannot occur until after they are loaded). They are
-            // intentionally NOT reset so they infer enable flip-flops (edfxtp) -- this
-            // keeps the conditional-load mux off the address-adder critical path.
+            // d_addr_r/d_write_r/d_size_r/d_wdata_r/d_load_r/d_rd_r/d_func3_r/d_pc_r
+            // and instH are write-before-read (loaded in EXECUTE, consumed only in the
+            // later address/data phases or while heldE, which cannot occur until after
+            // they are loaded). They are intentionally NOT reset so they infer enable
+            // flip-flops (edfxtp) -- this keeps the conditional-load mux off the
+            // address-adder critical path.
             for (i=0;i<8;i=i+1) regs[i] <= 16'd0;
             regs[2] <= 16'hF000;
         end else if (halt_r) begin
-            // frozen
-        end else if (memph) begin
-            // ---- data phase ----
-            if (D_HREADY) begin
+            // frozen (the halting ECALL waited for the D-bus to be idle)
+        end else begin
+            // ---- D-bus: address phase (registered outputs), then data phase ----
+            if (d_req && D_HREADY) begin d_req <= 1'b0; memph <= 1'b1; end
+            if (memph && D_HREADY) begin
                 if (d_load_r) regs[d_rd_r] <= load_data;
-                memph  <= 1'b0;
-                validE <= 1'b0;          // refill bubble
-                if (step_armed) begin    // the stepped instruction was a load/store
-                    pcF <= 16'h0002; epc <= pcE + 16'd2; ie <= 1'b0; step_armed <= 1'b0;
-                end else
-                    pcF <= pcE + 16'd2;  // refetch the instruction after the mem op
+                memph <= 1'b0;
+                if (d_ser) begin
+                    validE <= 1'b0;          // refill bubble
+                    if (step_armed) begin    // the stepped instruction was a load/store
+                        pcF <= 16'h0002; epc <= d_pc_r + 16'd2; ie <= 1'b0; step_armed <= 1'b0;
+                    end else
+                        pcF <= d_pc_r + 16'd2;  // refetch the instruction after the mem op
+                end
             end
-        end else if (d_req) begin
-            // ---- address phase (registered outputs) ----
-            if (D_HREADY) begin d_req <= 1'b0; memph <= 1'b1; end
-        end else if (validE) begin
-            if (I_HREADY) begin
-                if (take_irq) begin
-                    // hardware interrupt: squash the EXECUTE instruction and vector
-                    epc <= pcE; ie <= 1'b0;
-                    pcF <= vec_irq; validE <= 1'b0;
-                end else if (is_mem) begin
-                    // register address/control/data; start the address phase next cycle
-                    d_addr_r  <= daddr_w;
-                    d_write_r <= is_store;
-                    d_size_r  <= (func3==3'd1) ? 3'b001 : 3'b000;
-                    d_wdata_r <= sdata_w;
-                    d_load_r  <= is_load;
-                    d_rd_r    <= a_field;
-                    d_func3_r <= func3;
-                    d_req     <= 1'b1;
-                end else begin
-                    if (wr_en) regs[wr_addr] <= wb_data;
-                    if      (is_ebreak) begin epc <= pcE; ie <= 1'b0; end
-                    else if (is_reti)   begin ie <= 1'b1;
-                                              if (step_req) begin step_armed <= 1'b1; step_req <= 1'b0; end end
-                    else if (is_ei)     ie  <= 1'b1;
-                    else if (is_di)     ie  <= 1'b0;
-                    else if (is_mtepc)  epc <= regs[a_field];
-                    else if (is_step)   step_req <= 1'b1;
-                    if (is_ecall && svc==10'h3FF) halt_r <= 1'b1;
-                    if (step_armed) begin     // single-step: this instr committed -> trap to vec 1
-                        pcF <= 16'h0002; validE <= 1'b0;
-                        epc <= redirect ? target : pcF;   // resume point after the stepped instr
-                        ie  <= 1'b0; step_armed <= 1'b0;
-                    end else if (redirect) begin
-                        pcF <= target; validE <= 1'b0;
+            // ---- EXECUTE / refill (FWD=1: alongside a data access) ----
+            if (ser_busy) begin
+                // EXECUTE waits for the serialized access
+            end else if (validE) begin
+                if (I_HREADY && stallE) begin
+                    heldE <= 1'b1; instH <= inst;   // hold; the I-bus idles
+                end else if (I_HREADY) begin
+                    heldE <= 1'b0;
+                    if (take_irq) begin
+                        // hardware interrupt: squash the EXECUTE instruction and vector
+                        epc <= pcE; ie <= 1'b0;
+                        pcF <= vec_irq; validE <= 1'b0;
+                    end else if (is_mem) begin
+                        // register address/control/data; start the address phase next cycle
+                        d_addr_r  <= daddr_w;
+                        d_write_r <= is_store;
+                        d_size_r  <= (func3==3'd1) ? 3'b001 : 3'b000;
+                        d_wdata_r <= sdata_w;
+                        d_load_r  <= is_load;
+                        d_rd_r    <= a_field;
+                        d_func3_r <= func3;
+                        d_pc_r    <= pcE;
+                        d_req     <= 1'b1;
+                        d_ser     <= !FWD || step_armed;
+                        if (FWD && !step_armed) begin   // overlapped: move on
+                            pcE <= pcF; pcF <= pcF + 16'd2; validE <= 1'b1;
+                        end
                     end else begin
-                        pcE <= pcF; pcF <= pcF + 16'd2; validE <= 1'b1;
+                        // after the load's write above: the younger write wins
+                        if (wr_en) regs[wr_addr] <= wb_data;
+                        if      (is_ebreak) begin epc <= pcE; ie <= 1'b0; end
+                        else if (is_reti)   begin ie <= 1'b1;
+                                                  if (step_req) begin step_armed <= 1'b1; step_req <= 1'b0; end end
+                        else if (is_ei)     ie  <= 1'b1;
+                        else if (is_di)     ie  <= 1'b0;
+                        else if (is_mtepc)  epc <= regs[a_field];
+                        else if (is_step)   step_req <= 1'b1;
+                        if (is_ecall && svc==10'h3FF) halt_r <= 1'b1;
+                        if (step_armed) begin     // single-step: this instr committed -> trap to vec 1
+                            pcF <= 16'h0002; validE <= 1'b0;
+                            epc <= redirect ? target : pcF;   // resume point after the stepped instr
+                            ie  <= 1'b0; step_armed <= 1'b0;
+                        end else if (redirect) begin
+                            pcF <= target; validE <= 1'b0;
+                        end else begin
+                            pcE <= pcF; pcF <= pcF + 16'd2; validE <= 1'b1;
+                        end
                     end
                 end
-            end
-        end else begin
-            // ---- refill bubble: address phase of pcF in flight ----
-            if (I_HREADY) begin
-                pcE <= pcF; pcF <= pcF + 16'd2; validE <= 1'b1;
+            end else begin
+                // ---- refill bubble: address phase of pcF in flight ----
+                if (I_HREADY) begin
+                    pcE <= pcF; pcF <= pcF + 16'd2; validE <= 1'b1;
+                end
             end
         end
     end
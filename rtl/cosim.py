@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Lockstep co-simulation: the RTL's retirement trace against ZX16.step().
+
+The testbenches (tb_zx16.v, ahb/tb_zx16_ahb.v) given +trace=<file> write one 12-byte
+record per retired instruction -- three little-endian 32-bit words
+{wdata,pc} {mdata,maddr} {mword,mwe,rd[2:0],we} taken from the core's rt_* port. Here
+vvp writes them into a pipe (+trace=/dev/fd/N) and compare() steps the golden sim
+once per record, so nothing is buffered beyond the pipe and a mismatch is found at
+the retirement where it happens: the comparator stops there, kills vvp and reports
+both architectural states (the RTL's rebuilt from its trace) with the retirements
+leading up to it.
+
+The AHB core built with FWD=1 retires younger instructions while a load / store is
+still on the D-bus, so compare(late_mem=True) accepts a load's or store's record
+after theirs: its golden record is held until the RTL retires it, and a younger
+write to a pending load's register diverges there.
+
+Usage:  python3 rtl/cosim.py [--ahb [--fwd]] [--muldiv] [--ws N] [prog.c|prog.s ...]   (default: examples)
+"""
+import os, sys, glob, struct, subprocess, tempfile
+from collections import deque, namedtuple
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+for d in ('compiler', 'simulator', 'assembler'):
+    sys.path.insert(0, os.path.join(ROOT, d))
+import zx16sim as Z     # noqa: E402
+import hdlsim           # noqa: E402
+
+REC = struct.Struct('<III')
+MASK = 0xFFFF
+# register / memory fields are only meaningful when their enable is set; the
+# don't-care fields are zeroed on both sides
+Retire = namedtuple('Retire', 'pc we rd wdata mwe mword maddr mdata')
+
+
+def retire(pc, we, rd, wdata, mwe, mword, maddr, mdata):
+    we, mwe, mword = bool(we), bool(mwe), bool(mword) and bool(mwe)
+    return Retire(pc & MASK, we, rd if we else 0, wdata & MASK if we else 0, mwe, mword,
+                  maddr & MASK if mwe else 0, (mdata & (MASK if mword else 0xFF)) if mwe else 0)
+
+
+def unpack(w0, w1, w2):
+    return retire(w0, w2 & 1, (w2 >> 1) & 7, w0 >> 16, (w2 >> 4) & 1, (w2 >> 5) & 1,
+                  w1, w1 >> 16)
+
+
+def pack(r):
+    """One trace record (the tb's $fwrite("%u%u%u", ...)) -- used by the tests."""
+    return REC.pack((r.wdata << 16) | r.pc, (r.mdata << 16) | r.maddr,
+                    r.we | (r.rd << 1) | (r.mwe << 4) | (r.mword << 5))
+
+
+def step_retire(sim):
+    """Execute one instruction on `sim` and return its Retire record (None once
+    halted): the PC it ran at (an interrupt's vector entry when one is taken), the
+    register it wrote and the store it made, decoded as the cores' rt_* port is."""
+    if sim.halted:
+        return None
+    pc = sim.irq_vec if sim.ie and sim.irq_pending and not sim.step_armed else sim.pc
+    w = sim.mem[pc] | (sim.mem[(pc + 1) & MASK] << 8)
+    op, f3, rd = w & 7, (w >> 3) & 7, (w >> 6) & 7
+    mwe = op == 3
+    maddr = mdata = 0
+    if mwe:
+        imm4 = (w >> 12) & 0xF
+        maddr = sim.reg[rd] + (imm4 - 16 if imm4 >= 8 else imm4)
+        mdata = sim.reg[(w >> 9) & 7]
+    sim.step()
+    we = (op in (1, 4, 6) or (op == 0 and w >> 12 != 0xB) or (op == 5 and w >> 15)
+          or (op == 7 and f3 == 5))
+    return retire(pc, we, rd, sim.reg[rd], mwe, f3 == 1, maddr, mdata)
+
+
+class Divergence:
+    """The first retirement where the RTL and the sim disagree (either side None:
+    that side stopped retiring first)."""
+    def __init__(self, index, rtl, sim, rtl_regs, sim_regs, sim_pc, history):
+        self.index, self.rtl, self.sim = index, rtl, sim
+        self.rtl_regs, self.sim_regs, self.sim_pc = rtl_regs, sim_regs, sim_pc
+        self.history = history
+
+    @staticmethod
+    def _rec(r):
+        if r is None: return "(no retirement)"
+        s = f"pc={r.pc:04x}"
+        if r.we: s += f"  x{r.rd}<-{r.wdata:04x}"
+        if r.mwe: s += f"  mem{'16' if r.mword else '8'}[{r.maddr:04x}]<-{r.mdata:04x}"
+        return s
+
+    def report(self):
+        regs = lambda rs: " ".join(f"x{i}={v:04x}" for i, v in enumerate(rs))
+        lines = [f"first divergence at retirement #{self.index}:",
+                 f"  rtl: {self._rec(self.rtl)}",
+                 f"  sim: {self._rec(self.sim)}",
+                 f"  rtl regs after: {regs(self.rtl_regs)}",
+                 f"  sim regs after: {regs(self.sim_regs)}  next pc={self.sim_pc:04x}",
+                 "  preceding retirements (both agree):"]
+        lines += [f"    #{i}: {self._rec(r)}" for i, r in self.history]
+        return "\n".join(lines)
+
+
+def compare(stream, sim, history=8, late_mem=False):
+    """Check a binary trace stream against `sim` retirement by retirement. Returns
+    (matching retirements, Divergence or None)."""
+    regs = list(sim.reg)                  # the RTL's registers, rebuilt from its writes
+    hist = deque(maxlen=history)
+    n = 0
+    pending = None                        # late_mem: golden record of a load / store in flight
+    def diverge(got, want):
+        if got is not None and got.we: regs[got.rd] = got.wdata
+        return n, Divergence(n, got, want, regs, list(sim.reg), sim.pc, list(hist))
+    while True:
+        block = stream.read(REC.size * 4096)
+        for words in REC.iter_unpack(block[:len(block) - len(block) % REC.size]):
+            got = unpack(*words)
+            if pending is not None and got.pc == pending.pc:
+                want, pending = pending, None
+            else:
+                want = step_retire(sim)
+                if (late_mem and pending is None and want is not None
+                        and got.pc != want.pc and sim.mem[want.pc] & 7 in (3, 4)):
+                    pending, want = want, step_retire(sim)
+                if pending is not None and pending.we and got.we and got.rd == pending.rd:
+                    return diverge(got, pending)      # overtook the load's write
+            if got != want:
+                return diverge(got, want)
+            if got.we: regs[got.rd] = got.wdata
+            hist.append((n, got)); n += 1
+        if len(block) < REC.size * 4096:
+            break
+    if pending is not None:               # the load / store never retired
+        return diverge(None, pending)
+    if not sim.halted:                    # the RTL stopped (halt, timeout or a crash)
+        return diverge(None, step_retire(sim))
+    return n, None
+
+
+def lockstep(vvp, memfile, binary, pre_run=None, plusargs=(), history=8, late_mem=False):
+    """Run `memfile` on a trace-capable testbench build `vvp` with the trace piped
+    into compare() against `binary` on the golden sim. Returns (n, Divergence|None)."""
+    sim = Z.ZX16()
+    sim.load(binary, 0x0000)
+    if pre_run: pre_run(sim)
+    r, w = os.pipe()
+    with tempfile.TemporaryFile() as log:
+        p = subprocess.Popen(hdlsim.command(vvp) + ['+mem=' + memfile,
+                                                     '+trace=/dev/fd/%d' % w] + list(plusargs), stdout=log, stderr=subprocess.STDOUT,
+                             pass_fds=(w,))
+        os.close(w)
+        try:
+            with os.fdopen(r, 'rb', buffering=1 << 16) as f:
+                res = compare(f, sim, history, late_mem)
+        finally:
+            if p.poll() is None: p.kill()
+            p.wait()
+    return res
+
+
+def main():
+    import buildcache
+    args = [a for a in sys.argv[1:]]
+    ahb = '--ahb' in args
+    fwd = '--fwd' in args
+    md = int('--muldiv' in args)
+    ws = int(args[args.index('--ws') + 1]) if '--ws' in args else 0
+    paths = [a for i, a in enumerate(args) if not a.startswith('--')
+             and (i == 0 or args[i - 1] != '--ws')]
+    paths = paths or sorted(glob.glob(os.path.join(ROOT, 'compiler', 'examples', '*.c')))
+    if ahb:
+        sys.path.insert(0, os.path.join(HERE, 'ahb'))
+        import verify_ahb as V
+        vvp, extra = V.build(fwd=int(fwd), muldiv=md), ['+ws=%d' % ws]
+    else:
+        import verify as V
+        vvp, extra = V.build_rtl(muldiv=md), []
+    bad = 0
+    for path in paths:
+        src = open(path).read()
+        b = V.build_prog(src, md) if path.endswith('.c') else buildcache.assemble(src)
+        mem = V.mem_image(b)
+        pre = V.setup_poll if os.path.basename(path).startswith('02') else None
+        try:
+            n, div = lockstep(vvp, mem, b.binary, pre, extra, late_mem=fwd)
+        finally:
+            os.unlink(mem)
+        bad += div is not None
+        print(f"{'PASS' if div is None else 'FAIL'}  {os.path.basename(path):<20} "
+              f"{n} retirements in lockstep")
+        if div is not None:
+            print(div.report())
+    sys.exit(1 if bad else 0)
+
+
+if __name__ == '__main__':
+    main()
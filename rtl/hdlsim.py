@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""HDL simulator back ends for the RTL testbenches: Icarus Verilog (the reference)
+or Verilator.
+
+Every testbench (tb_zx16.v, ahb/tb_zx16_ahb.v, soc/tb_zx16_soc.v) is plain Verilog
+with its own clock and plusargs, so Verilator builds it unchanged with --binary
+--timing: the same +mem/+memh/+list/+trace/+rxfile interface, run as a native
+executable instead of `vvp <file>.vvp`. ZX16_SIM=verilator selects it for every
+runner (verify.py, ahb/verify_ahb.py, soc/soc_run.py and their tests); the default
+stays iverilog. A build returns an artifact path; command() turns it into argv.
+"""
+import os, shutil, subprocess
+
+BACKENDS = ("iverilog", "verilator")
+
+
+def backend():
+    sim = os.environ.get("ZX16_SIM", "iverilog").strip().lower() or "iverilog"
+    if sim not in BACKENDS:
+        raise ValueError(f"ZX16_SIM={sim!r}: expected one of {', '.join(BACKENDS)}")
+    return sim
+
+
+def available(sim=None):
+    """Are the back end's tools on the PATH?"""
+    sim = sim or backend()
+    return all(shutil.which(t) for t in (("iverilog", "vvp") if sim == "iverilog"
+                                         else ("verilator",)))
+
+
+def build(srcs, top, out, sim=None, iverilog_flags=(), params=None):
+    """Compile `srcs` with `top` as the root module, overriding its `params`
+    ({name: int}). `out` is an artifact stem (<out>.vvp for iverilog, <out>.vl/<top>
+    for Verilator); returns the artifact."""
+    sim = sim or backend()
+    params = params or {}
+    if sim == "iverilog":
+        art = out + ".vvp"
+        cmd = (["iverilog"] + list(iverilog_flags) + [f"-P{top}.{k}={v}" for k, v in
+                                                      params.items()]
+               + ["-s", top, "-o", art] + list(srcs))
+    else:
+        mdir = out + ".vl"
+        art = os.path.join(mdir, top)
+        # -Wno-fatal: the vendored IP and the testbenches are lint-clean for Icarus,
+        # not for Verilator's stricter width/style checks; warnings don't stop the build.
+        # --timescale covers the files without a `timescale (tb_zx16.v and the cores).
+        cmd = (["verilator", "--binary", "--timing", "-O3", "--x-assign", "fast",
+                "--x-initial", "fast", "--timescale", "1ns/1ps", "-Wno-fatal", "-Wno-lint",
+                "-Wno-style", "--top-module", top, "--Mdir", mdir, "-o", top]
+               + [f"-G{k}={v}" for k, v in params.items()] + list(srcs))
+    r = subprocess.run(cmd, capture_output=True, text=True)
+    if r.returncode != 0:
+        raise RuntimeError(f"{sim} failed:\n" + r.stdout + r.stderr)
+    return art
+
+
+def command(art):
+    """argv prefix that runs a built artifact (plusargs follow)."""
+    return ["vvp", art] if art.endswith(".vvp") else [art]
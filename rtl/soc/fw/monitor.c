@@ -4,13 +4,21 @@
 //   w <addr> <val>      write a 16-bit word, print "ok"
 //   d <addr> <n>        dump n 16-bit words from addr
 //   L <addr> <n>        load n raw bytes (streamed right after the newline) to addr
+//   B                   framed binary load (CRC-checked, acked frames; see bulk_load())
 //   g <addr>            jump to addr / execute (does not return)
 //   q                   quit -> halt
 // Note: a loaded image must be position-independent or assembled for its load address.
 // Build for the SoC (codegen.INTRINSIC_IO=False); see rtl/soc/soc_run.py.
 #include "stdio_si.c"
+#include "string.c"
+
+#define LOAD_BLOCK 256                 // most data bytes one 'B' frame carries
+#define LOAD_WAIT  0x2000              // SR polls before a byte inside a frame times out
 
 int go_target;                         // set by 'g', read by the asm jump below
+char load_buf[LOAD_BLOCK];             // a 'B' frame's data, written once its CRC checks
+unsigned frame_crc;                    // running CRC of the frame being received
+int load_err;                          // the line went quiet mid-frame
 
 int hexval(int c){                     // hex digit -> 0..15, else -1
     if (c < '0') return -1;
@@ -42,6 +50,69 @@ int getcmd(void){                      // next non-blank command character
     }
 }
 
+void jump(unsigned a){                 // execute from a (does not return)
+    go_target = a;
+    asm("la x5, g_go_target");
+    asm("lw x5, 0(x5)");
+    asm("jr x5");
+}
+
+unsigned crc16(unsigned crc, int b){   // CRC-16/CCITT (poly 0x1021, MSB first), one byte
+    unsigned x;
+    x = ((crc >> 8) ^ b) & 255;
+    x = x ^ (x >> 4);
+    return (crc << 8) ^ (x << 12) ^ (x << 5) ^ x;
+}
+
+int getb(void){                        // next frame byte into frame_crc; 0 + load_err on timeout
+    unsigned t; int c;
+    t = LOAD_WAIT;
+    while ((*(volatile unsigned *)UART_SR & 2) == 0){
+        t = t - 1;
+        if (t == 0){ load_err = 1; return 0; }
+    }
+    c = *(volatile unsigned *)UART_DR & 255;
+    frame_crc = crc16(frame_crc, c);
+    return c;
+}
+
+// 'B': frames of <addr u16> <len u16> <data> <crc u16>, little-endian. len bit 15 set =
+// zero-fill (len & 0x7FFF) bytes, no data sent; the CRC-16/CCITT (init FFFF) covers
+// everything before it. A good frame is written and acked 'K'. A bad CRC, an
+// oversized block or a line gone quiet mid-frame writes nothing: the monitor waits for
+// the line to go idle and sends 'N' for the host to resend. len 0 ends the load ('K',
+// newline), then jumps to addr unless it is 0. See rtl/soc/MONITOR.md.
+void bulk_load(void){
+    int c; unsigned a; unsigned n; unsigned i; unsigned crc;
+    while (1){
+        c = uart_getc();               // a frame's first byte waits as long as it takes
+        frame_crc = crc16(0xFFFF, c); load_err = 0;
+        a = c | (getb() << 8);
+        n = getb(); n = n | (getb() << 8);
+        i = 0;
+        if ((n & 0x8000) == 0){
+            if (n > LOAD_BLOCK) load_err = 1;
+            while (i < n){
+                if (load_err) break;
+                load_buf[i] = getb(); i = i + 1;
+            }
+        }
+        crc = frame_crc;
+        c = getb(); c = c | (getb() << 8);
+        if (c != crc) load_err = 1;
+        if (load_err){
+            load_err = 0;
+            while (load_err == 0) getb();   // drain until the line is idle
+            putchar('N');
+            continue;
+        }
+        if (n == 0){ puts("K"); if (a != 0) jump(a); return; }
+        if (n & 0x8000) memset((char *)a, 0, n & 0x7FFF);
+        else memcpy((char *)a, load_buf, n);
+        putchar('K');                  // written: the host may send the next frame
+    }
+}
+
 int main(void){
     int cmd; unsigned a; unsigned v; unsigned n; unsigned i;
     uart_init();
@@ -60,10 +131,8 @@ int main(void){
         else if (cmd == 'L'){ a = gethex(); n = gethex(); i = 0;   // load: L <addr> <nbytes> <raw bytes>
                               while (i < n){ *(volatile char *)(a + i) = uart_getc(); i = i + 1; }
                               puts("ok"); }
-        else if (cmd == 'g'){ a = gethex(); go_target = a;        // go: execute from <addr>
-                              asm("la x5, g_go_target");
-                              asm("lw x5, 0(x5)");
-                              asm("jr x5"); }
+        else if (cmd == 'B'){ bulk_load(); }
+        else if (cmd == 'g'){ jump(gethex()); }                    // go: execute from <addr>
         else { puts("?"); }
     }
 }
@@ -0,0 +1,30 @@
+// Cycles (PCLK, timed with timer_si.c) to print one log line through stdio_si.c's
+// polled puts() and through uart_irq.c's buffered uq_puts().
+#include "stdio_si.c"
+#include "uart_irq.c"
+#include "timer_si.c"
+
+struct uart_q con;
+#pragma interrupt 3 on_uart
+void on_uart(void){ uq_isr(&con); }
+
+int main(void){
+    unsigned t0; unsigned polled; unsigned queued;
+    uart_init();
+    timer_start(0, 65535);                    // free-running PCLK count
+    t0 = timer_count();
+    puts("log: polled puts()");
+    polled = timer_count() - t0;
+    while ((*(volatile unsigned *)UART_SR & 0x20) == 0) { }     // let it leave the line
+    uq_init(&con);
+    t0 = timer_count();
+    uq_puts(&con, "log: queued uq_puts()");
+    queued = timer_count() - t0;
+    uq_putstr(&con, "polled ");
+    uq_putint(&con, polled);
+    uq_putstr(&con, ", queued ");
+    uq_putint(&con, queued);
+    uq_puts(&con, " clocks a line");
+    uq_flush(&con);
+    return 0;
+}
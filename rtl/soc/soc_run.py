@@ -3,25 +3,39 @@
 + nc_uart + nc_tmr) and return the bytes the real UART transmitted.
 
 Flow: compile .c (INTRINSIC_IO off, stack below the peripheral window) -> assemble to
-a 64 KB image -> pack little-endian 32-bit words -> iverilog/vvp with +memh -> parse
-the testbench's "UART <n>" lines.
+a 64 KB image -> pack the populated little-endian 32-bit words -> iverilog/vvp with
++memh -> parse
+the testbench's "UART <n>" lines. ZX16_SIM=verilator builds the same testbench with
+Verilator instead (../hdlsim.py) for long firmware soaks; iverilog is the reference.
 
-Usage: python3 rtl/soc/soc_run.py firmware.c
+run_model() runs the same image on the golden simulator with the peripheral models
+(simulator/zx16soc.py) instead: no HDL simulator needed, one PCLK per instruction.
+
+bulk_load() / host_load() are the host side of the debug monitor's framed 'B' load
+(fw/monitor.c, MONITOR.md): CRC-checked frames of the populated blocks, acked one by
+one. host_load() drives any link (a serial port on a bench board, or model_link()).
+
+Usage: python3 rtl/soc/soc_run.py [--cycles N] [--model] firmware.c ...
 """
-import os, sys, subprocess, tempfile, re, glob
+import os, sys, subprocess, tempfile, re, glob, struct, binascii
 HERE = os.path.dirname(os.path.abspath(__file__))
 RTLSOC = HERE
 RTL = os.path.dirname(HERE)
 ROOT = os.path.dirname(RTL)
 sys.path.insert(0, os.path.join(ROOT, "compiler"))
 sys.path.insert(0, os.path.join(ROOT, "simulator"))
-import codegen, codegen_patterns                              # noqa: E402
+sys.path.insert(0, os.path.join(ROOT, "assembler"))
+sys.path.insert(0, RTL)
+import codegen, codegen_patterns, buildcache, zx16asm         # noqa: E402
+import hdlsim                                                  # noqa: E402
 LIB = os.path.join(ROOT, "compiler", "lib")
 ASM = os.path.join(ROOT, "assembler", "zx16asm.py")
 SCRATCH = os.environ.get("ZX16_SCRATCH", tempfile.gettempdir())
-VVP = os.path.join(SCRATCH, "zx16_soc.vvp")
+SIM_STEM = os.path.join(SCRATCH, "zx16_soc")
+SIM = None                  # artifact of the last build_sim() (.vvp or Verilator binary)
 
 RTL_FILES = ([os.path.join(RTL, "zx16_alu.v"),
+              os.path.join(RTL, "zx16_muldiv.v"),
               os.path.join(RTL, "ahb", "zx16_core_ahb.v"),
               os.path.join(RTLSOC, "zx16_ahb16to32.v"),
               os.path.join(RTLSOC, "zx16_ahb32_sram.v"),
@@ -29,63 +43,194 @@ RTL_FILES = ([os.path.join(RTL, "zx16_alu.v"),
               os.path.join(RTLSOC, "tb_zx16_soc.v")]
              + sorted(glob.glob(os.path.join(RTLSOC, "vendor", "*.v"))))
 
-def build_sim():
-    r = subprocess.run(["iverilog", "-g2012", "-s", "tb_zx16_soc", "-o", VVP] + RTL_FILES,
-                       capture_output=True, text=True)
-    if r.returncode != 0:
-        raise RuntimeError("iverilog failed:\n" + r.stdout + r.stderr)
+def build_sim(sim=None, muldiv=0):
+    """Build tb_zx16_soc with `sim` ("iverilog" | "verilator"; default ZX16_SIM), its
+    core with the multiply/divide unit if `muldiv`."""
+    global SIM
+    SIM = hdlsim.build(RTL_FILES, "tb_zx16_soc", SIM_STEM + ("_md" if muldiv else ""), sim,
+                       ["-g2012"], params={"MULDIV": 1} if muldiv else None)
+    return SIM
+
+def sim_command():
+    """argv prefix running the built SoC testbench (plusargs follow)."""
+    if SIM is None or not os.path.exists(SIM):
+        build_sim()
+    return hdlsim.command(SIM)
 
 def compile_firmware(cfile):
     """Compile a SoC firmware .c to a 64 KB byte image (UART I/O, SP below 0xC000)."""
+    return firmware_image(open(cfile).read(), cfile)
+
+def firmware_asm(src):
+    """compile_firmware()'s assembly for firmware source text."""
     save_io, save_sp = codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP
     codegen.INTRINSIC_IO = False
     codegen_patterns.STACK_TOP = 0xC000
     try:
-        asm = codegen.compile_src(open(cfile).read(), base_dir=LIB)
+        return buildcache.compile_src(src, base_dir=LIB)
     finally:
         codegen.INTRINSIC_IO, codegen_patterns.STACK_TOP = save_io, save_sp
-    with tempfile.NamedTemporaryFile("w", suffix=".s", delete=False) as f:
-        f.write(asm); src = f.name
-    out = src + ".bin"
-    r = subprocess.run([sys.executable, ASM, src, "-o", out], capture_output=True, text=True)
-    if "successfully" not in r.stdout:
-        raise RuntimeError("assembly failed:\n" + r.stdout + r.stderr)
-    return open(out, "rb").read()
-
-def pack_memh(b):
+
+def firmware_image(src, name="<fw>"):
+    """compile_firmware() for firmware source text."""
+    return assemble_image(firmware_asm(src), name)
+
+def assemble_image(asm, name="<asm>"):
+    """Assemble (build-cached); return the 64 KB byte image (RuntimeError on errors)."""
+    return buildcache.assemble(asm, name).binary
+
+def pack_memh(b, sparse=False):
+    """$readmemh text for zx16_ahb32_sram: little-endian 32-bit words. sparse=True
+    writes only the populated words, each run after an @<word index> line (the SRAM
+    clears itself before loading)."""
+    if sparse:
+        return "\n".join(zx16asm.memh_from_segments(zx16asm.image_segments(b), 32)) + "\n"
     if len(b) % 4:
         b = b + b"\x00" * (4 - len(b) % 4)
     return "".join(f"{b[i] | (b[i+1]<<8) | (b[i+2]<<16) | (b[i+3]<<24):08x}\n"
                    for i in range(0, len(b), 4))
 
-def run(cfile, timeout=120, rx=None):
+def run(cfile, timeout=120, rx=None, max_cycles=None, image=None):
     """Run firmware; optionally inject `rx` (str or iterable of byte values) on the
-    UART RX line (for the debug monitor). Returns captured UART TX + halt/timeout."""
-    image = compile_firmware(cfile)
+    UART RX line (for the debug monitor). `max_cycles` raises the testbench's
+    150000-cycle TIMEOUT; `image` runs an already built image instead of compiling
+    `cfile`. Returns captured UART TX + halt/timeout, and "cycles", the clocks to
+    the halt (None if it never came)."""
+    image = compile_firmware(cfile) if image is None else image
     memh = os.path.join(SCRATCH, "zx16_soc.memh")
-    open(memh, "w").write(pack_memh(image))
-    args = ["vvp", VVP, "+memh=" + memh]
+    open(memh, "w").write(pack_memh(image, sparse=True))
+    args = sim_command() + ["+memh=" + memh]
+    if max_cycles is not None:
+        args.append("+maxcycles=%d" % max_cycles)
     if rx is not None:
         data = rx.encode() if isinstance(rx, str) else bytes(rx)
         rxf = os.path.join(SCRATCH, "zx16_soc.rx")
         open(rxf, "w").write("".join(f"{b}\n" for b in data))
         args.append("+rxfile=" + rxf)
-    if not os.path.exists(VVP):
-        build_sim()
     r = subprocess.run(args, capture_output=True, text=True, timeout=timeout)
-    out_bytes, halted, timed = [], False, False
+    out_bytes, halted, timed, cycles = [], False, False, None
     for line in r.stdout.splitlines():
         m = re.match(r"UART (\d+)", line)
         if m: out_bytes.append(int(m.group(1))); continue
+        m = re.match(r"CYCLES (\d+)", line)
+        if m: cycles = int(m.group(1)); continue
         if line.strip() == "HALT": halted = True
         if line.strip() == "TIMEOUT": timed = True
     return {"bytes": out_bytes, "text": "".join(chr(c) for c in out_bytes),
-            "halted": halted, "timeout": timed, "raw": r.stdout}
+            "halted": halted, "timeout": timed, "cycles": cycles, "raw": r.stdout}
+
+def run_model(cfile, rx=None, max_cycles=None, clocks=1, image=None):
+    """run() on zx16sim + zx16soc instead of the RTL: the same firmware image, `rx`
+    fed on the RX line from cycle 5000 paced as tb_zx16_soc.v does, the same
+    150000-cycle TIMEOUT (`max_cycles` raises it). Returns the same dict, "raw" being
+    the simulator's own summary and "cycles" its instruction count."""
+    import zx16sim, zx16soc
+    sim = zx16sim.ZX16()
+    sim.load(compile_firmware(cfile) if image is None else image, 0)
+    limit = 150000 if max_cycles is None else max_cycles
+    sim.max_cycles = limit + 1
+    uart, _ = zx16soc.attach(sim, clocks)
+    if rx is not None:
+        uart.feed(rx.encode() if isinstance(rx, str) else bytes(rx), at=5000 // clocks)
+    sim.run(until=limit)
+    out_bytes = list(uart.drain())
+    return {"bytes": out_bytes, "text": "".join(chr(c) for c in out_bytes),
+            "halted": sim.halted, "timeout": not sim.halted, "cycles": sim.cycles,
+            "raw": f"zx16sim: {sim.cycles} cycles, pc={sim.pc:04x}, halted={sim.halted}\n"}
+
+# ---- the monitor's 'B' bulk load, host side ---------------------------------------
+LOAD_BLOCK = 256            # monitor.c LOAD_BLOCK: the most data bytes one frame carries
+LOAD_FILL = 0x7FFF          # the longest zero fill one frame asks for
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT (poly 0x1021, MSB first, init FFFF) as monitor.c's crc16()."""
+    return binascii.crc_hqx(data, crc)
+
+def load_frame(addr, data=b"", fill=0):
+    """One 'B' frame: `data` to load at addr, a zero fill of `fill` bytes, or (with
+    neither) the end frame, after which the monitor jumps to addr unless it is 0."""
+    body = struct.pack("<HH", addr, 0x8000 | fill if fill else len(data)) + bytes(data)
+    return body + struct.pack("<H", crc16(body))
+
+def load_frames(image, block=LOAD_BLOCK, go=0):
+    """The frames loading `image`: a flat image (its zero runs are skipped) or a
+    zx16asm segment list (zero-fill segments become fill frames). Each run goes out in
+    `block`-byte frames, an all-zero block as a fill frame; then the end frame."""
+    if not 0 < block <= LOAD_BLOCK:
+        raise ValueError(f"block must be 1..{LOAD_BLOCK} bytes")
+    segs = zx16asm.image_segments(image) if isinstance(image, (bytes, bytearray)) else image
+    frames = []
+    for addr, n, data in segs:
+        if data is None:
+            frames += [load_frame(addr + o, fill=min(LOAD_FILL, n - o))
+                       for o in range(0, n, LOAD_FILL)]
+            continue
+        for o in range(0, n, block):
+            chunk = bytes(data[o:o + block])
+            frames.append(load_frame(addr + o, chunk) if any(chunk) else
+                          load_frame(addr + o, fill=len(chunk)))
+    frames.append(load_frame(go))
+    return frames
+
+def bulk_load(image, block=LOAD_BLOCK, go=0):
+    """The RX bytes of a whole 'B' load, for a scripted run(rx=...) / run_model(rx=...)
+    that cannot wait for the acks: the paced line gives the monitor time for each."""
+    return b"B" + b"".join(load_frames(image, block, go))
+
+def host_load(send, recv, image, block=LOAD_BLOCK, go=0, retries=3):
+    """Load `image` through the monitor at its prompt the way a bench host does:
+    send(bytes) writes the monitor's RX line, recv() returns its next transmitted byte
+    (None on a timeout). Sends 'B', then each frame, and waits for its 'K', resending
+    on 'N' or a timeout up to `retries` times (RuntimeError after that). Returns
+    {"frames", "resent", "bytes" sent}; e.g. with pyserial:
+    host_load(port.write, lambda: (port.read(1) or [None])[0], image)"""
+    frames = load_frames(image, block, go)
+    send(b"B")
+    resent, sent = 0, 1
+    for i, f in enumerate(frames):
+        for attempt in range(retries + 1):
+            send(f); sent += len(f)
+            r = recv()
+            if r == ord("K"):
+                break
+            resent += 1
+        else:
+            raise RuntimeError(f"bulk load: frame {i} of {len(frames)} not acked "
+                               f"after {retries} retries (last reply {r!r})")
+    if recv() != 10:
+        raise RuntimeError("bulk load: no newline after the end frame")
+    return {"frames": len(frames), "resent": resent, "bytes": sent}
+
+def model_link(sim, uart, limit=10**7, mangle=None):
+    """send / recv for host_load() on zx16sim + zx16soc: send() puts the bytes on the RX
+    line back to back (a host at the full line rate), recv() runs the simulator until
+    the UART has transmitted one more byte (None at `limit` cycles or a halt).
+    mangle(data) -> data, if given, corrupts what send() puts on the line."""
+    seen = [len(uart.sent)]
+    def send(data):
+        uart.feed(mangle(data) if mangle else data, gap=-(-uart.frame_clocks() // uart.clocks))
+    def recv():
+        while True:
+            uart.drain() if sim.halted else uart.sync()   # a halt: the shifter empties
+            if len(uart.sent) > seen[0]:
+                seen[0] += 1
+                return uart.sent[seen[0] - 1]
+            if sim.halted or sim.cycles >= limit:
+                return None
+            sim.run(until=min(limit, sim.cycles + 4 * uart.frame_clocks() // uart.clocks))
+    return send, recv
 
 if __name__ == "__main__":
-    build_sim()
-    for c in sys.argv[1:]:
-        res = run(c)
+    argv = sys.argv[1:]
+    cycles = None
+    if "--cycles" in argv:
+        i = argv.index("--cycles"); cycles = int(argv[i + 1]); del argv[i:i + 2]
+    model = "--model" in argv
+    if model: argv.remove("--model")
+    else: build_sim()
+    for c in argv:
+        res = (run_model(c, max_cycles=cycles) if model else
+               run(c, timeout=None if cycles else 120, max_cycles=cycles))
         print(f"{os.path.basename(c)}: halted={res['halted']} timeout={res['timeout']}")
         print("  UART bytes:", res["bytes"])
         print("  UART text :", repr(res["text"]))
@@ -3,9 +3,14 @@
 //============================================================================
 // tb_zx16_soc -- runs a ZX16 SoC image and decodes the real nc_uart TX line.
 // The on-chip RAM loads the program via +memh=<file> (see zx16_ahb32_sram).
-// Captured UART bytes are printed as "UART <decimal>"; halt prints "HALT".
+// Captured UART bytes are printed as "UART <decimal>"; halt prints "HALT", preceded
+// when the core halts by "CYCLES <n>", the clocks from power-on (8 of them in reset).
+// +rxfile=<file> bit-bangs bytes into the UART RX line; +maxcycles=<n> raises the
+// 150000-cycle TIMEOUT for long firmware soaks (e.g. under Verilator, ../hdlsim.py).
+// MULDIV=1 (iverilog -Ptb_zx16_soc.MULDIV=1) builds the core with its multiply/divide
+// unit.
 //============================================================================
-module tb_zx16_soc;
+module tb_zx16_soc #(parameter MULDIV = 0);
     reg clk = 1'b0, rst_n = 1'b0;
     always #5 clk = ~clk;                          // 100 MHz
 
@@ -13,7 +18,7 @@ module tb_zx16_soc;
     wire uart_irq, tmr_irq, ecall_valid, halted;
     wire [9:0]  ecall_svc;  wire [15:0] dbg_a0;
 
-    zx16_soc dut (
+    zx16_soc #(.MULDIV(MULDIV)) dut (
         .clk(clk), .rst_n(rst_n), .uart_rx(uart_rx), .uart_tx(uart_tx),
         .uart_irq(uart_irq), .tmr_irq(tmr_irq),
         .ecall_valid(ecall_valid), .ecall_svc(ecall_svc), .dbg_a0(dbg_a0), .halted(halted)
@@ -67,13 +72,14 @@ module tb_zx16_soc;
     // ---- stop on halt (ECALL 0x3FF) or timeout ----
     // After halt, keep clocking ~4000 cycles so the UART can shift out any byte still
     // in its FIFO/shift register (else the last char is lost), then finish.
-    integer cyc = 0;  integer drain = -1;
+    integer cyc = 0;  integer drain = -1;  integer maxcyc;
+    initial if (!$value$plusargs("maxcycles=%d", maxcyc)) maxcyc = 150000;
     always @(posedge clk) begin
         cyc <= cyc + 1;
-        if (rst_n && halted && drain < 0) drain <= 0;
+        if (rst_n && halted && drain < 0) begin drain <= 0; $display("CYCLES %0d", cyc); end
         if (drain >= 0) drain <= drain + 1;
         if (drain > 4000)  begin $display("HALT"); $finish; end
-        if (cyc > 150000)  begin $display("TIMEOUT"); $finish; end   // legit runs << this
+        if (cyc > maxcyc)  begin $display("TIMEOUT"); $finish; end   // legit runs << this
     end
 endmodule
 `default_nettype wire
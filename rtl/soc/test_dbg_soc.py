@@ -57,15 +57,13 @@ dbg_isr:
 
 def main():
     sp = soc_run.SCRATCH
-    open(sp + "/dbg.s", "w").write(ASM)
-    r = subprocess.run([sys.executable, soc_run.ASM, sp + "/dbg.s", "-o", sp + "/dbg.bin"],
-                       capture_output=True, text=True)
-    if "successfully" not in r.stdout:
-        print("ASM FAIL:", r.stdout[-300:], r.stderr[:200]); sys.exit(1)
-    image = open(sp + "/dbg.bin", "rb").read()
-    open(sp + "/zx16_soc.memh", "w").write(soc_run.pack_memh(image))
+    try:
+        image = soc_run.assemble_image(ASM, "dbg.s")
+    except RuntimeError as ex:
+        print("ASM FAIL:", str(ex)[-300:]); sys.exit(1)
+    open(sp + "/zx16_soc.memh", "w").write(soc_run.pack_memh(image, sparse=True))
     soc_run.build_sim()
-    rr = subprocess.run(["vvp", soc_run.VVP, "+memh=" + sp + "/zx16_soc.memh"],
+    rr = subprocess.run(soc_run.sim_command() + ["+memh=" + sp + "/zx16_soc.memh"],
                         capture_output=True, text=True, timeout=120)
     bs = [int(m) for m in re.findall(r"UART (\d+)", rr.stdout)]
     halted = "HALT" in rr.stdout
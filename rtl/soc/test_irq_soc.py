@@ -4,8 +4,9 @@ raises its IRQ -> SoC interrupt controller -> AHB core takes it (IE=1) -> vector
 -> asm ISR clears the timer UIF and bumps a counter -> RETI. After 3 timer interrupts
 the main loop prints 'K' and halts. If interrupts don't work the loop spins -> TIMEOUT.
 
-(RTL-only: the golden sim doesn't model the nc peripherals, so no differential here;
-the AHB core's trap entry/RETI are also differentially checked at the ISA level.)"""
+(The same ASM also runs on the golden sim's peripheral models, simulator/zx16soc.py,
+in compiler/tests/test_socmodel.py; the AHB core's trap entry/RETI are also
+differentially checked at the ISA level.)"""
 import os, sys, subprocess, re
 HERE = os.path.dirname(os.path.abspath(__file__))
 sys.path.insert(0, HERE)
@@ -68,15 +69,13 @@ tmr_isr:
 
 def main():
     sp = soc_run.SCRATCH
-    open(sp + "/irq.s", "w").write(ASM)
-    r = subprocess.run([sys.executable, soc_run.ASM, sp + "/irq.s", "-o", sp + "/irq.bin"],
-                       capture_output=True, text=True)
-    if "successfully" not in r.stdout:
-        print("ASM FAIL:", r.stdout[-300:], r.stderr[:200]); sys.exit(1)
-    image = open(sp + "/irq.bin", "rb").read()
-    open(sp + "/zx16_soc.memh", "w").write(soc_run.pack_memh(image))
+    try:
+        image = soc_run.assemble_image(ASM, "irq.s")
+    except RuntimeError as ex:
+        print("ASM FAIL:", str(ex)[-300:]); sys.exit(1)
+    open(sp + "/zx16_soc.memh", "w").write(soc_run.pack_memh(image, sparse=True))
     soc_run.build_sim()
-    rr = subprocess.run(["vvp", soc_run.VVP, "+memh=" + sp + "/zx16_soc.memh"],
+    rr = subprocess.run(soc_run.sim_command() + ["+memh=" + sp + "/zx16_soc.memh"],
                         capture_output=True, text=True, timeout=120)
     bs = [int(m) for m in re.findall(r"UART (\d+)", rr.stdout)]
     halted = "HALT" in rr.stdout
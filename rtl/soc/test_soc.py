@@ -5,6 +5,7 @@ by the testbench). Requires iverilog + vvp.
 
   - hello.c : stdio_si over the UART (puts/putint/puthex)
   - tmr.c   : nc_tmr periodic overflow polling
+  - with verilator on the PATH: the Verilator build transmits the same bytes
 
 Run: python3 rtl/soc/test_soc.py"""
 import os, sys
@@ -15,11 +16,7 @@ FW = os.path.join(HERE, "fw")
 
 def asm_bytes(src, org=0x20):
     """Assemble raw asm; return the emitted bytes (for position-independent payloads)."""
-    import subprocess, tempfile
-    f = tempfile.NamedTemporaryFile("w", suffix=".s", delete=False); f.write(src); f.close()
-    out = f.name + ".bin"
-    subprocess.run([sys.executable, soc_run.ASM, f.name, "-o", out], capture_output=True, text=True)
-    img = open(out, "rb").read(); end = org
+    img = soc_run.assemble_image(src); end = org
     for i in range(org, len(img)):
         if img[i]: end = i + 1
     return img[org:end]
@@ -42,6 +39,14 @@ check("tmr: nc_tmr periodic overflows",
       r["halted"] and not r["timeout"] and r["text"] == "timer: 5 overflows\n",
       repr(r["text"]))
 
+# interrupt-driven UART (compiler/lib/uart_irq.c): nc_uart irq_o on vector 3
+r = soc_run.run(os.path.join(FW, "uartlog.c"))
+lines = r["text"].splitlines()
+check("uartlog: a line queued through the TX interrupt, then the polled/queued timing",
+      r["halted"] and not r["timeout"] and lines[:2] == ["log: polled puts()",
+      "log: queued uq_puts()"] and len(lines) == 3 and lines[2].endswith("clocks a line"),
+      repr(r["text"]))
+
 # debug monitor driven over the real UART (RX commands in, TX responses out)
 r = soc_run.run(os.path.join(FW, "monitor.c"),
                 rx="w A000 ABCD\nr A000\nw A002 1234\nd A000 2\nq\n")
@@ -67,5 +72,24 @@ r = soc_run.run(os.path.join(FW, "monitor.c"),
 check("monitor: load + go (loaded code prints 'K')",
       r["halted"] and not r["timeout"] and 75 in r["bytes"], repr(r["text"]))
 
+# framed loader: the same payload through 'B' (CRC-checked frames), then run it
+r = soc_run.run(os.path.join(FW, "monitor.c"),
+                rx=soc_run.bulk_load([(0x9000, len(pl), pl)], go=0x9000))
+check("monitor: framed 'B' load + go (acked, then 'K' from the payload)",
+      r["halted"] and not r["timeout"] and r["text"] == "ZX16MON\n>KK\nK", repr(r["text"]))
+
+# the Verilator build (ZX16_SIM=verilator, ../hdlsim.py) against the iverilog reference
+if soc_run.hdlsim.available("verilator") and soc_run.hdlsim.backend() == "iverilog":
+    runs = [("hello.c", None), ("tmr.c", None),
+            ("monitor.c", "w A000 ABCD\nr A000\nd A000 2\nq\n")]
+    ref = [soc_run.run(os.path.join(FW, f), rx=rx) for f, rx in runs]
+    soc_run.build_sim("verilator")
+    for (f, rx), want in zip(runs, ref):
+        got = soc_run.run(os.path.join(FW, f), rx=rx)
+        check(f"verilator: {f} transmits the iverilog bytes",
+              got["halted"] and got["bytes"] == want["bytes"], repr(got["text"]))
+else:
+    print("SKIP verilator cross-check (no verilator, or ZX16_SIM already selects it)")
+
 print(f"\n{npass}/{ntot} SoC tests passed")
 sys.exit(0 if npass == ntot else 1)
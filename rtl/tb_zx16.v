@@ -3,41 +3,90 @@
 // so the combinational ecall_valid/dbg_a0 reflect the instruction executing this
 // cycle (before the rising edge advances PC). Output lines are machine-parseable
 // for the differential harness (rtl/verify.py):
-//   "OUT INT <signed-decimal>"   "OUT CHR <0..255>"   "OUT HALT"
-module tb_zx16;
+//   "OUT INT <signed-decimal>"   "OUT CHR <0..255>"   "OUT HALT"   "OUT TIMEOUT"
+// and, after "OUT HALT", "CYCLES <n>": the clocks from reset to the halting ECALL.
+// +list=<file> runs a batch in one process (see rtl/vvp_batch.py): each program is
+// loaded into cleared memory and run from reset, announced by "OUT BEGIN <n>".
+// +trace=<file> streams every retirement (rt_* port of the core) to <file> as three
+// little-endian 32-bit words, {wdata,pc} {mdata,maddr} {mword,mwe,rd,we}, for the
+// lockstep comparator rtl/cosim.py. MULDIV (iverilog -Ptb_zx16.MULDIV=1, verilator
+// -GMULDIV=1) builds the core with its multiply/divide unit.
+module tb_zx16 #(parameter MULDIV = 0);
     reg clk = 1'b0;
     reg rst = 1'b1;
     wire        halt, ecall_valid;
     wire [9:0]  ecall_svc;
     wire [15:0] dbg_a0;
 
-    zx16_top dut(.clk(clk), .rst(rst), .halt(halt),
+    zx16_top #(.MULDIV(MULDIV)) dut(.clk(clk), .rst(rst), .halt(halt),
                  .ecall_valid(ecall_valid), .ecall_svc(ecall_svc), .dbg_a0(dbg_a0));
 
     always #5 clk = ~clk;
 
-    reg [1023:0] memfile;
-    integer cyc;
-    initial begin
-        if (!$value$plusargs("mem=%s", memfile)) begin
-            $display("ERROR: no +mem=<file>"); $finish;
+    reg [1023:0] memfile, listfile, tracefile;
+    integer cyc, i, fd, n, wsval, done, tfd;
+
+    // Clear the memory and load one $readmemh image (called with rst held high).
+    task load_image;
+        begin
+            for (i = 0; i < 32768; i = i + 1) dut.mem.mem[i] = 16'd0;
+            $readmemh(memfile, dut.mem.mem);
         end
-        $readmemh(memfile, dut.mem.mem);
-        @(posedge clk);          // apply reset
-        @(negedge clk); rst = 1'b0;
-        // generous cap: the software __mul/__div are O(operand), so programs with
-        // negative/large multiplicands (e.g. the FFT's negative twiddles) can run
-        // into the millions of instructions. Halts early via ECALL 0x3FF.
-        for (cyc = 0; cyc < 20000000; cyc = cyc + 1) begin
-            @(negedge clk);
-            if (ecall_valid) begin
-                if      (ecall_svc == 10'h000) $display("OUT INT %0d", $signed(dbg_a0));
-                else if (ecall_svc == 10'h001) $display("OUT CHR %0d", dbg_a0[7:0]);
-                else if (ecall_svc == 10'h3FF) begin
-                    $display("OUT HALT"); $finish;
+    endtask
+
+    // Reset the core and run the loaded image until ECALL 0x3FF or the cycle cap.
+    task run_image;
+        begin
+            @(posedge clk);          // apply reset
+            @(negedge clk); rst = 1'b0;
+            // generous cap: the software __mul/__div are O(operand), so programs with
+            // negative/large multiplicands (e.g. the FFT's negative twiddles) can run
+            // into the millions of instructions. Halts early via ECALL 0x3FF.
+            done = 0;
+            for (cyc = 0; cyc < 20000000 && !done; cyc = cyc + 1) begin
+                @(negedge clk);
+                if (tfd != 0 && dut.core.rt_valid)
+                    $fwrite(tfd, "%u%u%u", {dut.core.rt_wdata, dut.core.rt_pc},
+                            {dut.core.rt_mdata, dut.core.rt_maddr},
+                            {26'd0, dut.core.rt_mword, dut.core.rt_mwe, dut.core.rt_rd,
+                             dut.core.rt_we});
+                if (ecall_valid) begin
+                    if      (ecall_svc == 10'h000) $display("OUT INT %0d", $signed(dbg_a0));
+                    else if (ecall_svc == 10'h001) $display("OUT CHR %0d", dbg_a0[7:0]);
+                    else if (ecall_svc == 10'h3FF) begin
+                        $display("OUT HALT"); $display("CYCLES %0d", cyc); done = 1;
+                    end
                 end
             end
+            if (!done) $display("OUT TIMEOUT");
+            rst = 1'b1;
+        end
+    endtask
+
+    initial begin
+        tfd = 0;
+        if ($value$plusargs("trace=%s", tracefile)) tfd = $fopen(tracefile, "wb");
+        if ($value$plusargs("list=%s", listfile)) begin
+            // batch mode: one "<memfile> <ws>" line per program (ws is ignored here:
+            // this memory has no wait states); each is preceded by "OUT BEGIN <n>"
+            fd = $fopen(listfile, "r");
+            if (fd == 0) begin $display("ERROR: cannot open %0s", listfile); $finish; end
+            n = 0;
+            while ($fscanf(fd, "%s %d\n", memfile, wsval) == 2) begin
+                $display("OUT BEGIN %0d", n);
+                load_image;
+                run_image;
+                n = n + 1;
+            end
+            $fclose(fd);
+            $display("OUT DONE");
+        end else if (!$value$plusargs("mem=%s", memfile)) begin
+            $display("ERROR: no +mem=<file> or +list=<file>");
+        end else begin
+            load_image;
+            run_image;
         end
-        $display("OUT TIMEOUT"); $finish;
+        if (tfd != 0) $fclose(tfd);
+        $finish;
     end
 endmodule
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Lockstep comparator (rtl/cosim.py). Without an HDL simulator: a trace synthesized
+from the golden sim itself is accepted in full on MD5 and a trap/interrupt
+program, and an injected fault (a wrong register value, store address or PC, a
+missing or extra retirement) is reported at exactly its retirement; with late_mem
+(the FWD=1 AHB core), a load / store retiring after younger instructions is accepted
+unless one of them writes the load's register. With the HDL simulator on the PATH
+(iverilog, or Verilator under ZX16_SIM=verilator): every example in lockstep on the
+single-cycle core and on the AHB core (FWD=0 and FWD=1) at ws=0 and ws=2."""
+import io, os, sys, glob
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+import cosim as C                               # noqa: E402
+import hdlsim                                   # noqa: E402
+import verify as V                              # noqa: E402
+
+TRAP_PROG = """
+.text
+.org 0x0002
+    j ebk
+    j irq
+.org 0x0020
+main:
+    ei
+    li16 x6, 100
+    ebreak
+    sb   x6, -1(x2)
+    ecall 0x000
+    ecall 0x3FF
+ebk:
+    mfepc x6
+    addi  x6, 2
+    mtepc x6
+    reti
+irq:
+    addi x7, 1
+    sw   x7, -4(x2)
+    reti
+"""
+
+npass = ntot = 0
+def check(label, cond, got=None):
+    global npass, ntot
+    ntot += 1; npass += bool(cond)
+    print(("PASS " if cond else "FAIL ") + label + ("" if cond else f"   got={got}"))
+
+def golden_trace(b, pre=None):
+    sim = C.Z.ZX16(); sim.load(b.binary, 0)
+    if pre: pre(sim)
+    recs = []
+    while True:
+        r = C.step_retire(sim)
+        if r is None: return recs
+        recs.append(r)
+
+def against(b, recs, pre=None, late_mem=False):
+    sim = C.Z.ZX16(); sim.load(b.binary, 0)
+    if pre: pre(sim)
+    return C.compare(io.BytesIO(b"".join(map(C.pack, recs))), sim, late_mem=late_mem)
+
+md5 = V.buildcache.build(open(os.path.join(V.EXAMPLES, '08_md5.c')).read())
+recs = golden_trace(md5)
+n, div = against(md5, recs)
+check(f"MD5: a faithful trace of {len(recs)} retirements is accepted", n == len(recs)
+      and div is None, (n, div and div.report()))
+b = V.buildcache.assemble(TRAP_PROG)
+t = golden_trace(b, lambda sim: sim.raise_irq(2))
+check("EBREAK and a hardware interrupt: vector entries and RETI retire in order",
+      against(b, t, lambda sim: sim.raise_irq(2)) == (len(t), None)
+      and [r.pc for r in t[:4]] == [0x20, 0x4, 0x36, 0x38], [hex(r.pc) for r in t])
+
+k = len(recs) // 2
+w = next(i for i in range(k, len(recs)) if recs[i].we)
+s = next(i for i in range(k, len(recs)) if recs[i].mwe)
+for label, idx, bad in [
+        ("register value", w, recs[w]._replace(wdata=recs[w].wdata ^ 0x0100)),
+        ("store address", s, recs[s]._replace(maddr=(recs[s].maddr + 2) & 0xFFFF)),
+        ("PC", 12345, recs[12345]._replace(pc=recs[12345].pc + 2))]:
+    n, div = against(md5, recs[:idx] + [bad] + recs[idx + 1:])
+    check(f"wrong {label} reported at retirement #{idx}", div is not None and n == idx
+          and div.index == idx and div.rtl == bad and div.sim == recs[idx]
+          and len(div.history) == 8 and div.history[-1] == (idx - 1, recs[idx - 1]),
+          div and div.report())
+n, div = against(md5, recs[:5000])
+check("a trace that stops early diverges where it stops", div is not None and n == 5000
+      and div.rtl is None and div.sim == recs[5000], div and div.report())
+n, div = against(md5, recs + [recs[-1]])
+check("retiring past the halt diverges", div is not None and n == len(recs)
+      and div.sim is None and "no retirement" in div.report(), div and div.report())
+n, div = against(md5, recs[:w] + [recs[w]._replace(wdata=recs[w].wdata ^ 1)])
+rep = div.report()
+check("the report shows both states and the write that differs",
+      f"x{recs[w].rd}<-{recs[w].wdata ^ 1:04x}" in rep and f"x{recs[w].rd}<-{recs[w].wdata:04x}"
+      in rep and rep.count("regs after") == 2, rep)
+
+# ---- late_mem: records of loads / stores after younger ones, as FWD=1 retires them ----
+op = lambda r: md5.binary[r.pc] & 7
+late = list(recs)
+moved = 0
+for i in range(len(late) - 1):
+    a, y = late[i], late[i + 1]
+    if op(a) in (3, 4) and op(y) not in (3, 4, 7) and not (a.we and y.we and y.rd == a.rd):
+        late[i], late[i + 1] = y, a
+        moved += 1
+n, div = against(md5, late, late_mem=True)
+check(f"MD5: {moved} loads / stores retiring after a younger instruction are accepted",
+      moved > 1000 and n == len(recs) and div is None, (n, div and div.report()))
+n, div = against(md5, late)
+check("... and diverge where the first one does without late_mem", div is not None
+      and late[n] != recs[n] and late[:n] == recs[:n], div and div.report())
+WAW = """
+.text
+.org 0x0020
+main:
+    lw   x5, -2(x2)
+    li   x5, 3
+    ecall 0x3FF
+"""
+b = V.buildcache.assemble(WAW)
+t = golden_trace(b)
+n, div = against(b, [t[1], t[0]] + t[2:], late_mem=True)
+check("a younger write to a pending load's register diverges", div is not None and n == 0
+      and div.rtl == t[1] and div.sim == t[0], div and div.report())
+
+if hdlsim.available():
+    sys.path.insert(0, os.path.join(HERE, 'ahb'))
+    import verify_ahb as VA                     # noqa: E402
+    builds = [(V.build_rtl(), [], "single-cycle", False)] + [
+        (VA.build(fwd=fwd), ['+ws=%d' % ws], f"AHB FWD={fwd} ws={ws}", bool(fwd))
+        for fwd in (0, 1) for ws in (0, 2)]
+    for c in sorted(glob.glob(os.path.join(V.EXAMPLES, '*.c'))):
+        b = V.buildcache.build(open(c).read())
+        pre = V.setup_poll if os.path.basename(c).startswith('02') else None
+        mem = V.mem_image(b)
+        for vvp, extra, core, late in builds:
+            n, div = C.lockstep(vvp, mem, b.binary, pre, extra, late_mem=late)
+            check(f"{os.path.basename(c)}: {core} core in lockstep ({n} retirements)",
+                  div is None, div and div.report())
+        os.unlink(mem)
+else:
+    print(f"SKIP RTL lockstep runs ({hdlsim.backend()} not on the PATH)")
+
+print(f"\n{npass}/{ntot} lockstep comparator checks passed")
+sys.exit(0 if npass == ntot else 1)
@@ -65,8 +65,9 @@ vvp = V.build_rtl()
 npass = ntot = 0
 for label, prog, want_vals in [("EBREAK round-trip", EBREAK_PROG, [100, 150, 200]),
                                ("single-step a0 0->1->2->3", STEP_PROG, [0, 1, 2, 3, 3])]:
-    want = V.sim_output(prog)
-    got = V.rtl_output(vvp, V.mem_image(prog))
+    b = V.buildcache.assemble(prog)
+    want = V.sim_output(b)
+    got = V.rtl_output(vvp, V.mem_image(b))
     ok = (got == want) and ([v for _, v in got] == want_vals)
     ntot += 1; npass += ok
     print(f"{'PASS' if ok else 'FAIL'}  {label:<26} rtl={[v for _,v in got]} sim={[v for _,v in want]}")
@@ -2,62 +2,84 @@
 """Differential verification for the ZX16 single-cycle RTL core.
 
 For each ZC example: compile it, run it on (a) the Verilog core via iverilog/vvp
-and (b) the Python golden simulator, then compare the console output (the ECALL
-print_int / print_char sequence). A match on every program -- including MD5, FFT,
-and TEA -- is strong evidence the RTL implements the ISA correctly.
-
-Run:  python3 rtl/verify.py
+(Verilator with ZX16_SIM=verilator, see hdlsim.py) and (b) the Python golden
+simulator, then compare the console output (the ECALL print_int / print_char
+sequence). A match on every program -- including MD5, FFT, and TEA -- is strong
+evidence the RTL implements the ISA correctly. The corpus runs as a batch
+(rtl/vvp_batch.py): one simulator process per core, each resetting tb_zx16 between
+the programs dealt to it.
+
+The corpus runs twice: on the core as built by default, and on the core with its
+multiply/divide unit (MULDIV=1) with every example compiled for it
+(codegen.HW_MULDIV). A MULDIV=1 program must also print what its runtime-routine
+build prints, so the instructions are checked against __mul / __udivmod / __div /
+__mod as well as against the golden simulator.
+
+Run:  python3 rtl/verify.py [--muldiv 0|1]      (default: both)
 """
-import sys, os, glob, subprocess, re, tempfile
+import sys, os, glob, subprocess, tempfile
 HERE = os.path.dirname(os.path.abspath(__file__))
 ROOT = os.path.dirname(HERE)
 for d in ('compiler', 'simulator', 'assembler'):
     sys.path.insert(0, os.path.join(ROOT, d))
+import buildcache       # noqa: E402
 import codegen          # noqa: E402
 import zx16sim as Z     # noqa: E402
-import zx16asm          # noqa: E402
+import hdlsim           # noqa: E402
+import vvp_batch        # noqa: E402
+import cosim            # noqa: E402
 
 EXAMPLES = os.path.join(ROOT, 'compiler', 'examples')
-RTL_SRCS = ['zx16_alu.v', 'zx16_mem.v', 'zx16_core.v', 'zx16_top.v', 'tb_zx16.v']
+RTL_SRCS = ['zx16_alu.v', 'zx16_muldiv.v', 'zx16_mem.v', 'zx16_core.v', 'zx16_top.v', 'tb_zx16.v']
 
 
-def build_rtl():
-    vvp = os.path.join(tempfile.gettempdir(), 'zx16_verify.vvp')
+def build_rtl(sim=None, muldiv=0):
     srcs = [os.path.join(HERE, f) for f in RTL_SRCS]
-    subprocess.run(['iverilog', '-o', vvp] + srcs, check=True)
-    return vvp
+    return hdlsim.build(srcs, 'tb_zx16', os.path.join(
+        tempfile.gettempdir(), 'zx16_verify' + ('_md' if muldiv else '')), sim,
+        params={'MULDIV': 1} if muldiv else None)
+
+
+def build_prog(src, muldiv=0):
+    """buildcache.build(src), compiled for the multiply/divide unit if `muldiv`."""
+    save = codegen.HW_MULDIV
+    codegen.HW_MULDIV = bool(muldiv)
+    try:
+        return buildcache.build(src)
+    finally:
+        codegen.HW_MULDIV = save
+
 
+def golden(b, pre=None):
+    """(console output, retired instructions) of the image on the Python sim."""
+    out, sim = Z.run_image(b.binary, pre_run=pre)
+    return [('INT' if k == 'int' else 'CHR', v) for k, v in out], sim.cycles
 
-def sim_output(asm, pre=None):
-    out, _ = Z.assemble_and_run(asm, pre_run=pre)
-    return [('INT' if k == 'int' else 'CHR', v) for k, v in out]
 
+def sim_output(b, pre=None):
+    return golden(b, pre)[0]
 
-def mem_image(asm):
-    a = zx16asm.ZX16Assembler()
-    if not a.assemble(asm, '<verify>'):
-        raise RuntimeError('assembly failed')
-    lines = [L for L in a.get_memory_file_output().splitlines() if not L.startswith('#')]
-    fd, path = tempfile.mkstemp(suffix='.mem')
-    with os.fdopen(fd, 'w') as f:
-        f.write("\n".join(lines) + "\n")
-    return path
+
+mem_image = vvp_batch.mem_image
 
 
 def rtl_output(vvp, memfile):
-    r = subprocess.run(['vvp', vvp, '+mem=' + memfile],
+    """One program in its own vvp process (the batch path is vvp_batch.run_batch)."""
+    r = subprocess.run(hdlsim.command(vvp) + ['+mem=' + memfile],
                        capture_output=True, text=True, timeout=300)
-    res = []
-    for line in r.stdout.splitlines():
-        m = re.match(r'OUT INT (-?\d+)', line)
-        if m:
-            res.append(('INT', int(m.group(1)))); continue
-        m = re.match(r'OUT CHR (\d+)', line)
-        if m:
-            res.append(('CHR', int(m.group(1)))); continue
-        if 'OUT TIMEOUT' in line:
-            res.append(('TIMEOUT', 0))
-    return res
+    return vvp_batch.parse_output(r.stdout)
+
+
+def first_divergence(vvp, b, pre=None, plusargs=(), late_mem=False):
+    """Rerun one image in lockstep (rtl/cosim.py) and describe where it first
+    differs from the golden sim."""
+    mem = mem_image(b)
+    try:
+        n, div = cosim.lockstep(vvp, mem, b.binary, pre, plusargs, late_mem=late_mem)
+    finally:
+        os.unlink(mem)
+    return "      " + (div.report().replace("\n", "\n      ") if div else
+                       f"(all {n} retirements match: the difference is in the console path)")
 
 
 def setup_poll(sim):                       # mirrors test_embedded's 02 setup
@@ -65,24 +87,56 @@ def setup_poll(sim):                       # mirrors test_embedded's 02 setup
     sim.mmio_regs[0xF021] = 99
 
 
+def muldiv_choice(args):
+    """The MULDIV values selected by `--muldiv N` in args (removed), default both."""
+    if '--muldiv' not in args: return [0, 1]
+    i = args.index('--muldiv')
+    md = [int(args[i + 1])]
+    del args[i:i + 2]
+    return md
+
+
 def main():
-    vvp = build_rtl()
+    args = sys.argv[1:]
+    ok = True
+    for md in muldiv_choice(args):
+        ok &= verify_core(md)
+    sys.exit(0 if ok else 1)
+
+
+def verify_core(muldiv):
+    vvp = build_rtl(muldiv=muldiv)
     progs = sorted(glob.glob(os.path.join(EXAMPLES, '*.c')))
-    npass = 0
+    builds, wants, jobs, soft = [], [], [], []
+    print(f"=== MULDIV={muldiv} ===")
     for c in progs:
+        src = open(c).read()
+        b = build_prog(src, muldiv)
+        pre = setup_poll if os.path.basename(c).startswith('02') else None
+        want, cycles = golden(b, pre)
+        # MULDIV=1: the runtime-routine build is the reference for the output
+        soft.append(sim_output(build_prog(src), pre) if muldiv else want)
+        builds.append((b, pre)); wants.append(want); jobs.append((mem_image(b), 0, cycles))
+    try:
+        gots = vvp_batch.run_batch(vvp, jobs)
+    finally:
+        for mem, _, _ in jobs: os.unlink(mem)
+    npass = 0
+    for c, (b, pre), want, got, ref in zip(progs, builds, wants, gots, soft):
         name = os.path.basename(c)
-        asm = codegen.compile_src(open(c).read())
-        pre = setup_poll if name.startswith('02') else None
-        want = sim_output(asm, pre)
-        got = rtl_output(vvp, mem_image(asm))
-        ok = (got == want)
+        ok = (got == want == ref)
         npass += ok
         print(f"{'PASS' if ok else 'FAIL'}  {name:<20} sim={len(want)} vals, rtl={len(got)} vals")
         if not ok:
+            if ref != want:
+                print(f"      runtime build: {ref}")
             print(f"      sim: {want}")
             print(f"      rtl: {got}")
-    print(f"\n{npass}/{len(progs)} examples: RTL output matches the golden simulator")
-    sys.exit(0 if npass == len(progs) else 1)
+            if got != want:
+                print(first_divergence(vvp, b, pre))
+    print(f"\n{npass}/{len(progs)} examples: RTL output matches the golden simulator"
+          + (" and the runtime-routine build" if muldiv else ""))
+    return npass == len(progs)
 
 
 if __name__ == '__main__':
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Batch runner for the RTL testbenches (tb_zx16.v, ahb/tb_zx16_ahb.v).
+
+A testbench started with +list=<file> runs every "<memfile> <ws>" line of the file in
+one vvp process, resetting the design and reloading cleared memory between programs,
+and prefixes each program's output with "OUT BEGIN <n>". run_batch() deals a list of
+jobs over parallel vvp workers (one per core; ZX16_JOBS=N overrides, as for the
+compiler suites), heaviest first by the caller's weight, so a regression's wall time
+tracks the core count instead of the number of programs x wait-state settings.
+raw=True returns each program's own testbench text instead, for callers that read
+more than the console (the "CYCLES <n>" line, compiler/bench/bench_suite.py).
+The build may be either back end of hdlsim.py (a .vvp file or a Verilator binary).
+"""
+import os, re, subprocess, tempfile
+from concurrent.futures import ThreadPoolExecutor
+import hdlsim
+
+
+def workers():
+    n = os.environ.get("ZX16_JOBS")
+    return max(1, int(n)) if n else (os.cpu_count() or 1)
+
+
+def mem_image(b):
+    """Write a build's $readmemh text (comment lines dropped) to a temp file."""
+    lines = [L for L in b.mem.splitlines() if not L.startswith('#')]
+    fd, path = tempfile.mkstemp(suffix='.mem')
+    with os.fdopen(fd, 'w') as f:
+        f.write("\n".join(lines) + "\n")
+    return path
+
+
+def parse_output(text):
+    """Console lines of one program -> [('INT', v) | ('CHR', v) | ('TIMEOUT', 0)], plus
+    ('ICACHE' | 'DCACHE', (hits, misses)) when tb_zx16_ahb runs with a cache."""
+    res = []
+    for line in text.splitlines():
+        m = re.match(r'OUT INT (-?\d+)', line)
+        if m:
+            res.append(('INT', int(m.group(1)))); continue
+        m = re.match(r'OUT CHR (\d+)', line)
+        if m:
+            res.append(('CHR', int(m.group(1)))); continue
+        m = re.match(r'OUT ([ID]CACHE) (\d+) (\d+)', line)
+        if m:
+            res.append((m.group(1), (int(m.group(2)), int(m.group(3))))); continue
+        if 'OUT TIMEOUT' in line:
+            res.append(('TIMEOUT', 0))
+    return res
+
+
+def _run_list(vvp, jobs, timeout, raw=False):
+    fd, lst = tempfile.mkstemp(suffix='.list')
+    with os.fdopen(fd, 'w') as f:
+        for mem, ws, _ in jobs:
+            f.write(f"{mem} {ws}\n")
+    try:
+        stdout = subprocess.run(hdlsim.command(vvp) + ['+list=' + lst], capture_output=True,
+                                text=True, timeout=timeout * len(jobs)).stdout
+    except subprocess.TimeoutExpired as ex:
+        stdout = ex.stdout.decode() if isinstance(ex.stdout, bytes) else (ex.stdout or "")
+    finally:
+        os.unlink(lst)
+    chunks = re.split(r'^OUT BEGIN (\d+)\n', stdout, flags=re.M)
+    text = {int(chunks[i]): chunks[i + 1] for i in range(1, len(chunks) - 1, 2)}
+    res = []
+    for i in range(len(jobs)):
+        t = text.get(i, "")
+        if raw:
+            res.append(t); continue
+        o = parse_output(t)
+        if 'OUT HALT' not in t and 'OUT TIMEOUT' not in t:
+            o.append(('TIMEOUT', 0))      # cut off by a crash or the vvp timeout
+        res.append(o)
+    return res
+
+
+def run_batch(vvp, jobs, timeout=300, nworkers=None, raw=False):
+    """jobs: [(memfile, ws, weight)] -> the parsed output of each (its text if `raw`),
+    in job order. Jobs are dealt longest-processing-time first onto min(workers,
+    len(jobs)) vvp processes; `timeout` seconds are allowed per program."""
+    n = max(1, min(nworkers or workers(), len(jobs)))
+    bins = [[] for _ in range(n)]
+    load = [0] * n
+    for i in sorted(range(len(jobs)), key=lambda i: -jobs[i][2]):
+        k = load.index(min(load))
+        bins[k].append(i); load[k] += jobs[i][2]
+    bins = [b for b in bins if b]
+    out = [None] * len(jobs)
+    with ThreadPoolExecutor(len(bins)) as pool:
+        for b, res in zip(bins, pool.map(lambda b: _run_list(vvp, [jobs[i] for i in b],
+                                                                 timeout, raw), bins)):
+            for i, o in zip(b, res):
+                out[i] = o
+    return out
@@ -16,8 +16,11 @@
 //       0 ECALL (svc 0x3FF halts; svc/a0 exposed), 1 EBREAK, 2 RETI, 3 EI, 4 DI,
 //       5 MFEPC rd, 6 MTEPC rd.  Trap: EPC<-PC, IE<-0, PC<-vector (J-table, entry i*2).
 //       EBREAK -> vector 1 (0x0002); a hardware irq_req (when IE) -> vector irq_num.
+//   * MULDIV=1 adds the multiply/divide unit (zx16_muldiv.v, R-type funct4 0xD): the
+//     core holds PC and writes for the unit's 17 extra cycles, then retires it.
 module zx16_core #(
-    parameter RESET_PC = 16'h0020
+    parameter RESET_PC = 16'h0020,
+    parameter MULDIV   = 0          // 1 = MUL/MULH/MULHU/DIV/DIVU/REM/REMU
 )(
     input             clk,
     input             rst,
@@ -39,7 +42,18 @@ module zx16_core #(
     output            ecall_valid,
     output     [9:0]  ecall_svc,
     output     [15:0] dbg_a0,
-    output            halted
+    output            halted,
+    // retirement trace (verification only; rtl/cosim.py): valid when the instruction
+    // at rt_pc commits at the coming edge, with its register and memory writes
+    output            rt_valid,
+    output     [15:0] rt_pc,
+    output            rt_we,      // writes rt_wdata to register rt_rd
+    output     [2:0]  rt_rd,
+    output     [15:0] rt_wdata,
+    output            rt_mwe,     // stores rt_mdata (a word, or the byte in [7:0])
+    output            rt_mword,
+    output     [15:0] rt_maddr,
+    output     [15:0] rt_mdata
 );
     // ---- ALU op encoding (must match zx16_alu.v) ----
     localparam ALU_ADD=4'd0, ALU_SUB=4'd1, ALU_SLT=4'd2, ALU_SLTU=4'd3,
@@ -113,6 +127,15 @@ module zx16_core #(
     wire [15:0] alu_y;
     zx16_alu u_alu(.op(alu_op), .a(alu_a), .b(alu_b), .shamt(shamt), .y(alu_y));
 
+    // ---- multiply / divide (MULDIV=1): start, wait for done, retire on the next edge ----
+    wire is_md = MULDIV && (opcode==OP_R) && (funct4==4'hD);
+    wire md_busy, md_done;
+    wire [15:0] md_y;
+    wire md_wait = is_md && ~md_done;          // hold PC and every write meanwhile
+    wire md_start;
+    zx16_muldiv u_md(.clk(clk), .rst(rst), .start(md_start), .ack(is_md && ~halt_r),
+                     .op(func3), .a(ra), .b(rb), .busy(md_busy), .done(md_done), .y(md_y));
+
     // ---- instruction class helpers ----
     wire is_load  = (opcode==OP_L);
     wire is_store = (opcode==OP_S);
@@ -133,8 +156,10 @@ module zx16_core #(
     wire is_mfepc  = is_sys && (func3==3'd5);
     wire is_mtepc  = is_sys && (func3==3'd6);
     wire is_step   = is_sys && (func3==3'd7);
-    wire take_irq  = ie && irq_req && ~halt_r && ~step_armed;  // don't preempt a single-step
-    wire step_trap = step_armed && ~halt_r;                    // trap after the stepped instr
+    wire take_irq  = ie && irq_req && ~halt_r && ~step_armed   // don't preempt a single-step
+                     && ~md_busy && ~md_done;                  // nor a started MUL/DIV
+    wire step_trap = step_armed && ~halt_r && ~md_wait;        // trap after the stepped instr
+    assign md_start = md_wait && ~md_busy && ~halt_r && ~rst && ~take_irq;
     wire [15:0] vec_irq = {11'b0, irq_num, 1'b0};     // irq_num * 2
 
     // ---- data memory interface (suppressed when servicing an interrupt) ----
@@ -152,6 +177,7 @@ module zx16_core #(
     // ---- writeback mux ----
     wire [15:0] wb_data =
         is_mfepc           ? epc              :  // MFEPC rd <- EPC
+        is_md              ? md_y             :
         is_load            ? load_data        :
         (is_jal||is_jalr)  ? pc_plus2         :  // link = PC+2
         is_lui             ? uimm             :
@@ -205,6 +231,18 @@ module zx16_core #(
     assign ecall_valid = is_ecall && ~halt_r && ~take_irq;
     assign ecall_svc   = svc;
 
+    // ---- retirement trace ----
+    assign rt_valid = ~rst && ~halt_r && ~take_irq    // an interrupt squashes the instruction
+                      && ~md_wait;
+    assign rt_pc    = pc;
+    assign rt_we    = wr_en;
+    assign rt_rd    = wr_addr;
+    assign rt_wdata = wb_data;
+    assign rt_mwe   = dwe;
+    assign rt_mword = dword;
+    assign rt_maddr = daddr;
+    assign rt_mdata = dword ? dwdata : {8'b0, dwdata[7:0]};
+
     // ---- sequential state ----
     integer i;
     always @(posedge clk) begin
@@ -217,7 +255,7 @@ module zx16_core #(
             halt_r <= 1'b0;
             for (i=0;i<8;i=i+1) regs[i] <= 16'd0;
             regs[2] <= 16'hF000;          // SP
-        end else if (!halt_r) begin
+        end else if (!halt_r && !md_wait) begin
             pc <= next_pc;
             if (take_irq) begin
                 epc <= pc;                // save the interrupted PC; instruction is re-run
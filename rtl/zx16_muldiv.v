@@ -0,0 +1,74 @@
+// zx16_muldiv.v -- ZX16 optional multiply/divide unit (multi-cycle). Verilog-2001.
+// R-type funct4 0xD, operation in func3 (README.md, R-Type Instructions):
+//   0 MUL   low 16 bits of a*b        4 DIV   signed a/b, truncating
+//   1 MULH  high 16 bits, signed      5 DIVU  unsigned a/b
+//   2 MULHU high 16 bits, unsigned    6 REM   signed a%b (sign of a)
+//   3 (reserved)                      7 REMU  unsigned a%b
+// Division by zero gives what restoring division does, which is also what the
+// software runtime (__udivmod / __div / __mod) returns: a/0 = 0xFFFF (1 for a
+// negative signed a), a%0 = a. -32768 / -1 = -32768, remainder 0.
+//
+// One radix-2 step a cycle on a 32-bit {hi,lo} register: shift-add for the
+// products, restoring division on magnitudes for the quotients, signs fixed up at
+// the output. start latches the operands; 16 cycles later done rises with y valid
+// and stays up until ack (the core retires the instruction). The core holds the
+// instruction in EXECUTE meanwhile, so one costs 1 + 17 cycles.
+module zx16_muldiv(
+    input             clk,
+    input             rst,
+    input             start,     // begin op on a, b (ignored while busy or done)
+    input             ack,       // the result was taken: drop done
+    input      [2:0]  op,        // func3
+    input      [15:0] a,         // rd / rs1
+    input      [15:0] b,         // rs2
+    output reg        busy,
+    output reg        done,
+    output     [15:0] y
+);
+    reg [15:0] hi, lo, m;        // product / {remainder, quotient}; multiplicand / divisor
+    reg [2:0]  op_r;
+    reg        neg_r;            // negate the result (signed ops)
+    reg [3:0]  cnt;
+
+    wire sgn    = (op == 3'd1) || (op == 3'd4) || (op == 3'd6);
+    wire is_div = op[2];
+    wire [15:0] ma = (sgn && a[15]) ? -a : a;   // magnitudes (-32768 -> 0x8000)
+    wire [15:0] mb = (sgn && b[15]) ? -b : b;
+    wire neg = sgn && (op == 3'd6 ? a[15] : a[15] ^ b[15]);
+
+    // one step
+    wire [16:0] sum  = {1'b0, hi} + (lo[0] ? {1'b0, m} : 17'd0);   // shift-add
+    wire [16:0] sh   = {hi, lo[15]};                                // restoring
+    wire [17:0] diff = {1'b0, sh} - {2'b0, m};
+    wire        ge   = ~diff[17];
+
+    wire [31:0] prod = neg_r ? -{hi, lo} : {hi, lo};
+    wire [15:0] quo  = neg_r ? -lo : lo;
+    wire [15:0] rem  = neg_r ? -hi : hi;
+    assign y = (op_r == 3'd0) ? prod[15:0] :
+               (op_r[2] == 1'b0) ? prod[31:16] :
+               (op_r[1] == 1'b0) ? quo : rem;
+
+    always @(posedge clk) begin
+        if (rst) begin
+            busy <= 1'b0; done <= 1'b0;
+        end else if (busy) begin
+            if (op_r[2]) begin
+                hi <= ge ? diff[15:0] : sh[15:0];
+                lo <= {lo[14:0], ge};
+            end else begin
+                hi <= sum[16:1];
+                lo <= {sum[0], lo[15:1]};
+            end
+            cnt <= cnt + 4'd1;
+            if (cnt == 4'd15) begin busy <= 1'b0; done <= 1'b1; end
+        end else if (done) begin
+            if (ack) done <= 1'b0;
+        end else if (start) begin
+            hi <= 16'd0;
+            lo <= is_div ? ma : mb;
+            m  <= is_div ? mb : ma;
+            op_r <= op; neg_r <= neg; cnt <= 4'd0; busy <= 1'b1;
+        end
+    end
+endmodule
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Cache model for the AHB core's optional caches (rtl/ahb/zx16_ahb_cache.v).
+
+A Cache tracks tags only -- zx16sim keeps the data -- and replays the RTL's
+decisions access for access: `sets` x `ways` (1 = direct-mapped, 2 = LRU) lines
+of `line_words` halfwords, invalid way 0 then way 1 filled first, a hit marking
+the other way for replacement. Reads below `uncached` hit or allocate; stores are
+write-through without allocation and leave the tags and LRU alone; MMIO reads go
+straight to the bus. hits/misses count cacheable reads, as the RTL's counters do.
+
+access() also returns the data-phase length the core sees (`ws` = the bus's wait
+states per transfer), the figure zx16prof.Profiler charges per fetch / load / store:
+
+  hit 1     miss 2 + line_words * (1 + ws)     store, MMIO read 1 + ws
+
+so a store or an MMIO access costs what it does uncached, and a miss two cycles
+more than fetching its line's halfwords one by one.
+
+A geometry is written SETSxWAYSxWORDS ("16x2x4": 16 sets, 2-way, 4 halfwords).
+"""
+
+
+class Cache:
+    def __init__(self, sets=16, ways=1, line_words=4, uncached=0xF000):
+        for name, v in (("sets", sets), ("line_words", line_words)):
+            if v < 1 or v & (v - 1):
+                raise ValueError(f"{name} must be a power of two, got {v}")
+        if line_words < 2:
+            raise ValueError("line_words must be at least 2")
+        if ways not in (1, 2):
+            raise ValueError(f"ways must be 1 or 2, got {ways}")
+        if sets * line_words * 2 > 0x8000:
+            raise ValueError("cache larger than half the address space")
+        self.sets, self.ways, self.line_words, self.uncached = sets, ways, line_words, uncached
+        self._shift = (line_words * 2).bit_length() - 1     # byte offset bits
+        self.tags = [[None] * ways for _ in range(sets)]    # None = invalid way
+        self.lru = [0] * sets                               # way to replace next
+        self.hits = self.misses = self.bypass = 0
+
+    @classmethod
+    def parse(cls, spec, uncached=0xF000):
+        """Cache from a "SETSxWAYSxWORDS" geometry string."""
+        try:
+            sets, ways, words = (int(x) for x in spec.lower().split("x"))
+        except ValueError:
+            raise ValueError(f"bad cache geometry {spec!r} (want SETSxWAYSxWORDS, "
+                             f"e.g. 16x2x4)") from None
+        return cls(sets, ways, words, uncached)
+
+    @property
+    def size(self):
+        """Data capacity in bytes."""
+        return self.sets * self.ways * self.line_words * 2
+
+    def __str__(self):
+        return f"{self.sets}x{self.ways}x{self.line_words} ({self.size} B)"
+
+    def read(self, addr):
+        """One read: True on a hit, False on a miss (the line is filled), None when
+        the address is uncached."""
+        if addr >= self.uncached:
+            self.bypass += 1
+            return None
+        line = addr >> self._shift
+        s = line & (self.sets - 1)
+        tag = line // self.sets
+        ways = self.tags[s]
+        if ways[0] == tag or (self.ways == 2 and ways[1] == tag):
+            self.hits += 1
+            if self.ways == 2: self.lru[s] = 1 if ways[0] == tag else 0
+            return True
+        self.misses += 1
+        v = 0 if self.ways == 1 or ways[0] is None else 1 if ways[1] is None else self.lru[s]
+        ways[v] = tag
+        if self.ways == 2: self.lru[s] = 1 - v
+        return False
+
+    def access(self, addr, ws, write=False):
+        """Account one core access; return its data-phase cycles."""
+        if write:
+            self.bypass += 1
+            return 1 + ws
+        hit = self.read(addr)
+        if hit is None:
+            return 1 + ws
+        return 1 if hit else 2 + self.line_words * (1 + ws)
+
+    def hit_rate(self):
+        n = self.hits + self.misses
+        return self.hits / n if n else 0.0
+
+    def report(self, name):
+        return (f"{name} {self}: hits {self.hits}  misses {self.misses}  "
+                f"hit rate {100.0 * self.hit_rate():.2f}%  stores + MMIO {self.bypass}")
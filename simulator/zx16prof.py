@@ -0,0 +1,338 @@
+#!/usr/bin/env python3
+"""Execution profiler for zx16sim: per-PC / per-class / per-function counts and a
+cycle estimate for the 2-stage AHB-Lite core (rtl/ahb/zx16_core_ahb.v).
+
+ZX16.cycles counts retired instructions. A Profiler attached to a simulator
+(sim.profile = prof, or profile_asm()) sees every retire through step() and
+charges it what the pipelined core would spend, with `iws` / `dws` HREADY wait
+states per transfer on the instruction / data bus (ahb_sram's WAITS):
+
+  every instruction              1 + iws    (fetch of the next overlaps execute)
+  + taken branch, J/JAL, JR/JALR,
+    EBREAK, RETI (redirect)      1 + iws    (flush: refill bubble, squashed fetch)
+  + load / store                 3 + dws    (I-bus idles: D address phase, data
+                                             phase, then the pipeline refills)
+  + hardware interrupt taken     2 + 2*iws  (EXECUTE squashed, then the refill;
+                                             2 + iws over a load / store, which
+                                             leaves no fetch to squash)
+  + single-step trap             1 + iws    (unless the instruction already flushed)
+  + MUL ... REMU (funct4 0xD)    17         (EXECUTE held while the multiply/divide
+                                             unit, MULDIV=1, iterates)
+
+With an I-cache and / or D-cache (zx16cache.Cache, the model of
+rtl/ahb/zx16_ahb_cache.v) the bus terms become per-access data-phase lengths:
+each fetch -- including the squashed fetch of PC+2 a flush discards -- and each
+load / store costs what its cache returns instead of 1 + iws / 1 + dws.
+
+`fwd` models the core built with FWD=1 instead: a load / store leaves EXECUTE after
+its own fetch and fetch carries on, its address phase and data phase overlapping
+the instructions after it. Those are held back only while a load's destination is
+not yet available (it is forwarded in the cycle its data phase completes), while
+the D-bus is busy with the previous access (for a load / store), or until the D-bus
+is idle (SYS instructions and interrupt entry). A single-stepped load / store is
+serialized as above.
+
+Functions are the text-section symbols of the assembler's table, minus emitter
+labels (`__else3`) and routine-internal ones (`__mul_lp`), plus every address
+reached by a call; a PC folds to the nearest entry at or below it. A shadow call
+stack (JAL/JALR linking into x1 push, `ret` pops; an interrupt or trap pushes, RETI pops)
+gives the collapsed-stack profile (`outer;inner cycles` lines) flamegraph.pl and
+speedscope read.
+
+    python3 simulator/zx16prof.py prog.c [--iws N] [--dws N] [--top N] [--folded F]
+                                         [--icache 16x2x4] [--dcache 16x2x4] [--fwd]
+"""
+import os, re, sys
+from bisect import bisect_right
+from collections import Counter
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, HERE)
+import zx16sim                                  # noqa: E402
+
+# opcode (bits 2:0) -> class name, as the ISA spec names the formats
+CLASSES = ("R", "I", "B", "S", "L", "J", "U", "SYS")
+MULDIV_CYCLES = 17          # rtl/zx16_muldiv.v: 16 steps, then the result cycle
+_LOCAL = re.compile(r"__(?:[A-Za-z]+\d+|[A-Za-z0-9]+_\w+)$")
+
+def is_local(name):
+    return bool(_LOCAL.match(name))
+
+def text_labels(image):
+    """{addr: name} for the labels inside an AssemblyImage's .text; where several
+    name one address, a function name wins over a local label."""
+    lo = image.section_addresses.get(".text", 0)
+    hi = lo + len(image.sections.get(".text", b""))
+    labels = {}
+    for name, v in sorted(image.symbols.items(), key=lambda s: (is_local(s[0]), s[1], s[0])):
+        if lo <= v < hi:
+            labels.setdefault(v, name)
+    return labels
+
+class Profiler:
+    def __init__(self, labels=None, iws=0, dws=0, icache=None, dcache=None, fwd=False):
+        self.labels = dict(labels or {})   # addr -> name (text_labels)
+        self.iws, self.dws = iws, dws
+        self.fwd = fwd                 # the FWD=1 core: overlapped loads / stores
+        self.icache, self.dcache = icache, dcache   # zx16cache.Cache or None
+        self.instructions = 0
+        self.cycles = 0                # modeled core cycles
+        self.insns = Counter()         # pc -> retired instructions
+        self.pc_cycles = Counter()     # pc -> modeled cycles
+        self.classes = Counter()       # "R".."SYS" -> retired instructions
+        self.taken = Counter()         # branch pc -> taken
+        self.not_taken = Counter()     # branch pc -> fell through
+        self.mem = Counter()           # load/store pc -> accesses
+        self.loads = self.stores = self.flushes = 0
+        self.call_targets = set()
+        self._dfree, self._ldrd = 0, None   # FWD=1: D-bus free cycle, in-flight load rd
+        self._stack = []               # PC of each active call site / interrupted PC
+        self._stacks = {(): Counter()} # call-site tuple -> Counter(pc -> cycles)
+        self._cur = self._stacks[()]
+        self.sim = None
+
+    def attach(self, sim):
+        sim.profile = self; self.sim = sim
+        return self
+
+    def _fetch(self, addr):
+        ic = self.icache
+        return 1 + self.iws if ic is None else ic.access(addr, self.iws)
+
+    def retire(self, pc, w, nextpc, take, irq, trap, addr=0):
+        """Called by ZX16.step() for every instruction: `pc` executed (after any
+        interrupt redirect), `nextpc` next, `take` for a taken branch, `irq` the
+        interrupted PC when a hardware interrupt was taken first (else None), `trap`
+        when a single-step trap follows, `addr` a load / store's address."""
+        op = w & 7
+        mem = op == 3 or op == 4
+        redirect = False
+        frame = 0                      # +1 call / trap entry, -1 return, after charging
+        if mem:
+            self.mem[pc] += 1
+            if op == 3: self.stores += 1
+            else: self.loads += 1
+        elif op == 2:
+            redirect = take
+            if take: self.taken[pc] += 1
+            else: self.not_taken[pc] += 1
+        elif op == 5:
+            redirect = True
+            if w >> 15 and (w >> 6) & 7 == 1: frame = 1
+        elif op == 0:
+            f4 = w >> 12
+            if f4 == 0xC:
+                redirect = True
+                if (w >> 6) & 7 == 1: frame = 1
+            elif f4 == 0xB:
+                redirect = True
+                if (w >> 6) & 7 == 1: frame = -1
+        elif op == 7:
+            f3 = (w >> 3) & 7
+            if f3 == 1: redirect = True; frame = 1          # EBREAK
+            elif f3 == 2: redirect = True; frame = -1       # RETI
+        if redirect: self.flushes += 1
+        if irq is not None:            # charged to the handler's frame
+            self._push(irq)
+        c = (self._overlapped if self.fwd else self._serialized)(
+            pc, w, op, mem, redirect, irq, trap, addr)
+        self.instructions += 1
+        self.cycles += c
+        self.insns[pc] += 1
+        self.pc_cycles[pc] += c
+        self.classes[CLASSES[op]] += 1
+        self._cur[pc] += c
+        if frame > 0:
+            if op != 7: self.call_targets.add(nextpc)
+            self._push(pc)
+        elif frame < 0 and self._stack:
+            self._pop()
+        if trap:
+            self._push(nextpc)
+
+    def _data(self, addr, write):
+        dc = self.dcache
+        return 1 + self.dws if dc is None else dc.access(addr, self.dws, write)
+
+    def _serialized(self, pc, w, op, mem, redirect, irq, trap, addr):
+        """Cycles of one instruction on the FWD=0 core (the table above)."""
+        c = 0
+        if irq is not None:
+            c += self._fetch(irq)      # the squashed instruction's fetch
+            iop = self.sim.mem[irq] & 7
+            c += 1 if iop == 3 or iop == 4 else self._fetch((irq + 2) & 0xFFFF)
+        c += self._fetch(pc)
+        if op == 0 and w >> 12 == 0xD:
+            c += MULDIV_CYCLES
+        if mem:
+            c += 2 + self._data(addr, op == 3)
+        if redirect or (trap and not mem):
+            c += self._fetch((pc + 2) & 0xFFFF)     # the squashed fetch of PC+2
+        return c
+
+    def _overlapped(self, pc, w, op, mem, redirect, irq, trap, addr):
+        """Cycles of one instruction on the FWD=1 core, on a timeline: self.cycles is
+        the cycle the next fetch's address phase is accepted, self._dfree the cycle
+        the last load / store's data phase completes (forwarding its load data)."""
+        now = self.cycles
+        if irq is not None:            # taken once the D-bus is idle; PC+2 squashed
+            t = max(now + self._fetch(irq), self._dfree + 1)
+            now = t + self._fetch((irq + 2) & 0xFFFF)
+        t = now + self._fetch(pc)      # EXECUTE, unless held
+        rd = (w >> 6) & 7
+        if op == 7:
+            t = max(t, self._dfree + 1)             # SYS waits for an idle D-bus
+        elif self._ldrd is not None and (rd == self._ldrd or (
+                op in (0, 2, 3, 4) and (w >> 9) & 7 == self._ldrd)):
+            t = max(t, self._dfree)                 # load-use: wait for the data phase
+        if op == 0 and w >> 12 == 0xD:
+            t += MULDIV_CYCLES                      # the unit starts once nothing holds it
+        if mem:
+            t = max(t, self._dfree)                 # one access on the D-bus at a time
+            self._dfree = t + 1 + self._data(addr, op == 3)
+            self._ldrd = rd if op == 4 else None
+            if trap:                   # single-stepped: serialized, then the trap
+                return self._dfree + 1 - self.cycles
+        elif redirect or trap:
+            t += self._fetch((pc + 2) & 0xFFFF)     # the squashed fetch of PC+2
+        return t - self.cycles
+
+    def _push(self, pc):
+        self._stack.append(pc)
+        self._enter()
+
+    def _pop(self):
+        self._stack.pop()
+        self._enter()
+
+    def _enter(self):
+        key = tuple(self._stack)
+        cur = self._stacks.get(key)
+        if cur is None:
+            cur = self._stacks[key] = Counter()
+        self._cur = cur
+
+    # ---- folding / reports ---------------------------------------------------------
+    def _namer(self):
+        entries = {a: n for a, n in self.labels.items() if not is_local(n)}
+        for t in self.call_targets: entries.setdefault(t, self.labels.get(t, "0x%04x" % t))
+        addrs = sorted(entries)
+        names = [entries[a] for a in addrs]
+        cache = {}
+        def name(pc):
+            n = cache.get(pc)
+            if n is None:
+                i = bisect_right(addrs, pc) - 1
+                n = cache[pc] = names[i] if i >= 0 else (
+                    "<vectors>" if pc < 0x20 else "0x%04x" % pc)
+            return n
+        return name
+
+    def stacks(self):
+        """Counter mapping (outermost, ..., leaf) function-name tuples to cycles.
+        Frames are the functions holding each call site; the leaf is the function
+        of the executing PC (a self-recursive frame is not repeated)."""
+        name = self._namer()
+        out = Counter()
+        for sites, pcs in self._stacks.items():
+            frames = []
+            for s in sites:
+                n = name(s)
+                if not frames or frames[-1] != n: frames.append(n)
+            for pc, c in pcs.items():
+                leaf = name(pc)
+                out[tuple(frames + [leaf] if not frames or frames[-1] != leaf
+                          else frames)] += c
+        return out
+
+    def functions_table(self):
+        """[(name, self_cycles, incl_cycles, insns, loads+stores, taken, not_taken)],
+        hottest self time first."""
+        name = self._namer()
+        rows = {}
+        def row(n):
+            r = rows.get(n)
+            if r is None: r = rows[n] = [n, 0, 0, 0, 0, 0, 0]
+            return r
+        for pc, n in self.insns.items():
+            r = row(name(pc))
+            r[1] += self.pc_cycles[pc]; r[3] += n; r[4] += self.mem[pc]
+        for pc, n in self.taken.items(): row(name(pc))[5] += n
+        for pc, n in self.not_taken.items(): row(name(pc))[6] += n
+        for st, c in self.stacks().items():
+            for n in set(st): row(n)[2] += c
+        return sorted((tuple(r) for r in rows.values()), key=lambda r: (-r[1], r[0]))
+
+    def flat(self, top=None):
+        """Flat profile text: a summary, the opcode classes and one row per function."""
+        cyc = self.cycles or 1
+        nb = sum(self.taken.values()) + sum(self.not_taken.values())
+        lines = [f"instructions {self.instructions}  cycles {self.cycles}  "
+                 f"CPI {self.cycles / max(self.instructions, 1):.2f}  "
+                 f"(iws={self.iws} dws={self.dws}{' FWD' if self.fwd else ''})",
+                 f"branches {nb}: taken {sum(self.taken.values())}, not taken "
+                 f"{sum(self.not_taken.values())}  loads {self.loads}  stores {self.stores}  "
+                 f"flushes {self.flushes}",
+                 "classes  " + "  ".join(f"{k} {self.classes[k]}" for k in CLASSES
+                                         if self.classes[k])]
+        lines += [c.report(n) for n, c in (("icache", self.icache), ("dcache", self.dcache))
+                  if c is not None]
+        lines += ["",
+                 f"{'self cyc':>10} {'self%':>6} {'incl cyc':>10} {'incl%':>6} "
+                 f"{'insns':>9} {'mem':>7} {'br tk':>7} {'br nt':>7}  function"]
+        for r in self.functions_table()[:top]:
+            lines.append(f"{r[1]:>10} {100.0 * r[1] / cyc:>6.2f} {r[2]:>10} "
+                         f"{100.0 * r[2] / cyc:>6.2f} {r[3]:>9} {r[4]:>7} {r[5]:>7} "
+                         f"{r[6]:>7}  {r[0]}")
+        return "\n".join(lines)
+
+    def collapsed(self):
+        """Collapsed-stack text (one `a;b;c cycles` line per stack), weighted by
+        modeled cycles."""
+        return "".join(f"{';'.join(st)} {c}\n"
+                       for st, c in sorted(self.stacks().items()) if c)
+
+def profile_image(image, pre_run=None, iws=0, dws=0, icache=None, dcache=None, fwd=False):
+    """Run an AssemblyImage under a Profiler; returns (out, sim, prof)."""
+    sim = zx16sim.ZX16()
+    sim.load(image.binary(), 0x0000)
+    prof = Profiler(text_labels(image), iws, dws, icache, dcache, fwd).attach(sim)
+    if pre_run: pre_run(sim)
+    return sim.run(), sim, prof
+
+def profile_asm(asm_text, pre_run=None, iws=0, dws=0, asm_path=None, icache=None,
+                dcache=None, fwd=False):
+    """assemble_and_run() with a Profiler attached; returns (out, sim, prof)."""
+    image = zx16sim.load_assembler(asm_path).assemble(asm_text, '<asm>')
+    if not image.ok:
+        raise Exception("assembly failed:\n" + image.report())
+    return profile_image(image, pre_run, iws, dws, icache, dcache, fwd)
+
+if __name__ == '__main__':
+    import argparse
+    ap = argparse.ArgumentParser(description="Profile a ZX16 program (.s, or .c via zcc)")
+    ap.add_argument("input")
+    ap.add_argument("--iws", type=int, default=0, help="I-bus HREADY wait states per fetch")
+    ap.add_argument("--dws", type=int, default=0, help="D-bus HREADY wait states per access")
+    ap.add_argument("--top", type=int, default=None, help="functions to list")
+    ap.add_argument("--folded", help="write the collapsed stacks here")
+    ap.add_argument("--lib", help="#include directory for .c input (default: its own)")
+    ap.add_argument("--icache", metavar="SxWxN", help="model an I-cache: sets x ways x "
+                    "halfwords per line (e.g. 16x2x4)")
+    ap.add_argument("--dcache", metavar="SxWxN", help="model a write-through D-cache")
+    ap.add_argument("--fwd", action="store_true", help="model the FWD=1 core (overlapped "
+                    "loads / stores, load-use interlock)")
+    args = ap.parse_args()
+    import zx16cache
+    caches = [zx16cache.Cache.parse(g) if g else None for g in (args.icache, args.dcache)]
+    text = open(args.input).read()
+    if args.input.endswith(".c"):
+        sys.path.insert(0, os.path.join(os.path.dirname(HERE), "compiler"))
+        import codegen
+        text = codegen.compile_src(text, args.lib or os.path.dirname(os.path.abspath(args.input)))
+    out, sim, prof = profile_asm(text, iws=args.iws, dws=args.dws, icache=caches[0],
+                                 dcache=caches[1], fwd=args.fwd)
+    print(prof.flat(args.top))
+    if args.folded:
+        with open(args.folded, "w") as f: f.write(prof.collapsed())
+        print(f"\ncollapsed stacks -> {args.folded}")
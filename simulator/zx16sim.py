@@ -9,15 +9,238 @@ Implements the ZX16 instruction set per the corrected spec:
 
 This is a validation tool for the ZC compiler, not a teaching artifact.
 """
-import sys
+import sys, json, zlib, base64, heapq, math, mmap, struct
+from collections import deque
 
 MASK = 0xFFFF
+PAGE_SHIFT = 8                    # memory-map dispatch granularity (256-byte pages)
+_LE = sys.byteorder == 'little'   # aligned RAM words are read through a 'H' view
+CODE_PAGE_SHIFT = 6               # translated-code invalidation granularity (64-byte pages)
+BLOCK_MAX = 64                    # instructions per translated block
+BLOCK_HOT = 2                     # translate a block on its second visit
 
 def s16(v):
     v &= MASK
     return v - 0x10000 if v >= 0x8000 else v
 
+def muldiv(f3, a, b):
+    """The optional multiply/divide unit (R-type funct4 0xD; rtl/zx16_muldiv.v), by
+    func3, on 16-bit operands. Division follows the runtime's __udivmod / __div /
+    __mod: x/0 = 0xFFFF (1 for a negative signed x), x%0 = x, -32768/-1 = -32768.
+    None for the reserved func3 3."""
+    if f3 == 0: return (a * b) & MASK                            # MUL
+    if f3 == 1: return ((s16(a) * s16(b)) >> 16) & MASK          # MULH
+    if f3 == 2: return (a * b) >> 16                             # MULHU
+    if f3 in (5, 7):
+        q, r = (a // b, a % b) if b else (MASK, a)
+        return q if f3 == 5 else r                               # DIVU / REMU
+    if f3 in (4, 6):
+        sa, sb = s16(a), s16(b)
+        q, r = ((abs(sa) // abs(sb), abs(sa) % abs(sb)) if sb else (MASK, abs(sa)))
+        if f3 == 4: return (-q if (sa < 0) != (sb < 0) else q) & MASK   # DIV
+        return (-r if sa < 0 else r) & MASK                      # REM
+    return None
+
+def _ea(base, off):
+    """Python source for the effective address base+off (base is already 16-bit)."""
+    if off == 0: return '_a = %s' % base
+    return '_a = (%s %s %d) & 65535' % (base, '-' if off < 0 else '+', abs(off))
+
+class ScriptedMMIO:
+    """Default device behind the MMIO window: byte registers that read back what was
+    last written, a write log, and per-address scripted reads. Assigning a list to
+    script[addr] queues values returned (and consumed) by successive reads of addr;
+    once the queue is empty the register value is returned."""
+    def __init__(self):
+        self.writes = []          # (addr, value, size)
+        self.regs = {}            # addr -> byte
+        self.script = _ReadScript()
+
+    def idle_until(self, addrs):
+        """Registers only change when written; a scripted read consumes its queue."""
+        return None if any(self.script.get(a) for a in addrs) else math.inf
+
+    def read(self, a):
+        q = self.script.get(a)
+        if q: return q.popleft() & 0xFF
+        return self.regs.get(a, 0) & 0xFF
+
+    def write(self, a, v, size):
+        self.regs[a] = v & 0xFF
+        if size == 2: self.regs[(a+1)&MASK] = (v >> 8) & 0xFF
+        self.writes.append((a, v, size))
+
+    def save_state(self):
+        return [sink_state(self.writes), sorted(self.regs.items()),
+                [[a, list(q)] for a, q in self.script.items()]]
+
+    def restore_state(self, state):
+        writes, regs, script = state
+        sink_restore(self.writes, writes)                # in place: sim.mmio_* alias these
+        self.regs.clear(); self.regs.update((a, v) for a, v in regs)
+        self.script.clear()
+        for a, q in script: self.script[a] = q
+
+class _ReadScript(dict):
+    """addr -> deque of scripted read values (lists are converted on assignment)."""
+    def __setitem__(self, a, values):
+        super().__setitem__(a, values if isinstance(values, deque) else deque(values))
+
+# ---- record sinks ----------------------------------------------------------------
+# The simulator logs MMIO writes (addr, value, size) to self.mmio_writes and program
+# output ('int' | 'char', value) to self.out; the UART model logs transmitted bytes to
+# its `sent`. Each is a sink: anything with append(record). The default is a plain
+# list (everything, in memory); log_to() swaps in one of these for long runs. A sink
+# joins snapshots through save_state() / restore_state() (a list through its items).
+
+class RingSink(deque):
+    """The last `n` records (RingSink(0) keeps none); `total` counts them all."""
+    def __init__(self, n):
+        super().__init__(maxlen=n)
+        self.total = 0
+
+    def append(self, rec):
+        self.total += 1
+        deque.append(self, rec)
+
+    def save_state(self):
+        return {'records': list(self), 'total': self.total}
+
+    def restore_state(self, state):
+        self.clear(); self.extend(tuple(r) if isinstance(r, list) else r
+                                  for r in state['records'])
+        self.total = state['total']
+
+class FilterSink:
+    """Pass on to `inner` only the records whose first field (an MMIO address, an
+    output kind) is in `keep` (a set, a range), or for which keep(record) is true."""
+    def __init__(self, inner, keep):
+        self.inner = inner
+        self.keep = keep if callable(keep) else (lambda rec, c=keep: rec[0] in c)
+
+    def append(self, rec):
+        if self.keep(rec): self.inner.append(rec)
+
+    def __iter__(self): return iter(self.inner)
+    def __len__(self): return len(self.inner)
+    def save_state(self): return sink_state(self.inner)
+    def restore_state(self, state): sink_restore(self.inner, state)
+
+class CallbackSink:
+    """Call fn(record) for each record and keep nothing (a restore cannot take back
+    calls already made)."""
+    def __init__(self, fn): self.fn = fn
+    def append(self, rec): self.fn(rec)
+    def save_state(self): return None
+    def restore_state(self, state): pass
+
+class BinarySink:
+    """Fixed-width little-endian records appended to a file (a path, or an open binary
+    file): 'mmio' = addr u16, value u16, size u8; 'out' = kind u8 (0 int, 1 char),
+    value s16; 'byte' = u8. read_records() decodes them; a restore truncates the file
+    back to the snapshot's record."""
+    FORMATS = {'mmio': struct.Struct('<HHB'), 'out': struct.Struct('<Bh'),
+               'byte': struct.Struct('<B')}
+    _KINDS = ('int', 'char')
+
+    def __init__(self, f, kind='mmio'):
+        self.kind, self.rec = kind, self.FORMATS[kind]
+        self.f = open(f, 'w+b') if isinstance(f, str) else f
+        self.total = 0
+        self._pack = {'mmio': lambda r: self.rec.pack(r[0] & MASK, r[1] & MASK, r[2]),
+                      'out': lambda r: self.rec.pack(self._KINDS.index(r[0]), r[1]),
+                      'byte': lambda r: self.rec.pack(r & 0xFF)}[kind]
+
+    def append(self, rec):
+        self.f.write(self._pack(rec)); self.total += 1
+
+    def flush(self): self.f.flush()
+    def close(self): self.f.close()
+
+    def save_state(self):
+        return {'total': self.total}
+
+    def restore_state(self, state):
+        self.total = state['total']
+        self.f.flush(); self.f.seek(self.total * self.rec.size); self.f.truncate()
+
+def read_records(f, kind='mmio'):
+    """The records a BinarySink wrote to `f` (a path or a binary file), as the
+    simulator logged them."""
+    data = open(f, 'rb').read() if isinstance(f, str) else f.read()
+    rec = BinarySink.FORMATS[kind]
+    for t in rec.iter_unpack(data[:len(data) - len(data) % rec.size]):
+        if kind == 'mmio': yield t
+        elif kind == 'out': yield (BinarySink._KINDS[t[0]], t[1])
+        else: yield t[0]
+
+def sink_state(sink):
+    """What a snapshot keeps of a sink."""
+    return sink.save_state() if hasattr(sink, 'save_state') else list(sink)
+
+def sink_restore(sink, state):
+    if hasattr(sink, 'restore_state'): sink.restore_state(state)
+    else: sink[:] = [tuple(r) if isinstance(r, list) else r for r in state]
+
+class Snapshot:
+    """Saved ZX16 state (ZX16.save()): the CPU fields, the pages of memory that differ
+    from the loaded image, and each mapped device's save_state(). `image_crc` ties it
+    to that image; to_bytes()/from_bytes() are the compact on-disk form (each dirty
+    page XORed with the image, zlib-compressed)."""
+    MAGIC = b'ZX16SNAP1'
+
+    def __init__(self, cycles, cpu, pages, devices, image_crc):
+        self.cycles = cycles      # the cycle count it was taken at
+        self.cpu = cpu            # dict of CPU fields (see ZX16._CPU_FIELDS) + 'out'
+        self.pages = pages        # page number -> its 256 bytes
+        self.devices = devices    # save_state() of each mapped device, in address order
+        self.image_crc = image_crc
+
+    def to_bytes(self, image):
+        """Serialize against `image`, the loaded image (ZX16.image)."""
+        size = 1 << PAGE_SHIFT
+        pages = {p: base64.b64encode(bytes(x ^ y for x, y in
+                                           zip(d, image[p * size:(p + 1) * size]))).decode()
+                 for p, d in self.pages.items()}
+        doc = {'cycles': self.cycles, 'cpu': self.cpu, 'pages': pages,
+               'devices': self.devices, 'image_crc': self.image_crc}
+        return self.MAGIC + zlib.compress(json.dumps(doc, separators=(',', ':')).encode(), 9)
+
+    @classmethod
+    def from_bytes(cls, data, image):
+        if not data.startswith(cls.MAGIC):
+            raise ValueError("not a ZX16 snapshot")
+        doc = json.loads(zlib.decompress(data[len(cls.MAGIC):]))
+        if doc['image_crc'] != zlib.crc32(image):
+            raise ValueError("snapshot was taken against a different image")
+        size = 1 << PAGE_SHIFT
+        pages = {int(p): bytes(x ^ y for x, y in zip(base64.b64decode(d),
+                                                   image[int(p) * size:(int(p) + 1) * size]))
+                 for p, d in doc['pages'].items()}
+        cpu = doc['cpu']
+        if isinstance(cpu['out'], list): cpu['out'] = [tuple(o) for o in cpu['out']]
+        return cls(doc['cycles'], cpu, pages, doc['devices'], doc['image_crc'])
+
+def checkpoint_before(snapshots, cycle):
+    """The latest of `snapshots` taken at or before `cycle` (they are in cycle order,
+    as run_checkpointed() returns them)."""
+    best = None
+    for s in snapshots:
+        if s.cycles > cycle: break
+        best = s
+    if best is None:
+        raise ValueError(f"no checkpoint at or before cycle {cycle}")
+    return best
+
+# translated block functions are pure (state comes in through S/R/M/H), so identical
+# blocks share one compiled function across simulator instances
+_BLOCK_CODE = {}
+
 class ZX16:
+    # what save() keeps besides memory, the devices and `out`
+    _CPU_FIELDS = ('reg', 'pc', 'halted', 'cycles', 'ie', 'epc', 'irq_pending', 'irq_vec',
+                   'step_req', 'step_armed')
+
     def __init__(self, mem_size=0x10000):
         self.mem = bytearray(mem_size)
         self.reg = [0]*8
@@ -34,44 +257,215 @@ class ZX16:
         self.step_req = False     # STEP requested (armed by the next RETI)
         self.step_armed = False   # step active: trap to vector 1 after one instruction
         self.max_cycles = 5_000_000
+        self.profile = None       # a zx16prof.Profiler: run() steps and reports each retire
+        # --- memory map: one dispatch entry per 256-byte page (see map_device) ---
+        # None = RAM backed directly by self.mem; else a device with read()/write()
+        self._page_dev = [None] * (0x10000 >> PAGE_SHIFT)
+        self._ram_top = 0x10000   # lowest device address: everything below is RAM
+        self._words = memoryview(self.mem).cast('H') if _LE and not mem_size & 1 else None
         # --- MMIO device model (0xF000..0xFFFF) ---
         self.mmio_base = 0xF000
-        self.mmio_writes = []     # log of (addr, value, size) writes to MMIO
-        self.mmio_regs = {}       # addr -> current value (byte granularity)
-        # scripted reads: addr -> list of values returned on successive reads
-        self.mmio_read_script = {}
+        self.mmio = ScriptedMMIO()
+        self.mmio_writes = self.mmio.writes   # log of (addr, value, size) writes to MMIO
+        self.mmio_regs = self.mmio.regs       # addr -> current value (byte granularity)
+        # scripted reads: addr -> values returned on successive reads
+        self.mmio_read_script = self.mmio.script
+        self._blocks = {}
+        self.map_device(self.mmio_base, 0xFFFF, self.mmio)
+        # --- block translation cache (see run()) ---
+        self.fast = True          # run() uses translated blocks; False = step() only
+        # start pc -> (fn, ninstr, pages, instructions before the first store or output);
+        # fn None = "use step()"
+        self._blocks.clear()
+        self._page_blocks = {}    # 64-byte code page -> set of block start pcs
+        self._codemap = bytearray(0x10000 >> CODE_PAGE_SHIFT)  # 1 = page holds cached code
+        self._heat = {}           # pc -> visits before translation (BLOCK_HOT)
+        self._smc_hit = False     # a store just invalidated cached code
+        # --- device events (see at()) ---
+        self._events = []         # heap of (cycle, seq, fn)
+        self._seq = 0
+        self._boff = 0            # instructions into the running block (see now())
+        # --- idle-loop skipping (see run()) ---
+        self.idle_skip = True     # fast-forward pure polling loops to the next change
+        self.idle_cycles = 0      # cycles skipped that way (each still counted in cycles)
+        self._io_seen = set()     # device addresses read since the loop head
+        self.image = bytes(self.mem)   # memory as loaded: what snapshots are a delta from
 
     def load(self, data, addr=0x0020):
         self.mem[addr:addr+len(data)] = data
+        self.flush_code_cache()
+        self.image = bytes(self.mem)
+
+    def load_segments(self, segments):
+        """Load (address, length, bytes or None) segments, as zx16asm.image_segments()
+        and unpack_image() give them: data is copied in, a zero fill clears its range,
+        every other byte is left as it is."""
+        for addr, n, data in segments:
+            self.mem[addr:addr + n] = bytes(n) if data is None else data
+        self.flush_code_cache()
+        self.image = bytes(self.mem)
+
+    def load_image_file(self, path):
+        """Load a segment-list image (zx16asm.py -f zxi). The file is mmapped and only
+        its data segments are copied, straight from the mapping."""
+        unpack = load_assembler().unpack_image
+        with open(path, 'rb') as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as m:
+            segs = unpack(m)
+            try:
+                self.load_segments(segs)
+            finally:
+                for _, _, data in segs:
+                    if data is not None: data.release()
+                del segs
+
+    def log_to(self, mmio=None, out=None):
+        """Send the MMIO write log and/or the program output to other sinks (RingSink,
+        FilterSink, CallbackSink, BinarySink, or any object with append()); the
+        defaults are lists. Returns (mmio_writes, out)."""
+        if mmio is not None:
+            self.mmio.writes = self.mmio_writes = mmio
+        if out is not None:
+            self.out = out
+        return self.mmio_writes, self.out
+
+    # ---- snapshots -----------------------------------------------------------------
+    def devices(self):
+        """The distinct mapped devices, in address order."""
+        seen = []
+        for d in self._page_dev:
+            if d is not None and all(d is not e for e in seen): seen.append(d)
+        return seen
+
+    def save(self):
+        """A Snapshot of the current state. Only RAM pages that differ from the
+        loaded image are kept; a device joins in through save_state() /
+        restore_state(state) (a device without them is assumed stateless)."""
+        size = 1 << PAGE_SHIFT; mem = self.mem; image = self.image
+        pages = {}
+        for p in range(len(mem) >> PAGE_SHIFT):
+            lo = p << PAGE_SHIFT
+            if self._page_dev[p] is None and mem[lo:lo + size] != image[lo:lo + size]:
+                pages[p] = bytes(mem[lo:lo + size])
+        cpu = {f: getattr(self, f) for f in self._CPU_FIELDS}
+        cpu['reg'] = list(self.reg); cpu['out'] = sink_state(self.out)
+        devs = [d.save_state() if hasattr(d, 'save_state') else None for d in self.devices()]
+        return Snapshot(self.cycles, cpu, pages, json.loads(json.dumps(devs)),   # deep copy
+                        zlib.crc32(image))
+
+    def restore(self, snap):
+        """Put this simulator back in the state `snap` was saved in. It must hold the
+        same loaded image and device map."""
+        if snap.image_crc != zlib.crc32(self.image):
+            raise ValueError("snapshot was taken against a different image")
+        devs = self.devices()
+        if len(devs) != len(snap.devices):
+            raise ValueError(f"snapshot has {len(snap.devices)} devices, the map has {len(devs)}")
+        self.mem[:] = self.image
+        self._events.clear()                            # devices reschedule their own
+        for p, data in snap.pages.items():
+            self.mem[p << PAGE_SHIFT:(p << PAGE_SHIFT) + len(data)] = data
+        self.flush_code_cache()
+        for f in self._CPU_FIELDS:
+            if f != 'reg': setattr(self, f, snap.cpu[f])
+        self.reg[:] = snap.cpu['reg']                   # in place: translated code holds it
+        sink_restore(self.out, snap.cpu['out'])
+        for d, state in zip(devs, snap.devices):
+            if state is not None: d.restore_state(state)
+        self._smc_hit = False
+
+    def run_checkpointed(self, until, every):
+        """run() to cycle `until` (or the halt), saving a Snapshot now and at every
+        multiple of `every` cycles on the way, and at the end. Returns them in cycle
+        order, for checkpoint_before() and restore()."""
+        snaps = [self.save()]
+        while not self.halted and self.cycles < until:
+            self.run(min(until, (self.cycles // every + 1) * every))
+            snaps.append(self.save())
+        return snaps
+
+    def map_device(self, lo, hi, dev):
+        """Route every page overlapping lo..hi (inclusive) to `dev`, or back to RAM
+        when dev is None. A device implements read(addr) -> byte and
+        write(addr, value, size) with size 1 (byte) or 2 (word at addr, addr+1)."""
+        for p in range(lo >> PAGE_SHIFT, (hi >> PAGE_SHIFT) + 1):
+            self._page_dev[p] = dev
+        top = [p for p, d in enumerate(self._page_dev) if d is not None]
+        self._ram_top = (top[0] << PAGE_SHIFT) if top else 0x10000
+        if self._blocks: self.flush_code_cache()   # translated code inlines _ram_top
+
+    def now(self):
+        """The cycle the executing instruction started on: what a device sees from
+        read()/write(), also from inside a translated block."""
+        return self.cycles + self._boff
+
+    def at(self, cycle, fn):
+        """Call fn(sim) once `cycle` instructions have retired, before the next one
+        (cycle <= now() means at the next instruction boundary). run() and its
+        translated blocks stop exactly there; a device uses it to raise_irq() on
+        time, keeping its registers lazily up to date on access in between. A device
+        store that schedules one ends its translated block, like a store into code."""
+        self._seq += 1
+        heapq.heappush(self._events, (cycle, self._seq, fn))
+        self._smc_hit = True
+
+    def next_event(self):
+        """The cycle of the earliest scheduled event, or None."""
+        return self._events[0][0] if self._events else None
+
+    def _stable_until(self, addrs):
+        """The first cycle a read of one of the device addresses `addrs` may return
+        something else: the minimum of each device's idle_until(its addresses), which
+        is math.inf when nothing will change until it is written, and None (taken as
+        "now") when the device cannot tell. A device without the hook is not trusted."""
+        by_dev = {}
+        for a in addrs:
+            dev = self._page_dev[a >> PAGE_SHIFT]
+            by_dev.setdefault(id(dev), [dev]).append(a)
+        bound = math.inf
+        for dev, *mine in by_dev.values():
+            t = dev.idle_until(mine) if hasattr(dev, 'idle_until') else None
+            bound = min(bound, self.cycles if t is None else t)
+        return bound
+
+    def _fire(self):
+        ev = self._events
+        while ev and ev[0][0] <= self.cycles:
+            heapq.heappop(ev)[2](self)
 
     def is_mmio(self, a):
-        return a >= self.mmio_base
+        return self._page_dev[a >> PAGE_SHIFT] is not None
 
     def _read_byte(self, a):
-        if self.is_mmio(a):
-            if a in self.mmio_read_script and self.mmio_read_script[a]:
-                return self.mmio_read_script[a].pop(0) & 0xFF
-            return self.mmio_regs.get(a, 0) & 0xFF
-        return self.mem[a]
+        dev = self._page_dev[a >> PAGE_SHIFT]
+        if dev is None: return self.mem[a]
+        self._io_seen.add(a)
+        return dev.read(a) & 0xFF
 
     def _write_byte(self, a, v):
-        v &= 0xFF
-        if self.is_mmio(a):
-            self.mmio_regs[a] = v
-            self.mmio_writes.append((a, v, 1))
+        dev = self._page_dev[a >> PAGE_SHIFT]
+        if dev is None:
+            self.mem[a] = v & 0xFF
+            if self._codemap[a >> CODE_PAGE_SHIFT]:
+                self._code_written(a); self._smc_hit = True
         else:
-            self.mem[a] = v
+            dev.write(a, v & 0xFF, 1)
 
     def lw(self, a):
+        if not a & 1 and self._page_dev[a >> PAGE_SHIFT] is None:
+            if self._words is not None: return self._words[a >> 1]
+            return self.mem[a] | (self.mem[a + 1] << 8)
         return self._read_byte(a) | (self._read_byte((a+1)&MASK) << 8)
     def sw(self, a, v):
-        if self.is_mmio(a):
-            self.mmio_regs[a] = v & 0xFF
-            self.mmio_regs[(a+1)&MASK] = (v>>8) & 0xFF
-            self.mmio_writes.append((a, v & MASK, 2))
+        dev = self._page_dev[a >> PAGE_SHIFT]
+        if dev is not None:
+            dev.write(a, v & MASK, 2)
+        elif not a & 1 and self._words is not None:
+            self._words[a >> 1] = v & MASK
+            if self._codemap[a >> CODE_PAGE_SHIFT]:
+                self._code_written(a); self._smc_hit = True
         else:
-            self.mem[a] = v & 0xFF
-            self.mem[(a+1)&MASK] = (v >> 8) & 0xFF
+            self._write_byte(a, v)
+            self._write_byte((a+1)&MASK, v >> 8)
     def lb(self, a):
         return self._read_byte(a)
 
@@ -83,8 +477,10 @@ class ZX16:
 
     def step(self):
         armed = self.step_armed   # the instruction this cycle is the one being stepped
+        irq = None                # the interrupted PC when an interrupt is taken
         # take a pending hardware interrupt at the instruction boundary (not mid-step)
         if self.ie and self.irq_pending and not armed:
+            irq = self.pc
             self.epc = self.pc
             self.ie = False
             self.irq_pending = False
@@ -94,6 +490,8 @@ class ZX16:
         f3 = (w >> 3) & 0x7
         rd = (w >> 6) & 0x7        # rd/rs1
         nextpc = (self.pc + 2) & MASK
+        take = False
+        addr = 0                   # load / store effective address
 
         if op == 0:  # R-type
             funct4 = (w >> 12) & 0xF
@@ -113,6 +511,7 @@ class ZX16:
             elif funct4 == 0xB: nextpc = self.reg[rd]                    # JR  PC<-rd
             elif funct4 == 0xC:                                          # JALR
                 tmp = self.reg[rs2]; self.reg[rd] = nextpc; nextpc = tmp
+            elif funct4 == 0xD and f3 != 3: self.reg[rd] = muldiv(f3, a, b)   # MUL..REMU
             else: raise Exception(f"bad R funct4 {funct4:x} @ {self.pc:04x}")
 
         elif op == 1:  # I-type
@@ -140,7 +539,6 @@ class ZX16:
             off5 = (imm_hi << 1)
             if off5 >= 0x10: off5 -= 0x20      # 5-bit signed, imm[0]=0
             a = self.reg[rd]; b = self.reg[rs2]
-            take = False
             if   f3 == 0x0: take = (a == b)
             elif f3 == 0x1: take = (a != b)
             elif f3 == 0x2: take = (a == 0)
@@ -201,6 +599,9 @@ class ZX16:
             elif f3 == 0x6: self.epc = self.reg[rd]                               # MTEPC rd
             elif f3 == 0x7: self.step_req = True                                  # STEP (armed by RETI)
 
+        if self.profile is not None:
+            self.profile.retire(self.pc, w, nextpc, take, irq, armed and not self.halted,
+                                addr)
         self.pc = nextpc
         if armed and not self.halted:        # single-step: trap to vector 1 after one instruction
             self.step_armed = False
@@ -224,33 +625,323 @@ class ZX16:
             # unknown service: ignore
             pass
 
-    def run(self):
-        while not self.halted:
+    def run(self, until=None):
+        """Execute until halted, or until cycle `until` when given (exactly: blocks
+        that would cross it are stepped). With self.fast (the default) straight-line code runs
+        as translated blocks; step() is still used for anything a block cannot
+        reproduce cycle-for-cycle (pending IRQ, single-step, SYS traps, the last few
+        cycles before max_cycles), so both paths yield identical architectural state.
+        A profiler (self.profile) needs every retire, so it runs step() throughout.
+
+        With self.idle_skip, a loop of translated blocks that neither stores nor
+        prints, and comes back to its head with the same registers, is fast-forwarded:
+        once one whole pass has run while every device address it reads is known not
+        to change (each device's idle_until()), the passes up to that change, the next
+        event or the run's limit are skipped and counted, so cycles, pc and registers
+        are exactly those of running them (self.idle_cycles totals the skipped ones)."""
+        stop = self.max_cycles + 1 if until is None else until
+        ev = self._events
+        if not self.fast or self.profile is not None:
+            while not self.halted and self.cycles < stop:
+                if ev and ev[0][0] <= self.cycles: self._fire(); continue
+                self.step()
+                if self.cycles > self.max_cycles:
+                    raise Exception("cycle limit exceeded (infinite loop?)")
+            return self.out
+        blocks = self._blocks; heat = self._heat
+        R = self.reg; M = self.mem; H = self._words
+        while not self.halted and self.cycles < stop:
+            if ev and ev[0][0] <= self.cycles: self._fire(); continue
+            if not (self.step_armed or (self.ie and self.irq_pending)):
+                # inner dispatch loop: chain translated blocks without touching
+                # interrupt/step state (blocks never change it)
+                pc = self.pc; cyc = self.cycles
+                limit = min(self.max_cycles, stop, ev[0][0] if ev else stop)
+                left = False
+                idle = self.idle_skip; head = -1; seen = self._io_seen
+                while True:
+                    b = blocks.get(pc)
+                    if b is None:
+                        h = heat.get(pc, 0) + 1
+                        if h < BLOCK_HOT:        # cold: interpret, translate on reuse
+                            heat[pc] = h; break
+                        b = self._translate(pc)
+                    fn = b[0]
+                    if fn is None or cyc + b[1] > limit: break
+                    self.cycles = cyc            # for now()
+                    v = fn(self, R, M, H)        # next pc | retired << 16
+                    if v < 0:                    # left early (halt / code store)
+                        v = ~v; left = True
+                    cyc += v >> 16; bpc = pc; pc = v & MASK
+                    if left: break
+                    if not idle: continue
+                    if v >> 16 > b[3]: head = -1         # it stored or printed: not idle
+                    elif pc <= bpc:                      # a backward edge: a loop head
+                        if pc != head or R != snap:
+                            head = pc; snap = R[:]; hcyc = cyc; seen.clear(); bound = None
+                        elif bound is not None and cyc <= bound and seen <= bseen:
+                            # the last pass ran inside [hcyc, bound) with its inputs
+                            # unchanged and came back to the same state: so will the
+                            # next ones, up to the bound
+                            per = cyc - hcyc
+                            k = (min(bound, limit) - cyc) // per
+                            cyc += k * per; self.idle_cycles += k * per; head = -1
+                        else:
+                            self.cycles = cyc
+                            bound = self._stable_until(seen); bseen = set(seen)
+                            hcyc = cyc; seen.clear()
+                self.pc = pc; self.cycles = cyc
+                if left or cyc >= stop or (ev and cyc >= ev[0][0]): continue
             self.step()
             if self.cycles > self.max_cycles:
                 raise Exception("cycle limit exceeded (infinite loop?)")
         return self.out
 
+    # ---- block translation -------------------------------------------------------
+    # A block is the run of instructions from a PC up to the first JR/JALR/halt (or
+    # BLOCK_MAX), following unconditional J/JAL; conditional branches become side exits.
+    # It is compiled once into a Python function with the touched registers held in
+    # locals, returning next_pc | retired << 16 (bitwise-inverted when the dispatch
+    # loop must be left: halt, store into code). SYS instructions other than the
+    # built-in ECALL services, and anything step() would reject, end the block *before*
+    # them so step() executes them. Every page a block was decoded from is marked in
+    # _codemap; a store into a marked page drops those blocks (and, from inside a block,
+    # ends it right after the store), so loaders and self-modifying code stay exact.
+
+    def flush_code_cache(self):
+        """Drop all translated blocks. Call after writing self.mem directly (writes
+        through sw()/_write_byte()/stores invalidate automatically)."""
+        self._blocks.clear()
+        self._page_blocks.clear()
+        self._heat.clear()
+        self._codemap[:] = bytes(len(self._codemap))
+
+    def _code_written(self, a):
+        for p in {a >> CODE_PAGE_SHIFT, ((a + 1) & MASK) >> CODE_PAGE_SHIFT}:
+            for pc in self._page_blocks.pop(p, ()):
+                b = self._blocks.pop(pc, None)
+                if b is None: continue
+                for q in b[2]:
+                    s = self._page_blocks.get(q)
+                    if s is None: continue
+                    s.discard(pc)
+                    if not s:
+                        del self._page_blocks[q]; self._codemap[q] = 0
+            self._codemap[p] = 0
+
+    def _translate(self, start):
+        body = []          # (indent-free) python lines
+        used = set(); written = set()
+        pages = set()
+        pc = start; n = 0
+        pure = BLOCK_MAX             # instructions before the first store or output
+        inline_ecall = type(self).ecall is ZX16.ecall
+        MB = self._ram_top; words = self._words is not None
+
+        def R(i): used.add(i); return 'r%d' % i
+        def W(i): used.add(i); written.add(i); return 'r%d' % i
+        def exit_(k, npc):
+            # placeholder, expanded once the register sets are final; k = '=N' marks
+            # an early exit after N instructions
+            return '\x00EXIT %s %s' % (k, npc)
+
+        while n < BLOCK_MAX:
+            if pc + 1 >= MB or pc + 1 >= len(self.mem): break
+            w = self.mem[pc] | (self.mem[pc + 1] << 8)
+            op = w & 0x7; f3 = (w >> 3) & 0x7; rd = (w >> 6) & 0x7
+            nextpc = (pc + 2) & MASK
+            code = None; end = None   # end = python expr for the next pc (ends block)
+            r2 = (w >> 9) & 0x7
+            if op == 0:
+                f4 = (w >> 12) & 0xF
+                a = 'r%d' % rd; b = 'r%d' % r2
+                ex = {0x0: '(%s + %s) & 65535', 0x1: '(%s - %s) & 65535',
+                      0x2: '1 if (%s ^ 32768) < (%s ^ 32768) else 0',
+                      0x3: '1 if %s < %s else 0',
+                      0x4: '(%s << (%s & 15)) & 65535',
+                      0x5: '%s >> (%s & 15)',
+                      0x6: '(((%s ^ 32768) - 32768) >> (%s & 15)) & 65535',
+                      0x7: '%s | %s', 0x8: '%s & %s', 0x9: '%s ^ %s'}
+                if f4 in ex:
+                    R(rd); R(r2); code = ['%s = %s' % (W(rd), ex[f4] % (a, b))]
+                elif f4 == 0xA: code = ['%s = %s' % (W(rd), R(r2))]
+                elif f4 == 0xB: code = []; end = R(rd)
+                elif f4 == 0xC:
+                    code = ['_t = %s' % R(r2), '%s = %d' % (W(rd), nextpc)]; end = '_t'
+                elif f4 == 0xD and f3 != 3:
+                    R(rd); R(r2); code = ['%s = muldiv(%d, %s, %s)' % (W(rd), f3, a, b)]
+            elif op == 1:
+                imm7 = (w >> 9) & 0x7F
+                simm = imm7 - 0x80 if imm7 >= 0x40 else imm7
+                a = R(rd) if f3 != 0x7 else None
+                if   f3 == 0x0: code = ['%s = (%s %s %d) & 65535' % (W(rd), a, '-' if simm < 0 else '+', abs(simm))]
+                elif f3 == 0x1: code = ['%s = 1 if (%s ^ 32768) - 32768 < %d else 0' % (W(rd), a, simm)]
+                elif f3 == 0x2: code = ['%s = 1 if %s < %d else 0' % (W(rd), a, simm & MASK)]
+                elif f3 == 0x3:
+                    styp = (imm7 >> 4) & 0x7; amt = imm7 & 0xF
+                    if   styp == 0x1: code = ['%s = (%s << %d) & 65535' % (W(rd), a, amt)]
+                    elif styp == 0x2: code = ['%s = %s >> %d' % (W(rd), a, amt)]
+                    elif styp == 0x4: code = ['%s = (((%s ^ 32768) - 32768) >> %d) & 65535' % (W(rd), a, amt)]
+                elif f3 == 0x4: code = ['%s = %s | %d' % (W(rd), a, imm7)]
+                elif f3 == 0x5: code = ['%s = %s & %d' % (W(rd), a, simm & MASK)]
+                elif f3 == 0x6: code = ['%s = %s ^ %d' % (W(rd), a, simm & MASK)]
+                elif f3 == 0x7: code = ['%s = %d' % (W(rd), simm & MASK)]
+            elif op == 2:
+                off5 = ((w >> 12) & 0xF) << 1
+                if off5 >= 0x10: off5 -= 0x20
+                a = R(rd); b = R(r2)
+                cond = ['%s == %s' % (a, b), '%s != %s' % (a, b), '%s == 0' % a, '%s != 0' % a,
+                        '(%s ^ 32768) < (%s ^ 32768)' % (a, b), '(%s ^ 32768) >= (%s ^ 32768)' % (a, b),
+                        '%s < %s' % (a, b), '%s >= %s' % (a, b)][f3]
+                # side exit when taken; the block carries on along the fall-through
+                code = ['if %s: %s' % (cond, exit_(n + 1, (nextpc + off5) & MASK))]
+            elif op == 3:
+                imm4 = (w >> 12) & 0xF
+                off = imm4 - 0x10 if imm4 >= 0x8 else imm4
+                v = R(r2)
+                if f3 in (0x0, 0x1):
+                    pure = min(pure, n)
+                    code = [_ea(R(rd), off)]
+                    if f3 == 0x0:
+                        code += ['if _a < %d:' % MB,
+                                 '    M[_a] = %s & 255' % v,
+                                 '    if CM[_a >> %d]: S._code_written(_a); %s' % (CODE_PAGE_SHIFT, exit_('=%d' % (n + 1), nextpc)),
+                                 'else:',
+                                 '    S._boff = %d; S._write_byte(_a, %s); S._boff = 0' % (n, v)]
+                    else:
+                        code += ['if _a < %d and not _a & 1:' % MB if words else 'if _a < %d:' % (MB - 1),
+                                 '    H[_a >> 1] = %s' % v if words else
+                                 '    M[_a] = %s & 255; M[_a + 1] = %s >> 8' % (v, v),
+                                 '    if CM[_a >> %d]: S._code_written(_a); %s' % (CODE_PAGE_SHIFT, exit_('=%d' % (n + 1), nextpc))
+                                 if words else
+                                 '    if CM[_a >> %d] or CM[(_a + 1) >> %d]: S._code_written(_a); %s'
+                                 % (CODE_PAGE_SHIFT, CODE_PAGE_SHIFT, exit_('=%d' % (n + 1), nextpc)),
+                                 'else:',
+                                 '    S._boff = %d; S.sw(_a, %s); S._boff = 0' % (n, v)]
+                    code += ['    if S._smc_hit: S._smc_hit = False; %s' % exit_('=%d' % (n + 1), nextpc)]
+            elif op == 4:
+                imm4 = (w >> 12) & 0xF
+                off = imm4 - 0x10 if imm4 >= 0x8 else imm4
+                if f3 in (0x0, 0x1, 0x4):
+                    code = [_ea(R(r2), off)]
+                    d = W(rd)
+                    # a device access publishes the cycle it happens on (S.now())
+                    dev = 'else: S._boff = %d; %s = S.%%s(_a); S._boff = 0' % (n, d)
+                    if   f3 == 0x0: code += ['if _a < %d: %s = M[_a]' % (MB, d), dev % '_read_byte',
+                                         '%s = ((%s ^ 128) - 128) & 65535' % (d, d)]
+                    elif f3 == 0x1 and words: code += ['if _a < %d and not _a & 1: %s = H[_a >> 1]' % (MB, d),
+                                                       dev % 'lw']
+                    elif f3 == 0x1: code += ['if _a < %d: %s = M[_a] | (M[_a + 1] << 8)' % (MB - 1, d),
+                                             dev % 'lw']
+                    else:           code += ['if _a < %d: %s = M[_a]' % (MB, d), dev % '_read_byte']
+            elif op == 5:
+                imm_hi = (w >> 9) & 0x3F; imm_lo = (w >> 3) & 0x7
+                off = (imm_hi << 4) | (imm_lo << 1)
+                if off >= 0x200: off -= 0x400
+                code = ['%s = %d' % (W(rd), nextpc)] if (w >> 15) & 1 else []
+                target = (nextpc + off) & MASK
+                # follow the jump: the block continues at the target
+                body.extend(code); pages.add(pc >> CODE_PAGE_SHIFT); pages.add((pc + 1) >> CODE_PAGE_SHIFT)
+                n += 1; pc = target
+                continue
+            elif op == 6:
+                v9 = (((w >> 9) & 0x3F) << 3) | ((w >> 3) & 0x7)
+                val = (v9 << 7) & MASK
+                code = ['%s = %d' % (W(rd), val if not (w >> 15) & 1 else (pc + val) & MASK)]
+            elif op == 7 and f3 == 0 and inline_ecall:
+                svc = (w >> 6) & 0x3FF; pure = min(pure, n)
+                if svc == 0x3FF:
+                    code = ['S.halted = True', exit_('=%d' % (n + 1), nextpc)]; end = ''
+                elif svc == 0x000: code = ["S.out.append(('int', (%s ^ 32768) - 32768))" % R(6)]
+                elif svc == 0x001: code = ["S.out.append(('char', %s & 255))" % R(6)]
+                else: code = []
+            if code is None:
+                break                         # step() handles it (or raises)
+            body.extend(code)
+            pages.add(pc >> CODE_PAGE_SHIFT); pages.add((pc + 1) >> CODE_PAGE_SHIFT)
+            n += 1
+            if end is not None:
+                break
+            pc = nextpc
+        if n == 0:
+            body = None; pages = {start >> CODE_PAGE_SHIFT}
+        elif end != '':
+            body.append(exit_(n, end if end is not None else '%d' % pc))
+
+        b = (self._compile_block(start, body, used, written) if body else None,
+             n, frozenset(pages), pure)
+        self._blocks[start] = b
+        for p in pages:
+            self._page_blocks.setdefault(p, set()).add(start)
+            self._codemap[p] = 1
+        return b
+
+    @staticmethod
+    def _compile_block(start, body, used, written):
+        key = (tuple(body), frozenset(used), frozenset(written))
+        fn = _BLOCK_CODE.get(key)
+        if fn is None:
+            fn = _BLOCK_CODE[key] = ZX16._build_block(start, body, used, written)
+        return fn
+
+    @staticmethod
+    def _build_block(start, body, used, written):
+        regs = sorted(used); wb = sorted(written)
+        def expand(line):
+            i = line.find('\x00EXIT')
+            if i < 0: return line
+            _, k, npc = line[i:].split(' ', 2)
+            tail = ''.join('R[%d] = r%d; ' % (r, r) for r in wb)
+            early = k.startswith('=')     # early exit: leave the dispatch loop
+            k = int(k.lstrip('='))
+            try: ret = str(int(npc) + (k << 16))
+            except ValueError: ret = '(%s) + %d' % (npc, k << 16)
+            return line[:i] + tail + 'return ' + ('~(%s)' % ret if early else ret)
+        src = ['def _blk(S, R, M, H):', '    CM = S._codemap']
+        if regs:
+            src.append('    ' + ', '.join('r%d' % r for r in regs) + ' = '
+                       + ', '.join('R[%d]' % r for r in regs))
+        src += ['    ' + expand(l) for l in body]
+        ns = {'muldiv': muldiv}
+        exec(compile('\n'.join(src), '<zx16 block %04x>' % start, 'exec'), ns)
+        return ns['_blk']
+
+
+_ASSEMBLERS = {}
+
+def load_assembler(asm_path=None):
+    """Import the repo assembler module (../assembler/zx16asm.py by default) once."""
+    import os, importlib, importlib.util
+    default = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'assembler')
+    if asm_path is None or os.path.realpath(os.path.dirname(asm_path)) == os.path.realpath(default):
+        if os.path.realpath(default) not in map(os.path.realpath, sys.path):
+            sys.path.insert(0, default)
+        return importlib.import_module('zx16asm')
+    asm_path = os.path.realpath(asm_path)
+    mod = _ASSEMBLERS.get(asm_path)
+    if mod is None:
+        name = 'zx16asm_%d' % len(_ASSEMBLERS)
+        spec = importlib.util.spec_from_file_location(name, asm_path)
+        mod = sys.modules[name] = importlib.util.module_from_spec(spec)
+        spec.loader.exec_module(mod)
+        _ASSEMBLERS[asm_path] = mod
+    return mod
 
 def assemble_and_run(asm_text, asm_path=None, pre_run=None):
-    """Helper: assemble ZX16 source via the repo assembler, then execute.
+    """Helper: assemble ZX16 source in-process with the repo assembler, then execute.
     pre_run(sim) is called after load, before run() — used to script MMIO reads.
-    asm_path defaults to ../assembler/zx16asm.py relative to this file."""
-    import subprocess, tempfile, os
-    if asm_path is None:
-        asm_path = os.path.join(os.path.dirname(os.path.abspath(__file__)),
-                                '..', 'assembler', 'zx16asm.py')
-    with tempfile.NamedTemporaryFile('w', suffix='.s', delete=False) as f:
-        f.write(asm_text); src = f.name
-    out_bin = src + '.bin'
-    r = subprocess.run([sys.executable, asm_path, src, '-o', out_bin],
-                       capture_output=True, text=True)
-    if 'successfully' not in r.stdout:
-        raise Exception("assembly failed:\n" + r.stdout + r.stderr)
-    data = open(out_bin, 'rb').read()
+    asm_path selects another zx16asm.py (default ../assembler/zx16asm.py)."""
+    image = load_assembler(asm_path).assemble(asm_text, '<asm>')
+    if not image.ok:
+        raise Exception("assembly failed:\n" + image.report())
+    return run_image(image.binary(), pre_run)
+
+
+def run_image(binary, pre_run=None):
+    """Load a flat image at 0x0000 (sections already at absolute addresses, as
+    zx16asm's binary() / buildcache produce it) and run it; returns (out, sim)."""
     sim = ZX16()
-    # assembler emits a full 64KB image with sections already at absolute addrs
-    sim.load(data, 0x0000)
+    sim.load(binary, 0x0000)
     if pre_run: pre_run(sim)
     return sim.run(), sim
 
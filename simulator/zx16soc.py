@@ -0,0 +1,437 @@
+#!/usr/bin/env python3
+"""Functional models of the ZX16 SoC peripherals (rtl/soc) for zx16sim: nc_uart at
+0xC000 and nc_tmr at 0xD000 behind the 16-bit window, and zx16_soc.v's interrupt
+folding (timer -> vector 2, UART -> vector 3, the timer first).
+
+Register-accurate where firmware can tell: the RTL's offsets, reset values and bit
+fields, write-1-to-clear ICR / ERRCR, the timer's shadowed PSC / ARR and repetition
+counter, FIFO levels, the UART's edge-set RIS flags. Time is PCLK, `clocks` per
+simulator cycle (default 1: one clock per instruction, where the RTL core takes
+several, so only the firmware's own ratios carry over). A device is brought up to
+date lazily, when a register is touched; an edge that can interrupt is put on the
+simulator's event queue (ZX16.at()), so raise_irq() lands on the right instruction
+without stepping the devices every cycle.
+
+Not modelled: the timer's capture/compare, PWM, encoder, break and slave modes (their
+registers read back what was written) and center-aligned counting; the UART's
+parity / framing errors, RX timeout, DMA requests, and the bus stall on a full TX
+FIFO (the byte is queued as if the bus had waited).
+
+  sim = zx16sim.ZX16(); sim.load(image, 0); uart, tmr = zx16soc.attach(sim)
+  uart.feed(b"r A000\\n", at=5000); sim.run(); bytes(uart.sent)
+"""
+import copy, math
+from collections import deque
+from zx16sim import sink_state, sink_restore
+
+M32 = 0xFFFFFFFF
+
+
+class SocIrq:
+    """zx16_soc.v: irq_req = tmr | uart, irq_num = 2 if tmr else 3. Re-evaluated
+    whenever a source's line may have changed; the CPU is asked again only when the
+    winning vector changes, so a handler must clear its flag, as on the SoC."""
+    def __init__(self, sim):
+        self.sim = sim
+        self.lines = []           # (device, vector), highest priority first
+        self.level = None         # the vector being requested, or None
+
+    def current(self):
+        return next((vec for dev, vec in self.lines if dev.asserted()), None)
+
+    def update(self):
+        vec = self.current()
+        if vec != self.level:
+            self.level = vec
+            if vec is None: self.sim.irq_pending = False
+            else: self.sim.raise_irq(vec); self.sim._smc_hit = True   # end the block
+
+
+class ApbWindow:
+    """A 32-bit APB peripheral behind zx16_ahb16to32: ZX16 address bits [1:0] pick the
+    byte lanes of the register at offset & 0xFFC, and a store writes the whole
+    register with the other lanes zero (APB3 has no strobes). A halfword load is one
+    register read (the odd byte comes from the same access)."""
+    _STATE = ()                   # attribute names save_state() keeps
+    _SINKS = ()                   # ... of those, record sinks (see zx16sim.log_to)
+
+    def __init__(self, sim, irq, clocks):
+        self.sim, self.irq, self.clocks = sim, irq, clocks
+        self._latch = (None, 0)   # (odd address, register value) of a halfword load
+        self._due = None          # the cycle of this device's pending event
+        self.t = 0                # PCLK the state is up to date with
+
+    def read(self, a):
+        if self._latch[0] == a:
+            v = self._latch[1]; self._latch = (None, 0)
+        else:
+            self.sync()
+            v = self.reg_read(a & 0xFFC)
+            self._latch = ((a + 1) & 0xFFFF, v) if not a & 1 else (None, 0)
+        return (v >> (8 * (a & 3))) & 0xFF
+
+    def write(self, a, v, size):
+        self._latch = (None, 0)
+        self.sync()
+        self.reg_write(a & 0xFFC, (v & (0xFF if size == 1 else 0xFFFF)) << (8 * (a & 3)))
+        self._schedule()
+
+    def sync(self):
+        t = self.sim.now() * self.clocks
+        if t > self.t:
+            self.advance(t)
+        self.t = max(self.t, t)
+
+    def _cycle(self, t):
+        """The first simulator cycle at or after PCLK t."""
+        return -(-t // self.clocks)
+
+    def _schedule(self, update=True):
+        """Tell the controller, and put the next interrupting edge on the queue."""
+        if update: self.irq.update()
+        t = self.next_edge()
+        due = None if t is None else self._cycle(t)
+        if due != self._due:
+            self._due = due
+            if due is not None: self.sim.at(due, lambda sim, due=due: self._event(due))
+
+    def _event(self, due):
+        if due != self._due: return          # rescheduled since
+        self._due = None
+        self.sync(); self._schedule()
+
+    def save_state(self):
+        return copy.deepcopy({k: sink_state(v) if k in self._SINKS else
+                              list(v) if isinstance(v, deque) else v
+                              for k in self._STATE for v in [getattr(self, k)]})
+
+    def restore_state(self, state):
+        for k, v in copy.deepcopy(state).items():     # the snapshot stays as it was
+            if k in self._SINKS: sink_restore(getattr(self, k), v)
+            else: setattr(self, k, deque(v) if isinstance(getattr(self, k), deque) else v)
+        self._latch = (None, 0); self._due = None
+        self.irq.level = self.irq.current()
+        self._schedule(update=False)
+
+
+class Timer(ApbWindow):
+    """nc_tmr, edge-aligned: counts at PCLK / (PSC_shadow + 1) from 0 to ARR_shadow
+    (DIR: down from ARR_shadow to 0) and wraps; every RCR + 1 wraps an update event
+    sets RIS.UIF and loads the shadows (ARR at once unless CR.ARPE). mode 01 is one
+    pulse: the update also clears CEN. EGR.UG forces an update."""
+    CR, SR, IM, RIS, MIS, ICR = 0x000, 0x004, 0x020, 0x024, 0x028, 0x02C
+    CNT, PSC, ARR, RCR, EGR = 0x100, 0x104, 0x108, 0x10C, 0x134
+    FEATURE, ID = 0xFF8, 0xFFC
+    EN, SRST, DIR, ARPE = 0x001, 0x002, 0x040, 0x400
+    # registers kept but not modelled: CCR1..4 (32-bit), BDTR, SMCR, CCMR1/2, CCER
+    _PLAIN = {0x110: M32, 0x114: M32, 0x118: M32, 0x11C: M32, 0x120: 0xFFFF,
+              0x124: 0xFFFF, 0x128: 0xFFFF, 0x12C: 0xFFFF, 0x130: 0xFFFF}
+    _STATE = ('cr', 'im', 'ris', 'cnt', 'psc', 'psc_sh', 'pscc', 'arr', 'arr_sh', 'rcr',
+              'rcr_c', 'plain', 't')
+
+    def __init__(self, sim, irq, clocks=1):
+        super().__init__(sim, irq, clocks)
+        self.reset()
+
+    def reset(self):
+        self.cr = self.im = self.ris = self.cnt = self.psc = self.rcr = 0
+        self.psc_sh = self.pscc = self.rcr_c = 0   # prescaler shadow / down-counter
+        self.arr = self.arr_sh = M32
+        self.plain = {}
+
+    def asserted(self):
+        return bool(self.ris & self.im)
+
+    # ---- counting ---------------------------------------------------------------
+    def _period(self):
+        """Clocks from one wrap to the next."""
+        return (self.psc_sh + 1) * (self.arr_sh + 1)
+
+    def _to_wrap(self):
+        steps = (self.cnt if self.cr & self.DIR else (self.arr_sh - self.cnt) & M32) + 1
+        return self.pscc + 1 + (steps - 1) * (self.psc_sh + 1)
+
+    def _count(self, dt):
+        """Advance dt < _to_wrap() clocks."""
+        if dt <= self.pscc:
+            self.pscc -= dt; return
+        d = dt - self.pscc - 1
+        steps = 1 + d // (self.psc_sh + 1)
+        self.pscc = self.psc_sh - d % (self.psc_sh + 1)
+        self.cnt = (self.cnt - steps if self.cr & self.DIR else self.cnt + steps) & M32
+
+    def _update(self):
+        self.ris |= 1
+        self.psc_sh = self.pscc = self.psc
+        self.arr_sh = self.arr; self.rcr_c = self.rcr
+        if self.cr & 0xC == 0x4: self.cr &= ~self.EN          # one-pulse mode
+
+    def _wrap(self):
+        self.cnt = self.arr_sh if self.cr & self.DIR else 0
+        self.pscc = self.psc_sh
+        if self.rcr_c == 0: self._update()
+        else: self.rcr_c -= 1
+
+    def advance(self, t):
+        dt = t - self.t
+        while dt > 0 and self.cr & self.EN:
+            w = self._to_wrap()
+            if dt < w:
+                self._count(dt); return
+            dt -= w; self._wrap()
+            # steady and periodic: skip whole periods (one pulse stops at its update,
+            # at most RCR + 1 wraps away, so it takes them one by one)
+            if (self.cr & self.EN and self.cr & 0xC != 0x4 and self.psc_sh == self.psc
+                    and self.arr_sh == self.arr):
+                p = self._period(); k = dt // p
+                if k:
+                    n = self.rcr + 1
+                    if k > self.rcr_c:
+                        self.ris |= 1; self.rcr_c = self.rcr - (k - self.rcr_c - 1) % n
+                    else:
+                        self.rcr_c -= k
+                    dt -= k * p
+
+    def idle_until(self, addrs):
+        """Every register but CNT holds still until the next update event."""
+        self.sync()
+        if not self.cr & self.EN: return math.inf
+        if any(a & 0xFFC == self.CNT for a in addrs): return None
+        return self._cycle(self.t + self._to_wrap() + self.rcr_c * self._period())
+
+    def next_edge(self):
+        """PCLK of the next update event while it can interrupt, else None."""
+        if not (self.cr & self.EN and self.im & 1 and not self.ris & 1): return None
+        return self.t + self._to_wrap() + self.rcr_c * self._period()
+
+    # ---- registers ----------------------------------------------------------------
+    def reg_read(self, off):
+        if off == self.CR:  return self.cr
+        if off == self.SR:  return (self.cr & self.EN) << 2
+        if off == self.IM:  return self.im
+        if off == self.RIS: return self.ris
+        if off == self.MIS: return self.ris & self.im
+        if off == self.CNT: return self.cnt
+        if off == self.PSC: return self.psc
+        if off == self.ARR: return self.arr
+        if off == self.RCR: return self.rcr
+        if off == self.FEATURE: return 0x000000CF
+        if off == self.ID:  return 0x00100010
+        return self.plain.get(str(off), 0)
+
+    def reg_write(self, off, v):
+        if off == self.CR:
+            if v & self.SRST:
+                self.reset(); return
+            self.cr = v & 0x1F7F
+            if not self.cr & self.EN: self.pscc = 0
+        elif off == self.IM:  self.im = v & 0xFF
+        elif off == self.ICR: self.ris &= ~v & 0xFF
+        elif off == self.CNT: self.cnt = v; self.pscc = self.psc_sh
+        elif off == self.PSC: self.psc = v & 0xFFFF
+        elif off == self.ARR:
+            self.arr = v
+            if not self.cr & self.ARPE: self.arr_sh = v
+        elif off == self.RCR: self.rcr = v & 0xFF
+        elif off == self.EGR:
+            if v & 1: self._update()
+        elif off in self._PLAIN: self.plain[str(off)] = v & self._PLAIN[off]
+
+
+class Uart(ApbWindow):
+    """nc_uart: 1 start, 5-8 data (LINCR.WLS), parity (PEN) and 1-2 stop bits (STB) at
+    16 * (BRR.DIV + 1) clocks per bit. A byte written to DR starts as soon as the
+    shifter is free; `sent` collects each one as its frame ends (what tb_zx16_soc.v
+    prints as "UART n"). RX bytes come from feed() and enter the RX FIFO when their
+    frame ends (an overrun sets OVR); CR.MODE 01 loops TX back to RX. RIS bits set on
+    the rising edge of TX (level <= TXTH), RX (level >= RXTH), TC, ERR and IDLE, and on
+    the OVR / UDR pulses; clearing EN or SRST flushes both FIFOs."""
+    CR, SR, DR, IM, RIS, MIS, ICR = 0x000, 0x004, 0x008, 0x020, 0x024, 0x028, 0x02C
+    DMACR, FIFOCTRL, FIFOSTR, ERRCR = 0x040, 0x050, 0x054, 0x090
+    BRR, LINCR, RXTO, FEATURE, IDR = 0x100, 0x104, 0x108, 0xFF8, 0xFFC
+    _STATE = ('cr', 'im', 'ris', 'dmacr', 'fifoctrl', 'errcr', 'brr', 'lincr', 'rxto',
+              'txq', 'tx_cur', 'tx_end', 'rxf', 'rx_in', 'lv', 'sent', 't')
+    _SINKS = ('sent',)
+
+    def __init__(self, sim, irq, clocks=1, tx_depth=16, rx_depth=16):
+        super().__init__(sim, irq, clocks)
+        self.tx_depth, self.rx_depth = tx_depth, rx_depth
+        self.sent = []            # transmitted bytes, in order: a sink (zx16sim.log_to)
+        self.rx_in = deque()      # [PCLK the frame ends, byte], in time order
+        self.reset()
+        self.lincr = 0x3          # 8N1; kept by SRST
+
+    def reset(self):
+        self.cr = self.im = self.ris = self.dmacr = self.fifoctrl = self.errcr = 0
+        self.brr = self.rxto = 0
+        self.lincr = getattr(self, 'lincr', 0x3)
+        self.txq, self.rxf = deque(), deque()
+        self.tx_cur = self.tx_end = None     # the byte in the shifter, when it is out
+        self.lv = 0                          # the TX/RX/TC/ERR/IDLE levels last seen
+
+    def asserted(self):
+        return bool(self.ris & self.im)
+
+    def bit_clocks(self):
+        return 16 * ((self.brr & 0xFFFF) + 1)
+
+    def frame_clocks(self):
+        bits = 1 + (self.lincr & 3) + 5 + (self.lincr >> 3 & 1) + (2 if self.lincr & 4 else 1)
+        return bits * self.bit_clocks()
+
+    def feed(self, data, at=None, gap=None):
+        """Queue `data` (bytes or str) on the RX line: the first frame starts at cycle
+        `at` (default now), the next ones every `gap` cycles (default 25 bit times, a
+        stop bit plus 16 idle bits, as tb_zx16_soc.v paces +rxfile)."""
+        if isinstance(data, str): data = data.encode()
+        self.sync()
+        start = self.t if at is None else at * self.clocks
+        step = 25 * self.bit_clocks() if gap is None else gap * self.clocks
+        if self.rx_in: start = max(start, self.rx_in[-1][0] - self.frame_clocks() + step)
+        for i, b in enumerate(data):
+            self.rx_in.append([start + i * step + self.frame_clocks(), b & 0xFF])
+        self._schedule()
+
+    # ---- the line ---------------------------------------------------------------
+    def _on(self, bit):           # EN and TXEN (8) / RXEN (9)
+        return self.cr & 1 and self.cr >> bit & 1
+
+    def _levels(self):
+        txl, busy = len(self.txq), self.tx_cur is not None
+        if not self.cr & 1: return 0
+        return ((self._on(8) and txl <= (self.fifoctrl & 15))
+                | (self._on(9) and len(self.rxf) >= (self.fifoctrl >> 4 & 15)) << 1
+                | (txl == 0 and not busy) << 2 | bool(self.errcr & 0x7F) << 3
+                | (not busy) << 4)
+
+    def _edges(self):
+        lv = self._levels()
+        self.ris |= lv & ~self.lv
+        self.lv = lv
+
+    def _tx_start(self, t):
+        if self.tx_cur is None and self.txq and self._on(8):
+            self.tx_cur = self.txq.popleft(); self.tx_end = t + self.frame_clocks()
+
+    def _underflow(self):
+        """The transmitter found the FIFO empty (UDR: ERRCR bit 1, RIS bit 6)."""
+        if self._on(8):
+            self.errcr |= 0x02; self.ris |= 0x40
+
+    def _rx_push(self, b):
+        if not self._on(9): return
+        if len(self.rxf) >= self.rx_depth:
+            self.errcr |= 0x01; self.ris |= 0x20           # overrun
+        else:
+            self.rxf.append(b)
+
+    def _frame_due(self):
+        """PCLK of the next frame end, TX or RX, or None."""
+        due = [x for x in (self.tx_end, self.rx_in[0][0] if self.rx_in else None)
+               if x is not None]
+        return min(due) if due else None
+
+    def advance(self, t):
+        while True:
+            now = self._frame_due()
+            if now is None or now > t: break
+            if self.tx_end == now:
+                b = self.tx_cur; self.sent.append(b)
+                self.tx_cur = self.tx_end = None
+                if self.cr & 0xC == 0x4: self._rx_push(b)    # loopback
+                self._tx_start(now)
+                if self.tx_cur is None: self._underflow()
+            else:
+                self._rx_push(self.rx_in.popleft()[1])
+            self._edges()
+
+    def next_edge(self):
+        """PCLK of the next frame end (TX out or RX in) while an interrupt is
+        unmasked, else None."""
+        return self._frame_due() if self.im else None
+
+    def idle_until(self, addrs):
+        """The registers hold still until the next frame ends, unless DR is being
+        read with bytes in the RX FIFO (each read pops one)."""
+        self.sync()
+        if self.rxf and self._on(9) and any(a & 0xFFC == self.DR for a in addrs): return None
+        due = self._frame_due()
+        return math.inf if due is None else self._cycle(due)
+
+    def drain(self):
+        """Finish every frame in flight (after a halt: the testbench keeps clocking
+        so the last bytes leave the shifter). Returns what `sent` holds, when it is a
+        sink that holds anything."""
+        while self.tx_cur is not None or (self.txq and self._on(8)):
+            self.advance(self.tx_end if self.tx_end is not None else self.t)
+            self.t = max(self.t, self.tx_end or self.t)
+        return bytes(self.sent) if hasattr(self.sent, '__iter__') else None
+
+    # ---- registers ----------------------------------------------------------------
+    def reg_read(self, off):
+        if off == self.DR:
+            if not self.rxf: return 0
+            if not self._on(9): return self.rxf[0]
+            b = self.rxf.popleft(); self._edges(); self._schedule()
+            return b
+        if off == self.SR:
+            busy = self.tx_cur is not None; txe = not self.txq
+            return (txe | bool(self.rxf) << 1 | busy << 2 | bool(self.errcr & 0x7F) << 3
+                    | (not busy) << 4 | (txe and not busy) << 5)
+        if off == self.MIS: return self.ris & self.im
+        if off == self.FIFOSTR: return len(self.rxf) << 16 | len(self.txq)
+        if off == self.FEATURE:
+            return 1 << 9 | ((self.rx_depth - 1) & 15) << 4 | ((self.tx_depth - 1) & 15)
+        if off == self.IDR: return 0x00100001
+        reg = {self.CR: 'cr', self.IM: 'im', self.RIS: 'ris', self.DMACR: 'dmacr',
+               self.FIFOCTRL: 'fifoctrl', self.ERRCR: 'errcr', self.BRR: 'brr',
+               self.LINCR: 'lincr', self.RXTO: 'rxto'}.get(off)
+        return getattr(self, reg) if reg else 0
+
+    def reg_write(self, off, v):
+        if off == self.CR:
+            if v & 2:
+                self.reset(); return
+            was = self._on(8)
+            self.cr = v & 0x33D
+            if not self.cr & 1:
+                self.txq.clear(); self.rxf.clear(); self.tx_cur = self.tx_end = None
+            elif self._on(8) and not was:
+                self._tx_start(self.t)
+                if self.tx_cur is None: self._underflow()
+        elif off == self.DR:
+            if self._on(8):
+                self.txq.append(v & 0xFF); self._tx_start(self.t)
+        elif off == self.IM: self.im = v & 0xFF
+        elif off == self.ICR: self.ris &= ~v & 0xFF
+        elif off == self.DMACR: self.dmacr = v
+        elif off == self.FIFOCTRL:
+            self.fifoctrl = v & 0xFF
+            if v & 0x100: self.txq.clear()
+            if v & 0x200: self.rxf.clear()
+        elif off == self.ERRCR: self.errcr &= ~(v & 0x6F)
+        elif off == self.BRR: self.brr = v & 0xFFFFF
+        elif off == self.LINCR: self.lincr = v & 0x7F
+        elif off == self.RXTO: self.rxto = v & 0xFF
+        self._edges()
+
+
+class Unmapped:
+    """APB slots with nothing behind them: reads 0, writes ignored (PREADY high)."""
+    def read(self, a): return 0
+    def write(self, a, v, size): pass
+    def idle_until(self, addrs): return math.inf
+
+
+def attach(sim, clocks=1, rx_depth=32):
+    """Map the SoC's peripherals into `sim` as zx16_soc.v lays them out (nc_uart with
+    RX_FIFO_DEPTH=32 at 0xC000, nc_tmr at 0xD000, free APB slots 0xE000-0xFFFF) and
+    return (uart, timer)."""
+    irq = SocIrq(sim)
+    uart = Uart(sim, irq, clocks, rx_depth=rx_depth)
+    tmr = Timer(sim, irq, clocks)
+    irq.lines = [(tmr, 2), (uart, 3)]
+    sim.map_device(0xC000, 0xCFFF, uart)
+    sim.map_device(0xD000, 0xDFFF, tmr)
+    sim.map_device(0xE000, 0xFFFF, Unmapped())
+    return uart, tmr